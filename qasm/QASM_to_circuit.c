@@ -1,5 +1,52 @@
 #include "QASM_to_circuit.h"
 
+/**
+ * Allocates the circuit of <c_s> (max_qubits x max_wire identity gates).
+ */
+static void alloc_c_struct(C_struct* c_s)
+{
+    c_s->circuit = malloc(c_s->max_qubits*sizeof(c_s->circuit));
+    for (BDDVAR i = 0; i < c_s->max_qubits; ++i) {
+        c_s->circuit[i] = malloc(c_s->max_wire * sizeof(Gate));
+        for (BDDVAR j = 0; j < c_s->max_wire; j++)
+            c_s->circuit[i][j] = gate_I;
+    }
+}
+
+/**
+ * Reads the next line of <f> (line number <index>) and handles it in <c_s>. Returns
+ * false at the end of the file.
+ */
+static bool read_line_c_struct(FILE *f, char **line, size_t *len, int *index, C_struct* c_s)
+{
+    // Initialise variables
+    char *l, *c;
+    if (getline(line, len, f) == -1)
+        return false;
+    (*index)++;
+    l = *line;
+    // skip if comment
+    if(l[0] == '/' && l[1] == '/')
+        return true;
+    // remove leading spaces
+    while ((*l == ' ') || (*l == '\t'))
+        l++;
+    // remove empty lines and trailing information after ';'
+    c = strchr(l, ';');
+    if (c != NULL) {
+        *c = '\0';
+        // Handle line
+        if(!handle_line_c_struct(l, c_s)) {
+            fprintf(stderr, "Line %d: invalid QASM code.\n", *index);
+            exit(EXIT_FAILURE);
+        }
+        // If a register was added, make room for its qubits
+        if (c_s->qubits > c_s->max_qubits)
+            reallocate_qubits(c_s, c_s->qubits);
+    }
+    return true;
+}
+
 C_struct make_c_struct(char *filename, bool optimize)
 {
     // Open the QASM file (or give error)
@@ -12,53 +59,26 @@ C_struct make_c_struct(char *filename, bool optimize)
     // Create a default circuit struct
     C_struct c_s = c_struct_default;
     // Allocate space for the circuit
-    c_s.circuit = malloc(c_s.max_qubits*sizeof(c_s.circuit));
-    for (BDDVAR i = 0; i < c_s.max_qubits; ++i) {
-        c_s.circuit[i] = malloc(c_s.max_wire * sizeof(Gate));
-        for (BDDVAR j = 0; j < c_s.max_wire; j++)
-            c_s.circuit[i][j] = gate_I;
-    }
+    alloc_c_struct(&c_s);
     // Initialise variables
     char* line = NULL;
-    char* c;
     size_t len = 0;
-    ssize_t read;
     int index = 0;
     // Read all lines from the file
-    while ((read = getline(&line, &len, f)) != -1) {
-        index++;
-        // If the circuit takes more than 128 qubits, give error
-        if (c_s.qubits >= c_s.max_qubits) {
-            fprintf(stderr, "Too many qubits, current maximum is 128.\n");
-            exit(EXIT_FAILURE);
-        }
+    do {
         // If the current maximum depth is reached, increase the depth and reallocate
         if(c_s.depth == c_s.max_wire-1)
             reallocate_wire(&c_s);
-        // skip if comment
-        if(line[0] == '/' && line[1] == '/')
-            continue;
-        // remove leading spaces
-        while ((*line == ' ') || (*line == '\t'))
-            line++;
-        // remove empty lines and trailing information after ';'
-        c = strchr(line, ';');
-        if (c != NULL) {
-            line[c - line] = '\0';
-            // Handle line
-            if(!handle_line_c_struct(line, &c_s)) {
-                fprintf(stderr, "Line %d: invalid QASM code.\n", index);
-                exit(EXIT_FAILURE);
-            }
-        }
-    }
+    } while (read_line_c_struct(f, &line, &len, &index, &c_s));
     // Free variables
     free(line);
     fclose(f);
 
     // Optimize if needed
-    if (optimize)
+    if (optimize) {
         optimize_c_struct(&c_s);
+        fuse_c_struct(&c_s);
+    }
     // Reduce circuit depth by parallelising
     reduce_c_struct(&c_s);
     // Reduce circuit memory by copying the circuit struct (until depth)
@@ -66,6 +86,62 @@ C_struct make_c_struct(char *filename, bool optimize)
     return final_c_s;
 }
 
+C_stream* open_c_stream(char *filename, BDDVAR window, bool optimize)
+{
+    // Open the QASM file (or give error)
+    C_stream *s = malloc(sizeof(C_stream));
+    s->f = fopen(filename, "r");
+    if (s->f == NULL) {
+        fprintf(stderr, "Unable to open QASM file.\n");
+        exit(EXIT_FAILURE);
+    }
+    s->line = NULL;
+    s->len = 0;
+    s->index = 0;
+    s->optimize = optimize;
+    // Allocate a window of <window> columns (at least 2, since column 0 stays empty while reading)
+    s->window = c_struct_default;
+    s->window.max_wire = (window < 2) ? 2 : window;
+    alloc_c_struct(&s->window);
+    // Read the first window
+    next_window_c_stream(s);
+    return s;
+}
+
+bool next_window_c_stream(C_stream* s)
+{
+    // Remove the previous window
+    clear_c_struct(&s->window);
+    // Read lines until the window is full
+    while (s->window.depth < s->window.max_wire-1) {
+        if (!read_line_c_struct(s->f, &s->line, &s->len, &s->index, &s->window))
+            break;
+    }
+    bool has_gates = (s->window.depth != 0);
+    // Optimize and reduce within the window
+    if (s->optimize) {
+        optimize_c_struct(&s->window);
+        fuse_c_struct(&s->window);
+    }
+    reduce_c_struct(&s->window);
+    return has_gates;
+}
+
+void rewind_c_stream(C_stream* s)
+{
+    rewind(s->f);
+    s->index = 0;
+    next_window_c_stream(s);
+}
+
+void close_c_stream(C_stream* s)
+{
+    delete_c_struct(&s->window);
+    free(s->line);
+    fclose(s->f);
+    free(s);
+}
+
 void reallocate_wire(C_struct* c_s)
 {
     // Increase maximum depth
@@ -86,6 +162,34 @@ void reallocate_wire(C_struct* c_s)
     }
 }
 
+void reallocate_qubits(C_struct* c_s, BDDVAR qubits)
+{
+    // The number of qubits is limited by the variable field of the nodes
+    if (qubits >= AADD_INVALID_VAR) {
+        fprintf(stderr, "Too many qubits, current maximum is %u.\n", AADD_INVALID_VAR-1);
+        delete_c_struct(c_s);
+        exit(EXIT_FAILURE);
+    }
+    // Increase maximum number of qubits (at least double)
+    BDDVAR old_max = c_s->max_qubits;
+    c_s->max_qubits = (qubits > 2*old_max) ? qubits : 2*old_max;
+    c_s->circuit = realloc(c_s->circuit, c_s->max_qubits * sizeof(c_s->circuit));
+    if (c_s->circuit == NULL) {
+        fprintf(stderr, "Memory allocation failed.");
+        exit(EXIT_FAILURE);
+    }
+    // Allocate new wires filled with identity gates
+    for (BDDVAR i = old_max; i < c_s->max_qubits; i++) {
+        c_s->circuit[i] = malloc(c_s->max_wire * sizeof(Gate));
+        if (c_s->circuit[i] == NULL) {
+            fprintf(stderr, "Memory allocation failed.");
+            exit(EXIT_FAILURE);
+        }
+        for (BDDVAR j = 0; j < c_s->max_wire; j++)
+            c_s->circuit[i][j] = gate_I;
+    }
+}
+
 C_struct copy_c_struct(C_struct* c_s)
 {
     // Create a default circuit struct
@@ -114,6 +218,9 @@ void delete_c_struct(C_struct* c_s)
             if (c_s->circuit[i][j].id != gate_I.id) {
                 if (c_s->circuit[i][j].control != NULL || c_s->circuit[i][j].controlSize != 0)
                     free(c_s->circuit[i][j].control);
+                // Fused gates have their own matrix
+                if (c_s->circuit[i][j].unitary != NULL)
+                    free(c_s->circuit[i][j].unitary);
             }
         }
     }
@@ -124,6 +231,23 @@ void delete_c_struct(C_struct* c_s)
     free(c_s->circuit);
 }
 
+void clear_c_struct(C_struct* c_s)
+{
+    // Free the gates (as in delete_c_struct) and replace them by identity gates
+    for (BDDVAR j = 0; j < c_s->max_wire; j++) {
+        for (BDDVAR i = 0; i < c_s->max_qubits; i++) {
+            if (c_s->circuit[i][j].id != gate_I.id) {
+                if (c_s->circuit[i][j].control != NULL || c_s->circuit[i][j].controlSize != 0)
+                    free(c_s->circuit[i][j].control);
+                if (c_s->circuit[i][j].unitary != NULL)
+                    free(c_s->circuit[i][j].unitary);
+                c_s->circuit[i][j] = gate_I;
+            }
+        }
+    }
+    c_s->depth = 0;
+}
+
 bool handle_line_c_struct(char* line, C_struct* c_s)
 {
     // Initialise variables
@@ -502,6 +626,147 @@ void remove_gate(C_struct* c_s, BDDVAR q, BDDVAR depth)
     c_s->circuit[q][depth] = gate_I;
 }
 
+// Matrix entries smaller than this are considered zero when fusing gates
+static const double fuse_tolerance = 1e-14;
+
+bool get_gate_matrix(Gate gate_s, complex_t m[4])
+{
+    // Rotations are the same as the Sylvan gates (GATEID_Rx, etc.), i.e. theta/2 = pi*a
+    fl_t a = flt_acos(-1.0) * gate_s.rotation;
+    fl_t r = 1.0/flt_sqrt(2.0);
+    // Start with the identity, only set entries which differ
+    m[0] = cone(); m[1] = czero(); m[2] = czero(); m[3] = cone();
+    if (gate_s.id == gate_I.id)
+        return true;
+    else if (gate_s.id == gate_X.id) {
+        m[0] = czero(); m[1] = cone(); m[2] = cone(); m[3] = czero();
+    }
+    else if (gate_s.id == gate_Y.id) {
+        m[0] = czero(); m[1] = cmake(0, -1); m[2] = cmake(0, 1); m[3] = czero();
+    }
+    else if (gate_s.id == gate_Z.id)
+        m[3] = cmone();
+    else if (gate_s.id == gate_H.id) {
+        m[0] = m[1] = m[2] = cmake(r, 0); m[3] = cmake(-r, 0);
+    }
+    else if (gate_s.id == gate_sX.id) {
+        m[0] = m[3] = cmake(0.5, 0.5); m[1] = m[2] = cmake(0.5, -0.5);
+    }
+    else if (gate_s.id == gate_sY.id) {
+        m[0] = m[2] = m[3] = cmake(0.5, 0.5); m[1] = cmake(-0.5, -0.5);
+    }
+    else if (gate_s.id == gate_S.id)
+        m[3] = cmake(0, 1);
+    else if (gate_s.id == gate_Sd.id)
+        m[3] = cmake(0, -1);
+    else if (gate_s.id == gate_T.id)
+        m[3] = cmake(r, r);
+    else if (gate_s.id == gate_Td.id)
+        m[3] = cmake(r, -r);
+    else if (gate_s.id == gate_Rx.id) {
+        m[0] = m[3] = cmake(flt_cos(a), 0); m[1] = m[2] = cmake(0, -flt_sin(a));
+    }
+    else if (gate_s.id == gate_Ry.id) {
+        m[0] = m[3] = cmake(flt_cos(a), 0); m[1] = cmake(-flt_sin(a), 0); m[2] = cmake(flt_sin(a), 0);
+    }
+    else if (gate_s.id == gate_Rz.id) {
+        m[0] = cmake_angle(-a, 1); m[3] = cmake_angle(a, 1);
+    }
+    else if (gate_s.id == gate_U.id) {
+        for (int k = 0; k < 4; k++) m[k] = gate_s.unitary[k];
+    }
+    else
+        return false;
+    return true;
+}
+
+static bool is_zero(complex_t a)
+{
+    return flt_abs(a.r) < fuse_tolerance && flt_abs(a.i) < fuse_tolerance;
+}
+
+static bool is_diagonal(const complex_t m[4])
+{
+    return is_zero(m[1]) && is_zero(m[2]);
+}
+
+static bool is_identity(const complex_t m[4])
+{
+    return is_diagonal(m) && is_zero(csub(m[0], cone())) && is_zero(csub(m[3], cone()));
+}
+
+/**
+ * Writes the gates fused on qubit <q> at <depth> to <c_s>. Returns the number of gates removed.
+ */
+static BDDVAR fuse_flush(C_struct* c_s, BDDVAR q, BDDVAR depth, const complex_t m[4], BDDVAR fused)
+{
+    // A single gate is kept as it is
+    if (fused < 2) return 0;
+    if (is_identity(m)) {
+        remove_gate(c_s, q, depth);
+        return fused;
+    }
+    Gate gate_s = gate_U;
+    gate_s.unitary = malloc(4 * sizeof(complex_t));
+    for (int k = 0; k < 4; k++) gate_s.unitary[k] = m[k];
+    c_s->circuit[q][depth] = gate_s;
+    return fused - 1;
+}
+
+BDDVAR fuse_c_struct(C_struct* c_s)
+{
+    // Initialise variables
+    BDDVAR removed = 0;
+    complex_t m[4], g[4], prod[4];
+    Gate gate_s;
+    for (BDDVAR q = 0; q < c_s->qubits; q++) {
+        // The gates fused so far are (to be) placed on the last one of them, at <pending>
+        BDDVAR pending = 0, fused = 0;
+        // While reading, the columns are 1..depth, a copied circuit has 0..depth-1
+        for (BDDVAR depth = 0; depth <= c_s->depth && depth < c_s->max_wire; depth++) {
+            gate_s = c_s->circuit[q][depth];
+            // Vertical bars of other gates do not act on this qubit
+            if (gate_s.id == gate_I.id || gate_s.id == gate_ctrl_c.id)
+                continue;
+            // Fuse uncontrolled single-qubit gates into the product matrix
+            if (gate_s.controlSize == 0 && gate_s.classical_expect == -1 && get_gate_matrix(gate_s, g)) {
+                if (fused == 0) {
+                    for (int k = 0; k < 4; k++) m[k] = g[k];
+                }
+                else {
+                    // m := g * m (the new gate is applied after the previous ones)
+                    prod[0] = cadd(cmul(g[0], m[0]), cmul(g[1], m[2]));
+                    prod[1] = cadd(cmul(g[0], m[1]), cmul(g[1], m[3]));
+                    prod[2] = cadd(cmul(g[2], m[0]), cmul(g[3], m[2]));
+                    prod[3] = cadd(cmul(g[2], m[1]), cmul(g[3], m[3]));
+                    for (int k = 0; k < 4; k++) m[k] = prod[k];
+                    // Move the fused gates from <pending> to here
+                    if (c_s->circuit[q][pending].unitary != NULL)
+                        free(c_s->circuit[q][pending].unitary);
+                    c_s->circuit[q][pending] = gate_I;
+                }
+                pending = depth;
+                fused++;
+                continue;
+            }
+            // Diagonal gates commute with controls and controlled diagonal gates, 
+            // so keep the pending gates to move them past this gate
+            if (fused > 0 && is_diagonal(m)) {
+                if (gate_s.id == gate_ctrl.id)
+                    continue;
+                if (gate_s.controlSize > 0 && gate_s.id != gate_measure.id && gate_s.id != gate_barrier.id &&
+                    get_gate_matrix(gate_s, g) && is_diagonal(g))
+                    continue;
+            }
+            // Anything else blocks fusion
+            removed += fuse_flush(c_s, q, pending, m, fused);
+            fused = 0;
+        }
+        removed += fuse_flush(c_s, q, pending, m, fused);
+    }
+    return removed;
+}
+
 void reduce_c_struct(C_struct* c_s)
 {
     // Initialise variables
@@ -12,27 +12,29 @@ typedef struct Gate
     BDDVAR controlSize;
     int16_t classical_control;
     int16_t classical_expect;
+    complex_t *unitary; // row major 2x2 matrix of a fused gate (gate_U), else NULL
 } Gate;
 
 // Default gates
-static const Gate gate_I = {0, "--", 0, NULL, 0, -1, -1};
-static const Gate gate_X = {1, "X-", 0.5, NULL, 0, -1, -1};
-static const Gate gate_Y = {2, "Y-", 0.5, NULL, 0, -1, -1};
-static const Gate gate_Z = {3, "Z-", 0.5, NULL, 0, -1, -1};
-static const Gate gate_H = {4, "H-", 0.5, NULL, 0, -1, -1};
-static const Gate gate_sX = {9, "sX", 0.25, NULL, 0, -1, -1};
-static const Gate gate_sY = {10, "sY", 0.25, NULL, 0, -1, -1};
-static const Gate gate_S = {5, "S-", 0.25, NULL, 0, -1, -1};
-static const Gate gate_Sd = {6, "Sd", -0.25, NULL, 0, -1, -1};
-static const Gate gate_T = {7, "T-", 0.125, NULL, 0, -1, -1};
-static const Gate gate_Td = {8, "Td", -0.125, NULL, 0, -1, -1};
-static const Gate gate_Rx = {11, "Rx", 0, NULL, 0, -1, -1};
-static const Gate gate_Ry = {12, "Ry", 0, NULL, 0, -1, -1};
-static const Gate gate_Rz = {13, "Rz", 0, NULL, 0, -1, -1}; // same as PhaseGate (p)
-static const Gate gate_ctrl = {14, "@-", 0, NULL, 0, -1, -1};
-static const Gate gate_ctrl_c = {15, "|-", 0, NULL, 0, -1, -1};
-static const Gate gate_measure = {16, "M-", 0, NULL, 0, -1, -1};
-static const Gate gate_barrier = {17, "#-", 0, NULL, 0, -1, -1};
+static const Gate gate_I = {0, "--", 0, NULL, 0, -1, -1, NULL};
+static const Gate gate_X = {1, "X-", 0.5, NULL, 0, -1, -1, NULL};
+static const Gate gate_Y = {2, "Y-", 0.5, NULL, 0, -1, -1, NULL};
+static const Gate gate_Z = {3, "Z-", 0.5, NULL, 0, -1, -1, NULL};
+static const Gate gate_H = {4, "H-", 0.5, NULL, 0, -1, -1, NULL};
+static const Gate gate_sX = {9, "sX", 0.25, NULL, 0, -1, -1, NULL};
+static const Gate gate_sY = {10, "sY", 0.25, NULL, 0, -1, -1, NULL};
+static const Gate gate_S = {5, "S-", 0.25, NULL, 0, -1, -1, NULL};
+static const Gate gate_Sd = {6, "Sd", -0.25, NULL, 0, -1, -1, NULL};
+static const Gate gate_T = {7, "T-", 0.125, NULL, 0, -1, -1, NULL};
+static const Gate gate_Td = {8, "Td", -0.125, NULL, 0, -1, -1, NULL};
+static const Gate gate_Rx = {11, "Rx", 0, NULL, 0, -1, -1, NULL};
+static const Gate gate_Ry = {12, "Ry", 0, NULL, 0, -1, -1, NULL};
+static const Gate gate_Rz = {13, "Rz", 0, NULL, 0, -1, -1, NULL}; // same as PhaseGate (p)
+static const Gate gate_ctrl = {14, "@-", 0, NULL, 0, -1, -1, NULL};
+static const Gate gate_ctrl_c = {15, "|-", 0, NULL, 0, -1, -1, NULL};
+static const Gate gate_measure = {16, "M-", 0, NULL, 0, -1, -1, NULL};
+static const Gate gate_barrier = {17, "#-", 0, NULL, 0, -1, -1, NULL};
+static const Gate gate_U = {18, "U-", 0, NULL, 0, -1, -1, NULL}; // fused single-qubit gates
 
 // Circuit struct
 typedef struct C_struct
@@ -48,29 +50,88 @@ typedef struct C_struct
 // Default circuit
 static const C_struct c_struct_default = {NULL, 0, 0, 0, 128, 1024};
 
+// Circuit which is read from a QASM file one window (of columns) at a time
+typedef struct C_stream
+{
+    FILE *f;
+    char *line;
+    size_t len;
+    int index;
+    bool optimize;
+    C_struct window;
+} C_stream;
+
 /**
  * Creates a circuit struct that represents the circuit described in <filename>. If
- * <optimize> is true, negating gates will be removed.
+ * <optimize> is true, negating gates will be removed and runs of single-qubit gates
+ * will be fused.
  * 
  * ATTRIBUTES:
  * - circuit: a two dimensional array containing gates corresponding to the QASM file
  * - qubits: number of rows/qubits in the circuit
  * - depth: number of columns in the circuit
- * - max_qubits: the maximum number of qubits
+ * - max_qubits: the maximum number of qubits (can be extended with 'reallocate_qubits')
  * - max_wire: the maximum wire length (can be extended with 'reallocate_wire')
  * 
  * PARAMETERS:
  * - filename: the path to the file containing the QASM circuit code
- * - optimize: if optimize is true, negating gates will be removed
+ * - optimize: if optimize is true, negating gates will be removed and gates will be fused
  * 
  * RETURN:
  * - a circuit struct reperesenting the circuit described in <filename>
  * 
  * NOTE:
- * The current maximum number of qubits is 128. However this can easily be changed.
+ * The number of qubits is only limited by the variable field of the QMDD nodes
+ * (see AADD_INVALID_VAR).
  */
 C_struct make_c_struct(char *filename, bool optimize);
 
+/**
+ * Opens <filename> for reading the circuit in windows of at most <window> columns
+ * and reads the first window. Contrary to make_c_struct, the circuit is never fully
+ * stored, so the memory needed is independent of the depth of the circuit.
+ * 
+ * ATTRIBUTES:
+ * - window: the current window, a circuit struct of which the qubits and bits are
+ *   those declared so far in the file
+ * 
+ * PARAMETERS:
+ * - filename: the path to the file containing the QASM circuit code
+ * - window: the maximum number of columns of a window
+ * - optimize: if optimize is true, each window is optimized as in make_c_struct
+ * 
+ * RETURN:
+ * - a stream of which window contains the first part of the circuit
+ */
+C_stream* open_c_stream(char *filename, BDDVAR window, bool optimize);
+
+/**
+ * Replaces the window of <s> by the next part of the circuit.
+ * 
+ * PARAMETERS:
+ * - s: the stream to read from
+ * 
+ * RETURN:
+ * - false if the end of the file was reached before any gate was read, else true
+ */
+bool next_window_c_stream(C_stream* s);
+
+/**
+ * Restarts <s> at the beginning of the file and reads the first window.
+ * 
+ * PARAMETERS:
+ * - s: the stream to rewind
+ */
+void rewind_c_stream(C_stream* s);
+
+/**
+ * Closes the file of <s> and frees all variables used by <s>.
+ * 
+ * PARAMETERS:
+ * - s: the stream to close
+ */
+void close_c_stream(C_stream* s);
+
 /**
  * Increases the maximum depth of <c_s> and reallocates the circuit.
  * 
@@ -79,6 +140,16 @@ C_struct make_c_struct(char *filename, bool optimize);
  */
 void reallocate_wire(C_struct* c_s);
 
+/**
+ * Increases the maximum number of qubits of <c_s> to at least <qubits> and
+ * reallocates the circuit.
+ * 
+ * PARAMETERS:
+ * - c_s: circuit struct of which the number of qubits needs to be increased
+ * - qubits: the number of qubits needed
+ */
+void reallocate_qubits(C_struct* c_s, BDDVAR qubits);
+
 /**
  * Returns a copy of <c_s> where max_qubits and max_wire are set to qubits and depth respectively.
  * 
@@ -98,6 +169,14 @@ C_struct copy_c_struct(C_struct* c_s);
  */
 void delete_c_struct(C_struct* c_s);
 
+/**
+ * Removes all gates from <c_s> (keeping the allocated space) and sets its depth to 0.
+ * 
+ * PARAMETERS:
+ * - c_s: the circuit struct to clear
+ */
+void clear_c_struct(C_struct* c_s);
+
 /**
  * Parses a gate command <line> to be included in <c_s>
  * 
@@ -256,6 +335,33 @@ bool find_palindromes(C_struct* c_s, BDDVAR q, BDDVAR depth1, BDDVAR depth2);
  */
 void remove_gate(C_struct* c_s, BDDVAR q, BDDVAR depth);
 
+/**
+ * Fuses runs of single-qubit gates on the same wire into a single gate_U with the
+ * product matrix. Diagonal gates (Z, S, T, Rz, ...) commute with controls and with
+ * the targets of controlled diagonal gates, so those are moved past such gates to
+ * fuse with the gates on the other side. Fused gates which are the identity are
+ * removed. Should be called after optimize_c_struct and before reduce_c_struct.
+ * 
+ * PARAMETERS:
+ * - c_s: the circuit struct to fuse the gates of
+ * 
+ * RETURN:
+ * - the number of gates that were removed
+ */
+BDDVAR fuse_c_struct(C_struct* c_s);
+
+/**
+ * Gets the 2x2 matrix of a single-qubit gate.
+ * 
+ * PARAMETERS:
+ * - gate_s: the (uncontrolled) gate
+ * - m: the array in which the row major matrix is stored
+ * 
+ * RETURN:
+ * - true if <gate_s> is a single-qubit unitary, false otherwise (e.g. measure)
+ */
+bool get_gate_matrix(Gate gate_s, complex_t m[4]);
+
 /**
  * Reduces the depth variable of <c_s>. First all gates are moved to the left if possible. (parallelising)
  * Then the depth variable is set to the rightmost gate that is not identity.
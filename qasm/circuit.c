@@ -1,3 +1,5 @@
+#include <sylvan_edge_weights_complex.h>
+
 #include "circuit.h"
 
 Circuit* create_circuit(char* filename)
@@ -26,6 +28,11 @@ Circuit* create_circuit(char* filename)
             circuit_s->circuit[i][j].control = malloc(c_s.circuit[i][j].controlSize*sizeof(BDDVAR));
             for (BDDVAR i = 0; i < c_s.circuit[i][j].controlSize; i++)
                 circuit_s->circuit[i][j].control[i] = c_s.circuit[i][j].control[i];
+            // Fused gates also have their own matrix
+            if (c_s.circuit[i][j].unitary != NULL) {
+                circuit_s->circuit[i][j].unitary = malloc(4 * sizeof(complex_t));
+                memcpy(circuit_s->circuit[i][j].unitary, c_s.circuit[i][j].unitary, 4 * sizeof(complex_t));
+            }
         }
     }
     // Remove the c struct (since everything we need is copied)
@@ -87,6 +94,8 @@ void delete_circuit(Circuit* circuit_s)
             if (circuit_s->circuit[i][j].id != gate_I.id) {
                 if (circuit_s->circuit[i][j].control != NULL || circuit_s->circuit[i][j].controlSize != 0)
                     free(circuit_s->circuit[i][j].control);
+                if (circuit_s->circuit[i][j].unitary != NULL)
+                    free(circuit_s->circuit[i][j].unitary);
             }
         }
     }
@@ -176,6 +185,12 @@ TASK_IMPL_1(BDDVAR, get_gateid, Gate, gate)
         gate_id = GATEID_Ry(gate.rotation);
     else if (gate.id == gate_Rz.id)
         gate_id = GATEID_Rz(gate.rotation);
+    // Fused gates have an arbitrary matrix, equal matrices get the same GATEID
+    else if (gate.id == gate_U.id) {
+        AMP u[4];
+        for (int k = 0; k < 4; k++) u[k] = complex_lookup(gate.unitary[k].r, gate.unitary[k].i);
+        gate_id = GATEID_custom(u);
+    }
     else {
         fprintf(stderr, "Unknown gate: %d\n", gate.id);
         exit(EXIT_FAILURE);
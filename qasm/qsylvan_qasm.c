@@ -1,7 +1,11 @@
 #include <inttypes.h>
+#ifndef QSYLVAN_QASM_NO_MAIN
 #include <popt.h>
+#endif
 #include <sys/time.h>
 #include <libgen.h>
+#include <sylvan_edge_weights_complex.h>
+#include <sylvan_int.h>
 
 #include "qsylvan_qasm.h"
 
@@ -74,6 +78,12 @@ TASK_IMPL_1(BDDVAR, get_gate_id, Gate, gate)
         gate_id = GATEID_Ry(gate.rotation);
     else if (gate.id == gate_Rz.id)
         gate_id = GATEID_Rz(gate.rotation);
+    // Fused gates have an arbitrary matrix, equal matrices get the same GATEID
+    else if (gate.id == gate_U.id) {
+        AMP u[4];
+        for (int k = 0; k < 4; k++) u[k] = complex_lookup(gate.unitary[k].r, gate.unitary[k].i);
+        gate_id = GATEID_custom(u);
+    }
     else {
         fprintf(stderr, "Unknown gate: %d\n", gate.id);
         exit(EXIT_FAILURE);
@@ -663,15 +673,105 @@ QMDD run_circuit_matrix(C_struct c_s, int* measurements, bool* results, int limi
     return vec;
 }
 
-QMDD run_c_struct(C_struct c_s, int* measurements, bool* results, bool experiments)
+bool column_is_layer(C_struct c_s, BDDVAR j)
+{
+    Gate gate;
+    for (BDDVAR i = 0; i < c_s.qubits; i++) {
+        gate = c_s.circuit[i][j];
+        // Measurements and classically controlled gates depend on the order
+        // in which the gates of the column are applied
+        if (gate.id == gate_measure.id || gate.classical_expect != -1)
+            return false;
+    }
+    return true;
+}
+
+QMDD apply_layer(QMDD qmdd, C_struct c_s, BDDVAR j)
+{
+    LACE_ME;
+    Gate gate;
+    bool above;
+    gate_id_t *gates = malloc(c_s.qubits * sizeof(gate_id_t));
+    int *controls = malloc(c_s.qubits * sizeof(int));
+    for (BDDVAR i = 0; i < c_s.qubits; i++) {
+        gates[i] = GATEID_I;
+        controls[i] = -1;
+    }
+    // Collect all gates of which the controls (if any) are above the target
+    for (BDDVAR i = 0; i < c_s.qubits; i++) {
+        gate = c_s.circuit[i][j];
+        if (gate.id == gate_barrier.id || gate.id == gate_ctrl.id || gate.id == gate_ctrl_c.id || gate.id == gate_I.id)
+            continue;
+        above = true;
+        for (BDDVAR k = 0; k < gate.controlSize; k++) {
+            if (gate.control[k] > i)
+                above = false;
+        }
+        if (!above)
+            continue;
+        gates[i] = (gate_id_t) get_gate_id(gate);
+        for (BDDVAR k = 0; k < gate.controlSize; k++)
+            controls[gate.control[k]] = i;
+    }
+    qmdd = qmdd_gate_layer(qmdd, c_s.qubits, gates, controls);
+    // Remaining gates (controls below the target) are applied one by one
+    for (BDDVAR i = 0; i < c_s.qubits; i++) {
+        gate = c_s.circuit[i][j];
+        if (gate.controlSize != 0 && gates[i] == GATEID_I && gate.id != gate_ctrl.id && gate.id != gate_ctrl_c.id)
+            qmdd = apply_gate(qmdd, gate, i, c_s.qubits);
+    }
+    free(gates);
+    free(controls);
+    return qmdd;
+}
+
+QMDD apply_column(QMDD qmdd, C_struct c_s, BDDVAR j, int* measurements, bool* results, bool experiments)
 {
     // Inisialise variables
     LACE_ME;
     Gate gate;
     bool final, satisfied;
-    double *p = malloc(sizeof(double));
+    double p;
     int result;
     BDDVAR nodecount;
+    for (BDDVAR i = 0; i < c_s.qubits; i++) {
+        gate = c_s.circuit[i][j];
+        // If classical control is not equal to max qubits, the gate is classically controlled
+        if (gate.classical_expect != -1) {
+            satisfied = check_classical_if(c_s.bits, gate, results);
+            if (!satisfied)
+                continue;
+        }
+        // Skip barrier (does not affect runs)
+        // Skip control gates (controls are used by target gate)
+        if (gate.id == gate_barrier.id || gate.id == gate_ctrl.id || gate.id == gate_ctrl_c.id || gate.id == gate_I.id)
+            continue;
+        // Set measurement flag
+        else if (gate.id == gate_measure.id) {
+            final = is_final_measure(c_s, i, j);
+            if (final)
+                measurements[i] = gate.control[0];
+            else {
+                qmdd = qmdd_measure_qubit(qmdd, i, c_s.qubits, &result, &p);
+                results[gate.control[0]] = (bool) result;
+            }
+        }
+        // Apply gate
+        else
+            qmdd = apply_gate(qmdd, gate, i, c_s.qubits);
+        if (experiments) {
+            nodecount = aadd_countnodes(qmdd);
+            printf("nodecount: %d\n", nodecount);
+        }
+    }
+    return qmdd;
+}
+
+QMDD run_c_struct(C_struct c_s, int* measurements, bool* results, bool experiments)
+{
+    // Inisialise variables
+    LACE_ME;
+    BDDVAR nodecount;
     for (BDDVAR i = 0; i < c_s.bits; i++) results[i] = 0;
     for (BDDVAR i = 0; i < c_s.qubits; i++) measurements[i] = -1;
     QMDD qmdd = qmdd_create_all_zero_state(c_s.qubits);
@@ -683,42 +783,245 @@ QMDD run_c_struct(C_struct c_s, int* measurements, bool* results, bool experimen
     }
     // Loop over all places in the circuit
     for (BDDVAR j = 0; j < c_s.depth; j++) {
-        for (BDDVAR i = 0; i < c_s.qubits; i++) {
-            gate = c_s.circuit[i][j];
-            // If classical control is not equal to max qubits, the gate is classically controlled
-            if (gate.classical_expect != -1) {
-                satisfied = check_classical_if(c_s.bits, gate, results);
-                if (!satisfied)
-                    continue;
-            }
-            // Skip barrier (does not affect runs)
-            // Skip control gates (controls are used by target gate)
-            if (gate.id == gate_barrier.id || gate.id == gate_ctrl.id || gate.id == gate_ctrl_c.id || gate.id == gate_I.id)
-                continue;
-            // Set measurement flag
-            else if (gate.id == gate_measure.id) {
-                final = is_final_measure(c_s, i, j);
-                if (final)
-                    measurements[i] = gate.control[0];
-                else {
-                    qmdd = qmdd_measure_qubit(qmdd, i, c_s.qubits, &result, p);
-                    results[gate.control[0]] = (bool) result;
-                }
-            }
-            // Apply gate
-            else
-                qmdd = apply_gate(qmdd, gate, i, c_s.qubits);
+        // Apply all gates in the column in one go if possible
+        if (column_is_layer(c_s, j)) {
+            qmdd = apply_layer(qmdd, c_s, j);
             if (experiments) {
                 nodecount = aadd_countnodes(qmdd);
                 printf("nodecount: %d\n", nodecount);
             }
+            continue;
         }
+        qmdd = apply_column(qmdd, c_s, j, measurements, results, experiments);
     }
     aadd_unprotect(&qmdd);
     return qmdd;
 }
 
+// Number of columns between two refreshes of the cost model
+#define ADAPTIVE_INTERVAL 8
+// Work per gate QMDD node relative to a statevector QMDD node: a matrix-matrix step recurses
+// into eight products where a matrix-vector step recurses into four, and the segment has to be
+// applied to the state at the end. That makes a factor of at least 2; 8 is a conservative guess
+// (it favours the matrix-vector method), not a tuned value.
+#define ADAPTIVE_MATMAT_COST 8
+
+static QMDD column_matrix(C_struct c_s, BDDVAR j)
+{
+    LACE_ME;
+    Gate gate;
+    QMDD qmdd, qmdd_column = AADD_TERMINAL;
+    BDDVAR *gateids = malloc(c_s.qubits * sizeof(BDDVAR));
+    qmdd = qmdd_create_single_qubit_gates_same(c_s.qubits, GATEID_I);
+    aadd_protect(&qmdd);
+    aadd_protect(&qmdd_column);
+    for (BDDVAR i = 0; i < c_s.qubits; i++) {
+        gate = c_s.circuit[i][j];
+        gateids[i] = GATEID_I;
+        if (gate.id == gate_barrier.id || gate.id == gate_ctrl.id || gate.id == gate_ctrl_c.id || gate.id == gate_I.id)
+            continue;
+        // Controlled gates are multiplied separately, the gates of a layer act on different qubits
+        if (gate.controlSize != 0) {
+            qmdd_column = handle_control_matrix(gate, i, c_s.qubits);
+            qmdd = aadd_matmat_mult(qmdd_column, qmdd, c_s.qubits);
+        }
+        else
+            gateids[i] = get_gate_id(gate);
+    }
+    qmdd_column = qmdd_create_single_qubit_gates(c_s.qubits, gateids);
+    qmdd = aadd_matmat_mult(qmdd_column, qmdd, c_s.qubits);
+    aadd_unprotect(&qmdd);
+    aadd_unprotect(&qmdd_column);
+    free(gateids);
+    return qmdd;
+}
+
+static double cache_hit_rate(sylvan_stats_t *now, sylvan_stats_t *prev, const int *ops, int n_ops)
+{
+    uint64_t hits = 0, lookups = 0, h, m;
+    for (int k = 0; k < n_ops; k++) {
+        h = CACHE_OPID_COUNTERS + 3*ops[k] + CACHE_STATS_HIT;
+        m = CACHE_OPID_COUNTERS + 3*ops[k] + CACHE_STATS_MISS;
+        hits += now->counters[h] - prev->counters[h];
+        lookups += now->counters[h] - prev->counters[h] + now->counters[m] - prev->counters[m];
+    }
+    // Without lookups (or without SYLVAN_STATS) only the sizes count
+    return (lookups == 0) ? 0.0 : (double)hits / (double)lookups;
+}
+
+QMDD run_circuit_adaptive(C_struct c_s, int* measurements, bool* results, bool experiments)
+{
+    LACE_ME;
+    sylvan_stats_t prev, now;
+    double h_vec = 0.0, h_mat = 0.0;
+    // Operation cache ids of the matrix-vector and matrix-matrix operations
+    const int vec_ops[] = {CACHE_AADD_MATVEC_MULT >> 40, CACHE_QMDD_GATE >> 40, CACHE_QMDD_CGATE >> 40,
+                           CACHE_QMDD_CGATE_RANGE >> 40, CACHE_QMDD_GATE_LAYER >> 40,
+                           CACHE_QMDD_GATE2 >> 40, CACHE_QMDD_GATE2_MIX >> 40};
+    const int mat_op = CACHE_AADD_MATMAT_MULT >> 40;
+    BDDVAR v = 0, m = c_s.qubits + 1, start = 0;
+    BDDVAR n_vec = 0, n_mat = 0, n_segments = 0;
+    for (BDDVAR i = 0; i < c_s.bits; i++) results[i] = 0;
+    for (BDDVAR i = 0; i < c_s.qubits; i++) measurements[i] = -1;
+    QMDD vec = qmdd_create_all_zero_state(c_s.qubits);
+    QMDD mat = AADD_TERMINAL;
+    QMDD column = AADD_TERMINAL;
+    aadd_protect(&vec);
+    aadd_protect(&mat);
+    aadd_protect(&column);
+    sylvan_stats_snapshot(&prev);
+
+    for (BDDVAR j = 0; j < c_s.depth; j++) {
+        // Refresh the state size and the cache behaviour of both methods
+        if (j % ADAPTIVE_INTERVAL == 0) {
+            v = aadd_countnodes(vec);
+            sylvan_stats_snapshot(&now);
+            h_vec = cache_hit_rate(&now, &prev, vec_ops, sizeof(vec_ops)/sizeof(int));
+            h_mat = cache_hit_rate(&now, &prev, &mat_op, 1);
+            prev = now;
+        }
+        // Grow the segment matrix as long as this is expected to do less work than
+        // applying the column to the state, i.e. the uncached part of the matrix
+        // is smaller than the uncached part of the statevector
+        if (column_is_layer(c_s, j) && ADAPTIVE_MATMAT_COST * m * (1.0 - h_mat) < v * (1.0 - h_vec)) {
+            if (mat == AADD_TERMINAL) {
+                mat = qmdd_create_single_qubit_gates_same(c_s.qubits, GATEID_I);
+                start = j;
+            }
+            column = column_matrix(c_s, j);
+            mat = aadd_matmat_mult(column, mat, c_s.qubits);
+            m = aadd_countnodes(mat);
+            n_mat++;
+            continue;
+        }
+        // Flush the segment before applying the column to the state vector
+        if (mat != AADD_TERMINAL) {
+            vec = aadd_matvec_mult(mat, vec, c_s.qubits);
+            v = aadd_countnodes(vec);
+            n_segments++;
+            if (experiments)
+                printf("columns %d-%d via matmat, segment nodes: %d, state nodes: %d\n", start, j-1, m, v);
+            mat = AADD_TERMINAL;
+            m = c_s.qubits + 1;
+        }
+        if (column_is_layer(c_s, j))
+            vec = apply_layer(vec, c_s, j);
+        else
+            vec = apply_column(vec, c_s, j, measurements, results, false);
+        n_vec++;
+        if (experiments) {
+            v = aadd_countnodes(vec);
+            printf("column %d via matvec, state nodes: %d\n", j, v);
+        }
+    }
+    if (mat != AADD_TERMINAL) {
+        vec = aadd_matvec_mult(mat, vec, c_s.qubits);
+        n_segments++;
+        if (experiments) {
+            v = aadd_countnodes(vec);
+            printf("columns %d-%d via matmat, segment nodes: %d, state nodes: %d\n", start, c_s.depth-1, m, v);
+        }
+    }
+    if (experiments)
+        INFO("Adaptive: %d columns via matvec, %d columns via matmat in %d segments\n", n_vec, n_mat, n_segments);
+    aadd_unprotect(&vec);
+    aadd_unprotect(&mat);
+    aadd_unprotect(&column);
+    return vec;
+}
+
+QMDD run_c_stream(C_stream* s, int* measurements, bool* results, bool experiments, bool* intermediate)
+{
+    // Inisialise variables
+    LACE_ME;
+    Gate gate;
+    bool satisfied, classical;
+    double *p = malloc(sizeof(double));
+    int result;
+    BDDVAR nodecount;
+    C_struct* w = &s->window;
+    BDDVAR qubits = w->qubits;
+    // Bit of the measurement of each qubit which is not performed yet (-1 if none)
+    int *pending = malloc(qubits * sizeof(int));
+    for (BDDVAR i = 0; i < w->bits; i++) results[i] = 0;
+    for (BDDVAR i = 0; i < qubits; i++) pending[i] = -1;
+    *intermediate = false;
+    QMDD qmdd = qmdd_create_all_zero_state(qubits);
+    aadd_protect(&qmdd);
+
+    if (experiments) {
+        nodecount = aadd_countnodes(qmdd);
+        printf("nodecount: %d\n", nodecount);
+    }
+    do {
+        if (w->qubits != qubits) {
+            fprintf(stderr, "Line %d: registers must be declared before the first gate when streaming.\n", s->index);
+            exit(EXIT_FAILURE);
+        }
+        for (BDDVAR j = 0; j < w->depth; j++) {
+            // Perform the pending measurements of qubits which are used again, and all of them
+            // if a gate depends on the classical bits
+            classical = false;
+            for (BDDVAR i = 0; i < qubits; i++) {
+                if (w->circuit[i][j].classical_expect != -1)
+                    classical = true;
+            }
+            for (BDDVAR i = 0; i < qubits; i++) {
+                gate = w->circuit[i][j];
+                if (pending[i] == -1)
+                    continue;
+                if (classical || (gate.id != gate_I.id && gate.id != gate_ctrl_c.id && gate.id != gate_barrier.id)) {
+                    qmdd = qmdd_measure_qubit(qmdd, i, qubits, &result, p);
+                    results[pending[i]] = (bool) result;
+                    pending[i] = -1;
+                    *intermediate = true;
+                }
+            }
+            // Apply all gates in the column in one go if possible
+            if (column_is_layer(*w, j)) {
+                qmdd = apply_layer(qmdd, *w, j);
+                if (experiments) {
+                    nodecount = aadd_countnodes(qmdd);
+                    printf("nodecount: %d\n", nodecount);
+                }
+                continue;
+            }
+            for (BDDVAR i = 0; i < qubits; i++) {
+                gate = w->circuit[i][j];
+                // If classical control is not equal to max qubits, the gate is classically controlled
+                if (gate.classical_expect != -1) {
+                    satisfied = check_classical_if(w->bits, gate, results);
+                    if (!satisfied)
+                        continue;
+                }
+                // Skip barrier, control gates and identity gates
+                if (gate.id == gate_barrier.id || gate.id == gate_ctrl.id || gate.id == gate_ctrl_c.id || gate.id == gate_I.id)
+                    continue;
+                // Postpone measurements until the qubit is used again
+                else if (gate.id == gate_measure.id)
+                    pending[i] = gate.control[0];
+                // Apply gate
+                else
+                    qmdd = apply_gate(qmdd, gate, i, qubits);
+                if (experiments) {
+                    nodecount = aadd_countnodes(qmdd);
+                    printf("nodecount: %d\n", nodecount);
+                }
+            }
+        }
+    } while (next_window_c_stream(s));
+    // Measurements which were not followed by other gates are final measurements
+    for (BDDVAR i = 0; i < qubits; i++) measurements[i] = pending[i];
+    aadd_unprotect(&qmdd);
+    free(pending);
+    free(p);
+    return qmdd;
+}
+
 // TODO: move this main to separate file?
+// The tests link the functions above without the command line interface
+#ifndef QSYLVAN_QASM_NO_MAIN
+
 /**
  * Runs QASM circuit given by <filename> and prints the results.
  * Using the -m flag activates gate-gate multiplication runs, gate-statevector runs are used otherwise.
@@ -732,9 +1035,11 @@ QMDD run_c_struct(C_struct c_s, int* measurements, bool* results, bool experimen
  * [-m matrix (int)] (optional) the boundaray value of nodes in a tree before multiplying with the state vector
  * [-g greedy] (optional) runs the circuit matrix-vector method using a greedy algorithm
  * [-b balance (int)] (optional) runs the circuit switching between matrix-matrix method and greedy method
- * [-o optimize] (optional) optimize the circuit if true. This option will remove negating gates before running
+ * [-a adaptive] (optional) runs the circuit switching between matrix-vector and matrix-matrix method based on a cost model
+ * [-o optimize] (optional) optimize the circuit if true. This option will remove negating gates and fuse single-qubit gates before running
  * [-e experiment] (optional) prints the nodcount and palindrome signals
  * [-t time] (optional) prints the time taken to run the circuit
+ * [--stream window (int)] (optional) simulate while reading the file, keeping at most <window> columns
  * 
  * NOTE:
  * Since multiplying a gate-QMDD with a gate-QMDD is more expensive than multiplying a gate-QMDD with
@@ -755,6 +1060,8 @@ int main(int argc, char *argv[])
     int balance = 0;
     int greedy = 0;
     int optimize = 0;
+    int stream = 0;
+    int adaptive = 0;
     int intermediate_measuring = 0;
     int experiments = 0;
     bool intermediate_experiments;
@@ -771,10 +1078,12 @@ int main(int argc, char *argv[])
         { "matrix", 'm', POPT_ARG_INT, &matrix, 'm', "Boundaray value of nodes in a DD before multiplying with the state vector.", NULL },
         { "greedy", 'g', POPT_ARG_NONE, &greedy, 'g', "Runs the circuit matrix-vector method using a greedy algorithm.", NULL },
         { "balance", 'b', POPT_ARG_INT, &balance, 'b', "Runs the circuit switching between matrix-matrix method and greedy method", NULL },
-        { "optimize", 'o', POPT_ARG_NONE, &optimize, 'o', "Optimize the circuit. This option will remove negating gates before running.", NULL },
+        { "optimize", 'o', POPT_ARG_NONE, &optimize, 'o', "Optimize the circuit. This option will remove negating gates and fuse single-qubit gates before running.", NULL },
+        { "adaptive", 'a', POPT_ARG_NONE, &adaptive, 'a', "Switch between the matrix-vector and matrix-matrix method based on the DD sizes and cache hit rates.", NULL },
         { "experiment", 'e', POPT_ARG_NONE, &experiments, 'e', "Prints the nodecount and palindrome signals.", NULL },
         { "norm-strat", 9, POPT_ARG_INT, &wgt_norm_strat, 9, "Weight norm strat as int: <0(low)|1(largest)|2(l2)>.", NULL },
         { "csv-output", 10, POPT_ARG_STRING, &csv_outputfile, 10, "Write stats to given filename (or append if file exists.", NULL },
+        { "stream", 11, POPT_ARG_INT, &stream, 11, "Simulate while reading the file, keeping at most this many columns of the circuit in memory.", NULL },
         {NULL, 0, 0, NULL, 0, NULL, NULL}
     };
     con = poptGetContext("q-sylvan-sim", argc, (const char **)argv, optiontable, 0);
@@ -799,7 +1108,9 @@ int main(int argc, char *argv[])
     INFO("Option matrix=%d\n", matrix);
     INFO("Option balance=%d\n", balance);
     INFO("Option greedy=%d\n", greedy);
+    INFO("Option adaptive=%d\n", adaptive);
     INFO("Option experiments=%d\n", experiments);
+    INFO("Option stream=%d\n", stream);
     INFO("Option rseed=%d\n", seed);
 
     // Set randomness seed
@@ -813,6 +1124,11 @@ int main(int argc, char *argv[])
         fprintf(stderr, "Invalid QASM file.\n");
         exit(EXIT_FAILURE);
     }
+    // The other methods need to look ahead further than a single window
+    if (stream != 0 && (greedy || matrix != 0 || balance != 0 || adaptive)) {
+        fprintf(stderr, "Streaming is only supported by the default (matrix-vector) method.\n");
+        exit(EXIT_FAILURE);
+    }
 
     double start,end;
     start = wctime();
@@ -828,12 +1144,31 @@ int main(int argc, char *argv[])
     qmdd_set_testing_mode(true); // turn on internal sanity tests
 
     // Create a circuit struct representing the QASM circuit in the given file
-    C_struct c_s = make_c_struct(filename, optimize);
+    C_struct c_s;
+    C_stream* c_stream = NULL;
+    if (stream != 0) {
+        // Only read the first window, the circuit struct only holds the sizes
+        c_stream = open_c_stream(filename, stream, optimize);
+        c_s = c_struct_default;
+        c_s.qubits = c_stream->window.qubits;
+        c_s.bits = c_stream->window.bits;
+        c_s.max_qubits = 0;
+        c_s.max_wire = 0;
+    }
+    else
+        c_s = make_c_struct(filename, optimize);
     
     int* measurements = malloc(c_s.qubits * sizeof(int));
     bool* bit_res = malloc(c_s.bits * sizeof(bool));
     bool* bit_print;
-    intermediate_measuring = check_measuring_gates(c_s);
+    if (c_stream != NULL) {
+        // Intermediate measurements are only found while running
+        bool intermediate;
+        qmdd = run_c_stream(c_stream, measurements, bit_res, experiments, &intermediate);
+        intermediate_measuring = intermediate;
+    }
+    else
+        intermediate_measuring = check_measuring_gates(c_s);
     BDDVAR* results = malloc(pow(2,c_s.bits) * sizeof(BDDVAR));
     for (BDDVAR i = 0; i < pow(2,c_s.bits); i++) results[i] = 0;
     BDDVAR* nodecount_matrix = malloc(sizeof(BDDVAR));
@@ -845,12 +1180,22 @@ int main(int argc, char *argv[])
         intermediate_experiments = experiments;
         // Run the circuit based on method
         for (BDDVAR i = 0; i < runs; i++) {
-            if (greedy)
+            if (c_stream != NULL) {
+                // The first run was done while finding the intermediate measurements
+                if (i > 0) {
+                    bool intermediate;
+                    rewind_c_stream(c_stream);
+                    qmdd = run_c_stream(c_stream, measurements, bit_res, intermediate_experiments, &intermediate);
+                }
+            }
+            else if (greedy)
                 qmdd = greedy_run_circuit(c_s, measurements, bit_res, intermediate_experiments);
             else if (matrix != 0)
                 qmdd = run_circuit_matrix(c_s, measurements, bit_res, matrix, intermediate_experiments);
             else if (balance != 0)
                 qmdd = run_circuit_balance(c_s, measurements, bit_res, balance, intermediate_experiments);
+            else if (adaptive)
+                qmdd = run_circuit_adaptive(c_s, measurements, bit_res, intermediate_experiments);
             else
                 qmdd = run_c_struct(c_s, measurements, bit_res, intermediate_experiments);
             // Measure all qubits
@@ -863,19 +1208,40 @@ int main(int argc, char *argv[])
     }
     else {
         // Run the circuit based on method
-        if (greedy)
+        if (c_stream != NULL) {
+            // already run while reading the file
+        }
+        else if (greedy)
                 qmdd = greedy_run_circuit(c_s, measurements, bit_res, experiments);
         else if (matrix != 0)
             qmdd = run_circuit_matrix(c_s, measurements, bit_res, matrix, experiments);
         else if (balance != 0)
             qmdd = run_circuit_balance(c_s, measurements, bit_res, balance, experiments);
+        else if (adaptive)
+            qmdd = run_circuit_adaptive(c_s, measurements, bit_res, experiments);
         else
             qmdd = run_c_struct(c_s, measurements, bit_res, experiments);
-        // Measure all qubits
-        for (BDDVAR i = 0; i < runs; i++) {
-            final_measure(qmdd, measurements, c_s, bit_res);
-            res = bitarray_to_int(bit_res, c_s.bits, false);
-            results[res]++;
+        // Measure all qubits: sample all runs from the final state at once
+        if (c_s.qubits <= 64) {
+            qmdd_shots_t shots;
+            qmdd_sample_shots(qmdd, c_s.qubits, runs, (seed == 0) ? (uint64_t)rand() : seed, &shots);
+            for (size_t k = 0; k < shots.n_outcomes; k++) {
+                for (BDDVAR i = 0; i < c_s.bits; i++) bit_res[i] = 0;
+                for (BDDVAR i = 0; i < c_s.qubits; i++) {
+                    if (measurements[i] != -1)
+                        bit_res[measurements[i]] = (shots.outcomes[k] >> i) & 1;
+                }
+                res = bitarray_to_int(bit_res, c_s.bits, false);
+                results[res] += shots.counts[k];
+            }
+            qmdd_shots_free(&shots);
+        }
+        else {
+            for (BDDVAR i = 0; i < runs; i++) {
+                final_measure(qmdd, measurements, c_s, bit_res);
+                res = bitarray_to_int(bit_res, c_s.bits, false);
+                results[res]++;
+            }
         }
     }
 
@@ -928,9 +1294,13 @@ int main(int argc, char *argv[])
     }
 
     // Free variables
+    if (c_stream != NULL)
+        close_c_stream(c_stream);
     delete_c_struct(&c_s);
     sylvan_quit();
     lace_exit();
 
     return 0;
 }
+
+#endif
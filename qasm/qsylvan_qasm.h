@@ -229,6 +229,48 @@ QMDD greedy_run_circuit(C_struct c_s, int* measurements, bool* results, bool exp
  */
 QMDD run_c_struct_matrix(C_struct c_s, int* measurements, bool* bit_res, int limit, bool experiments);
 
+/**
+ * Check if column <j> of <c_s> can be applied as a single layer, i.e. if it contains no measurements
+ * and no classically controlled gates.
+ * 
+ * PARAMETERS:
+ * - c_s: the circuit_struct containing the column
+ * - j: the index of the column
+ * 
+ * RETURN:
+ * - true if the column can be applied with apply_layer
+ */
+bool column_is_layer(C_struct c_s, BDDVAR j);
+
+/**
+ * Applies all gates in column <j> of <c_s> to <qmdd> in a single traversal of the QMDD. Controlled
+ * gates which have a control below their target are applied separately afterwards.
+ * 
+ * PARAMETERS:
+ * - qmdd: the statevector QMDD
+ * - c_s: the circuit_struct containing the column
+ * - j: the index of the column
+ * 
+ * RETURN:
+ * - The resulting statevector QMDD after applying the column
+ */
+QMDD apply_layer(QMDD qmdd, C_struct c_s, BDDVAR j);
+
+/**
+ * Applies the gates in column <j> of <c_s> to <qmdd> one by one, performing measurements which
+ * are not final and skipping classically controlled gates whose condition does not hold.
+ * 
+ * PARAMETERS:
+ * - qmdd: the statevector QMDD
+ * - c_s: the circuit_struct containing the column
+ * - j: the index of the column
+ * - bit_res: the bit register to store measurements in
+ * 
+ * RETURN:
+ * - The resulting statevector QMDD after applying the column
+ */
+QMDD apply_column(QMDD qmdd, C_struct c_s, BDDVAR j, int* measurements, bool* bit_res, bool experiments);
+
 /**
  * Runs the circuit_struct <c_s> and stores measurements in <bit_res>. The run is done using the
  * matrix-vector method. Each gate is directly multiplied with the statevector QMDD.
@@ -241,4 +283,36 @@ QMDD run_c_struct_matrix(C_struct c_s, int* measurements, bool* bit_res, int lim
  * RETURN:
  * - The resulting statevector QMDD after running the circuit
  */
-QMDD run_c_struct(C_struct c_s, int* measurements, bool* bit_res, bool experiments);
\ No newline at end of file
+QMDD run_c_struct(C_struct c_s, int* measurements, bool* bit_res, bool experiments);
+
+/**
+ * Runs the circuit_struct <c_s> and stores measurements in <bit_res>, choosing per segment of
+ * columns between the matrix-vector and the matrix-matrix method. A column is added to the
+ * current gate QMDD when the part of that QMDD expected to miss the operation cache is smaller
+ * than that of the statevector QMDD, otherwise the segment is multiplied with the statevector
+ * and the column is applied directly. The cost model is refreshed every few columns.
+ * 
+ * PARAMETERS:
+ * - c_s: the circuit_struct to be run
+ * - bit_res: the bit register to store measurements in
+ * 
+ * RETURN:
+ * - The resulting statevector QMDD after running the circuit
+ */
+QMDD run_circuit_adaptive(C_struct c_s, int* measurements, bool* bit_res, bool experiments);
+
+/**
+ * Runs the circuit read by <s> window by window, applying each window as in run_c_struct before
+ * the next window is read. Since it is not known whether a measurement is the last gate on its
+ * qubit until the rest of the file is read, measurements are only performed once their qubit is
+ * used again. The remaining ones are final measurements, which are stored in <measurements>.
+ * 
+ * PARAMETERS:
+ * - s: the stream of the circuit to be run, positioned at its first window
+ * - bit_res: the bit register to store measurements in
+ * - intermediate: set to true if the circuit contains intermediate measurements
+ * 
+ * RETURN:
+ * - The resulting statevector QMDD after running the circuit
+ */
+QMDD run_c_stream(C_stream* s, int* measurements, bool* bit_res, bool experiments, bool* intermediate);
\ No newline at end of file
@@ -32,22 +32,100 @@ typedef union {
 static long double TOLERANCE = 1e-14l;
 static const uint64_t EMPTY = 14738995463583502973ull;
 static const uint64_t LOCK  = 14738995463583502974ull;
+static const uint64_t TOMBSTONE = 14738995463583502975ull;
 static const uint64_t CL_MASK = -(1ULL << CACHE_LINE);
 
+// max number of segments the table can grow to (segment k > 0 has size 
+// size*2^(k-1), so this is never the limiting factor in practice)
+#define MAX_SEGMENTS 48
+
+// when the table is allowed to grow, only probe this many cache lines per
+// segment before moving on to the next one (keeps lookups of values which live
+// in later segments cheap)
+#define GROW_PROBE_LINES 4
+
 /**
 \typedef Lockless hastable database.
+
+The table consists of segments. Segment 0 has `size` buckets, and segment k > 0
+has size*2^(k-1) buckets, such that the first k segments together have exactly
+size*2^(k-1) buckets. The index of a bucket is its offset in the concatenation
+of all segments, so indices remain valid when new segments are added.
+
+A value is always stored in the first segment (in order) which has an empty
+bucket on the probe sequence of that value. Since buckets never become empty
+again, all threads agree on which segment a given value belongs to.
 */
 typedef struct cmap_s cmap_t;
 struct cmap_s {
-    size_t              size;
-    size_t              mask;
-    size_t              threshold;
+    size_t              size;       // size of segment 0
+    size_t              log_size;
+    size_t              max_size;   // max total size (after growing)
+    size_t              threshold;  // max number of cache lines to probe
     int                 seen_0;
-    bucket_t  __attribute__(( __aligned__(32)))       *table;
+    volatile size_t     num_segments;
+    void             *(*alloc)(size_t);         // segment allocator
+    void              (*free)(void *, size_t);
+    bucket_t  __attribute__(( __aligned__(32)))       *table[MAX_SEGMENTS];
     // Q: should this 32 change to 16 now that we use doubles instead of
     // long doubles for the real and imaginary components?
 };
 
+static inline size_t
+segment_size(const cmap_t *cmap, size_t seg)
+{
+    return (seg == 0) ? cmap->size : cmap->size << (seg - 1);
+}
+
+static inline size_t
+total_size(const cmap_t *cmap, size_t num_segments)
+{
+    return cmap->size << (num_segments - 1);
+}
+
+static inline bucket_t *
+get_bucket(const cmap_t *cmap, uint64_t ref)
+{
+    if (ref < cmap->size) return &cmap->table[0][ref];
+    size_t seg = (63 - __builtin_clzll(ref)) - cmap->log_size + 1;
+    return &cmap->table[seg][ref - segment_size(cmap, seg)];
+}
+
+static void *
+calloc_segment(size_t size)
+{
+    return calloc(1, size);
+}
+
+static void
+free_segment(void *ptr, size_t size)
+{
+    free(ptr);
+    (void)size;
+}
+
+// allocator for the segments of new tables (set with cmap_set_allocator)
+static void *(*segment_alloc)(size_t) = calloc_segment;
+static void (*segment_free)(void *, size_t) = free_segment;
+
+void
+cmap_set_allocator(void *(*alloc)(size_t), void (*dealloc)(void *, size_t))
+{
+    segment_alloc = alloc ? alloc : calloc_segment;
+    segment_free = dealloc ? dealloc : free_segment;
+}
+
+static bucket_t *
+alloc_segment(const cmap_t *cmap, size_t size)
+{
+    bucket_t *segment = cmap->alloc(size * sizeof(bucket_t));
+    if (segment == NULL) return NULL;
+    for (size_t c = 0; c < size; c++) {
+        segment[c].d[0] = EMPTY;
+    }
+    return segment;
+}
+
 static void __attribute__((unused))
 print_bucket_floats(bucket_t *b)
 {
@@ -84,12 +162,94 @@ complex_close(complex_t *in_table, const complex_t* to_insert)
     
 }
 
-int
-cmap_find_or_put(const void *dbs, const complex_t *v, uint64_t *ret)
+typedef struct free_bucket_s {
+    bucket_t           *bucket;
+    uint64_t            ref;
+    uint64_t            seen;   // EMPTY or TOMBSTONE
+} free_bucket_t;
+
+/**
+ * Probe segment `seg` for `v`. Returns 1 if found, 0 if an empty bucket was
+ * reached (so `v` is not in the table) and -1 if the probe sequence of `v` in
+ * this segment was exhausted. The first free (empty or tombstone) bucket which
+ * is encountered is stored in `avail` (if it isn't set yet).
+ */
+static int
+segment_find(cmap_t *cmap, size_t seg, uint32_t hash, uint32_t prime,
+             const bucket_t *val, uint64_t *ret, free_bucket_t *avail)
 {
-    cmap_t *cmap = (cmap_t *) dbs;
-    bucket_t *val  = (bucket_t *) v;
+    bucket_t *table = cmap->table[seg];
+    uint64_t  mask  = segment_size(cmap, seg) - 1;
+    uint64_t  base  = (seg == 0) ? 0 : segment_size(cmap, seg);
+
+    for (unsigned int c = 0; c < cmap->threshold; c++) {
+        uint64_t            ref = hash & mask;
+        uint64_t            line_end = (ref & CL_MASK) + CACHE_LINE_SIZE;
+        for (size_t i = 0; i < CACHE_LINE_SIZE; i++) {
+            
+            // 1. Get bucket (wait if it is being written)
+            bucket_t *bucket = &table[ref];
+            uint64_t d0;
+            while ((d0 = atomic_read(&bucket->d[0])) == LOCK) {}
 
+            // 2. If bucket empty, `v` is not in the table
+            if (d0 == EMPTY || d0 == TOMBSTONE) {
+                if (avail->bucket == NULL) {
+                    avail->bucket = bucket;
+                    avail->ref    = base + ref;
+                    avail->seen   = d0;
+                }
+                if (d0 == EMPTY) return 0;
+            }
+
+            // 3. Bucket contains some complex value, check if close to `v`
+            else if (complex_close(&bucket->c, &val->c)) {
+                *ret = base + ref;
+                return 1;
+            }
+
+            // If unsuccessful, try next
+            ref += 1;
+            ref = ref == line_end ? line_end - CACHE_LINE_SIZE : ref;
+        }
+        hash += prime << CACHE_LINE;
+    }
+    return -1;
+}
+
+/**
+ * Add segment number `seg` to the table (if no other thread has done so 
+ * already). Returns false if the table cannot grow any further.
+ */
+static bool
+cmap_grow(cmap_t *cmap, size_t seg)
+{
+    if (atomic_read(&cmap->num_segments) > seg) return true;
+    if (seg >= MAX_SEGMENTS || total_size(cmap, seg+1) > cmap->max_size)
+        return false;
+
+    bucket_t *segment = alloc_segment(cmap, segment_size(cmap, seg));
+    if (segment == NULL) return false;
+
+    if (cas(&cmap->table[seg], NULL, segment)) {
+        // publish new segment only after the pointer is set
+        atomic_write(&cmap->num_segments, seg + 1);
+    }
+    else {
+        // some other thread beat us to it, wait until it is published
+        cmap->free(segment, segment_size(cmap, seg) * sizeof(bucket_t));
+        while (atomic_read(&cmap->num_segments) <= seg) {}
+    }
+    return true;
+}
+
+/**
+ * Hash of `v`, computed from `v` rounded to the tolerance, such that values
+ * which are close to each other (usually) end up at the same place.
+ */
+static inline uint32_t
+cmap_hash(const complex_t *v)
+{
     // Round the value to compute the hash with, but store the actual value v
     bucket_t round_v;
     if (TOLERANCE == 0.0) {
@@ -108,58 +268,106 @@ cmap_find_or_put(const void *dbs, const complex_t *v, uint64_t *ret)
     //printf("(%.3f,%.3f) ",(float)round_v.c.r,(float)round_v.c.i);
     //print_bucket_bits(&round_v); 
     
-    uint32_t hash  = SuperFastHash(&round_v, sizeof(complex_t), 0);
+    return SuperFastHash(&round_v, sizeof(complex_t), 0);
+}
+
+/**
+ * Prefetch the first cache line of the probe sequence of `hash` in the oldest
+ * and newest segment (the segments most values live in).
+ */
+static inline void
+cmap_prefetch(const cmap_t *cmap, uint32_t hash)
+{
+    size_t last = atomic_read(&cmap->num_segments) - 1;
+    __builtin_prefetch(&cmap->table[0][hash & (segment_size(cmap, 0) - 1)]);
+    if (last != 0) {
+        __builtin_prefetch(&cmap->table[last][hash & (segment_size(cmap, last) - 1)]);
+    }
+}
+
+static int
+cmap_find_or_put_hashed(cmap_t *cmap, const complex_t *v, uint32_t hash, uint64_t *ret)
+{
+    bucket_t *val  = (bucket_t *) v;
     uint32_t prime = odd_primes[hash & PRIME_MASK];
 
     assert (val->d[0] != LOCK);
     assert (val->d[0] != EMPTY);
+    assert (val->d[0] != TOMBSTONE);
 
-    // Insert/lookup `v`
-    for (unsigned int c = 0; c < cmap->threshold; c++) {
-        uint64_t            ref = hash & cmap->mask;
-        uint64_t            line_end = (ref & CL_MASK) + CACHE_LINE_SIZE;
-        for (size_t i = 0; i < CACHE_LINE_SIZE; i++) {
-            
-            // 1. Get bucket
-            bucket_t *bucket = &cmap->table[ref];
-
-            // 2. If bucket empty, insert new value here
-            if (bucket->d[0] == EMPTY) {
-                if (cas(&bucket->d[0], EMPTY, LOCK)) {
-                    *ret = ref;
-                    // write backwards (overwrite bucket->d[0] last)
-                    for (int k = entry_size-1; k >= 0; k--) {
-                        atomic_write (&bucket->d[k], val->d[k]);
-                    }
-                    return 0;
-                }
+    // Lookup `v`, and insert it in the first free bucket on its probe sequence
+    // if it isn't there. Values live in the first segment which had a free 
+    // bucket for them, so buckets in later segments only need to be checked
+    // if the probe sequence in an earlier segment didn't reach an empty one.
+    for (;;) {
+        free_bucket_t avail = { NULL, 0, EMPTY };
+        int found = -1;
+        for (size_t seg = 0; found == -1; seg++) {
+            if (seg == atomic_read(&cmap->num_segments)) {
+                // only add a segment if no free bucket has been found yet
+                if (avail.bucket != NULL || !cmap_grow(cmap, seg)) break;
             }
+            found = segment_find(cmap, seg, hash, prime, val, ret, &avail);
+        }
+        if (found == 1) return 1;
 
-            // 3. Bucket not empty, wait for lock
-            while (atomic_read(&bucket->d[0]) == LOCK) {}
+        // amplitude table full, unable to add
+        if (avail.bucket == NULL) return -1;
 
-            // 4. Bucket contains some complex value, check if close to `v`
-            complex_t *in_table = (complex_t *)bucket;
-            if (complex_close(in_table, v)) {
-                *ret = ref;
-                return 1;
+        // Claim the free bucket
+        if (cas(&avail.bucket->d[0], avail.seen, LOCK)) {
+            *ret = avail.ref;
+            // write backwards (overwrite bucket->d[0] last)
+            for (int k = entry_size-1; k >= 0; k--) {
+                atomic_write (&avail.bucket->d[k], val->d[k]);
             }
+            return 0;
+        }
+        // Some other thread claimed the bucket first, which might have been
+        // to insert `v` itself, so start over
+    }
+}
 
-            // If unsuccessful, try next
-            ref += 1;
-            ref = ref == line_end ? line_end - CACHE_LINE_SIZE : ref;
+int
+cmap_find_or_put(const void *dbs, const complex_t *v, uint64_t *ret)
+{
+    cmap_t *cmap = (cmap_t *) dbs;
+    return cmap_find_or_put_hashed(cmap, v, cmap_hash(v), ret);
+}
+
+int
+cmap_find_or_put_batch(const void *dbs, const complex_t *v, uint64_t *ret,
+                       int *present, size_t n)
+{
+    cmap_t *cmap = (cmap_t *) dbs;
+    uint32_t hash[CMAP_BATCH_SIZE];
+    int res = 0;
+
+    for (size_t start = 0; start < n; start += CMAP_BATCH_SIZE) {
+        size_t m = (n - start < CMAP_BATCH_SIZE) ? n - start : CMAP_BATCH_SIZE;
+
+        // 1. hash all values and prefetch their buckets, such that the cache
+        // misses of the lookups below overlap instead of being taken one by one
+        for (size_t k = 0; k < m; k++) {
+            hash[k] = cmap_hash(&v[start+k]);
+            cmap_prefetch(cmap, hash[k]);
+        }
+
+        // 2. the actual lookups
+        for (size_t k = 0; k < m; k++) {
+            present[start+k] = cmap_find_or_put_hashed(cmap, &v[start+k],
+                                                       hash[k], &ret[start+k]);
+            if (present[start+k] == -1) res = -1;
         }
-        hash += prime << CACHE_LINE;
     }
-    // amplitude table full, unable to add
-    return -1;
+    return res;
 }
 
 complex_t
 cmap_get(const void *dbs, const uint64_t ref)
 {
     cmap_t *cmap = (cmap_t *) dbs;
-    return cmap->table[ref].c;
+    return get_bucket(cmap, ref)->c;
 }
 
 uint64_t
@@ -167,13 +375,45 @@ cmap_count_entries(const void *dbs)
 {
     cmap_t *cmap = (cmap_t *) dbs;
     uint64_t entries = 0;
-    for (unsigned int c = 0; c < cmap->size; c++) {
-        if (cmap->table[c].d[0] != EMPTY)
-            entries++;
+    size_t num_segments = atomic_read(&cmap->num_segments);
+    for (size_t seg = 0; seg < num_segments; seg++) {
+        bucket_t *table = cmap->table[seg];
+        for (size_t c = 0; c < segment_size(cmap, seg); c++) {
+            if (table[c].d[0] != EMPTY && table[c].d[0] != TOMBSTONE)
+                entries++;
+        }
     }
     return entries;
 }
 
+uint64_t
+cmap_get_size(const void *dbs)
+{
+    cmap_t *cmap = (cmap_t *) dbs;
+    return total_size(cmap, atomic_read(&cmap->num_segments));
+}
+
+void
+cmap_delete(void *dbs, const uint64_t ref)
+{
+    cmap_t *cmap = (cmap_t *) dbs;
+    if (ref >= cmap_get_size(cmap)) return;
+    bucket_t *bucket = get_bucket(cmap, ref);
+    if (bucket->d[0] != EMPTY && bucket->d[0] != TOMBSTONE) {
+        atomic_write(&bucket->d[0], TOMBSTONE);
+    }
+}
+
+void
+cmap_set_max_size(void *dbs, uint64_t max_size)
+{
+    cmap_t *cmap = (cmap_t *) dbs;
+    cmap->max_size = (max_size < cmap->size) ? cmap->size : max_size;
+    if (cmap->max_size > cmap->size) {
+        cmap->threshold = min(cmap->threshold, GROW_PROBE_LINES);
+    }
+}
+
 void
 print_bitvalues(const void *dbs, const uint64_t ref)
 {
@@ -192,13 +432,15 @@ cmap_create(uint64_t size, double tolerance)
     TOLERANCE = tolerance;
     cmap_t  *cmap = calloc (1, sizeof(cmap_t));
     cmap->size = size;
-    cmap->mask = cmap->size - 1;
-    cmap->table = calloc (cmap->size, sizeof(bucket_t));
-    for (unsigned int c = 0; c < cmap->size; c++) {
-        cmap->table[c].d[0] = EMPTY;
-    }
+    cmap->log_size = 63 - __builtin_clzll(size);
+    cmap->max_size = size; // no growing unless cmap_set_max_size is called
+    cmap->alloc = segment_alloc;
+    cmap->free = segment_free;
+    cmap->table[0] = alloc_segment(cmap, cmap->size);
+    cmap->num_segments = 1;
     cmap->threshold = cmap->size / 100;
     cmap->threshold = min(cmap->threshold, 1ULL << 16);
+    cmap->threshold = max(cmap->threshold, 1);
     cmap->seen_0 = 0;
     return (void *) cmap;
 }
@@ -207,6 +449,8 @@ void
 cmap_free(void *dbs)
 {
     cmap_t * cmap = (cmap_t *) dbs;
-    free (cmap->table);
+    for (size_t seg = 0; seg < cmap->num_segments; seg++) {
+        cmap->free(cmap->table[seg], segment_size(cmap, seg) * sizeof(bucket_t));
+    }
     free (cmap);
 }
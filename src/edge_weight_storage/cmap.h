@@ -3,7 +3,8 @@
 
 /**
 \file cmap.h
-\brief Lockless non-resizing hash table implementation for fixed-length keys
+\brief Lockless hash table implementation for fixed-length keys, which can
+(optionally) grow without changing the indices of existing entries
 
 @inproceedings{Laarman:2010:BMR:1998496.1998541,
   author = {Laarman, Alfons and van de Pol, Jaco and Weber, Michael},
@@ -51,10 +52,46 @@ und.
 */
 extern int cmap_find_or_put(const void *dbs, const complex_t *v, uint64_t *ret);
 
+/**
+\brief Find or put n values at once. The values are hashed and their buckets
+prefetched before any of them is looked up.
+\param present Per value: 1 if it was present, 0 if it was added, -1 if the 
+table was full
+\return -1 if the table was full for any of the values, 0 otherwise
+*/
+#define CMAP_BATCH_SIZE 8
+extern int cmap_find_or_put_batch(const void *dbs, const complex_t *v, 
+                                  uint64_t *ret, int *present, size_t n);
+
 extern complex_t cmap_get(const void *dbs, const uint64_t ref);
 
 extern uint64_t cmap_count_entries(const void *dbs);
 
+/**
+\brief Returns the current capacity of the table (including grown segments).
+*/
+extern uint64_t cmap_get_size(const void *dbs);
+
+/**
+\brief Remove the entry at index ref (leaving a tombstone, such that the indices
+of other entries don't change). Only call this when no other threads access the
+table.
+*/
+extern void cmap_delete(void *dbs, const uint64_t ref);
+
+/**
+\brief Allow the table to grow up to (at most) max_size entries when full.
+By default a table does not grow beyond the size it was created with.
+*/
+extern void cmap_set_max_size(void *dbs, uint64_t max_size);
+
+/**
+\brief Set the allocator for the segments of tables created after this call.
+alloc(bytes) must return zeroed memory (or NULL), dealloc(ptr, bytes) releases it.
+Passing NULL restores calloc/free.
+*/
+extern void cmap_set_allocator(void *(*alloc)(size_t), void (*dealloc)(void *, size_t));
+
 extern void print_bitvalues(const void *dbs, const uint64_t ref);
 
 #endif // CMAP
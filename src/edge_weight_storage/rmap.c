@@ -185,6 +185,13 @@ rmap_count_entries(const void *dbs)
     return entries;
 }
 
+uint64_t
+rmap_get_size(const void *dbs)
+{
+    rmap_t * rmap = (rmap_t *) dbs;
+    return rmap->size;
+}
+
 void
 rmap_print_bitvalues(const void *dbs, const ref_t ref)
 {
@@ -58,6 +58,7 @@ extern fl_t *rmap_get(const void *dbs, const ref_t ref);
 extern complex_t rmap_get2(const void *dbs, const ref_t ref);
 
 extern uint64_t rmap_count_entries(const void *rmap);
+extern uint64_t rmap_get_size(const void *dbs);
 
 extern void rmap_print_bitvalues(const void *dbs, const ref_t ref);
 
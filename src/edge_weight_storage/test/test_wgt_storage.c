@@ -76,6 +76,121 @@ int test_cmap()
     return 0;
 }
 
+int test_cmap_grow()
+{
+    void *ctable = cmap_create(1<<10, 1e-14);
+    cmap_set_max_size(ctable, 1<<14);
+    test_assert(cmap_get_size(ctable) == 1<<10);
+
+    // insert more values than fit in the initial table
+    int n = 6000, found;
+    ref_t index[6000], index2;
+    complex_t val;
+    for (int k = 0; k < n; k++) {
+        val = cmake(0.001*k, 1.0/(k+1));
+        found = cmap_find_or_put(ctable, &val, &index[k]); test_assert(found == 0);
+    }
+    test_assert(cmap_get_size(ctable) > 1<<10);
+    test_assert(cmap_get_size(ctable) <= 1<<14);
+    test_assert(cmap_count_entries(ctable) == (uint64_t)n);
+
+    // indices of values inserted before growing are still valid
+    for (int k = 0; k < n; k++) {
+        val = cmake(0.001*k, 1.0/(k+1));
+        found = cmap_find_or_put(ctable, &val, &index2); test_assert(found == 1);
+        test_assert(index2 == index[k]);
+        val = cmap_get(ctable, index[k]);
+        test_assert(val.r == 0.001*k && val.i == 1.0/(k+1));
+    }
+
+    // without max size the table doesn't grow
+    cmap_free(ctable);
+    ctable = cmap_create(1<<10, 1e-14);
+    for (int k = 0; k < n; k++) {
+        val = cmake(0.001*k, 1.0/(k+1));
+        found = cmap_find_or_put(ctable, &val, &index2);
+        if (found == -1) break;
+    }
+    test_assert(found == -1);
+    test_assert(cmap_get_size(ctable) == 1<<10);
+
+    cmap_free(ctable);
+    if(VERBOSE) printf("cmap grow tests:          ok\n");
+    return 0;
+}
+
+int test_cmap_delete()
+{
+    void *ctable = cmap_create(1<<10, 1e-14);
+
+    int n = 500, found;
+    ref_t index[500], index2;
+    complex_t val;
+    for (int k = 0; k < n; k++) {
+        val = cmake(0.01*k, -0.5*k);
+        found = cmap_find_or_put(ctable, &val, &index[k]); test_assert(found == 0);
+    }
+
+    // delete every other value
+    for (int k = 0; k < n; k += 2) cmap_delete(ctable, index[k]);
+    test_assert(cmap_count_entries(ctable) == (uint64_t)n/2);
+
+    // remaining values keep their index
+    for (int k = 1; k < n; k += 2) {
+        val = cmake(0.01*k, -0.5*k);
+        found = cmap_find_or_put(ctable, &val, &index2); test_assert(found == 1);
+        test_assert(index2 == index[k]);
+    }
+
+    // deleted values can be re-inserted (reusing the freed buckets)
+    for (int k = 0; k < n; k += 2) {
+        val = cmake(0.01*k, -0.5*k);
+        found = cmap_find_or_put(ctable, &val, &index2); test_assert(found == 0);
+        found = cmap_find_or_put(ctable, &val, &index[k]); test_assert(found == 1);
+        test_assert(index2 == index[k]);
+        val = cmap_get(ctable, index[k]);
+        test_assert(val.r == 0.01*k && val.i == -0.5*k);
+    }
+    test_assert(cmap_count_entries(ctable) == (uint64_t)n);
+
+    cmap_free(ctable);
+    if(VERBOSE) printf("cmap delete tests:        ok\n");
+    return 0;
+}
+
+int test_cmap_batch()
+{
+    void *ctable = cmap_create(1<<10, 1e-14);
+
+    int n = 100, present[100], found;
+    uint64_t index[100], index2;
+    complex_t vals[100], val;
+    for (int k = 0; k < n; k++) {
+        vals[k] = cmake(0.01*k, 0.5*k);
+    }
+    // insert every third value one at a time
+    for (int k = 0; k < n; k += 3) {
+        found = cmap_find_or_put(ctable, &vals[k], &index[k]); test_assert(found == 0);
+    }
+    index2 = index[0];
+
+    // batched lookup finds those, and adds the others
+    found = cmap_find_or_put_batch(ctable, vals, index, present, n); test_assert(found == 0);
+    test_assert(index[0] == index2);
+    for (int k = 0; k < n; k++) {
+        test_assert(present[k] == ((k % 3 == 0) ? 1 : 0));
+        found = cmap_find_or_put(ctable, &vals[k], &index2); test_assert(found == 1);
+        test_assert(index2 == index[k]);
+        val = cmap_get(ctable, index[k]);
+        test_assert(val.r == vals[k].r && val.i == vals[k].i);
+    }
+    test_assert(cmap_count_entries(ctable) == (uint64_t)n);
+
+    cmap_free(ctable);
+    if(VERBOSE) printf("cmap batch tests:         ok\n");
+    return 0;
+}
+
 int test_rmap()
 {
     void *rtable = rmap_create(1<<10, 1e-14);
@@ -225,6 +340,9 @@ int test_tree_map()
 int runtests()
 {
     if (test_cmap()) return 1;
+    if (test_cmap_grow()) return 1;
+    if (test_cmap_delete()) return 1;
+    if (test_cmap_batch()) return 1;
     if (test_rmap()) return 1;
     if (test_tree_map()) return 1;
     return 0;
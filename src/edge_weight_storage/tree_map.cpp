@@ -163,6 +163,14 @@ tree_map_num_entries(const void *dbs)
     return map->entries;
 }
 
+// tree_map_get_size()
+uint64_t
+tree_map_get_size(const void *dbs)
+{
+    tree_map_t * map = (tree_map_t *) dbs;
+    return map->max_size;
+}
+
 // tree_map_get_tolerance
 double
 tree_map_get_tolerance()
@@ -15,6 +15,7 @@ int tree_map_find_or_put2(const void *dbs, const complex_t *v, uint64_t *ret);
 fl_t *tree_map_get(const void *dbs, const uint64_t ref);
 complex_t tree_map_get2(const void *dbs, const uint64_t ref);
 uint64_t tree_map_num_entries(const void *dbs);
+uint64_t tree_map_get_size(const void *dbs);
 double tree_map_get_tolerance();
 
 
@@ -22,6 +22,10 @@ extern void (*wgt_store_free)(void *wgt_storage);
 // find_or_put(void *dbs, complex_t *v, int *ret)
 extern int (*wgt_store_find_or_put)(const void *dbs, const complex_t *v, uint64_t *ret);
 
+// find_or_put_batch(void *dbs, complex_t *v, uint64_t *ret, int *present, size_t n)
+// (NULL if backend has no batched lookup)
+extern int (*wgt_store_find_or_put_batch)(const void *dbs, const complex_t *v, uint64_t *ret, int *present, size_t n);
+
 // get(void *dbs, int ref)
 extern complex_t (*wgt_store_get)(const void *dbs, const uint64_t ref);
 
@@ -31,6 +35,15 @@ extern uint64_t (*wgt_store_num_entries)(const void *dbs);
 // get tolerance
 extern double (*wgt_store_get_tol)();
 
+// current capacity(void *dbs)
+extern uint64_t (*wgt_store_get_size)(const void *dbs);
+
+// delete(void *dbs, uint64_t ref) (NULL if backend can't delete entries)
+extern void (*wgt_store_delete)(void *dbs, const uint64_t ref);
+
+// set_max_size(void *dbs, uint64_t max_size) (NULL if backend can't grow)
+extern void (*wgt_store_set_max_size)(void *dbs, uint64_t max_size);
+
 void init_wgt_storage_functions(wgt_storage_backend_t backend);
 
 #endif // AMP_STORAGE_INTERFACE
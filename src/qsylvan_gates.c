@@ -1,84 +1,216 @@
 #include <qsylvan_gates.h>
 #include <sylvan_int.h>
 #include <sylvan_edge_weights_complex.h>
+#include <sylvan_align.h>
 
 
 static long double Pi;    // set value of global Pi
 
-uint64_t gates[n_predef_gates+256+256+1000][4];
+uint64_t (*gates)[4] = NULL;
+uint64_t (*gates2)[16] = NULL;
 
 /********************** <dynamic custom rotation gates> ***********************/
 
-uint32_t next_custom_id; // set to 0 in init
+/**
+ * Registries of custom gates. The same matrix (i.e. the same edge weight
+ * indices) always gets the same gate ID, so results in the operation cache
+ * stay valid for as long as the gate is registered. A registry is an open 
+ * addressing hash table of gate IDs (0 = empty, which is never a custom ID),
+ * with the keys stored in the gate table itself (gates[id] or gates2[id]). 
+ * The weights of all registered gates are kept during gc of the edge weight 
+ * table, so gate IDs stay valid until the registry runs out of IDs.
+ */
+typedef struct gate_registry {
+    _Atomic(uint32_t) *buckets;
+    uint64_t           size;     // 2 * max_ids (power of 2)
+    uint64_t          *keys;     // key of gate k is keys[k*width ... ]
+    int                width;    // number of weights per gate
+    uint32_t           first_id;
+    uint32_t           max_ids;
+    _Atomic(uint32_t)  next;
+    uint8_t           *live;     // live[k]: ID first_id + k is in the buckets
+} gate_registry_t;
+
+static gate_registry_t registry1 = { .width = 4 };
+static gate_registry_t registry2 = { .width = 16 };
+
+static void
+gate_registry_clear(gate_registry_t *reg)
+{
+    if (reg->buckets == NULL) {
+        reg->buckets  = (_Atomic(uint32_t)*)alloc_aligned(reg->size * sizeof(uint32_t));
+        reg->live     = (uint8_t*)alloc_aligned(reg->max_ids * sizeof(uint8_t));
+        if (reg->buckets == NULL || reg->live == NULL) {
+            fprintf(stderr, "gate_registry_clear: Unable to allocate memory!\n");
+            exit(1);
+        }
+    }
+    else {
+        memset((void*)reg->buckets, 0, reg->size * sizeof(uint32_t));
+        memset(reg->live, 0, reg->max_ids * sizeof(uint8_t));
+    }
+    reg->next = 0;
+}
 
-uint32_t
-get_custom_gate_id()
+static void
+gate_registry_free(gate_registry_t *reg)
+{
+    if (reg->buckets != NULL) {
+        free_aligned(reg->buckets, reg->size * sizeof(uint32_t));
+        free_aligned(reg->live, reg->max_ids * sizeof(uint8_t));
+        reg->buckets = NULL;
+    }
+}
+
+static uint64_t
+gate_registry_hash(gate_registry_t *reg, const AMP *key)
+{
+    uint64_t hash = 14695981039346656037LLU;
+    for (int k = 0; k < reg->width; k += 2) {
+        hash = sylvan_fnvhash16(key[k], key[k+1], hash);
+    }
+    return hash;
+}
+
+/* Claims an unused ID, or returns 0 if all IDs are in use */
+static uint32_t
+gate_registry_claim(gate_registry_t *reg)
+{
+    uint32_t k = atomic_fetch_add(&reg->next, 1);
+    if (k >= reg->max_ids) return 0;
+    return reg->first_id + k;
+}
+
+static uint32_t
+gate_registry_find_or_put(gate_registry_t *reg, const AMP *key)
+{
+    uint64_t hash = gate_registry_hash(reg, key);
+
+    uint32_t mine = 0; // ID claimed by this thread, if any
+    for (uint64_t i = 0; i < reg->size; i++) {
+        _Atomic(uint32_t) *bucket = &reg->buckets[(hash + i) & (reg->size - 1)];
+        uint32_t gate_id = atomic_load_explicit(bucket, memory_order_acquire);
+        if (gate_id == 0) {
+            if (mine == 0) {
+                mine = gate_registry_claim(reg);
+                if (mine == 0) break;
+                memcpy(&reg->keys[mine * reg->width], key, reg->width * sizeof(AMP));
+            }
+            if (atomic_compare_exchange_strong(bucket, &gate_id, mine)) {
+                reg->live[mine - reg->first_id] = 1;
+                return mine;
+            }
+            // someone else took this bucket first, gate_id is now theirs
+        }
+        if (memcmp(&reg->keys[gate_id * reg->width], key, reg->width * sizeof(AMP)) == 0) {
+            return gate_id;
+        }
+    }
+
+    // All IDs in use: gate IDs are only created outside of operations, so the
+    // registry can start over here. This drops the cached results of all
+    // custom gates, and earlier custom gate IDs are no longer valid.
+    gate_registry_clear(reg);
+    sylvan_clear_cache();
+    return gate_registry_find_or_put(reg, key);
+}
+
+/**
+ * Keeps the weights of all registered gates during gc of the edge weight table,
+ * and rebuilds the buckets for the new weight indices. IDs which were claimed
+ * by a thread which then found its gate already registered stay unused.
+ */
+static void
+gate_registry_gc(gate_registry_t *reg)
 {
-    next_custom_id++;
-    if (next_custom_id >= num_dynamic_gates) {
-        // max custom gates used, reset ID counter to 0 and clear opcache
-        next_custom_id = 0;
-        sylvan_clear_cache();
+    if (reg->buckets == NULL) return;
+    uint32_t used = (reg->next < reg->max_ids) ? reg->next : reg->max_ids;
+    memset((void*)reg->buckets, 0, reg->size * sizeof(uint32_t));
+    for (uint32_t k = 0; k < used; k++) {
+        if (!reg->live[k]) continue;
+        uint32_t gate_id = reg->first_id + k;
+        uint64_t *key = &reg->keys[gate_id * reg->width];
+        for (int j = 0; j < reg->width; j++) {
+            key[j] = aadd_gc_keep_weight(key[j]);
+        }
+        uint64_t hash = gate_registry_hash(reg, key);
+        for (uint64_t i = 0; ; i++) {
+            _Atomic(uint32_t) *bucket = &reg->buckets[(hash + i) & (reg->size - 1)];
+            if (*bucket == 0) { *bucket = gate_id; break; }
+        }
     }
-    return num_static_gates + next_custom_id; // index offset by num_static_gates
+}
+
+void
+qmdd_gates_gc_keep()
+{
+    gate_registry_gc(&registry1);
+    gate_registry_gc(&registry2);
+}
+
+static inline bool
+gate_registry_is_live(gate_registry_t *reg, uint32_t gate_id)
+{
+    if (gate_id < reg->first_id) return true;
+    return gate_id - reg->first_id < reg->max_ids && reg->live[gate_id - reg->first_id];
+}
+
+bool
+qmdd_gate_is_live(uint32_t gate_id)
+{
+    return gate_registry_is_live(&registry1, gate_id);
+}
+
+bool
+qmdd_gate2_is_live(uint32_t gate_id)
+{
+    return gate_registry_is_live(&registry2, gate_id);
 }
 
 uint32_t
 GATEID_Rz(fl_t a)
 {
-    // get gate id for this gate
-    uint32_t gate_id = get_custom_gate_id();
-
-    // initialize gate
     double theta_over_2 = Pi * a;
     AMP u00, u11;
     u00 = complex_lookup_angle(-theta_over_2, 1);
     u11 = complex_lookup_angle(theta_over_2, 1);
-    gates[gate_id][0] = u00;    gates[gate_id][1] = AADD_ZERO;
-    gates[gate_id][2] = AADD_ZERO; gates[gate_id][3] = u11;
 
-    // return (temporary) gate_id for this gate
-    return gate_id;
+    // same matrix, same gate id
+    return gate_registry_find_or_put(&registry1, (AMP[4]){u00, AADD_ZERO, AADD_ZERO, u11});
 }
 
 uint32_t
 GATEID_Rx(fl_t a)
 {
-    // get gate id for this gate
-    uint32_t gate_id = get_custom_gate_id();
-
-    // initialize gate
     fl_t theta_over_2 = Pi * a;
     AMP u00, u01, u10, u11;
     u00 = complex_lookup(flt_cos(theta_over_2), 0.0);
     u01 = complex_lookup(0.0, -flt_sin(theta_over_2));
     u10 = complex_lookup(0.0, -flt_sin(theta_over_2));
     u11 = complex_lookup(flt_cos(theta_over_2), 0.0);
-    gates[gate_id][0] = u00; gates[gate_id][1] = u01;
-    gates[gate_id][2] = u10; gates[gate_id][3] = u11;
 
-    // return (temporary) gate_id for this gate
-    return gate_id;
+    // same matrix, same gate id
+    return gate_registry_find_or_put(&registry1, (AMP[4]){u00, u01, u10, u11});
 }
 
 uint32_t
 GATEID_Ry(fl_t a)
 {
-    // get gate id for this gate
-    uint32_t gate_id = get_custom_gate_id();
-
-    // initialize gate
     fl_t theta_over_2 = Pi * a;
     AMP u00, u01, u10, u11;
     u00 = complex_lookup(flt_cos(theta_over_2),  0.0);
     u01 = complex_lookup(-flt_sin(theta_over_2), 0.0);
     u10 = complex_lookup(flt_sin(theta_over_2),  0.0);
     u11 = complex_lookup(flt_cos(theta_over_2),  0.0);
-    gates[gate_id][0] = u00; gates[gate_id][1] = u01;
-    gates[gate_id][2] = u10; gates[gate_id][3] = u11;
 
-    // return (temporary) gate_id for this gate
-    return gate_id;
+    // same matrix, same gate id
+    return gate_registry_find_or_put(&registry1, (AMP[4]){u00, u01, u10, u11});
+}
+
+uint32_t
+GATEID_custom(const AMP u[4])
+{
+    return gate_registry_find_or_put(&registry1, u);
 }
 
 /********************* </dynamic custom rotation gates> ***********************/
@@ -90,6 +222,23 @@ qmdd_gates_init()
 {
     Pi = 2.0 * flt_acos(0.0);
 
+    if (gates == NULL) {
+        gates  = (uint64_t(*)[4])alloc_aligned((num_static_gates + num_dynamic_gates) * sizeof(uint64_t[4]));
+        gates2 = (uint64_t(*)[16])alloc_aligned((num_static_gates2 + num_dynamic_gates2) * sizeof(uint64_t[16]));
+        if (gates == NULL || gates2 == NULL) {
+            fprintf(stderr, "qmdd_gates_init: Unable to allocate memory!\n");
+            exit(1);
+        }
+        registry1.keys     = (uint64_t*)gates;
+        registry1.first_id = num_static_gates;
+        registry1.max_ids  = num_dynamic_gates;
+        registry1.size     = 2 * num_dynamic_gates;
+        registry2.keys     = (uint64_t*)gates2;
+        registry2.first_id = num_static_gates2;
+        registry2.max_ids  = num_dynamic_gates2;
+        registry2.size     = 2 * num_dynamic_gates2;
+    }
+
     // initialize 2x2 gates (complex values from gates currently stored in 
     // same table as complex amplitude values)
     uint32_t k;
@@ -147,8 +296,24 @@ qmdd_gates_init()
     gates[k][2] = complex_lookup(-0.5,0.5); gates[k][3] = complex_lookup(0.5,-0.5);
 
     qmdd_phase_gates_init(255);
+    qmdd_gates2_init();
 
-    next_custom_id = 0;
+    // custom gates are kept by qmdd_gates_gc_keep during gc
+    if (registry1.buckets == NULL) gate_registry_clear(&registry1);
+    if (registry2.buckets == NULL) gate_registry_clear(&registry2);
+}
+
+void
+qmdd_gates_free()
+{
+    if (gates != NULL) {
+        free_aligned(gates, (num_static_gates + num_dynamic_gates) * sizeof(uint64_t[4]));
+        free_aligned(gates2, (num_static_gates2 + num_dynamic_gates2) * sizeof(uint64_t[16]));
+        gates = NULL;
+        gates2 = NULL;
+    }
+    gate_registry_free(&registry1);
+    gate_registry_free(&registry2);
 }
 
 void
@@ -175,3 +340,90 @@ qmdd_phase_gates_init(int n)
         gates[gate_id][2] = AADD_ZERO; gates[gate_id][3] = weight_lookup(&cartesian);
     }
 }
+
+
+
+/****************************** <two-qubit gates> *****************************/
+
+static void
+gate2_set(uint64_t *u, AMP u00, AMP u11, AMP u22, AMP u33)
+{
+    for (int k = 0; k < 16; k++) u[k] = AADD_ZERO;
+    u[0] = u00; u[5] = u11; u[10] = u22; u[15] = u33;
+}
+
+void
+qmdd_gates2_init()
+{
+    uint64_t *u;
+
+    u = gates2[GATEID2_SWAP];
+    gate2_set(u, AADD_ONE, AADD_ZERO, AADD_ZERO, AADD_ONE);
+    u[1*4+2] = AADD_ONE;
+    u[2*4+1] = AADD_ONE;
+
+    u = gates2[GATEID2_iSWAP];
+    gate2_set(u, AADD_ONE, AADD_ZERO, AADD_ZERO, AADD_ONE);
+    u[1*4+2] = complex_lookup(0.0, 1.0);
+    u[2*4+1] = complex_lookup(0.0, 1.0);
+
+    u = gates2[GATEID2_sqrtSWAP];
+    gate2_set(u, AADD_ONE, complex_lookup(0.5, 0.5), complex_lookup(0.5, 0.5), AADD_ONE);
+    u[1*4+2] = complex_lookup(0.5,-0.5);
+    u[2*4+1] = complex_lookup(0.5,-0.5);
+}
+
+uint32_t
+GATEID2_custom(const AMP u[16])
+{
+    return gate_registry_find_or_put(&registry2, u);
+}
+
+uint32_t
+GATEID2_fSim(fl_t a, fl_t b)
+{
+    fl_t theta = 2*Pi * a;
+    fl_t phi   = 2*Pi * b;
+    AMP u[16];
+    gate2_set(u, AADD_ONE, complex_lookup(flt_cos(theta), 0.0),
+                 complex_lookup(flt_cos(theta), 0.0), complex_lookup_angle(-phi, 1));
+    u[1*4+2] = complex_lookup(0.0, -flt_sin(theta));
+    u[2*4+1] = complex_lookup(0.0, -flt_sin(theta));
+    return GATEID2_custom(u);
+}
+
+uint32_t
+GATEID2_XX(fl_t a)
+{
+    fl_t theta_over_2 = Pi * a;
+    AMP c = complex_lookup(flt_cos(theta_over_2), 0.0);
+    AMP u[16];
+    gate2_set(u, c, c, c, c);
+    u[0*4+3] = u[1*4+2] = u[2*4+1] = u[3*4+0] = complex_lookup(0.0, -flt_sin(theta_over_2));
+    return GATEID2_custom(u);
+}
+
+uint32_t
+GATEID2_YY(fl_t a)
+{
+    fl_t theta_over_2 = Pi * a;
+    AMP c = complex_lookup(flt_cos(theta_over_2), 0.0);
+    AMP u[16];
+    gate2_set(u, c, c, c, c);
+    u[0*4+3] = u[3*4+0] = complex_lookup(0.0,  flt_sin(theta_over_2));
+    u[1*4+2] = u[2*4+1] = complex_lookup(0.0, -flt_sin(theta_over_2));
+    return GATEID2_custom(u);
+}
+
+uint32_t
+GATEID2_ZZ(fl_t a)
+{
+    fl_t theta_over_2 = Pi * a;
+    AMP e_min = complex_lookup_angle(-theta_over_2, 1);
+    AMP e_pls = complex_lookup_angle(theta_over_2, 1);
+    AMP u[16];
+    gate2_set(u, e_min, e_pls, e_pls, e_min);
+    return GATEID2_custom(u);
+}
+
+/***************************** </two-qubit gates> *****************************/
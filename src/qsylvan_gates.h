@@ -1,13 +1,14 @@
 #ifndef SYLVAN_QMDD_GATES_H
 #define SYLVAN_QMDD_GATES_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <edge_weight_storage/flt.h>
 
 typedef uint64_t AMP; // TODO: replace with AADD_WGT?
 
 // GATE_ID's (gates are initialized in qmdd_gates_init)
-// currently 24 bits available for this number (see GATE_OPID)
+// currently 24 bits available for this number (see GATE_OPID_64)
 typedef enum predef_gates {
     GATEID_I,
     GATEID_X,
@@ -26,16 +27,26 @@ typedef enum predef_gates {
 } gate_id_t;
 
 static const uint64_t num_static_gates  = n_predef_gates+256+256; // predef gates + phase gates
-static const uint64_t num_dynamic_gates = 1000; // IDs in this rage are re-used
+static const uint64_t num_dynamic_gates = 1<<20; // IDs for custom gates
 
 // 2x2 gates, k := GATEID_U 
 // gates[k][0] = u00 (top left)
 // gates[k][1] = u01 (top right)
 // gates[k][2] = u10 (bottom left)
 // gates[k][3] = u11 (bottom right)
-extern uint64_t gates[n_predef_gates+256+256+1000][4]; // max 2^24 gates atm
+extern uint64_t (*gates)[4]; // num_static_gates + num_dynamic_gates (max 2^24)
 
 void qmdd_gates_init();
+void qmdd_gates_free();
+
+// Keeps the weights of the custom gates during gc of the edge weight table
+// (see aadd_set_gc_wgt_table_keep_hook), translated to their new indices.
+void qmdd_gates_gc_keep();
+
+// Whether a (static or custom) gate ID is in use, also during that gc.
+bool qmdd_gate_is_live(uint32_t gate_id);
+bool qmdd_gate2_is_live(uint32_t gate_id);
+
 // The next 255 gates are reserved for parameterized phase gates.
 // The reason why these are initialized beforhand instead of on-demand is that 
 // we would like a (for example) pi/16 gate to always have the same unique ID 
@@ -45,30 +56,62 @@ static inline uint32_t GATEID_Rk(int k) { return k + n_predef_gates; };
 // Another 255 parameterized phase gates, but this time with negative angles.
 static inline uint32_t GATEID_Rk_dag(int k){ return k + (n_predef_gates+256); };
 
-// Reserve 'num_dynamic_gates' gate IDs (comibned) for of the following: 
-// Rx, Ry, Rz. These gate IDs are re-used when a user requires more than 
-// 'num_dynamic_gates' custom gates.
+// Up to 'num_dynamic_gates' gate IDs (combined) for the following: Rx, Ry, Rz
+// and custom 2x2 gates.
+// Equal matrices get equal IDs, so e.g. repeating Rz(a) gives the same gate ID
+// and can reuse the operation cache. The weights of these gates are kept during
+// gc of the edge weight table, so their IDs stay valid. When all 
+// 'num_dynamic_gates' IDs are in use, all IDs are handed out again and the 
+// operation cache is cleared, so these functions should not be called while 
+// operations run.
 /**
  * Rotation around x-axis with angle 2pi*a.
- * NOTE: These gate IDs are dynamic. The returned ID (uint32_t) is only 
- * guaranteed to correspond to the Rx(a) rotation until the next generation of 
- * a custom gate id.
  */
 uint32_t GATEID_Rx(fl_t a);
 /**
  * Rotation around y-axis with angle 2pi*a.
- * NOTE: These gate IDs are dynamic. The returned ID (uint32_t) is only 
- * guaranteed to correspond to the Ry(a) rotation until the next generation of 
- * a custom gate id.
  */
 uint32_t GATEID_Ry(fl_t a);
 /**
  * Rotation around z-axis with angle 2pi*a.
- * NOTE: These gate IDs are dynamic. The returned ID (uint32_t) is only 
- * guaranteed to correspond to the Rz(a) rotation until the next generation of 
- * a custom gate id.
  */
 uint32_t GATEID_Rz(fl_t a);
+/**
+ * Gate with the given (row major) matrix of edge weights.
+ */
+uint32_t GATEID_custom(const AMP u[4]);
+
+
+// 4x4 (two-qubit) gates, k := GATEID2_U, applied to qubits (t1, t2)
+// gates2[k][4*r + c] = u_rc, where row/column index = 2*(bit of t1) + (bit of t2)
+typedef enum predef_gates2 {
+    GATEID2_SWAP,
+    GATEID2_iSWAP,
+    GATEID2_sqrtSWAP,
+    n_predef_gates2
+} gate2_id_t;
+
+static const uint64_t num_static_gates2  = n_predef_gates2;
+static const uint64_t num_dynamic_gates2 = 1<<16; // IDs for custom 4x4 gates
 
+extern uint64_t (*gates2)[16]; // num_static_gates2 + num_dynamic_gates2
+
+void qmdd_gates2_init();
+
+// Custom 4x4 gates, with the same ID for the same matrix (see Rx, Ry, Rz).
+/**
+ * Gate with the given (row major) matrix of edge weights.
+ */
+uint32_t GATEID2_custom(const AMP u[16]);
+/**
+ * fSim(theta, phi) gate with theta = 2pi*a, phi = 2pi*b.
+ */
+uint32_t GATEID2_fSim(fl_t a, fl_t b);
+/**
+ * Ising interactions exp(-i theta/2 P(x)P) for P = X, Y, Z, with theta = 2pi*a.
+ */
+uint32_t GATEID2_XX(fl_t a);
+uint32_t GATEID2_YY(fl_t a);
+uint32_t GATEID2_ZZ(fl_t a);
 
 #endif
@@ -1,6 +1,7 @@
 #include <qsylvan_simulator.h>
 
 #include <inttypes.h>
+#include <sylvan_align.h>
 
 
 static bool testing_mode = 0; // turns on/off (expensive) sanity checks
@@ -9,32 +10,66 @@ static int granularity = 1; // operation cache access granularity
 
 /***************<Helper functions for chaching QMDD operations>****************/
 
-// Pack 2 BDDVARs (assumed max 8 bits each)
-static inline uint32_t
-QMDD_PARAM_PACK_16(BDDVAR a, BDDVAR b) 
+// Qubit parameters in cache keys have the 20 bits of the AADD var field
+#define QMDD_PARAM_MASK 0xfffffULL
+
+// Pack 2 BDDVARs (20 bits each), fits next to the opid in the 1st cache key
+static inline uint64_t
+QMDD_PARAM_PACK_40(BDDVAR a, BDDVAR b) 
 {
-    return b<<8 | a;
+    return (b & QMDD_PARAM_MASK)<<20 | (a & QMDD_PARAM_MASK);
 }
 
-//Pack 24 bit gateid, 2 possible qubit parameters (e.g. control/target)
+// Pack 24 bit gateid, 2 possible qubit parameters (e.g. control/target)
 static inline uint64_t
-GATE_OPID_40(uint32_t gateid, BDDVAR a, BDDVAR b)
+GATE_OPID_64(uint32_t gateid, BDDVAR a, BDDVAR b)
 {
-    uint64_t res = ((uint64_t)b)<<32 | ((uint64_t)a)<<24 | gateid;
+    uint64_t res = (b & QMDD_PARAM_MASK)<<44 | 
+                   (a & QMDD_PARAM_MASK)<<24 | 
+                   (gateid & 0xffffff);
     return res;
 }
 
-// Pack 24 bit gateid w/ 5 possible qubit parameters (e.g. target/control/range)
-static inline uint64_t
-GATE_OPID_64(uint32_t gateid, BDDVAR a, BDDVAR b, BDDVAR c, BDDVAR d, BDDVAR e)
-{
-    uint64_t res = ((uint64_t)e)<<56 | 
-                   ((uint64_t)d)<<48 | 
-                   ((uint64_t)c)<<40 | 
-                   ((uint64_t)b)<<32 | 
-                   ((uint64_t)a)<<24 | 
-                   gateid;
-    return res;
+// Control qubit cs[ci+k], or AADD_INVALID_VAR past the last control. Cache 
+// keys only contain the controls which are still to come (cs[ci], ...).
+static inline BDDVAR
+qmdd_next_control(BDDVAR *cs, uint32_t ci, uint32_t k)
+{
+    return (ci + k < MAX_CONTROLS) ? cs[ci + k] : AADD_INVALID_VAR;
+}
+
+static bool qmdd_gate_layer_is_live(uint32_t id);
+
+static bool
+qmdd_remap_cache_entry(uint64_t opid, uint64_t *a, uint64_t *b, uint64_t *c, uint64_t *res)
+{
+    if (opid == CACHE_QMDD_GATE || opid == CACHE_QMDD_CGATE || 
+        opid == CACHE_QMDD_CGATE_RANGE) {
+        // (-, target, gate params) -> edge
+        if (!aadd_gc_is_node_gc() && !qmdd_gate_is_live(*c & 0xffffff)) return false;
+        return aadd_gc_remap_target(b) && aadd_gc_remap_edge(res);
+    }
+    else if (opid == CACHE_QMDD_GATE2) {
+        // (-, target, gate params) -> edge
+        if (!aadd_gc_is_node_gc() && !qmdd_gate2_is_live(*c & 0xffffff)) return false;
+        return aadd_gc_remap_target(b) && aadd_gc_remap_edge(res);
+    }
+    else if (opid == CACHE_QMDD_GATE2_MIX) {
+        // (target, edge, gate params) -> edge
+        if (!aadd_gc_is_node_gc() && !qmdd_gate2_is_live(*c & 0xffffff)) return false;
+        return aadd_gc_remap_target(a) && aadd_gc_remap_edge(b) && 
+               aadd_gc_remap_edge(res);
+    }
+    else if (opid == CACHE_QMDD_GATE_LAYER) {
+        // (next + layer id, target, disabled) -> edge
+        if (!qmdd_gate_layer_is_live((*a >> 20) & QMDD_PARAM_MASK)) return false;
+        return aadd_gc_remap_target(b) && aadd_gc_remap_edge(res);
+    }
+    else if (opid == CACHE_QMDD_SUBCIRC) {
+        // (ci, edge, circ params) -> edge
+        return aadd_gc_remap_edge(b) && aadd_gc_remap_edge(res);
+    }
+    return false;
 }
 
 /**************</Helper functions for chaching QMDD operations>****************/
@@ -45,10 +80,35 @@ GATE_OPID_64(uint32_t gateid, BDDVAR a, BDDVAR b, BDDVAR c, BDDVAR d, BDDVAR e)
 
 /******************************<Initialization>********************************/
 
+static void qmdd_sqnorms_invalidate();
+VOID_TASK_DECL_0(qmdd_sqnorms_gc);
+static void qmdd_sqnorms_free();
+VOID_TASK_DECL_0(qmdd_gate_layer_gc);
+static void qmdd_gate_layer_free();
+
+/* Called after (re)creating the edge weight table */
+static void
+qmdd_wgt_table_init()
+{
+    qmdd_gates_init();
+    // nodes keep their index, but their weight indices may have a new meaning
+    qmdd_sqnorms_invalidate();
+}
+
 void
 qsylvan_init_simulator(size_t wgt_tab_size, double wgt_tab_tolerance, int edge_weigth_backend, int norm_strat)
 {
-    sylvan_init_aadd(wgt_tab_size, wgt_tab_tolerance, edge_weigth_backend, norm_strat, &qmdd_gates_init);
+    sylvan_init_aadd(wgt_tab_size, wgt_tab_tolerance, edge_weigth_backend, norm_strat, &qmdd_wgt_table_init);
+    aadd_set_gc_wgt_table_cache_remap(&qmdd_remap_cache_entry);
+    aadd_set_gc_wgt_table_keep_hook(&qmdd_gates_gc_keep);
+    for (uint64_t opid = CACHE_QMDD_GATE; opid <= CACHE_QMDD_GATE2_MIX; opid += 1LL<<40) {
+        cache_set_check(opid, aadd_gc_check_cache_entry);
+    }
+    sylvan_gc_hook_postgc(TASK(qmdd_sqnorms_gc));
+    sylvan_gc_hook_pregc(TASK(qmdd_gate_layer_gc));
+    sylvan_register_quit(qmdd_sqnorms_free);
+    sylvan_register_quit(qmdd_gate_layer_free);
+    sylvan_register_quit(qmdd_gates_free);
 }
 
 void
@@ -377,6 +437,208 @@ TASK_IMPL_5(QMDD, qmdd_cgate_range, QMDD, qmdd, gate_id_t, gate, BDDVAR, c_first
     return qmdd_cgate_range_rec(qmdd,gate,c_first,c_last,t);
 }
 
+/* Wrapper for applying a two-qubit gate. */
+TASK_IMPL_4(QMDD, qmdd_gate2, QMDD, qmdd, uint32_t, gate, BDDVAR, t1, BDDVAR, t2)
+{
+    if (t1 == t2) {
+        fprintf(stderr, "qmdd_gate2: qubits need to be different (%d)\n", t1);
+        exit(1);
+    }
+    qmdd_do_before_gate(&qmdd);
+    if (t1 < t2) return qmdd_gate2_rec(qmdd, gate, t1, t2, false);
+    else         return qmdd_gate2_rec(qmdd, gate, t2, t1, true);
+}
+
+#define LAYER_NONE    0
+#define LAYER_TARGET  1
+#define LAYER_CONTROL 2
+
+struct qmdd_layer_s {
+    BDDVAR n;
+    uint32_t id;        // cache ID of the layer (0 if it is not cached)
+    gate_id_t *gates;   // gate at each (target) qubit
+    uint8_t *role;      // LAYER_NONE, LAYER_TARGET or LAYER_CONTROL
+    int *cgate;         // index of controlled gate the qubit belongs to, or -1
+    BDDVAR *next;       // next[k] = first qubit >= k with a role (n if none)
+};
+
+/**
+ * Registry of the layers applied by qmdd_gate_layer, which gives equal layers
+ * (the same gates and controls) the same cache ID. It is an open addressing 
+ * hash table of IDs (0 = empty), the key of ID k is layer_keys[k]: the number
+ * of qubits followed by the gates and the controls. When all IDs are in use,
+ * layers are applied without the cache until the next gc of the node table
+ * starts the registry over (the operation cache is cleared or swept then).
+ */
+#define LAYER_MAX_IDS (1<<16)
+static _Atomic(uint32_t) *layer_buckets = NULL; // 2 * LAYER_MAX_IDS buckets
+static uint32_t **layer_keys = NULL;
+static _Atomic(uint32_t) layer_next = 1;
+
+static uint64_t
+qmdd_layer_hash(BDDVAR n, gate_id_t *gates, int *controls)
+{
+    uint64_t hash = sylvan_fnvhash16(n, 0, 14695981039346656037LLU);
+    for (BDDVAR k = 0; k < n; k++) {
+        hash = sylvan_fnvhash16(gates[k], (uint32_t) controls[k], hash);
+    }
+    return hash;
+}
+
+static bool
+qmdd_layer_equal(uint32_t *key, BDDVAR n, gate_id_t *gates, int *controls)
+{
+    if (key[0] != n) return false;
+    for (BDDVAR k = 0; k < n; k++) {
+        if (key[1+k] != (uint32_t) gates[k] || key[1+n+k] != (uint32_t) controls[k]) return false;
+    }
+    return true;
+}
+
+uint32_t
+qmdd_gate_layer_id(BDDVAR n, gate_id_t *gates, int *controls)
+{
+    if (layer_buckets == NULL) {
+        layer_buckets = (_Atomic(uint32_t)*)alloc_aligned(2 * LAYER_MAX_IDS * sizeof(uint32_t));
+        layer_keys = (uint32_t**)calloc(LAYER_MAX_IDS, sizeof(uint32_t*));
+        if (layer_buckets == NULL || layer_keys == NULL) {
+            fprintf(stderr, "qmdd_gate_layer_id: Unable to allocate memory!\n");
+            exit(1);
+        }
+    }
+    uint64_t hash = qmdd_layer_hash(n, gates, controls);
+
+    uint32_t mine = 0; // ID claimed by this thread, if any
+    for (uint64_t i = 0; i < 2 * LAYER_MAX_IDS; i++) {
+        _Atomic(uint32_t) *bucket = &layer_buckets[(hash + i) & (2 * LAYER_MAX_IDS - 1)];
+        uint32_t id = atomic_load_explicit(bucket, memory_order_acquire);
+        if (id == 0) {
+            if (mine == 0) {
+                if (layer_next >= LAYER_MAX_IDS) return 0;
+                mine = atomic_fetch_add(&layer_next, 1);
+                if (mine >= LAYER_MAX_IDS) return 0;
+                uint32_t *key = malloc((1 + 2*n) * sizeof(uint32_t));
+                key[0] = n;
+                for (BDDVAR k = 0; k < n; k++) {
+                    key[1+k] = gates[k];
+                    key[1+n+k] = (uint32_t) controls[k];
+                }
+                layer_keys[mine] = key;
+            }
+            if (atomic_compare_exchange_strong(bucket, &id, mine)) return mine;
+            // someone else took this bucket first, id is now theirs
+        }
+        if (qmdd_layer_equal(layer_keys[id], n, gates, controls)) return id;
+    }
+    return 0;
+}
+
+static bool
+qmdd_gate_layer_is_live(uint32_t id)
+{
+    return id != 0 && id < LAYER_MAX_IDS && id < layer_next;
+}
+
+/* Starts the layer registry over when it is full (called before gc) */
+VOID_TASK_IMPL_0(qmdd_gate_layer_gc)
+{
+    if (layer_next < LAYER_MAX_IDS) return;
+    for (uint32_t k = 1; k < LAYER_MAX_IDS; k++) {
+        free(layer_keys[k]);
+        layer_keys[k] = NULL;
+    }
+    memset((void*)layer_buckets, 0, 2 * LAYER_MAX_IDS * sizeof(uint32_t));
+    layer_next = 1;
+}
+
+static void
+qmdd_gate_layer_free()
+{
+    if (layer_buckets != NULL) {
+        for (uint32_t k = 1; k < LAYER_MAX_IDS; k++) free(layer_keys[k]);
+        free(layer_keys);
+        free_aligned(layer_buckets, 2 * LAYER_MAX_IDS * sizeof(uint32_t));
+        layer_buckets = NULL;
+        layer_keys = NULL;
+    }
+    layer_next = 1;
+}
+
+/* Wrapper for applying a layer of gates on disjoint qubits. */
+TASK_IMPL_4(QMDD, qmdd_gate_layer, QMDD, qmdd, BDDVAR, n, gate_id_t*, gates, int*, controls)
+{
+    // Give every controlled gate an index (in the 'disabled' bitmap)
+    int *target_cgate = malloc(n * sizeof(int));
+    int num_cgates = 0;
+    for (BDDVAR k = 0; k < n; k++) target_cgate[k] = -1;
+    for (BDDVAR k = 0; k < n; k++) {
+        if (controls[k] < 0) continue;
+        BDDVAR t = (BDDVAR) controls[k];
+        if (t >= n || t <= k || gates[t] == GATEID_I || controls[t] >= 0) {
+            fprintf(stderr, "qmdd_gate_layer: invalid control %d -> %d\n", k, t);
+            exit(1);
+        }
+        if (target_cgate[t] == -1) target_cgate[t] = num_cgates++;
+    }
+
+    if (num_cgates > 64) {
+        // The bitmap has room for 64 controlled gates, so apply wider layers in
+        // parts (the gates act on disjoint qubits, so the order does not matter)
+        gate_id_t *part_gates = malloc(n * sizeof(gate_id_t));
+        int *part_controls = malloc(n * sizeof(int));
+        for (int first = 0; first < num_cgates; first += 64) {
+            for (BDDVAR k = 0; k < n; k++) {
+                int c = (controls[k] >= 0) ? target_cgate[controls[k]] : target_cgate[k];
+                bool in_part = (c == -1) ? (first == 0) : (c >= first && c < first + 64);
+                part_gates[k]    = in_part ? gates[k] : GATEID_I;
+                part_controls[k] = in_part ? controls[k] : -1;
+            }
+            aadd_refs_push(qmdd);
+            qmdd = CALL(qmdd_gate_layer, qmdd, n, part_gates, part_controls);
+            aadd_refs_pop(1);
+        }
+        free(part_gates);
+        free(part_controls);
+        free(target_cgate);
+        return qmdd;
+    }
+
+    struct qmdd_layer_s layer;
+    layer.n     = n;
+    layer.id    = qmdd_gate_layer_id(n, gates, controls);
+    layer.gates = gates;
+    layer.role  = malloc(n * sizeof(uint8_t));
+    layer.cgate = malloc(n * sizeof(int));
+    layer.next  = malloc((n+1) * sizeof(BDDVAR));
+    for (BDDVAR k = 0; k < n; k++) {
+        if (controls[k] >= 0) {
+            layer.role[k]  = LAYER_CONTROL;
+            layer.cgate[k] = target_cgate[controls[k]];
+        }
+        else if (gates[k] != GATEID_I) {
+            layer.role[k]  = LAYER_TARGET;
+            layer.cgate[k] = target_cgate[k];
+        }
+        else {
+            layer.role[k]  = LAYER_NONE;
+            layer.cgate[k] = -1;
+        }
+    }
+    layer.next[n] = n;
+    for (int k = n-1; k >= 0; k--) {
+        layer.next[k] = (layer.role[k] != LAYER_NONE) ? (BDDVAR) k : layer.next[k+1];
+    }
+    free(target_cgate);
+
+    qmdd_do_before_gate(&qmdd);
+    QMDD res = qmdd_gate_layer_rec(qmdd, &layer, 0, 0);
+
+    free(layer.role);
+    free(layer.cgate);
+    free(layer.next);
+    return res;
+}
+
 TASK_IMPL_3(QMDD, qmdd_gate_rec, QMDD, q, gate_id_t, gate, BDDVAR, target)
 {
     // Trivial cases
@@ -390,7 +652,7 @@ TASK_IMPL_3(QMDD, qmdd_gate_rec, QMDD, q, gate_id_t, gate, BDDVAR, target)
     // Check cache
     bool cachenow = ((var % granularity) == 0);
     if (cachenow) {
-        if (cache_get3(CACHE_QMDD_GATE, sylvan_false, AADD_TARGET(q), GATE_OPID_40(gate, target, 0), &res)) {
+        if (cache_get3(CACHE_QMDD_GATE, sylvan_false, AADD_TARGET(q), GATE_OPID_64(gate, target, 0), &res)) {
             sylvan_stats_count(QMDD_GATE_CACHED);
             // Multiply root of res with root of input qmdd
             AMP new_root_amp = wgt_mul(AADD_WEIGHT(q), AADD_WEIGHT(res));
@@ -400,10 +662,14 @@ TASK_IMPL_3(QMDD, qmdd_gate_rec, QMDD, q, gate_id_t, gate, BDDVAR, target)
     }
 
     if (var == target) {
-        AMP a_u00 = wgt_mul(AADD_WEIGHT(low), gates[gate][0]);
-        AMP a_u10 = wgt_mul(AADD_WEIGHT(low), gates[gate][2]);
-        AMP b_u01 = wgt_mul(AADD_WEIGHT(high), gates[gate][1]);
-        AMP b_u11 = wgt_mul(AADD_WEIGHT(high), gates[gate][3]);
+        AMP ws_a[4] = {AADD_WEIGHT(low), AADD_WEIGHT(low), AADD_WEIGHT(high), AADD_WEIGHT(high)};
+        AMP ws_b[4] = {gates[gate][0], gates[gate][2], gates[gate][1], gates[gate][3]};
+        AMP ws[4];
+        wgt_mul_batch(ws_a, ws_b, ws, 4);
+        AMP a_u00 = ws[0];
+        AMP a_u10 = ws[1];
+        AMP b_u01 = ws[2];
+        AMP b_u11 = ws[3];
         QMDD low1, low2, high1, high2;
         low1  = aadd_bundle(AADD_TARGET(low), a_u00);
         low2  = aadd_bundle(AADD_TARGET(high),b_u01);
@@ -427,7 +693,7 @@ TASK_IMPL_3(QMDD, qmdd_gate_rec, QMDD, q, gate_id_t, gate, BDDVAR, target)
 
     // Store not yet "root normalized" result in cache
     if (cachenow) {
-        if (cache_put3(CACHE_QMDD_GATE, sylvan_false, AADD_TARGET(q), GATE_OPID_40(gate, target, 0), res)) 
+        if (cache_put3(CACHE_QMDD_GATE, sylvan_false, AADD_TARGET(q), GATE_OPID_64(gate, target, 0), res)) 
             sylvan_stats_count(QMDD_GATE_CACHEDPUT);
     }
     // Multiply amp res with amp of input qmdd
@@ -456,8 +722,8 @@ TASK_IMPL_5(QMDD, qmdd_cgate_rec, QMDD, q, gate_id_t, gate, BDDVAR*, cs, uint32_
     // Check cache
     bool cachenow = ((var % granularity) == 0);
     if (cachenow) {
-        if (cache_get3(CACHE_QMDD_CGATE, sylvan_false, AADD_TARGET(q),
-                    GATE_OPID_64(gate, ci, cs[0], cs[1], cs[2], t),
+        if (cache_get3(CACHE_QMDD_CGATE, QMDD_PARAM_PACK_40(qmdd_next_control(cs, ci, 1), qmdd_next_control(cs, ci, 2)),
+                    AADD_TARGET(q), GATE_OPID_64(gate, c, t),
                     &res)) {
             sylvan_stats_count(QMDD_CGATE_CACHED);
             // Multiply root amp of res with input root amp
@@ -486,8 +752,8 @@ TASK_IMPL_5(QMDD, qmdd_cgate_rec, QMDD, q, gate_id_t, gate, BDDVAR*, cs, uint32_
 
     // Store not yet "root normalized" result in cache
     if (cachenow) {
-        if (cache_put3(CACHE_QMDD_CGATE, sylvan_false, AADD_TARGET(q),
-                    GATE_OPID_64(gate, ci, cs[0], cs[1], cs[2], t),
+        if (cache_put3(CACHE_QMDD_CGATE, QMDD_PARAM_PACK_40(qmdd_next_control(cs, ci, 1), qmdd_next_control(cs, ci, 2)),
+                    AADD_TARGET(q), GATE_OPID_64(gate, c, t),
                     res)) {
             sylvan_stats_count(QMDD_CGATE_CACHEDPUT);
         }
@@ -512,8 +778,8 @@ TASK_IMPL_6(QMDD, qmdd_cgate_range_rec, QMDD, q, gate_id_t, gate, BDDVAR, c_firs
     QMDD res;
     bool cachenow = ((k % granularity) == 0);
     if (cachenow) {
-        if (cache_get3(CACHE_QMDD_CGATE_RANGE, sylvan_false, AADD_TARGET(q),
-                       GATE_OPID_64(gate, c_first, c_last, k, t, 0),
+        if (cache_get3(CACHE_QMDD_CGATE_RANGE, QMDD_PARAM_PACK_40(k, t), AADD_TARGET(q),
+                       GATE_OPID_64(gate, c_first, c_last),
                        &res)) {
             sylvan_stats_count(QMDD_CGATE_CACHED);
             // Multiply root amp of result with the input root amp
@@ -555,8 +821,8 @@ TASK_IMPL_6(QMDD, qmdd_cgate_range_rec, QMDD, q, gate_id_t, gate, BDDVAR, c_firs
 
     // Store not yet "root normalized" result in cache
     if (cachenow) {
-        if (cache_put3(CACHE_QMDD_CGATE_RANGE, sylvan_false, AADD_TARGET(q),
-                       GATE_OPID_64(gate, c_first, c_last, k, t, 0),
+        if (cache_put3(CACHE_QMDD_CGATE_RANGE, QMDD_PARAM_PACK_40(k, t), AADD_TARGET(q),
+                       GATE_OPID_64(gate, c_first, c_last),
                        res)) {
             sylvan_stats_count(QMDD_CGATE_CACHEDPUT);
         }
@@ -567,6 +833,228 @@ TASK_IMPL_6(QMDD, qmdd_cgate_range_rec, QMDD, q, gate_id_t, gate, BDDVAR, c_firs
     return res;
 }
 
+TASK_IMPL_4(QMDD, qmdd_gate_layer_rec, QMDD, q, qmdd_layer_t, layer, BDDVAR, k, uint64_t, disabled)
+{
+    // Trivial cases
+    if (AADD_WEIGHT(q) == AADD_ZERO) return q;
+    BDDVAR next = layer->next[k];
+    if (next == layer->n) return q; // no more gates below k
+
+    BDDVAR var;
+    QMDD res, low, high;
+    aadd_get_topvar(q, next, &var, &low, &high);
+    assert(var <= next);
+
+    // Check cache
+    bool cachenow = layer->id != 0 && ((var % granularity) == 0);
+    if (cachenow) {
+        if (cache_get3(CACHE_QMDD_GATE_LAYER, QMDD_PARAM_PACK_40(next, layer->id), AADD_TARGET(q), disabled, &res)) {
+            sylvan_stats_count(QMDD_GATE_LAYER_CACHED);
+            // Multiply root of res with root of input qmdd
+            AMP new_root_amp = wgt_mul(AADD_WEIGHT(q), AADD_WEIGHT(res));
+            res = aadd_bundle(AADD_TARGET(res), new_root_amp);
+            return res;
+        }
+    }
+
+    // Apply the rest of the layer to both children (a control on |0> disables
+    // its gate on the low branch)
+    uint64_t disabled_low = disabled;
+    int cgate = (var == next) ? layer->cgate[var] : -1;
+    bool apply = (var == next && layer->role[var] == LAYER_TARGET);
+    if (cgate != -1) {
+        if (layer->role[var] == LAYER_CONTROL) disabled_low |= (1ULL << cgate);
+        else if ((disabled >> cgate) & 1) apply = false;
+    }
+    aadd_refs_spawn(SPAWN(qmdd_gate_layer_rec, high, layer, var+1, disabled));
+    low = CALL(qmdd_gate_layer_rec, low, layer, var+1, disabled_low);
+    aadd_refs_push(low);
+    high = aadd_refs_sync(SYNC(qmdd_gate_layer_rec));
+    aadd_refs_pop(1);
+
+    if (apply) {
+        // The gates below act on other qubits, so (commuting with those) the 
+        // gate at var can be applied to the already updated children
+        gate_id_t gate = layer->gates[var];
+        AMP ws_a[4] = {AADD_WEIGHT(low), AADD_WEIGHT(low), AADD_WEIGHT(high), AADD_WEIGHT(high)};
+        AMP ws_b[4] = {gates[gate][0], gates[gate][2], gates[gate][1], gates[gate][3]};
+        AMP ws[4];
+        wgt_mul_batch(ws_a, ws_b, ws, 4);
+        QMDD low1, low2, high1, high2;
+        low1  = aadd_bundle(AADD_TARGET(low), ws[0]);
+        low2  = aadd_bundle(AADD_TARGET(high),ws[2]);
+        high1 = aadd_bundle(AADD_TARGET(low), ws[1]);
+        high2 = aadd_bundle(AADD_TARGET(high),ws[3]);
+        aadd_refs_push(low);
+        aadd_refs_push(high);
+        aadd_refs_spawn(SPAWN(aadd_plus, high1, high2));
+        low = CALL(aadd_plus, low1, low2);
+        aadd_refs_push(low);
+        high = aadd_refs_sync(SYNC(aadd_plus));
+        aadd_refs_pop(3);
+    }
+    res = aadd_makenode(var, low, high);
+
+    // Store not yet "root normalized" result in cache
+    if (cachenow) {
+        if (cache_put3(CACHE_QMDD_GATE_LAYER, QMDD_PARAM_PACK_40(next, layer->id), AADD_TARGET(q), disabled, res)) 
+            sylvan_stats_count(QMDD_GATE_LAYER_CACHEDPUT);
+    }
+    // Multiply amp res with amp of input qmdd
+    AMP new_root_amp = wgt_mul(AADD_WEIGHT(q), AADD_WEIGHT(res));
+    res = aadd_bundle(AADD_TARGET(res), new_root_amp);
+    return res;
+}
+
+TASK_IMPL_5(QMDD, qmdd_gate2_rec, QMDD, q, uint32_t, gate, BDDVAR, lo, BDDVAR, hi, bool, swap)
+{
+    // Trivial cases
+    if (AADD_WEIGHT(q) == AADD_ZERO) return q;
+
+    BDDVAR var;
+    QMDD res, low, high;
+    aadd_get_topvar(q, lo, &var, &low, &high);
+    assert(var <= lo);
+
+    // Check cache
+    bool cachenow = ((var % granularity) == 0);
+    if (cachenow) {
+        if (cache_get3(CACHE_QMDD_GATE2, (uint64_t)swap, AADD_TARGET(q), GATE_OPID_64(gate, lo, hi), &res)) {
+            sylvan_stats_count(QMDD_GATE2_CACHED);
+            // Multiply root of res with root of input qmdd
+            AMP new_root_amp = wgt_mul(AADD_WEIGHT(q), AADD_WEIGHT(res));
+            res = aadd_bundle(AADD_TARGET(res), new_root_amp);
+            return res;
+        }
+    }
+
+    if (var == lo) {
+        // rows r = 0 and r = 1 of the gate on the (lo,hi) sub-matrices below
+        aadd_refs_spawn(SPAWN(qmdd_gate2_mix, low, high, gate, 1, hi, swap));
+        QMDD low_new = CALL(qmdd_gate2_mix, low, high, gate, 0, hi, swap);
+        aadd_refs_push(low_new);
+        high = aadd_refs_sync(SYNC(qmdd_gate2_mix));
+        aadd_refs_pop(1);
+        res = aadd_makenode(lo, low_new, high);
+    }
+    else { // var < lo: not at first qubit yet, recursive calls down
+        aadd_refs_spawn(SPAWN(qmdd_gate2_rec, high, gate, lo, hi, swap));
+        low = CALL(qmdd_gate2_rec, low, gate, lo, hi, swap);
+        aadd_refs_push(low);
+        high = aadd_refs_sync(SYNC(qmdd_gate2_rec));
+        aadd_refs_pop(1);
+        res  = aadd_makenode(var, low, high);
+    }
+
+    // Store not yet "root normalized" result in cache
+    if (cachenow) {
+        if (cache_put3(CACHE_QMDD_GATE2, (uint64_t)swap, AADD_TARGET(q), GATE_OPID_64(gate, lo, hi), res)) 
+            sylvan_stats_count(QMDD_GATE2_CACHEDPUT);
+    }
+    // Multiply amp res with amp of input qmdd
+    AMP new_root_amp = wgt_mul(AADD_WEIGHT(q), AADD_WEIGHT(res));
+    res = aadd_bundle(AADD_TARGET(res), new_root_amp);
+    return res;
+}
+
+/* Index in the 4x4 matrix of a gate for the given values of qubits lo, hi */
+static inline int
+gate2_index(bool swap, int b_lo, int b_hi)
+{
+    return swap ? (2*b_hi + b_lo) : (2*b_lo + b_hi);
+}
+
+TASK_IMPL_6(QMDD, qmdd_gate2_mix, QMDD, a, QMDD, b, uint32_t, gate, int, r, BDDVAR, hi, bool, swap)
+{
+    // Trivial cases
+    if (AADD_WEIGHT(a) == AADD_ZERO && AADD_WEIGHT(b) == AADD_ZERO) return a;
+
+    // Factor out the weight of a (or b if a is zero), so that the cached
+    // result can be reused for (a,b) with the same ratio between them
+    AMP factor;
+    bool a_zero = (AADD_WEIGHT(a) == AADD_ZERO);
+    if (!a_zero) {
+        factor = AADD_WEIGHT(a);
+        a = aadd_bundle(AADD_TARGET(a), AADD_ONE);
+        b = aadd_bundle(AADD_TARGET(b), wgt_div(AADD_WEIGHT(b), factor));
+    }
+    else {
+        factor = AADD_WEIGHT(b);
+        b = aadd_bundle(AADD_TARGET(b), AADD_ONE);
+    }
+    AADD_TARG key_t = a_zero ? AADD_TARGET(b) : AADD_TARGET(a);
+    QMDD key_e = a_zero ? a : b;
+    uint64_t key_p = GATE_OPID_64(gate, hi, swap | r<<1 | a_zero<<2);
+
+    QMDD res;
+    if (cache_get3(CACHE_QMDD_GATE2_MIX, key_t, key_e, key_p, &res)) {
+        sylvan_stats_count(QMDD_GATE2_CACHED);
+        return aadd_bundle(AADD_TARGET(res), wgt_mul(factor, AADD_WEIGHT(res)));
+    }
+
+    // Next variable of a and b, but not past hi
+    BDDVAR var_a, var_b, var;
+    QMDD a0, a1, b0, b1;
+    aadd_get_topvar(a, hi, &var_a, &a0, &a1);
+    aadd_get_topvar(b, hi, &var_b, &b0, &b1);
+    var = (var_a < var_b) ? var_a : var_b;
+    aadd_get_topvar(a, var, &var_a, &a0, &a1);
+    aadd_get_topvar(b, var, &var_b, &b0, &b1);
+    AMP ws_a[4] = {AADD_WEIGHT(a), AADD_WEIGHT(a), AADD_WEIGHT(b), AADD_WEIGHT(b)};
+    AMP ws_b[4] = {AADD_WEIGHT(a0), AADD_WEIGHT(a1), AADD_WEIGHT(b0), AADD_WEIGHT(b1)};
+    AMP ws[4];
+    wgt_mul_batch(ws_a, ws_b, ws, 4);
+    a0 = aadd_bundle(AADD_TARGET(a0), ws[0]);
+    a1 = aadd_bundle(AADD_TARGET(a1), ws[1]);
+    b0 = aadd_bundle(AADD_TARGET(b0), ws[2]);
+    b1 = aadd_bundle(AADD_TARGET(b1), ws[3]);
+
+    QMDD low, high;
+    if (var == hi) {
+        // out_s = sum_{c,d} u[(r,s),(c,d)] * x_cd, with x_0d = a_d, x_1d = b_d
+        QMDD x[4] = {a0, a1, b0, b1}; // x[2*c + d]
+        AMP us[8], xs[8], ps[8];
+        for (int s = 0; s < 2; s++) {
+            int row = gate2_index(swap, r, s);
+            for (int cd = 0; cd < 4; cd++) {
+                int col = gate2_index(swap, cd >> 1, cd & 1);
+                us[4*s + cd] = gates2[gate][4*row + col];
+                xs[4*s + cd] = AADD_WEIGHT(x[cd]);
+            }
+        }
+        wgt_mul_batch(us, xs, ps, 8);
+        QMDD terms[8];
+        for (int k = 0; k < 8; k++) {
+            terms[k] = aadd_bundle(AADD_TARGET(x[k % 4]), ps[k]);
+        }
+        QMDD sums[4];
+        for (int k = 0; k < 4; k++) {
+            aadd_refs_spawn(SPAWN(aadd_plus, terms[2*k], terms[2*k+1]));
+        }
+        for (int k = 3; k >= 0; k--) {
+            sums[k] = aadd_refs_sync(SYNC(aadd_plus));
+            aadd_refs_push(sums[k]);
+        }
+        aadd_refs_spawn(SPAWN(aadd_plus, sums[2], sums[3]));
+        low = CALL(aadd_plus, sums[0], sums[1]);
+        aadd_refs_push(low);
+        high = aadd_refs_sync(SYNC(aadd_plus));
+        aadd_refs_pop(5);
+    }
+    else { // var < hi: recursive calls down on both a and b
+        aadd_refs_spawn(SPAWN(qmdd_gate2_mix, a1, b1, gate, r, hi, swap));
+        low = CALL(qmdd_gate2_mix, a0, b0, gate, r, hi, swap);
+        aadd_refs_push(low);
+        high = aadd_refs_sync(SYNC(qmdd_gate2_mix));
+        aadd_refs_pop(1);
+    }
+    res = aadd_makenode(var, low, high);
+
+    if (cache_put3(CACHE_QMDD_GATE2_MIX, key_t, key_e, key_p, res))
+        sylvan_stats_count(QMDD_GATE2_CACHEDPUT);
+    return aadd_bundle(AADD_TARGET(res), wgt_mul(factor, AADD_WEIGHT(res)));
+}
+
 /******************************</Applying gates>*******************************/
 
 
@@ -656,6 +1144,9 @@ qmdd_circuit_QFT_inv(QMDD qmdd, BDDVAR first, BDDVAR last)
     return res;
 }
 
+static QMDD qmdd_memo_apply_at(QMDD qmdd, qmdd_memo_t memo, BDDVAR k);
+static uint32_t qmdd_memo_version(qmdd_memo_t memo);
+
 QMDD
 qmdd_circuit(QMDD qmdd, circuit_id_t circ_id, BDDVAR t1, BDDVAR t2)
 {
@@ -664,6 +1155,7 @@ qmdd_circuit(QMDD qmdd, circuit_id_t circ_id, BDDVAR t1, BDDVAR t2)
         case CIRCID_reverse_range : return qmdd_circuit_reverse_range(qmdd, t1, t2);
         case CIRCID_QFT           : return qmdd_circuit_QFT(qmdd, t1, t2);
         case CIRCID_QFT_inv       : return qmdd_circuit_QFT_inv(qmdd, t1, t2);
+        case CIRCID_memo          : return qmdd_memo_apply(qmdd, t1);
         default :
             assert ("Invalid circuit ID" && false);
             return AADD_TERMINAL;
@@ -672,12 +1164,16 @@ qmdd_circuit(QMDD qmdd, circuit_id_t circ_id, BDDVAR t1, BDDVAR t2)
 
 TASK_IMPL_6(QMDD, qmdd_ccircuit, QMDD, qmdd, circuit_id_t, circ_id, BDDVAR*, cs, uint32_t, ci, BDDVAR, t1, BDDVAR, t2)
 {
-    // Cache lookup
+    // Cache lookup, with the circuit ID (4 bits) and the last of the remaining
+    // controls (20 bits) in the place of the gate ID. For memos, the version
+    // of the memo takes the place of the (unused) t2.
     QMDD res;
     bool cachenow = 1;
+    uint32_t circ_param = (uint32_t)circ_id | (qmdd_next_control(cs, ci, 2) & QMDD_PARAM_MASK) << 4;
+    BDDVAR t2_key = (circ_id == CIRCID_memo) ? qmdd_memo_version(t1) : t2;
     if (cachenow) {
-        if (cache_get3(CACHE_QMDD_SUBCIRC, GATE_OPID_40(0, ci, 0), qmdd, 
-                       GATE_OPID_64(circ_id, cs[0], cs[1], cs[2], t1, t2),
+        if (cache_get3(CACHE_QMDD_SUBCIRC, QMDD_PARAM_PACK_40(qmdd_next_control(cs, ci, 0), qmdd_next_control(cs, ci, 1)),
+                       qmdd, GATE_OPID_64(circ_param, t1, t2_key),
                        &res)) {
             return res;
         }
@@ -688,7 +1184,13 @@ TASK_IMPL_6(QMDD, qmdd_ccircuit, QMDD, qmdd, circuit_id_t, circ_id, BDDVAR*, cs,
 
     // If no more control qubits, apply sub-circ here
     if (c == AADD_INVALID_VAR || ci > MAX_CONTROLS) {
-        res = qmdd_circuit(qmdd, circ_id, t1, t2);
+        if (circ_id == CIRCID_memo) {
+            // below the last control, multiply with the matching part of the matrix
+            res = qmdd_memo_apply_at(qmdd, t1, (ci == 0) ? 0 : cs[ci-1] + 1);
+        }
+        else {
+            res = qmdd_circuit(qmdd, circ_id, t1, t2);
+        }
         // the gates in qmdd_circuit already took care of multiplying the input 
         // root amp with normalization, so no need to do that here again
     }
@@ -719,13 +1221,244 @@ TASK_IMPL_6(QMDD, qmdd_ccircuit, QMDD, qmdd, circuit_id_t, circ_id, BDDVAR*, cs,
     
     // Add to cache, return
     if (cachenow) {
-        cache_put3(CACHE_QMDD_SUBCIRC, GATE_OPID_40(0, ci, 0), qmdd, 
-                   GATE_OPID_64(circ_id, cs[0], cs[1], cs[2], t1, t2), 
+        cache_put3(CACHE_QMDD_SUBCIRC, QMDD_PARAM_PACK_40(qmdd_next_control(cs, ci, 0), qmdd_next_control(cs, ci, 1)),
+                   qmdd, GATE_OPID_64(circ_param, t1, t2_key), 
                    res);
     }
     return res;
 }
 
+typedef struct qmdd_memo_s {
+    QMDD matrix; // protected
+    uint32_t version; // part of qmdd_ccircuit cache keys, changes with matrix
+    BDDVAR n;
+    BDDVAR first;
+    BDDVAR last;
+} *qmdd_memo_p;
+
+static qmdd_memo_p *memos = NULL;
+static uint32_t memos_count = 0;
+static uint32_t memos_size = 0;
+
+static qmdd_memo_p
+qmdd_memo_get(qmdd_memo_t memo)
+{
+    if (memo >= memos_count || memos[memo] == NULL) {
+        fprintf(stderr, "qmdd_memo: invalid memo %u\n", memo);
+        exit(1);
+    }
+    return memos[memo];
+}
+
+static void
+qmdd_memo_check_qubit(qmdd_memo_p m, BDDVAR q)
+{
+    if (q < m->first || q > m->last) {
+        fprintf(stderr, "qmdd_memo: qubit %d outside of memo range %d-%d\n", q, m->first, m->last);
+        exit(1);
+    }
+}
+
+static void
+qmdd_memo_mult(qmdd_memo_p m, QMDD gate)
+{
+    // the memo matrix is protected, only the new gate needs to survive gc
+    if (aadd_test_gc_wgt_table()) {
+        aadd_protect(&gate);
+        aadd_gc_wgt_table();
+        aadd_unprotect(&gate);
+    }
+    aadd_refs_push(gate);
+    m->matrix = aadd_matmat_mult(gate, m->matrix, m->n);
+    aadd_refs_pop(1);
+
+    // results cached for the previous matrix can't be returned anymore, unless
+    // the version wraps around, then they have to be cleared
+    if (++m->version > QMDD_PARAM_MASK) {
+        sylvan_clear_cache();
+        m->version = 0;
+    }
+}
+
+static void
+qmdd_memos_free()
+{
+    for (uint32_t i = 0; i < memos_count; i++) {
+        if (memos[i] != NULL) qmdd_memo_free(i);
+    }
+    free(memos);
+    memos = NULL;
+    memos_count = 0;
+    memos_size = 0;
+}
+
+qmdd_memo_t
+qmdd_memo_create(BDDVAR n, BDDVAR first, BDDVAR last)
+{
+    if (first > last || last >= n) {
+        fprintf(stderr, "qmdd_memo_create: invalid range %d-%d (n = %d)\n", first, last, n);
+        exit(1);
+    }
+    // memo IDs are part of qmdd_ccircuit cache keys
+    if (memos_count > QMDD_PARAM_MASK) {
+        fprintf(stderr, "qmdd_memo_create: too many memos\n");
+        exit(1);
+    }
+    if (memos_count == 0) sylvan_register_quit(qmdd_memos_free);
+    if (memos_count == memos_size) {
+        memos_size = (memos_size == 0) ? 16 : 2 * memos_size;
+        memos = realloc(memos, memos_size * sizeof(qmdd_memo_p));
+    }
+    qmdd_memo_p m = malloc(sizeof(struct qmdd_memo_s));
+    m->version = 0;
+    m->n = n;
+    m->first = first;
+    m->last = last;
+    m->matrix = qmdd_create_all_identity_matrix(n);
+    aadd_protect(&m->matrix);
+    memos[memos_count] = m;
+    return memos_count++;
+}
+
+void
+qmdd_memo_gate(qmdd_memo_t memo, gate_id_t gate, BDDVAR t)
+{
+    qmdd_memo_p m = qmdd_memo_get(memo);
+    qmdd_memo_check_qubit(m, t);
+    qmdd_memo_mult(m, qmdd_create_single_qubit_gate(m->n, t, gate));
+}
+
+void
+qmdd_memo_cgate(qmdd_memo_t memo, gate_id_t gate, BDDVAR *cs, BDDVAR t)
+{
+    qmdd_memo_p m = qmdd_memo_get(memo);
+    int c_options[m->n];
+    for (BDDVAR k = 0; k < m->n; k++) c_options[k] = -1;
+    for (uint32_t i = 0; i < MAX_CONTROLS && cs[i] != AADD_INVALID_VAR; i++) {
+        qmdd_memo_check_qubit(m, cs[i]);
+        c_options[cs[i]] = 1;
+    }
+    qmdd_memo_check_qubit(m, t);
+    c_options[t] = 2;
+    qmdd_memo_mult(m, qmdd_create_multi_cgate(m->n, c_options, gate));
+}
+
+void
+qmdd_memo_append(qmdd_memo_t memo, qmdd_memo_t sub)
+{
+    qmdd_memo_p m = qmdd_memo_get(memo);
+    qmdd_memo_p s = qmdd_memo_get(sub);
+    if (s->n != m->n || s->first < m->first || s->last > m->last) {
+        fprintf(stderr, "qmdd_memo_append: memo %u does not fit in memo %u\n", sub, memo);
+        exit(1);
+    }
+    qmdd_memo_mult(m, s->matrix);
+}
+
+static void
+qmdd_memo_cgate1(qmdd_memo_t memo, gate_id_t gate, BDDVAR c, BDDVAR t)
+{
+    BDDVAR cs[MAX_CONTROLS] = {c, AADD_INVALID_VAR, AADD_INVALID_VAR};
+    qmdd_memo_cgate(memo, gate, cs, t);
+}
+
+void
+qmdd_memo_circuit(qmdd_memo_t memo, circuit_id_t circ_id, BDDVAR t1, BDDVAR t2)
+{
+    // same gates as qmdd_circuit_swap, qmdd_circuit_reverse_range, etc.
+    BDDVAR a, b;
+    switch (circ_id) {
+        case CIRCID_swap :
+            assert (t1 < t2);
+            qmdd_memo_cgate1(memo, GATEID_X, t1, t2);
+            qmdd_memo_gate(memo, GATEID_H, t1);
+            qmdd_memo_cgate1(memo, GATEID_Z, t1, t2);
+            qmdd_memo_gate(memo, GATEID_H, t1);
+            qmdd_memo_cgate1(memo, GATEID_X, t1, t2);
+            break;
+        case CIRCID_reverse_range :
+            for (BDDVAR j = 0; j < (t2 - t1 + 1) / 2; j++) {
+                qmdd_memo_circuit(memo, CIRCID_swap, t1 + j, t2 - j);
+            }
+            break;
+        case CIRCID_QFT :
+            for (a = t1; a <= t2; a++) {
+                qmdd_memo_gate(memo, GATEID_H, a);
+                for (b = a+1; b <= t2; b++) {
+                    qmdd_memo_cgate1(memo, GATEID_Rk((b - a) + 1), a, b);
+                }
+            }
+            break;
+        case CIRCID_QFT_inv :
+            for (a = t2 + 1; a-- > t1; ) {
+                for (b = t2; b >= (a+1); b--) {
+                    qmdd_memo_cgate1(memo, GATEID_Rk_dag((b - a) + 1), a, b);
+                }
+                qmdd_memo_gate(memo, GATEID_H, a);
+            }
+            break;
+        case CIRCID_memo :
+            qmdd_memo_append(memo, t1);
+            break;
+        default :
+            assert ("Invalid circuit ID" && false);
+    }
+}
+
+static uint32_t
+qmdd_memo_version(qmdd_memo_t memo)
+{
+    return qmdd_memo_get(memo)->version;
+}
+
+QMDD
+qmdd_memo_matrix(qmdd_memo_t memo)
+{
+    return qmdd_memo_get(memo)->matrix;
+}
+
+/**
+ * Multiplies the memo matrix with a (sub-)state of which the top variable is 
+ * at least k <= first. Since the matrix is the identity on qubits 0 through 
+ * first-1, the part acting on qubits k and below is found by following the 
+ * diagonal down to k.
+ */
+static QMDD
+qmdd_memo_apply_at(QMDD qmdd, qmdd_memo_t memo, BDDVAR k)
+{
+    qmdd_memo_p m = qmdd_memo_get(memo);
+    if (k > m->first) {
+        fprintf(stderr, "qmdd_memo: memo range %d-%d can't be applied at qubit %d\n", m->first, m->last, k);
+        exit(1);
+    }
+    BDDVAR var;
+    QMDD mat = m->matrix, low, high;
+    AMP w = AADD_WEIGHT(mat);
+    for (BDDVAR v = 0; v < 2*k; v++) {
+        aadd_get_topvar(mat, v, &var, &low, &high);
+        w = wgt_mul(w, AADD_WEIGHT(low));
+        mat = low;
+    }
+    mat = aadd_bundle(AADD_TARGET(mat), w);
+    return RUN(aadd_matvec_mult_rec, mat, qmdd, m->n, k);
+}
+
+QMDD
+qmdd_memo_apply(QMDD qmdd, qmdd_memo_t memo)
+{
+    qmdd_do_before_gate(&qmdd);
+    return qmdd_memo_apply_at(qmdd, memo, 0);
+}
+
+void
+qmdd_memo_free(qmdd_memo_t memo)
+{
+    qmdd_memo_p m = qmdd_memo_get(memo);
+    aadd_unprotect(&m->matrix);
+    free(m);
+    memos[memo] = NULL;
+}
+
 QMDD
 qmdd_all_control_phase_rec(QMDD qmdd, BDDVAR k, BDDVAR n, bool *x)
 {
@@ -802,6 +1535,116 @@ qmdd_all_control_phase(QMDD qmdd, BDDVAR n, bool *x)
 
 /***********************<Measurements and probabilities>***********************/
 
+/**
+ * Squared norms of nodes. For every node index in the unique table, this side
+ * array holds the sum of |amp|^2 of the (sub)vector below that node, given an
+ * incoming edge weight of 1 and the terminal at level nvars. Entries are 
+ * tagged with (epoch, nvars); the epoch is bumped whenever node indices or
+ * weight indices can change meaning (gc of nodes or of the edge weight table).
+ */
+typedef struct qmdd_sqnorm_entry {
+    _Atomic(uint64_t) tag;  // epoch << 32 | nvars
+    double            norm;
+} qmdd_sqnorm_entry_t;
+
+static qmdd_sqnorm_entry_t *qmdd_sqnorms = NULL;
+static size_t qmdd_sqnorms_size = 0;
+static uint32_t qmdd_sqnorms_epoch = 1; // calloc'ed entries are invalid
+
+static void
+qmdd_sqnorms_invalidate()
+{
+    qmdd_sqnorms_epoch++;
+}
+
+static void
+qmdd_sqnorms_free()
+{
+    if (qmdd_sqnorms != NULL) {
+        free_aligned(qmdd_sqnorms, qmdd_sqnorms_size * sizeof(qmdd_sqnorm_entry_t));
+    }
+    qmdd_sqnorms = NULL;
+    qmdd_sqnorms_size = 0;
+}
+
+/* Called after gc of the nodes table (which may also have been resized) */
+VOID_TASK_IMPL_0(qmdd_sqnorms_gc)
+{
+    qmdd_sqnorms_invalidate();
+    if (qmdd_sqnorms != NULL && qmdd_sqnorms_size != llmsset_get_size(nodes)) {
+        qmdd_sqnorms_free();
+    }
+}
+
+static void
+qmdd_sqnorms_alloc()
+{
+    // not touched pages of the (mmapped) array do not take up memory
+    qmdd_sqnorms_size = llmsset_get_size(nodes);
+    qmdd_sqnorms = (qmdd_sqnorm_entry_t*)alloc_aligned(qmdd_sqnorms_size * sizeof(qmdd_sqnorm_entry_t));
+    if (qmdd_sqnorms == NULL) {
+        fprintf(stderr, "qmdd_sqnorms: Unable to allocate memory!\n");
+        exit(1);
+    }
+}
+
+static inline BDDVAR
+qmdd_target_var(AADD_TARG t, BDDVAR nvars)
+{
+    if (t == AADD_TERMINAL) return nvars;
+    return aaddnode_getvar(AADD_GETNODE(t));
+}
+
+/* Squared norm of edge e when starting at level 'level' */
+static inline double
+qmdd_edge_sqnorm(AADD e, double target_norm, BDDVAR level, BDDVAR nvars)
+{
+    if (AADD_WEIGHT(e) == AADD_ZERO) return 0.0;
+    // skipped levels are don't cares: each doubles the norm
+    int skipped = qmdd_target_var(AADD_TARGET(e), nvars) - level;
+    return qmdd_amp_to_prob(AADD_WEIGHT(e)) * ldexp(target_norm, skipped);
+}
+
+TASK_IMPL_2(double, qmdd_node_sqnorm, AADD_TARG, t, BDDVAR, nvars)
+{
+    if (t == AADD_TERMINAL) return 1.0;
+
+    // the array is allocated outside of any parallel fill
+    qmdd_sqnorm_entry_t *e = &qmdd_sqnorms[t];
+    const uint64_t tag = ((uint64_t)qmdd_sqnorms_epoch << 32) | nvars;
+    if (atomic_load_explicit(&e->tag, memory_order_acquire) == tag) return e->norm;
+
+    AADD low, high;
+    aaddnode_t node = AADD_GETNODE(t);
+    BDDVAR var = aaddnode_getvar(node);
+    aaddnode_getchilderen(node, &low, &high);
+
+    double norm_low, norm_high;
+    SPAWN(qmdd_node_sqnorm, AADD_TARGET(high), nvars);
+    norm_low  = CALL(qmdd_node_sqnorm, AADD_TARGET(low), nvars);
+    norm_high = SYNC(qmdd_node_sqnorm);
+    double norm = qmdd_edge_sqnorm(low,  norm_low,  var+1, nvars) +
+                  qmdd_edge_sqnorm(high, norm_high, var+1, nvars);
+
+    // concurrent writers write the same value
+    e->norm = norm;
+    atomic_store_explicit(&e->tag, tag, memory_order_release);
+    return norm;
+}
+
+/* Squared norm of an already filled in node */
+static inline double
+qmdd_sqnorm_get(AADD_TARG t)
+{
+    return (t == AADD_TERMINAL) ? 1.0 : qmdd_sqnorms[t].norm;
+}
+
+TASK_IMPL_2(double, qmdd_sqnorm_fill, QMDD, qmdd, BDDVAR, nvars)
+{
+    if (qmdd_sqnorms == NULL) qmdd_sqnorms_alloc();
+    return CALL(qmdd_node_sqnorm, AADD_TARGET(qmdd), nvars);
+}
+
 QMDD
 qmdd_measure_qubit(QMDD qmdd, BDDVAR k, BDDVAR nvars, int *m, double *p)
 {
@@ -932,54 +1775,148 @@ qmdd_measure_all(QMDD qmdd, BDDVAR n, bool* ms, double *p)
     return prev;
 }
 
-// Container for disguising doubles as ints so they can go in Sylvan's cache
-// (see also union "hack" in mtbdd_satcount)
-typedef union {
-    double   as_double;
-    uint64_t as_int;
-} double_hack_t;
-
 TASK_IMPL_3(double, qmdd_unnormed_prob, QMDD, qmdd, BDDVAR, topvar, BDDVAR, nvars)
 {
     assert(topvar <= nvars);
 
-    if (topvar == nvars) {
-        assert(AADD_TARGET(qmdd) == AADD_TERMINAL);
-        return qmdd_amp_to_prob(AADD_WEIGHT(qmdd));
-    }
+    double norm = CALL(qmdd_sqnorm_fill, qmdd, nvars);
+    return qmdd_edge_sqnorm(qmdd, norm, topvar, nvars);
+}
 
-    // Look in cache
-    bool cachenow = 1;
-    if (cachenow) {
-        uint64_t prob_bits;
-        if (cache_get3(CACHE_QMDD_PROB, sylvan_false, qmdd, QMDD_PARAM_PACK_16(topvar, nvars), &prob_bits)) {
-            sylvan_stats_count(QMDD_PROB_CACHED);
-            double_hack_t container = (double_hack_t) prob_bits;
-            return container.as_double;
+/**
+ * Multi-shot sampling. First the squared norms of all nodes reachable from the
+ * root are filled in (bottom-up, in parallel). Drawing a shot is then a single
+ * walk from the root without touching the operation cache. Shots are drawn in
+ * chunks of QMDD_SAMPLE_CHUNK, each chunk with its own random stream derived
+ * from (seed, chunk), so the result does not depend on the number of workers.
+ */
+#define QMDD_SAMPLE_CHUNK 256
+
+typedef struct qmdd_sample_ctx {
+    QMDD      root;
+    BDDVAR    n;
+    uint64_t  seed;
+    uint64_t *shots;    // outcome of every shot
+} qmdd_sample_ctx_t;
+
+static inline uint64_t
+qmdd_sample_rand(uint64_t *state)
+{
+    // splitmix64
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t
+qmdd_sample_one(qmdd_sample_ctx_t *ctx, uint64_t *state)
+{
+    uint64_t outcome = 0;
+    QMDD e = ctx->root;
+    for (BDDVAR k = 0; k < ctx->n; k++) {
+        double rnd = (qmdd_sample_rand(state) >> 11) * 0x1.0p-53;
+        if (qmdd_target_var(AADD_TARGET(e), ctx->n) > k) {
+            // skipped level: both outcomes equally likely
+            if (rnd >= 0.5) outcome |= (1ULL << k);
+            continue;
+        }
+        AADD low, high;
+        aaddnode_getchilderen(AADD_GETNODE(AADD_TARGET(e)), &low, &high);
+        double norm = qmdd_sqnorm_get(AADD_TARGET(e));
+        double norm_low = qmdd_edge_sqnorm(low, qmdd_sqnorm_get(AADD_TARGET(low)), k+1, ctx->n);
+        if (rnd * norm < norm_low) {
+            e = low;
+        }
+        else {
+            e = high;
+            outcome |= (1ULL << k);
         }
     }
+    return outcome;
+}
 
-    // Check if the node we want is being skipped
-    BDDVAR var;
-    QMDD low, high;
-    aadd_get_topvar(qmdd, topvar, &var, &low, &high);
-
-    double prob_low, prob_high, prob_root, prob_res; // "prob" = absolute amps squared
-    BDDVAR nextvar = topvar + 1;
+VOID_TASK_3(qmdd_sample_shots_rec, qmdd_sample_ctx_t*, ctx, uint64_t, from, uint64_t, count)
+{
+    if (count > QMDD_SAMPLE_CHUNK) {
+        uint64_t half = ((count / QMDD_SAMPLE_CHUNK) / 2) * QMDD_SAMPLE_CHUNK;
+        if (half == 0) half = QMDD_SAMPLE_CHUNK;
+        SPAWN(qmdd_sample_shots_rec, ctx, from, half);
+        CALL(qmdd_sample_shots_rec, ctx, from + half, count - half);
+        SYNC(qmdd_sample_shots_rec);
+        return;
+    }
+    uint64_t state = ctx->seed ^ (from * 0xD1B54A32D192ED03ULL);
+    for (uint64_t i = from; i < from + count; i++) {
+        ctx->shots[i] = qmdd_sample_one(ctx, &state);
+    }
+}
 
-    SPAWN(qmdd_unnormed_prob, high, nextvar, nvars);
-    prob_low  = CALL(qmdd_unnormed_prob, low, nextvar, nvars);
-    prob_high = SYNC(qmdd_unnormed_prob);
-    prob_root = qmdd_amp_to_prob(AADD_WEIGHT(qmdd));
-    prob_res  = prob_root * (prob_low + prob_high);
+static int
+qmdd_sample_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
 
-    // Put in cache and return
-    if (cachenow) {
-        double_hack_t container = (double_hack_t) prob_res;
-        if (cache_put3(CACHE_QMDD_PROB, sylvan_false, qmdd, QMDD_PARAM_PACK_16(topvar, nvars), container.as_int))
-            sylvan_stats_count(QMDD_PROB_CACHEDPUT);
+TASK_IMPL_5(size_t, qmdd_sample_shots, QMDD, qmdd, BDDVAR, n, uint64_t, shots, uint64_t, rng_seed, qmdd_shots_t*, out_counts)
+{
+    if (n > 64) {
+        fprintf(stderr, "qmdd_sample_shots: at most 64 qubits supported\n");
+        exit(1);
+    }
+    out_counts->n_outcomes = 0;
+    out_counts->outcomes = NULL;
+    out_counts->counts = NULL;
+    if (shots == 0) return 0;
+
+    qmdd_sample_ctx_t ctx;
+    ctx.shots = (uint64_t*)malloc(shots * sizeof(uint64_t));
+    if (ctx.shots == NULL) {
+        fprintf(stderr, "qmdd_sample_shots: Unable to allocate memory!\n");
+        exit(1);
+    }
+    ctx.root = qmdd;
+    ctx.n    = n;
+    ctx.seed = rng_seed;
+
+    // fill in squared norms, then draw all shots
+    CALL(qmdd_sqnorm_fill, qmdd, n);
+    CALL(qmdd_sample_shots_rec, &ctx, 0, shots);
+
+    // histogram of the (sorted) outcomes
+    qsort(ctx.shots, shots, sizeof(uint64_t), qmdd_sample_cmp);
+    size_t distinct = 1;
+    for (uint64_t i = 1; i < shots; i++) {
+        if (ctx.shots[i] != ctx.shots[i-1]) distinct++;
+    }
+    out_counts->outcomes = (uint64_t*)malloc(distinct * sizeof(uint64_t));
+    out_counts->counts   = (uint64_t*)calloc(distinct, sizeof(uint64_t));
+    if (out_counts->outcomes == NULL || out_counts->counts == NULL) {
+        fprintf(stderr, "qmdd_sample_shots: Unable to allocate memory!\n");
+        exit(1);
+    }
+    size_t j = 0;
+    out_counts->outcomes[0] = ctx.shots[0];
+    for (uint64_t i = 0; i < shots; i++) {
+        if (ctx.shots[i] != out_counts->outcomes[j]) {
+            out_counts->outcomes[++j] = ctx.shots[i];
+        }
+        out_counts->counts[j]++;
     }
-    return prob_res;
+    out_counts->n_outcomes = distinct;
+    free(ctx.shots);
+    return distinct;
+}
+
+void
+qmdd_shots_free(qmdd_shots_t *h)
+{
+    free(h->outcomes);
+    free(h->counts);
+    h->outcomes = NULL;
+    h->counts = NULL;
+    h->n_outcomes = 0;
 }
 
 complex_t
@@ -1142,17 +2079,7 @@ bool
 qmdd_is_close_to_unitvector(QMDD qmdd, BDDVAR n, double tol)
 {
     bool WRITE_TO_FILE = false;
-    bool has_next = true;
-    AMP a;
-    bool x[n];
-    for(BDDVAR k=0; k<n; k++) x[k] = 0;
-
-    double sum_abs_squares = 0.0;
-    while(has_next){
-        a = aadd_getvalue(qmdd, x);
-        sum_abs_squares += qmdd_amp_to_prob(a);
-        has_next = _next_bitstring(x, n);
-    }
+    double sum_abs_squares = qmdd_get_magnitude(qmdd, n);
 
     if (fabs(sum_abs_squares - 1.0) < tol) {
         if (WRITE_TO_FILE) {
@@ -47,6 +47,11 @@ class QSimulator()
 }
 */
 
+/**
+ * To bound the memory of the node table, operation cache and edge weight table
+ * together, use sylvan_set_memory_budget instead of sylvan_set_sizes. Then
+ * wgt_tab_size is only the initial size of the edge weight table.
+ */
 void qsylvan_init_simulator(size_t wgt_tab_size, double wgt_tab_tolerance, int edge_weigth_backend, int norm_strat);
 void qsylvan_init_defaults(size_t wgt_tab_size);
 
@@ -187,11 +192,43 @@ QMDD qmdd_measure_q0(QMDD qmdd, BDDVAR nvars, int *m, double *p);
 QMDD qmdd_measure_all(QMDD qmdd, BDDVAR n, bool* ms, double *p);
 
 /**
- * (Recursive) helper function for obtaining probabilities for measurements
+ * Sum of |amp|^2 of the given (sub)vector, which starts at level topvar. Reads
+ * the squared norms of nodes from a side array indexed by node, which is
+ * filled in (in parallel) for the nodes of qmdd that are not there yet.
  */
 #define qmdd_unnormed_prob(qmdd, topvar, nvars) (RUN(qmdd_unnormed_prob,qmdd,topvar,nvars))
 TASK_DECL_3(double, qmdd_unnormed_prob, QMDD, BDDVAR, BDDVAR);
 
+/**
+ * Fill in the squared norms of all nodes of qmdd (see above), returns the
+ * squared norm of the target of qmdd (i.e. ignoring the root weight).
+ */
+#define qmdd_sqnorm_fill(qmdd, nvars) (RUN(qmdd_sqnorm_fill,qmdd,nvars))
+TASK_DECL_2(double, qmdd_sqnorm_fill, QMDD, BDDVAR);
+TASK_DECL_2(double, qmdd_node_sqnorm, AADD_TARG, BDDVAR);
+
+/**
+ * Histogram of sampled measurement outcomes. Outcomes are bitstrings with bit
+ * k the outcome of qubit k, sorted in ascending order.
+ */
+typedef struct qmdd_shots {
+    size_t    n_outcomes;   // number of distinct outcomes
+    uint64_t *outcomes;
+    uint64_t *counts;
+} qmdd_shots_t;
+
+/**
+ * Sample <shots> computational basis measurements of all n (<= 64) qubits of
+ * the given state, without collapsing it. Branch probabilities are computed
+ * once per node, after which the shots are drawn in parallel. The same seed
+ * gives the same histogram, regardless of the number of workers.
+ * 
+ * @return The number of distinct outcomes in <out_counts>.
+ */
+#define qmdd_sample_shots(qmdd,n,shots,rng_seed,out_counts) (RUN(qmdd_sample_shots,qmdd,n,shots,rng_seed,out_counts))
+TASK_DECL_5(size_t, qmdd_sample_shots, QMDD, BDDVAR, uint64_t, uint64_t, qmdd_shots_t*);
+void qmdd_shots_free(qmdd_shots_t *h);
+
 /**
  * Get amplitude of given basis state.
  * 
@@ -246,6 +283,32 @@ TASK_DECL_6(QMDD, qmdd_cgate3, QMDD, gate_id_t, BDDVAR, BDDVAR, BDDVAR, BDDVAR);
 #define qmdd_cgate_range(qmdd,gate,c_first,c_last,t) (RUN(qmdd_cgate_range,qmdd,gate,c_first,c_last,t))
 TASK_DECL_5(QMDD, qmdd_cgate_range, QMDD, gate_id_t, BDDVAR, BDDVAR, BDDVAR);
 
+/**
+ * Applies a layer of gates on disjoint qubits to |q> in a single traversal.
+ * For every qubit k < n, gates[k] is the gate with target k (GATEID_I if none)
+ * and controls[k] is the target of the gate controlled by k (-1 if none). All
+ * controls of a gate need to be above (smaller than) its target. Layers with 
+ * more than 64 controlled gates are applied in parts. (Wrapper function)
+ */
+#define qmdd_gate_layer(qmdd,n,gates,controls) (RUN(qmdd_gate_layer,qmdd,n,gates,controls))
+TASK_DECL_4(QMDD, qmdd_gate_layer, QMDD, BDDVAR, gate_id_t*, int*);
+
+/**
+ * The ID under which qmdd_gate_layer caches its results for this layer. Equal
+ * layers get equal IDs, so applying a layer again can reuse the cache. Returns
+ * 0 (not cached) when all IDs are in use, until the next gc of the node table.
+ */
+uint32_t qmdd_gate_layer_id(BDDVAR n, gate_id_t *gates, int *controls);
+
+/**
+ * Applies the two-qubit gate 'gate' (a GATEID2_*, see qsylvan_gates.h) to 
+ * qubits t1 and t2 (t1 != t2) of |q> in a single traversal. Row and column
+ * indices of the 4x4 matrix are 2*b1 + b2 with b1 and b2 the values of t1 and
+ * t2. (Wrapper function)
+ */
+#define qmdd_gate2(qmdd,gate,t1,t2) (RUN(qmdd_gate2,qmdd,gate,t1,t2))
+TASK_DECL_4(QMDD, qmdd_gate2, QMDD, uint32_t, BDDVAR, BDDVAR);
+
 /**
  * Recursive implementation of applying single qubit gates
  */
@@ -265,6 +328,29 @@ TASK_DECL_5(QMDD, qmdd_cgate_rec, QMDD, gate_id_t, BDDVAR*, uint32_t, BDDVAR);
 #define qmdd_cgate_range_rec(q,gate,c_first,c_last,t) (RUN(qmdd_cgate_range_rec,q,gate,c_first,c_last,t,0))
 TASK_DECL_6(QMDD, qmdd_cgate_range_rec, QMDD, gate_id_t, BDDVAR, BDDVAR, BDDVAR, BDDVAR);
 
+/**
+ * Recursive implementation of applying a layer of gates, with 'disabled' the
+ * set of controlled gates (indices given by the layer) of which a control was
+ * seen to be |0> on the current path.
+ */
+typedef struct qmdd_layer_s *qmdd_layer_t;
+#define qmdd_gate_layer_rec(q,layer,k,disabled) (RUN(qmdd_gate_layer_rec,q,layer,k,disabled))
+TASK_DECL_4(QMDD, qmdd_gate_layer_rec, QMDD, qmdd_layer_t, BDDVAR, uint64_t);
+
+/**
+ * Recursive implementation of applying two-qubit gates on qubits lo < hi, 
+ * with 'swap' set if the first qubit of the gate is hi.
+ */
+#define qmdd_gate2_rec(q,gate,lo,hi,swap) (RUN(qmdd_gate2_rec,q,gate,lo,hi,swap))
+TASK_DECL_5(QMDD, qmdd_gate2_rec, QMDD, uint32_t, BDDVAR, BDDVAR, bool);
+
+/**
+ * Computes the lo = r half of applying a two-qubit gate on qubits lo < hi, 
+ * given the lo = 0 and lo = 1 children 'a' and 'b' of a node at lo.
+ */
+#define qmdd_gate2_mix(a,b,gate,r,hi,swap) (RUN(qmdd_gate2_mix,a,b,gate,r,hi,swap))
+TASK_DECL_6(QMDD, qmdd_gate2_mix, QMDD, QMDD, uint32_t, int, BDDVAR, bool);
+
 /******************************</Applying gates>*******************************/
 
 
@@ -278,7 +364,8 @@ typedef enum circuit_id {
     CIRCID_swap,
     CIRCID_reverse_range,
     CIRCID_QFT,
-    CIRCID_QFT_inv
+    CIRCID_QFT_inv,
+    CIRCID_memo
 } circuit_id_t;
 
 /**
@@ -319,6 +406,63 @@ QMDD qmdd_circuit(QMDD qmdd, circuit_id_t circ_id, BDDVAR t1, BDDVAR t2);
 #define qmdd_ccircuit(qmdd, circ_id, cs, t1, t2) (RUN(qmdd_ccircuit,qmdd,circ_id,cs,0,t1,t2));
 TASK_DECL_6(QMDD, qmdd_ccircuit, QMDD, circuit_id_t, BDDVAR*, uint32_t, BDDVAR, BDDVAR);
 
+/**
+ * Recorded sub-circuits ("memos"). The gates of a sub-circuit on qubits
+ * `first` through `last` are recorded once into a (protected) matrix QMDD,
+ * after which every application is a single matrix-vector multiplication.
+ * A memo can be applied controlled with qmdd_ccircuit(qmdd, CIRCID_memo, cs,
+ * memo, 0), as long as all controls are above `first`. Memo IDs are not
+ * reused and cached results are keyed on the memo's version, which changes
+ * when gates are appended, so results cached for freed memos or for earlier
+ * contents of a memo are never returned.
+ */
+typedef uint32_t qmdd_memo_t;
+
+/**
+ * Starts recording a sub-circuit on qubits `first` through `last` of an 
+ * `n`-qubit state. The memo starts out as the identity.
+ */
+qmdd_memo_t qmdd_memo_create(BDDVAR n, BDDVAR first, BDDVAR last);
+
+/**
+ * Appends a single qubit gate on qubit `t` to the memo.
+ */
+void qmdd_memo_gate(qmdd_memo_t memo, gate_id_t gate, BDDVAR t);
+
+/**
+ * Appends a controlled gate to the memo, with cs[] the control qubits as for
+ * qmdd_ccircuit (length MAX_CONTROLS, padded with AADD_INVALID_VAR). Unlike
+ * for qmdd_cgate, the controls may be below the target.
+ */
+void qmdd_memo_cgate(qmdd_memo_t memo, gate_id_t gate, BDDVAR *cs, BDDVAR t);
+
+/**
+ * Appends a previously recorded memo on (a subset of) the same qubits.
+ */
+void qmdd_memo_append(qmdd_memo_t memo, qmdd_memo_t sub);
+
+/**
+ * Appends one of the circuits above (parameters as for qmdd_circuit) to the 
+ * memo, e.g. to apply a controlled QFT as a single multiplication with 
+ * qmdd_ccircuit(qmdd, CIRCID_memo, cs, memo, 0).
+ */
+void qmdd_memo_circuit(qmdd_memo_t memo, circuit_id_t circ_id, BDDVAR t1, BDDVAR t2);
+
+/**
+ * Returns the matrix QMDD of all gates recorded in the memo so far.
+ */
+QMDD qmdd_memo_matrix(qmdd_memo_t memo);
+
+/**
+ * Applies the recorded sub-circuit to the given state.
+ */
+QMDD qmdd_memo_apply(QMDD qmdd, qmdd_memo_t memo);
+
+/**
+ * Releases the matrix QMDD of the memo.
+ */
+void qmdd_memo_free(qmdd_memo_t memo);
+
 /**
  * Applies a phase of -1 to a single basis state |x>.
  * This is a CZ gate where we control on all qubits and when x_k = 0 we control
@@ -55,6 +55,7 @@ namespace sylvan {
 
 #include <sylvan_common.h>
 #include <sylvan_stats.h>
+#include <sylvan_alloc.h>
 #include <sylvan_mt.h>
 #include <sylvan_mtbdd.h>
 #include <sylvan_bdd.h>
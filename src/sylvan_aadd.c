@@ -19,10 +19,15 @@
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <sylvan_int.h>
 #include <sylvan_aadd.h>
 #include <sylvan_refs.h>
+#include <sylvan_align.h>
 
 static int granularity = 1; // operation cache access granularity
 
@@ -198,6 +203,18 @@ VOID_TASK_0(aadd_refs_mark)
     TOGETHER(aadd_refs_mark_task);
 }
 
+/* Nodes created so far by aadd_reader_frombinary (one read at a time) */
+static AADD *aadd_reader_map = NULL;
+static size_t aadd_reader_map_size = 0;
+
+/* Called during garbage collection */
+VOID_TASK_0(aadd_gc_mark_reader)
+{
+    if (aadd_reader_map != NULL) {
+        CALL(aadd_refs_mark_r_par, aadd_reader_map, aadd_reader_map_size);
+    }
+}
+
 VOID_TASK_0(aadd_refs_init_task)
 {
     aadd_refs_internal_t s = (aadd_refs_internal_t)malloc(sizeof(struct aadd_refs_internal));
@@ -326,6 +343,18 @@ aadd_refs_sync(AADD result)
 
 static int auto_gc_wgt_table  = 1;
 static double wgt_table_gc_thres = 0.5;
+static bool gc_wgt_table_keep_cache = false;
+static bool gc_wgt_table_inplace = false;
+static bool gc_wgt_table_inplace_running = false;
+static aadd_cache_remap_cb gc_wgt_table_cache_remap = NULL;
+static aadd_gc_keep_hook_cb gc_wgt_table_keep_hook = NULL;
+static bool gc_nodes_running = false;
+static uint64_t wgt_table_live = 0; // (estimated) entries after the last gc
+static uint64_t wgt_index_limit = 0; // max entries with the available index bits
+
+// Map from old to new node index (only kept during gc of edge weight table)
+static AADD_TARG *node_gc_map = NULL;
+static size_t node_gc_map_size = 0;
 
 void
 aadd_set_auto_gc_wgt_table(bool enabled)
@@ -333,6 +362,30 @@ aadd_set_auto_gc_wgt_table(bool enabled)
     auto_gc_wgt_table = enabled;
 }
 
+void
+aadd_set_gc_wgt_table_keep_cache(bool enabled)
+{
+    gc_wgt_table_keep_cache = enabled;
+}
+
+void
+aadd_set_gc_wgt_table_inplace(bool enabled)
+{
+    gc_wgt_table_inplace = enabled;
+}
+
+void
+aadd_set_gc_wgt_table_cache_remap(aadd_cache_remap_cb cb)
+{
+    gc_wgt_table_cache_remap = cb;
+}
+
+void
+aadd_set_gc_wgt_table_keep_hook(aadd_gc_keep_hook_cb cb)
+{
+    gc_wgt_table_keep_hook = cb;
+}
+
 void
 aadd_set_gc_wgt_table_thres(double fraction_filled)
 {
@@ -345,11 +398,198 @@ aadd_get_gc_wgt_table_thres()
     return wgt_table_gc_thres;
 }
 
+AADD_WGT
+aadd_gc_keep_weight(AADD_WGT a)
+{
+    // in-place gc: mark it, copying gc: move it to the new table
+    if (gc_wgt_table_inplace_running) {
+        wgt_table_gc_mark(a);
+        return a;
+    }
+    return wgt_table_gc_keep(a);
+}
+
+bool
+aadd_gc_remap_weight(AADD_WGT *a)
+{
+    // gc of the node table doesn't touch the edge weight table
+    if (gc_nodes_running) return true;
+    // in-place gc: indices don't change, but some weights are deleted
+    if (gc_wgt_table_inplace_running) return wgt_table_gc_is_marked(*a);
+    return wgt_table_gc_map_get(*a, a);
+}
+
+bool
+aadd_gc_remap_target(AADD_TARG *t)
+{
+    if (gc_nodes_running) return *t == AADD_TERMINAL || llmsset_is_marked(nodes, *t);
+    if (*t == AADD_TERMINAL || gc_wgt_table_inplace_running) return true;
+    if (node_gc_map == NULL || *t >= node_gc_map_size) return false;
+    if (node_gc_map[*t] == 0) return false;
+    *t = node_gc_map[*t];
+    return true;
+}
+
+bool
+aadd_gc_remap_edge(AADD *a)
+{
+    AADD_TARG t = AADD_TARGET(*a);
+    AADD_WGT  w = AADD_WEIGHT(*a);
+    if (!aadd_gc_remap_target(&t) || !aadd_gc_remap_weight(&w)) return false;
+    *a = aadd_bundle(t, w);
+    return true;
+}
+
+static int
+aadd_remap_cache_entry(uint64_t *a, uint64_t *b, uint64_t *c, uint64_t *res)
+{
+    const uint64_t opid = *a & ~((1ULL<<40)-1);
+    uint64_t dd = *a & ((1ULL<<40)-1);
+    bool ok;
+
+    if (opid == CACHE_AADD_PLUS) {
+        // (-, edge, edge) -> edge
+        ok = aadd_gc_remap_edge(b) && aadd_gc_remap_edge(c) && aadd_gc_remap_edge(res);
+    }
+    else if (opid == CACHE_AADD_MATVEC_MULT || opid == CACHE_AADD_MATMAT_MULT) {
+        // (nextvar, target, target) -> edge
+        ok = aadd_gc_remap_target(b) && aadd_gc_remap_target(c) && aadd_gc_remap_edge(res);
+    }
+    else if (opid == CACHE_AADD_REPLACE_TERMINAL) {
+        // (target, target, -) -> target
+        ok = aadd_gc_remap_target(&dd) && aadd_gc_remap_target(b) && aadd_gc_remap_target(res);
+    }
+    else if (opid == CACHE_AADD_INC_VARS) {
+        // (target, k, -) -> target
+        ok = aadd_gc_remap_target(&dd) && aadd_gc_remap_target(res);
+    }
+    else if (opid == CACHE_AADD_IS_ORDERED) {
+        // (target, -, -) -> bool
+        ok = aadd_gc_remap_target(&dd);
+    }
+    else if (opid == CACHE_WGT_ADD || opid == CACHE_WGT_SUB || 
+             opid == CACHE_WGT_MUL || opid == CACHE_WGT_DIV) {
+        // (wgt, wgt, -) -> wgt
+        ok = aadd_gc_remap_weight(&dd) && aadd_gc_remap_weight(b) && aadd_gc_remap_weight(res);
+    }
+    else if (opid == CACHE_AADD_CLEAN_WGT_TABLE) {
+        // maps old to new edges, meaningless after gc
+        ok = false;
+    }
+    else if (gc_wgt_table_cache_remap != NULL) {
+        // operations outside of the AADD layer
+        ok = gc_wgt_table_cache_remap(opid, &dd, b, c, res);
+    }
+    else {
+        ok = false;
+    }
+
+    *a = dd | opid;
+    return ok;
+}
+
+bool
+aadd_gc_is_node_gc()
+{
+    return gc_nodes_running;
+}
+
+/* Cache check for sylvan_gc_set_keep_cache: nodes keep their index, so the
+   remap functions above only have to check if all nodes survived */
+int
+aadd_gc_check_cache_entry(uint64_t a, uint64_t b, uint64_t c, uint64_t res)
+{
+    return aadd_remap_cache_entry(&a, &b, &c, &res);
+}
+
+VOID_TASK_0(aadd_gc_nodes_start)
+{
+    gc_nodes_running = true;
+}
+
+VOID_TASK_0(aadd_gc_nodes_end)
+{
+    gc_nodes_running = false;
+}
+
+/* Mark the high edge weights of all nodes in the node table */
+VOID_TASK_2(aadd_gc_mark_node_weights_par, size_t, first, size_t, count)
+{
+    if (count > 1024) {
+        size_t split = count/2;
+        SPAWN(aadd_gc_mark_node_weights_par, first, split);
+        CALL(aadd_gc_mark_node_weights_par, first + split, count - split);
+        SYNC(aadd_gc_mark_node_weights_par);
+    } else {
+        for (size_t k = first; k < first + count; k++) {
+            if (k < 2 || !llmsset_is_marked(nodes, k)) continue;
+            aaddnode_t n = AADD_GETNODE(k);
+            wgt_table_gc_mark(AADD_WEIGHT(n->high));
+        }
+    }
+}
+
+static void
+aadd_gc_wgt_table_inplace()
+{
+    // 0. Remove nodes which are no longer in use from the node table first,
+    //    otherwise the weights they contain can't be freed
+    sylvan_gc_full();
+
+    // 1. Mark weights which are in use: 0, 1, -1, the root weights of the
+    //    protected AADDs, the weights stored in all nodes in the node table
+    //    and the weights used outside of AADDs
+    wgt_table_gc_mark_init();
+    wgt_table_gc_mark(AADD_ZERO);
+    wgt_table_gc_mark(AADD_ONE);
+    wgt_table_gc_mark(AADD_MIN_ONE);
+    uint64_t *it = protect_iter(&aadd_protected, 0, aadd_protected.refs_size);
+    while (it != NULL) {
+        AADD *to_protect_wgts = (AADD*)protect_next(&aadd_protected, &it, aadd_protected.refs_size);
+        if (to_protect_wgts != NULL) {
+            wgt_table_gc_mark(AADD_WEIGHT(*to_protect_wgts));
+        }
+    }
+    RUN(aadd_gc_mark_node_weights_par, 0, llmsset_get_size(nodes));
+    gc_wgt_table_inplace_running = true;
+    if (gc_wgt_table_keep_hook != NULL) gc_wgt_table_keep_hook();
+
+    // 2. Replace all unmarked weights with tombstones
+    wgt_table_gc_sweep();
+
+    // 3. Nodes only contain marked weights, so the node table stays valid. 
+    //    The cache might contain deleted weights, drop those entries.
+    cache_remap(aadd_remap_cache_entry);
+    gc_wgt_table_inplace_running = false;
+    wgt_table_gc_mark_free();
+
+    // 4. Reinitialize values outside of any AADD (which might be deleted)
+    if (init_wgt_table_entries != NULL) {
+        init_wgt_table_entries();
+    }
+    wgt_table_live = wgt_table_entries_estimate();
+}
 
 void
 aadd_gc_wgt_table()
 {
+    if (gc_wgt_table_inplace && wgt_table_gc_inplace_supported()) {
+        aadd_gc_wgt_table_inplace();
+        return;
+    }
+
     // gc edge weight table and keep wgts of protected AADDs (and update those)
+    // 0. Optionally, keep track of which weights/nodes move where
+    if (gc_wgt_table_keep_cache) {
+        wgt_table_gc_map_create();
+        node_gc_map_size = llmsset_get_size(nodes);
+        node_gc_map = (AADD_TARG*)alloc_aligned(node_gc_map_size * sizeof(AADD_TARG));
+        if (node_gc_map == NULL) {
+            fprintf(stderr, "aadd_gc_wgt_table: Unable to allocate memory!\n");
+            exit(1);
+        }
+    }
+
     // 1. Create new edge weight table table
     wgt_table_gc_init_new(init_wgt_table_entries);
 
@@ -362,67 +602,264 @@ aadd_gc_wgt_table()
         }
     }
 
-    // 3. Delete old edge weight table
+    // 3. Also keep the weights used outside of AADDs, delete old table
+    if (gc_wgt_table_keep_hook != NULL) gc_wgt_table_keep_hook();
     wgt_table_gc_delete_old();
 
     // 4. Any cache we migh have is now invalid because the same edge weights 
-    //    might now have different indices in the edge weight table
-    sylvan_clear_cache();
+    //    might now have different indices in the edge weight table. Either 
+    //    translate the cached entries to the new indices (and drop the ones 
+    //    containing weights/nodes which didn't survive), or clear everything.
+    if (gc_wgt_table_keep_cache) {
+        cache_remap(aadd_remap_cache_entry);
+        wgt_table_gc_map_free();
+        free_aligned(node_gc_map, node_gc_map_size * sizeof(AADD_TARG));
+        node_gc_map = NULL;
+        node_gc_map_size = 0;
+    }
+    else {
+        sylvan_clear_cache();
+    }
+    wgt_table_live = wgt_table_entries_estimate();
 }
 
-TASK_IMPL_1(AADD, _fill_new_wgt_table, AADD, a)
+/**
+ * Copies the node 'a' (and its descendants) to the new weight table. The 0/1
+ * edge weight of a node is only stored as flags, and aaddnode_unpack() turns
+ * those into the current AADD_ZERO/AADD_ONE, which already index the new
+ * table. So only the explicitly stored weight is moved from the old table.
+ */
+TASK_DECL_1(AADD_TARG, _fill_new_wgt_node, AADD_TARG);
+TASK_IMPL_1(AADD_TARG, _fill_new_wgt_node, AADD_TARG, a)
 {
+    if (a == AADD_TERMINAL) return a;
+
     // Check cache
-    AADD res;
+    uint64_t res;
     bool cachenow = 1;
     if (cachenow) {
         if (cache_get3(CACHE_AADD_CLEAN_WGT_TABLE, 0LL, a, 0LL, &res)) {
-            return res;
+            return (AADD_TARG) res;
         }
     }
 
-    // Move weight from old to new table, get new index
-    AADD_WGT new_wgt = wgt_table_gc_keep(AADD_WEIGHT(a));
-    a = aadd_bundle(AADD_TARGET(a), new_wgt);
+    aaddnode_t n = AADD_GETNODE(a);
+    AADD_TARG low  = aaddnode_getptrlow(n);
+    AADD_TARG high = aaddnode_getptrhigh(n);
+    bool norm_pos  = (n->low & aadd_wgt_pos_mask) >> 42;
+    bool norm_val  = (n->low & aadd_wgt_val_mask) >> 41;
+    AADD_WGT stored = wgt_table_gc_keep(AADD_WEIGHT(n->high));
 
-    // If terminal, return
-    if (AADD_TARGET(a) == AADD_TERMINAL) return a;
-    
     // Recursive for children
-    AADD low, high;
-    aaddnode_t n = AADD_GETNODE(AADD_TARGET(a));
-    aaddnode_getchilderen(n, &low, &high);
-    aadd_refs_spawn(SPAWN(_fill_new_wgt_table, high));
-    low = RUN(_fill_new_wgt_table, low);
+    aadd_refs_spawn(SPAWN(_fill_new_wgt_node, high));
+    low = CALL(_fill_new_wgt_node, low);
     aadd_refs_push(low);
-    high = aadd_refs_sync(SYNC(_fill_new_wgt_table));
+    high = aadd_refs_sync(SYNC(_fill_new_wgt_node));
     aadd_refs_pop(1);
 
     // We don't need to use the 'aadd_makenode()' function which normalizes the 
     // weights, because the AADD doesn't actually change, only the WGT indices,
     // but none of the actual values.
-    AADD_TARG ptr = _aadd_makenode(aaddnode_getvar(n), AADD_TARGET(low), AADD_TARGET(high), AADD_WEIGHT(low), AADD_WEIGHT(high));
+    AADD_WGT wgt_low, wgt_high;
+    if (weight_norm_strat == NORM_L2) {
+        // low is derived from high and not stored
+        wgt_low  = AADD_ONE;
+        wgt_high = stored;
+    }
+    else {
+        AADD_WGT implicit = (norm_val == 0) ? AADD_ZERO : AADD_ONE;
+        wgt_low  = (norm_pos == 0) ? implicit : stored;
+        wgt_high = (norm_pos == 0) ? stored : implicit;
+    }
+    AADD_TARG ptr = _aadd_makenode(aaddnode_getvar(n), low, high, wgt_low, wgt_high);
+    if (node_gc_map != NULL) node_gc_map[a] = ptr;
 
     // Put in cache, return
-    res = aadd_bundle(ptr, new_wgt);
-    if (cachenow) cache_put3(CACHE_AADD_CLEAN_WGT_TABLE, 0LL, a, 0LL, res);
-    return res;
+    if (cachenow) cache_put3(CACHE_AADD_CLEAN_WGT_TABLE, 0LL, a, 0LL, ptr);
+    return ptr;
+}
+
+TASK_IMPL_1(AADD, _fill_new_wgt_table, AADD, a)
+{
+    // Move weight from old to new table, get new index
+    AADD_WGT new_wgt = wgt_table_gc_keep(AADD_WEIGHT(a));
+    AADD_TARG ptr = CALL(_fill_new_wgt_node, AADD_TARGET(a));
+    return aadd_bundle(ptr, new_wgt);
 }
 
 bool
 aadd_test_gc_wgt_table()
 {
     uint64_t entries = wgt_table_entries_estimate();
-    uint64_t size    = sylvan_get_edge_weight_table_size();
+    uint64_t size    = sylvan_edge_weights_get_capacity();
     return ( ((double)entries / (double)size) > wgt_table_gc_thres );
 }
 
+/**
+ * The edge weight table as a store of the memory budget. It wants to grow when
+ * the weights that survived the last gc fill more than half of the table up to
+ * the gc threshold, since otherwise the next gc follows soon after.
+ */
+static size_t
+aadd_budget_usage()
+{
+    size_t bytes = sylvan_edge_weights_get_reserved() * sizeof(complex_t);
+    if (gc_wgt_table_inplace && wgt_table_gc_inplace_supported()) return bytes;
+    // a copying gc needs the old and the new table (and maybe the index map)
+    if (gc_wgt_table_keep_cache) bytes += sylvan_edge_weights_get_reserved() * sizeof(uint64_t);
+    return 2 * bytes;
+}
+
+static double
+aadd_budget_fill()
+{
+    uint64_t size = sylvan_edge_weights_get_reserved();
+    if (2 * size > wgt_index_limit) return 0;
+    return (double)wgt_table_live / (size * wgt_table_gc_thres);
+}
+
+static void
+aadd_budget_grow()
+{
+    sylvan_edge_weights_grow(2 * sylvan_edge_weights_get_reserved());
+}
+
 /************************</Cleaning edge weight table>*************************/
 
 
 
 
 
+/**********************<Adaptive caching per variable level>*******************/
+
+/**
+ * Every worker keeps (per operation and per variable level) the number of
+ * cache lookups and hits in the current window. When a window is full and its
+ * hit rate is below 1/AADD_ADAPTIVE_MIN_HITRATE, caching at that level is
+ * switched off. After AADD_ADAPTIVE_RETRY skipped calls the level is switched
+ * on again for another window, since the hit rate can change over time.
+ */
+#define AADD_ADAPTIVE_LEVELS 1024 // higher levels share the last entry
+#define AADD_ADAPTIVE_WINDOW 1024
+#define AADD_ADAPTIVE_MIN_HITRATE 64
+#define AADD_ADAPTIVE_RETRY (64*AADD_ADAPTIVE_WINDOW)
+
+typedef enum aadd_adaptive_op {
+    AADD_ADAPTIVE_PLUS,
+    AADD_ADAPTIVE_MATVEC,
+    AADD_ADAPTIVE_MATMAT,
+    AADD_ADAPTIVE_NUM_OPS
+} aadd_adaptive_op_t;
+
+typedef struct aadd_level_stats {
+    uint32_t lookups;
+    uint32_t hits;
+    uint32_t skipped;
+    uint32_t off;
+} aadd_level_stats_t;
+
+static bool adaptive_caching = false;
+static _Atomic(uint64_t) adaptive_switched_off = 0;
+static _Atomic(uint64_t) adaptive_switched_on = 0;
+DECLARE_THREAD_LOCAL(aadd_adaptive_key, aadd_level_stats_t*);
+
+void
+aadd_set_adaptive_caching(bool enabled)
+{
+    if (enabled && !adaptive_caching) {
+        adaptive_switched_off = 0;
+        adaptive_switched_on = 0;
+    }
+    adaptive_caching = enabled;
+}
+
+void
+aadd_get_adaptive_caching_switches(uint64_t *off, uint64_t *on)
+{
+    if (off != NULL) *off = adaptive_switched_off;
+    if (on != NULL) *on = adaptive_switched_on;
+}
+
+VOID_TASK_0(aadd_adaptive_init_task)
+{
+    size_t n = AADD_ADAPTIVE_NUM_OPS * AADD_ADAPTIVE_LEVELS;
+    aadd_level_stats_t *s = (aadd_level_stats_t*)calloc(n, sizeof(aadd_level_stats_t));
+    if (s == NULL) {
+        fprintf(stderr, "aadd_adaptive_init: Unable to allocate memory!\n");
+        exit(1);
+    }
+    SET_THREAD_LOCAL(aadd_adaptive_key, s);
+}
+
+VOID_TASK_0(aadd_adaptive_init)
+{
+    INIT_THREAD_LOCAL(aadd_adaptive_key);
+    TOGETHER(aadd_adaptive_init_task);
+}
+
+VOID_TASK_0(aadd_adaptive_cleanup_task)
+{
+    LOCALIZE_THREAD_LOCAL(aadd_adaptive_key, aadd_level_stats_t*);
+    free(aadd_adaptive_key);
+    SET_THREAD_LOCAL(aadd_adaptive_key, NULL);
+}
+
+VOID_TASK_0(aadd_adaptive_cleanup)
+{
+    TOGETHER(aadd_adaptive_cleanup_task);
+}
+
+static inline aadd_level_stats_t *
+aadd_level_stats(aadd_adaptive_op_t op, BDDVAR level)
+{
+    LOCALIZE_THREAD_LOCAL(aadd_adaptive_key, aadd_level_stats_t*);
+    if (level >= AADD_ADAPTIVE_LEVELS) level = AADD_ADAPTIVE_LEVELS - 1;
+    return &aadd_adaptive_key[op * AADD_ADAPTIVE_LEVELS + level];
+}
+
+/* Decides whether operation 'op' at 'level' should use the operation cache */
+static inline bool
+aadd_cache_level(aadd_adaptive_op_t op, BDDVAR level)
+{
+    if ((level % granularity) != 0) return false;
+    if (!adaptive_caching) return true;
+
+    aadd_level_stats_t *st = aadd_level_stats(op, level);
+    if (st->off) {
+        if (++st->skipped < AADD_ADAPTIVE_RETRY) {
+            sylvan_stats_count(AADD_CACHE_LEVEL_SKIP);
+            return false;
+        }
+        st->off = 0;
+        st->skipped = 0;
+        atomic_fetch_add_explicit(&adaptive_switched_on, 1, memory_order_relaxed);
+    }
+    if (st->lookups == AADD_ADAPTIVE_WINDOW) {
+        if (st->hits * AADD_ADAPTIVE_MIN_HITRATE < st->lookups) {
+            st->off = 1;
+            sylvan_stats_count(AADD_CACHE_LEVEL_OFF);
+            atomic_fetch_add_explicit(&adaptive_switched_off, 1, memory_order_relaxed);
+        }
+        st->lookups = 0;
+        st->hits = 0;
+    }
+    st->lookups++;
+    return true;
+}
+
+/* Records a cache hit of operation 'op' at 'level' */
+static inline void
+aadd_cache_level_hit(aadd_adaptive_op_t op, BDDVAR level)
+{
+    if (adaptive_caching) aadd_level_stats(op, level)->hits++;
+}
+
+/*********************</Adaptive caching per variable level>*******************/
+
+
+
+
+
 /******************************<Initialization>********************************/
 
 /**
@@ -430,15 +867,19 @@ aadd_test_gc_wgt_table()
  */
 static int aadd_initialized = 0;
 
+static void aadd_count_quit();
+
 static void
 aadd_quit()
 {
+    aadd_count_quit();
     refs_free(&aadd_refs);
     if (aadd_protected_created) {
         protect_free(&aadd_protected);
         aadd_protected_created = 0;
     }
     RUN(aadd_refs_cleanup);
+    RUN(aadd_adaptive_cleanup);
     aadd_initialized = 0;
     sylvan_edge_weights_free();
 }
@@ -449,18 +890,40 @@ sylvan_init_aadd(size_t wgt_tab_size, double wgt_tab_tolerance, int edge_weigth_
     if (aadd_initialized) return;
     aadd_initialized = 1;
 
+    // an index of the real backends packs two table indices
     int index_size = (int) ceil(log2(wgt_tab_size));
-    if (edge_weigth_backend == REAL_TUPLES_HASHMAP) index_size = index_size*2;
+    if (edge_weigth_backend != COMP_HASHMAP) index_size = index_size*2;
     if (index_size > 33) {
-        printf("max edge weight storage size is 2^33 (2^16 when using REAL_TUPLES_HASHMAP)\n");
+        printf("max edge weight storage size is 2^33 (2^16 when using REAL_TUPLES_HASHMAP or REAL_TREE)\n");
         exit(1);
     }
     if (index_size > 23) larger_wgt_indices = true;
     else larger_wgt_indices = false;
 
+    // Edge weight table can grow online until it runs out of index bits, or
+    // with a memory budget, when the budget allows it (see aadd_budget_grow)
+    wgt_index_limit = 1ULL << ((larger_wgt_indices ? 33 : 23) / (edge_weigth_backend != COMP_HASHMAP ? 2 : 1));
+    if (sylvan_get_memory_budget() != 0) {
+        sylvan_edge_weights_set_max_size(0);
+        sylvan_budget_add_store(aadd_budget_usage, aadd_budget_fill, aadd_budget_grow);
+    }
+    else if (edge_weigth_backend == COMP_HASHMAP) {
+        sylvan_edge_weights_set_max_size(wgt_index_limit);
+    }
+    wgt_table_live = 0;
+
     sylvan_register_quit(aadd_quit);
     sylvan_gc_add_mark(TASK(aadd_gc_mark_external_refs));
     sylvan_gc_add_mark(TASK(aadd_gc_mark_protected));
+    sylvan_gc_add_mark(TASK(aadd_gc_mark_reader));
+    sylvan_gc_hook_pregc(TASK(aadd_gc_nodes_start));
+    sylvan_gc_hook_postgc(TASK(aadd_gc_nodes_end));
+    for (uint64_t opid = CACHE_AADD_PLUS; opid <= CACHE_AADD_IS_ORDERED; opid += 1LL<<40) {
+        cache_set_check(opid, aadd_gc_check_cache_entry);
+    }
+    for (uint64_t opid = CACHE_WGT_ADD; opid <= CACHE_WGT_DIV; opid += 1LL<<40) {
+        cache_set_check(opid, aadd_gc_check_cache_entry);
+    }
 
     refs_create(&aadd_refs, 1024);
     if (!aadd_protected_created) {
@@ -495,6 +958,7 @@ sylvan_init_aadd(size_t wgt_tab_size, double wgt_tab_tolerance, int edge_weigth_
     }
 
     RUN(aadd_refs_init);
+    RUN(aadd_adaptive_init);
 }
 
 void
@@ -595,10 +1059,11 @@ TASK_IMPL_2(AADD, aadd_plus, AADD, a, AADD, b)
     // Check cache
     AADD x, y;
     norm_plus_cache_key(a, b, &x, &y); // (a+b) = (b+a) so normalize cache key
-    bool cachenow = ((topvar % granularity) == 0);
+    bool cachenow = aadd_cache_level(AADD_ADAPTIVE_PLUS, topvar);
     if (cachenow) {
         if (cache_get3(CACHE_AADD_PLUS, sylvan_false, x, y, &res)) {
             sylvan_stats_count(AADD_PLUS_CACHED);
+            aadd_cache_level_hit(AADD_ADAPTIVE_PLUS, topvar);
             return res;
         }
     }
@@ -663,10 +1128,11 @@ TASK_IMPL_4(AADD, aadd_matvec_mult_rec, AADD, mat, AADD, vec, BDDVAR, nvars, BDD
 
     // Check cache
     AADD res;
-    bool cachenow = ((nextvar % granularity) == 0);
+    bool cachenow = aadd_cache_level(AADD_ADAPTIVE_MATVEC, nextvar);
     if (cachenow) {
         if (cache_get3(CACHE_AADD_MATVEC_MULT, nextvar, AADD_TARGET(mat), AADD_TARGET(vec), &res)) {
             sylvan_stats_count(AADD_MULT_CACHED);
+            aadd_cache_level_hit(AADD_ADAPTIVE_MATVEC, nextvar);
             // 6. multiply w/ product of root weights
             AADD_WGT prod = wgt_mul(AADD_WEIGHT(mat), AADD_WEIGHT(vec));
             AADD_WGT new_weight = wgt_mul(prod, AADD_WEIGHT(res));
@@ -685,10 +1151,14 @@ TASK_IMPL_4(AADD, aadd_matvec_mult_rec, AADD, mat, AADD, vec, BDDVAR, nvars, BDD
     aadd_get_topvar(mat_high,2*nextvar+1, &var, &u01, &u11);
 
     // 2. propagate "in-between" weights of matrix AADD
-    u00 = aadd_bundle(AADD_TARGET(u00), wgt_mul(AADD_WEIGHT(u00), AADD_WEIGHT(mat_low)));
-    u10 = aadd_bundle(AADD_TARGET(u10), wgt_mul(AADD_WEIGHT(u10), AADD_WEIGHT(mat_low)));
-    u01 = aadd_bundle(AADD_TARGET(u01), wgt_mul(AADD_WEIGHT(u01), AADD_WEIGHT(mat_high)));
-    u11 = aadd_bundle(AADD_TARGET(u11), wgt_mul(AADD_WEIGHT(u11), AADD_WEIGHT(mat_high)));
+    AADD_WGT ws_a[4] = {AADD_WEIGHT(u00), AADD_WEIGHT(u10), AADD_WEIGHT(u01), AADD_WEIGHT(u11)};
+    AADD_WGT ws_b[4] = {AADD_WEIGHT(mat_low), AADD_WEIGHT(mat_low), AADD_WEIGHT(mat_high), AADD_WEIGHT(mat_high)};
+    AADD_WGT ws[4];
+    wgt_mul_batch(ws_a, ws_b, ws, 4);
+    u00 = aadd_bundle(AADD_TARGET(u00), ws[0]);
+    u10 = aadd_bundle(AADD_TARGET(u10), ws[1]);
+    u01 = aadd_bundle(AADD_TARGET(u01), ws[2]);
+    u11 = aadd_bundle(AADD_TARGET(u11), ws[3]);
 
     // 3. recursive calls (4 tasks: SPAWN 3, CALL 1)
     // |u00 u01| |vec_low | = vec_low|u00| + vec_high|u01|
@@ -744,10 +1214,11 @@ TASK_IMPL_4(AADD, aadd_matmat_mult_rec, AADD, a, AADD, b, BDDVAR, nvars, BDDVAR,
 
     // Check cache
     AADD res;
-    bool cachenow = ((nextvar % granularity) == 0);
+    bool cachenow = aadd_cache_level(AADD_ADAPTIVE_MATMAT, nextvar);
     if (cachenow) {
         if (cache_get3(CACHE_AADD_MATMAT_MULT, nextvar, AADD_TARGET(a), AADD_TARGET(b), &res)) {
             sylvan_stats_count(AADD_MULT_CACHED);
+            aadd_cache_level_hit(AADD_ADAPTIVE_MATMAT, nextvar);
             // 7. multiply w/ product of root weights
             AADD_WGT prod = wgt_mul(AADD_WEIGHT(a), AADD_WEIGHT(b));
             AADD_WGT new_weight = wgt_mul(prod, AADD_WEIGHT(res));
@@ -768,14 +1239,20 @@ TASK_IMPL_4(AADD, aadd_matmat_mult_rec, AADD, a, AADD, b, BDDVAR, nvars, BDDVAR,
     aadd_get_topvar(b_high,2*nextvar+1, &var, &b01, &b11);
 
     // 2. propagate "in-between" weights down
-    a00 = aadd_bundle(AADD_TARGET(a00), wgt_mul(AADD_WEIGHT(a_low), AADD_WEIGHT(a00)));
-    a10 = aadd_bundle(AADD_TARGET(a10), wgt_mul(AADD_WEIGHT(a_low), AADD_WEIGHT(a10)));
-    a01 = aadd_bundle(AADD_TARGET(a01), wgt_mul(AADD_WEIGHT(a_high),AADD_WEIGHT(a01)));
-    a11 = aadd_bundle(AADD_TARGET(a11), wgt_mul(AADD_WEIGHT(a_high),AADD_WEIGHT(a11)));
-    b00 = aadd_bundle(AADD_TARGET(b00), wgt_mul(AADD_WEIGHT(b_low), AADD_WEIGHT(b00)));
-    b10 = aadd_bundle(AADD_TARGET(b10), wgt_mul(AADD_WEIGHT(b_low), AADD_WEIGHT(b10)));
-    b01 = aadd_bundle(AADD_TARGET(b01), wgt_mul(AADD_WEIGHT(b_high),AADD_WEIGHT(b01)));
-    b11 = aadd_bundle(AADD_TARGET(b11), wgt_mul(AADD_WEIGHT(b_high),AADD_WEIGHT(b11)));
+    AADD_WGT ws_a[8] = {AADD_WEIGHT(a_low), AADD_WEIGHT(a_low), AADD_WEIGHT(a_high), AADD_WEIGHT(a_high),
+                        AADD_WEIGHT(b_low), AADD_WEIGHT(b_low), AADD_WEIGHT(b_high), AADD_WEIGHT(b_high)};
+    AADD_WGT ws_b[8] = {AADD_WEIGHT(a00), AADD_WEIGHT(a10), AADD_WEIGHT(a01), AADD_WEIGHT(a11),
+                        AADD_WEIGHT(b00), AADD_WEIGHT(b10), AADD_WEIGHT(b01), AADD_WEIGHT(b11)};
+    AADD_WGT ws[8];
+    wgt_mul_batch(ws_a, ws_b, ws, 8);
+    a00 = aadd_bundle(AADD_TARGET(a00), ws[0]);
+    a10 = aadd_bundle(AADD_TARGET(a10), ws[1]);
+    a01 = aadd_bundle(AADD_TARGET(a01), ws[2]);
+    a11 = aadd_bundle(AADD_TARGET(a11), ws[3]);
+    b00 = aadd_bundle(AADD_TARGET(b00), ws[4]);
+    b10 = aadd_bundle(AADD_TARGET(b10), ws[5]);
+    b01 = aadd_bundle(AADD_TARGET(b01), ws[6]);
+    b11 = aadd_bundle(AADD_TARGET(b11), ws[7]);
 
     // 3. recursive calls (8 tasks: SPAWN 7, CALL 1)
     // |a00 a01| |b00 b01| = b00|a00| + b10|a01| , b01|a00| + b11|a01|
@@ -937,23 +1414,200 @@ aadd_unmark_rec(AADD a)
 }
 
 /**
- * Counts nodes in the AADD by marking them.
+ * State of a single call of aadd_count_stats. Instead of marking nodes, the 
+ * visited nodes (and seen edge weights) are kept in bitmaps indexed by node
+ * table slot (and edge weight index). The bitmaps are kept between calls, and
+ * afterwards only the bits which were set are cleared, by traversing the 
+ * counted AADD again.
  */
-static uint64_t
-aadd_nodecount_mark(AADD a)
+typedef struct aadd_count_s {
+    _Atomic(uint64_t) *visited;     // 1 bit per node table slot
+    size_t visited_size;
+    _Atomic(uint64_t) *weights;     // 1 bit per edge weight, or NULL
+    size_t weights_size;
+    _Atomic(uint64_t) *level_nodes; // nodes per var, or NULL
+    BDDVAR nvars;
+    bool shared;                    // bitmaps are those of count_bitmaps
+} *aadd_count_t;
+
+// Bitmaps kept between counts, used by one count at a time (all zero when free)
+static struct aadd_count_s count_bitmaps = {0};
+static _Atomic(bool) count_bitmaps_busy = false;
+
+/* Sets bit i, returns true iff it was not set before */
+static inline bool
+aadd_count_claim(_Atomic(uint64_t) *bitmap, uint64_t i)
 {
-    if (AADD_TARGET(a) == AADD_TERMINAL) return 0; // don't (repeat) count terminal
-    aaddnode_t n = AADD_GETNODE(AADD_TARGET(a));
-    if (aaddnode_getmark(n)) return 0;
-    aaddnode_setmark(n, 1);
-    return 1 + aadd_nodecount_mark(aaddnode_getptrlow(n)) + aadd_nodecount_mark(aaddnode_getptrhigh(n));
+    uint64_t bit = 1ULL << (i & 63);
+    if (atomic_load_explicit(&bitmap[i >> 6], memory_order_relaxed) & bit) return false;
+    return !(atomic_fetch_or_explicit(&bitmap[i >> 6], bit, memory_order_relaxed) & bit);
+}
+
+/* Clears bit i, returns true iff it was set before */
+static inline bool
+aadd_count_release(_Atomic(uint64_t) *bitmap, uint64_t i)
+{
+    uint64_t bit = 1ULL << (i & 63);
+    if (!(atomic_load_explicit(&bitmap[i >> 6], memory_order_relaxed) & bit)) return false;
+    return atomic_fetch_and_explicit(&bitmap[i >> 6], ~bit, memory_order_relaxed) & bit;
+}
+
+/* Counts the edge weight a (if not yet seen) */
+static inline uint64_t
+aadd_count_weight(aadd_count_t c, AADD_WGT a)
+{
+    if (c->weights == NULL) return 0;
+    assert(a < c->weights_size); // see sylvan_edge_weights_index_bound()
+    return aadd_count_claim(c->weights, a) ? 1 : 0;
+}
+
+/**
+ * Counts the unvisited nodes below (and including) t. The number of new edge 
+ * weights on their outgoing edges is added to *weights.
+ */
+TASK_3(uint64_t, aadd_count_rec, AADD_TARG, t, aadd_count_t, c, uint64_t*, weights)
+{
+    if (t == AADD_TERMINAL) return 0; // terminal is counted once by the caller
+    if (!aadd_count_claim(c->visited, t)) return 0;
+
+    aaddnode_t n = AADD_GETNODE(t);
+    BDDVAR var = aaddnode_getvar(n);
+    if (c->level_nodes != NULL && var < c->nvars) {
+        atomic_fetch_add_explicit(&c->level_nodes[var], 1, memory_order_relaxed);
+    }
+
+    AADD low, high;
+    aaddnode_getchilderen(n, &low, &high);
+    uint64_t weights_high = 0, weights_low = 0;
+    if (c->weights != NULL) {
+        weights_low = aadd_count_weight(c, AADD_WEIGHT(low)) + aadd_count_weight(c, AADD_WEIGHT(high));
+    }
+
+    SPAWN(aadd_count_rec, AADD_TARGET(high), c, &weights_high);
+    uint64_t res = CALL(aadd_count_rec, AADD_TARGET(low), c, &weights_low);
+    res += SYNC(aadd_count_rec);
+    *weights += weights_low + weights_high;
+    return res + 1;
+}
+
+/* Clears the bits set by aadd_count_rec for the nodes below (and including) t */
+VOID_TASK_2(aadd_count_clear_rec, AADD_TARG, t, aadd_count_t, c)
+{
+    if (t == AADD_TERMINAL) return;
+    if (!aadd_count_release(c->visited, t)) return;
+
+    aaddnode_t n = AADD_GETNODE(t);
+    if (c->weights != NULL) {
+        AADD low, high;
+        aaddnode_getchilderen(n, &low, &high);
+        aadd_count_release(c->weights, AADD_WEIGHT(low));
+        aadd_count_release(c->weights, AADD_WEIGHT(high));
+    }
+
+    SPAWN(aadd_count_clear_rec, aaddnode_getptrhigh(n), c);
+    CALL(aadd_count_clear_rec, aaddnode_getptrlow(n), c);
+    SYNC(aadd_count_clear_rec);
+}
+
+static _Atomic(uint64_t)*
+aadd_count_bitmap(_Atomic(uint64_t) *old, size_t old_size, size_t size)
+{
+    if (old != NULL) free_aligned(old, (old_size + 63) / 64 * sizeof(uint64_t));
+    _Atomic(uint64_t) *res = alloc_aligned((size + 63) / 64 * sizeof(uint64_t));
+    if (res == NULL) {
+        fprintf(stderr, "aadd_count: Unable to allocate memory!\n");
+        exit(1);
+    }
+    return res;
+}
+
+/* Gets bitmaps for c (c->weights_size > 0 if the weights are counted) */
+static void
+aadd_count_alloc(aadd_count_t c)
+{
+    size_t visited_size = llmsset_get_size(nodes);
+    size_t weights_size = c->weights_size;
+    c->shared = !atomic_exchange(&count_bitmaps_busy, true);
+    if (!c->shared) {
+        // another count is running, use (lazily zeroed) bitmaps of our own
+        c->visited = aadd_count_bitmap(NULL, 0, visited_size);
+        c->visited_size = visited_size;
+        if (weights_size > 0) c->weights = aadd_count_bitmap(NULL, 0, weights_size);
+        return;
+    }
+
+    // the tables may have grown since the last count
+    if (count_bitmaps.visited_size < visited_size) {
+        count_bitmaps.visited = aadd_count_bitmap(count_bitmaps.visited, count_bitmaps.visited_size, visited_size);
+        count_bitmaps.visited_size = visited_size;
+    }
+    if (count_bitmaps.weights_size < weights_size) {
+        count_bitmaps.weights = aadd_count_bitmap(count_bitmaps.weights, count_bitmaps.weights_size, weights_size);
+        count_bitmaps.weights_size = weights_size;
+    }
+    c->visited = count_bitmaps.visited;
+    c->visited_size = count_bitmaps.visited_size;
+    if (weights_size > 0) {
+        c->weights = count_bitmaps.weights;
+        c->weights_size = count_bitmaps.weights_size;
+    }
+}
+
+/* Releases the bitmaps of c, after counting a */
+VOID_TASK_2(aadd_count_free, aadd_count_t, c, AADD, a)
+{
+    if (!c->shared) {
+        free_aligned(c->visited, (c->visited_size + 63) / 64 * sizeof(uint64_t));
+        if (c->weights != NULL) {
+            free_aligned(c->weights, (c->weights_size + 63) / 64 * sizeof(uint64_t));
+        }
+        return;
+    }
+    if (c->weights != NULL) aadd_count_release(c->weights, AADD_WEIGHT(a));
+    CALL(aadd_count_clear_rec, AADD_TARGET(a), c);
+    atomic_store(&count_bitmaps_busy, false);
+}
+
+/* Frees the bitmaps kept between counts */
+static void
+aadd_count_quit()
+{
+    if (count_bitmaps.visited != NULL) {
+        free_aligned(count_bitmaps.visited, (count_bitmaps.visited_size + 63) / 64 * sizeof(uint64_t));
+    }
+    if (count_bitmaps.weights != NULL) {
+        free_aligned(count_bitmaps.weights, (count_bitmaps.weights_size + 63) / 64 * sizeof(uint64_t));
+    }
+    count_bitmaps = (struct aadd_count_s){0};
+}
+
+TASK_IMPL_2(uint64_t, aadd_count_stats, AADD, a, aadd_stats_t*, stats)
+{
+    struct aadd_count_s c = {0};
+    c.weights_size = sylvan_edge_weights_index_bound();
+    if (stats->level_nodes != NULL) {
+        memset(stats->level_nodes, 0, stats->nvars * sizeof(uint64_t));
+        c.level_nodes = (_Atomic(uint64_t)*) stats->level_nodes;
+        c.nvars = stats->nvars;
+    }
+    aadd_count_alloc(&c);
+
+    uint64_t weights = aadd_count_weight(&c, AADD_WEIGHT(a));
+    stats->nodes = CALL(aadd_count_rec, AADD_TARGET(a), &c, &weights) + 1; // (+ 1 for terminal "node")
+    stats->weights = weights;
+
+    CALL(aadd_count_free, &c, a);
+    return stats->nodes;
 }
 
 uint64_t
 aadd_countnodes(AADD a)
 {
-    uint64_t res = aadd_nodecount_mark(a) + 1; // (+ 1 for terminal "node")
-    aadd_unmark_rec(a);
+    struct aadd_count_s c = {0};
+    aadd_count_alloc(&c);
+    uint64_t weights = 0;
+    uint64_t res = RUN(aadd_count_rec, AADD_TARGET(a), &c, &weights) + 1; // (+ 1 for terminal "node")
+    RUN(aadd_count_free, &c, a);
     return res;
 }
 
@@ -1087,6 +1741,438 @@ aadd_fprintdot(FILE *out, AADD a, bool draw_zeros)
     fprintf(out, "}\n");
 }
 
+/**
+ * Small open addressing map from node or edge weight index to an index in 
+ * the file, only used by the (sequential) writer.
+ */
+typedef struct aadd_file_map_s {
+    uint64_t *keys; // key + 1, 0 if empty
+    uint64_t *values;
+    size_t size;
+    size_t count;
+} aadd_file_map_t;
+
+static inline size_t
+aadd_file_map_slot(aadd_file_map_t *m, uint64_t key)
+{
+    size_t i = (key * 0x9E3779B97F4A7C15ULL) >> 20;
+    while (1) {
+        i &= m->size - 1;
+        if (m->keys[i] == 0 || m->keys[i] == key + 1) return i;
+        i++;
+    }
+}
+
+static void
+aadd_file_map_init(aadd_file_map_t *m)
+{
+    m->size = 1024;
+    m->count = 0;
+    m->keys = calloc(m->size, sizeof(uint64_t));
+    m->values = malloc(m->size * sizeof(uint64_t));
+}
+
+static void
+aadd_file_map_free(aadd_file_map_t *m)
+{
+    free(m->keys);
+    free(m->values);
+}
+
+static bool
+aadd_file_map_get(aadd_file_map_t *m, uint64_t key, uint64_t *value)
+{
+    size_t i = aadd_file_map_slot(m, key);
+    if (m->keys[i] == 0) return false;
+    *value = m->values[i];
+    return true;
+}
+
+/* The value of a key which must be in the map */
+static uint64_t
+aadd_file_map_id(aadd_file_map_t *m, uint64_t key)
+{
+    uint64_t value = 0;
+    if (!aadd_file_map_get(m, key, &value)) {
+        fprintf(stderr, "aadd_writer_tobinary: node or weight %" PRIu64 " was not collected!\n", key);
+        exit(1);
+    }
+    return value;
+}
+
+static void
+aadd_file_map_put(aadd_file_map_t *m, uint64_t key, uint64_t value)
+{
+    if (2 * (m->count + 1) > m->size) {
+        aadd_file_map_t old = *m;
+        m->size *= 2;
+        m->count = 0;
+        m->keys = calloc(m->size, sizeof(uint64_t));
+        m->values = malloc(m->size * sizeof(uint64_t));
+        for (size_t i = 0; i < old.size; i++) {
+            if (old.keys[i] != 0) aadd_file_map_put(m, old.keys[i] - 1, old.values[i]);
+        }
+        aadd_file_map_free(&old);
+    }
+    size_t i = aadd_file_map_slot(m, key);
+    if (m->keys[i] == 0) m->count++;
+    m->keys[i] = key + 1;
+    m->values[i] = value;
+}
+
+#define AADD_FILE_MAGIC "AADDBIN1"
+
+typedef struct aadd_file_header_s {
+    char magic[8];
+    uint32_t value_size;
+    uint8_t var_bytes;
+    uint8_t node_bytes;
+    uint8_t wgt_bytes;
+    uint8_t reserved1;
+    uint64_t nodes;
+    uint64_t weights;
+    uint64_t count;
+    uint64_t reserved2; // keeps the weight values 16 byte aligned
+} aadd_file_header_t;
+
+/* Number of bytes needed to store values up to (and including) max */
+static inline uint8_t
+aadd_file_bytes(uint64_t max)
+{
+    uint8_t bytes = 1;
+    while (bytes < 8 && (max >> (8 * bytes)) != 0) bytes++;
+    return bytes;
+}
+
+/* Variable width little endian integers */
+static inline void
+aadd_file_put(uint8_t **p, uint64_t value, uint8_t bytes)
+{
+    for (uint8_t i = 0; i < bytes; i++) (*p)[i] = (uint8_t)(value >> (8 * i));
+    *p += bytes;
+}
+
+static inline uint64_t
+aadd_file_get(const uint8_t **p, uint8_t bytes)
+{
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < bytes; i++) value |= (uint64_t)(*p)[i] << (8 * i);
+    *p += bytes;
+    return value;
+}
+
+typedef struct aadd_writer_s {
+    aadd_file_map_t node_ids;   // node index -> position in nodes (+ 1)
+    aadd_file_map_t wgt_ids;    // edge weight index -> position in wgts
+    AADD_TARG *nodes;
+    size_t n_nodes, nodes_size;
+    AADD_WGT *wgts;
+    size_t n_wgts, wgts_size;
+} aadd_writer_t;
+
+static void
+aadd_writer_add_weight(aadd_writer_t *w, AADD_WGT a)
+{
+    uint64_t id;
+    if (aadd_file_map_get(&w->wgt_ids, a, &id)) return;
+    if (w->n_wgts == w->wgts_size) {
+        w->wgts_size *= 2;
+        w->wgts = realloc(w->wgts, w->wgts_size * sizeof(AADD_WGT));
+    }
+    aadd_file_map_put(&w->wgt_ids, a, w->n_wgts);
+    w->wgts[w->n_wgts++] = a;
+}
+
+static void
+aadd_writer_add_rec(aadd_writer_t *w, AADD_TARG t)
+{
+    uint64_t id;
+    if (t == AADD_TERMINAL || aadd_file_map_get(&w->node_ids, t, &id)) return;
+    if (w->n_nodes == w->nodes_size) {
+        w->nodes_size *= 2;
+        w->nodes = realloc(w->nodes, w->nodes_size * sizeof(AADD_TARG));
+    }
+    aadd_file_map_put(&w->node_ids, t, 0);
+    w->nodes[w->n_nodes++] = t;
+
+    AADD low, high;
+    aaddnode_getchilderen(AADD_GETNODE(t), &low, &high);
+    aadd_writer_add_weight(w, AADD_WEIGHT(low));
+    aadd_writer_add_weight(w, AADD_WEIGHT(high));
+    aadd_writer_add_rec(w, AADD_TARGET(low));
+    aadd_writer_add_rec(w, AADD_TARGET(high));
+}
+
+/* Orders nodes by decreasing variable (children before parents) */
+static int
+aadd_writer_cmp(const void *a, const void *b)
+{
+    BDDVAR va = aaddnode_getvar(AADD_GETNODE(*(const AADD_TARG*)a));
+    BDDVAR vb = aaddnode_getvar(AADD_GETNODE(*(const AADD_TARG*)b));
+    if (va != vb) return (va > vb) ? -1 : 1;
+    AADD_TARG ta = *(const AADD_TARG*)a, tb = *(const AADD_TARG*)b;
+    return (ta > tb) - (ta < tb);
+}
+
+int
+aadd_writer_tobinary(FILE *out, AADD *dds, int count)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return -1; // the header and weight values are written as they are in memory
+#endif
+    aadd_writer_t w;
+    aadd_file_map_init(&w.node_ids);
+    aadd_file_map_init(&w.wgt_ids);
+    w.n_nodes = 0;
+    w.nodes_size = 1024;
+    w.nodes = malloc(w.nodes_size * sizeof(AADD_TARG));
+    w.n_wgts = 0;
+    w.wgts_size = 1024;
+    w.wgts = malloc(w.wgts_size * sizeof(AADD_WGT));
+
+    // collect nodes and weights, and number the nodes level by level
+    for (int i = 0; i < count; i++) {
+        aadd_writer_add_weight(&w, AADD_WEIGHT(dds[i]));
+        aadd_writer_add_rec(&w, AADD_TARGET(dds[i]));
+    }
+    qsort(w.nodes, w.n_nodes, sizeof(AADD_TARG), aadd_writer_cmp);
+    BDDVAR max_var = 0;
+    for (size_t i = 0; i < w.n_nodes; i++) {
+        aadd_file_map_put(&w.node_ids, w.nodes[i], i + 1);
+        BDDVAR var = aaddnode_getvar(AADD_GETNODE(w.nodes[i]));
+        if (var > max_var) max_var = var;
+    }
+    aadd_file_map_put(&w.node_ids, AADD_TERMINAL, 0);
+
+    aadd_file_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, AADD_FILE_MAGIC, 8);
+    h.value_size = sizeof(complex_t);
+    h.var_bytes  = aadd_file_bytes(max_var);
+    h.node_bytes = aadd_file_bytes(w.n_nodes);
+    h.wgt_bytes  = aadd_file_bytes(w.n_wgts);
+    h.nodes = w.n_nodes;
+    h.weights = w.n_wgts;
+    h.count = count;
+    bool ok = fwrite(&h, sizeof(h), 1, out) == 1;
+
+    // edge weight values
+    complex_t c;
+    for (size_t i = 0; i < w.n_wgts && ok; i++) {
+        weight_value(w.wgts[i], &c);
+        ok = fwrite(&c, sizeof(complex_t), 1, out) == 1;
+    }
+
+    // nodes, and the stored AADDs
+    size_t node_size = h.var_bytes + 2 * (h.node_bytes + h.wgt_bytes);
+    uint8_t *buf = malloc(node_size), *p;
+    AADD low, high;
+    for (size_t i = 0; i < w.n_nodes && ok; i++) {
+        aaddnode_t n = AADD_GETNODE(w.nodes[i]);
+        aaddnode_getchilderen(n, &low, &high);
+        p = buf;
+        aadd_file_put(&p, aaddnode_getvar(n), h.var_bytes);
+        aadd_file_put(&p, aadd_file_map_id(&w.node_ids, AADD_TARGET(low)), h.node_bytes);
+        aadd_file_put(&p, aadd_file_map_id(&w.wgt_ids, AADD_WEIGHT(low)), h.wgt_bytes);
+        aadd_file_put(&p, aadd_file_map_id(&w.node_ids, AADD_TARGET(high)), h.node_bytes);
+        aadd_file_put(&p, aadd_file_map_id(&w.wgt_ids, AADD_WEIGHT(high)), h.wgt_bytes);
+        ok = fwrite(buf, node_size, 1, out) == 1;
+    }
+    for (int i = 0; i < count && ok; i++) {
+        p = buf;
+        aadd_file_put(&p, aadd_file_map_id(&w.node_ids, AADD_TARGET(dds[i])), h.node_bytes);
+        aadd_file_put(&p, aadd_file_map_id(&w.wgt_ids, AADD_WEIGHT(dds[i])), h.wgt_bytes);
+        ok = fwrite(buf, h.node_bytes + h.wgt_bytes, 1, out) == 1;
+    }
+
+    free(buf);
+    free(w.nodes);
+    free(w.wgts);
+    aadd_file_map_free(&w.node_ids);
+    aadd_file_map_free(&w.wgt_ids);
+    return ok ? 0 : -1;
+}
+
+/**
+ * Total size of the file described by <h>, or 0 if it is not a valid file 
+ * (including headers of which the size does not fit in a size_t)
+ */
+static size_t
+aadd_file_size(const aadd_file_header_t *h)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return 0; // the header and weight values are little endian
+#endif
+    if (memcmp(h->magic, AADD_FILE_MAGIC, 8) != 0) return 0;
+    if (h->value_size != sizeof(complex_t)) return 0;
+    if (h->var_bytes == 0 || h->var_bytes > 8 || h->node_bytes == 0 || 
+        h->node_bytes > 8 || h->wgt_bytes == 0 || h->wgt_bytes > 8) return 0;
+    size_t node_size = h->var_bytes + 2 * (h->node_bytes + h->wgt_bytes);
+    size_t root_size = h->node_bytes + h->wgt_bytes;
+    size_t size = sizeof(aadd_file_header_t), part;
+    if (__builtin_mul_overflow(h->weights, h->value_size, &part) ||
+        __builtin_add_overflow(size, part, &size)) return 0;
+    if (__builtin_mul_overflow(h->nodes, node_size, &part) ||
+        __builtin_add_overflow(size, part, &size)) return 0;
+    if (__builtin_mul_overflow(h->count, root_size, &part) ||
+        __builtin_add_overflow(size, part, &size)) return 0;
+    return size;
+}
+
+/* The edge <e> with its weight multiplied by <w> */
+static inline AADD
+aadd_reader_edge(AADD e, AADD_WGT w)
+{
+    if (w == AADD_ZERO) return aadd_bundle(AADD_TERMINAL, AADD_ZERO);
+    if (AADD_WEIGHT(e) != AADD_ONE) w = wgt_mul(w, AADD_WEIGHT(e));
+    return aadd_bundle(AADD_TARGET(e), w);
+}
+
+VOID_TASK_3(aadd_reader_weights_par, const uint8_t*, values, AADD_WGT*, wgts, uint64_t, count)
+{
+    if (count < 64) {
+        complex_t c;
+        for (uint64_t i = 0; i < count; i++) {
+            memcpy(&c, values + i * sizeof(complex_t), sizeof(complex_t));
+            wgts[i] = weight_lookup(&c);
+        }
+    } else {
+        SPAWN(aadd_reader_weights_par, values, wgts, count / 2);
+        CALL(aadd_reader_weights_par, values + (count / 2) * sizeof(complex_t), wgts + (count / 2), count - count / 2);
+        SYNC(aadd_reader_weights_par);
+    }
+}
+
+/* Creates nodes first, ..., first + count - 1 (all on the same level) */
+VOID_TASK_5(aadd_reader_nodes_par, const aadd_file_header_t*, h, const uint8_t*, data, AADD_WGT*, wgts, uint64_t, first, uint64_t, count)
+{
+    if (count < 64) {
+        size_t node_size = h->var_bytes + 2 * (h->node_bytes + h->wgt_bytes);
+        const uint8_t *p = data + first * node_size;
+        for (uint64_t i = first; i < first + count; i++) {
+            BDDVAR var = aadd_file_get(&p, h->var_bytes);
+            AADD low = aadd_reader_map[aadd_file_get(&p, h->node_bytes)];
+            low = aadd_reader_edge(low, wgts[aadd_file_get(&p, h->wgt_bytes)]);
+            AADD high = aadd_reader_map[aadd_file_get(&p, h->node_bytes)];
+            high = aadd_reader_edge(high, wgts[aadd_file_get(&p, h->wgt_bytes)]);
+            aadd_reader_map[i + 1] = aadd_makenode(var, low, high);
+        }
+    } else {
+        SPAWN(aadd_reader_nodes_par, h, data, wgts, first, count / 2);
+        CALL(aadd_reader_nodes_par, h, data, wgts, first + count / 2, count - count / 2);
+        SYNC(aadd_reader_nodes_par);
+    }
+}
+
+/**
+ * Reads the AADDs from <data>, the contents of a file of which the header 
+ * (and total size) has already been checked.
+ */
+TASK_4(int, aadd_reader_frommemory, const uint8_t*, data, const aadd_file_header_t*, h, AADD*, dds, int, count)
+{
+    if (h->count != (uint64_t)count) return -1;
+    const uint8_t *values = data + sizeof(aadd_file_header_t);
+    const uint8_t *nodes = values + h->weights * h->value_size;
+    size_t node_size = h->var_bytes + 2 * (h->node_bytes + h->wgt_bytes);
+    const uint8_t *roots = nodes + h->nodes * node_size;
+
+    // check that every node only refers to nodes on deeper levels
+    const uint8_t *p = nodes;
+    uint64_t level_start = 0;
+    BDDVAR level_var = 0;
+    for (uint64_t i = 0; i < h->nodes; i++) {
+        BDDVAR var = aadd_file_get(&p, h->var_bytes);
+        if (var >= AADD_INVALID_VAR || (i > 0 && var > level_var)) return -1;
+        if (i == 0 || var != level_var) level_start = i;
+        level_var = var;
+        for (int k = 0; k < 2; k++) {
+            if (aadd_file_get(&p, h->node_bytes) > level_start) return -1;
+            if (aadd_file_get(&p, h->wgt_bytes) >= h->weights) return -1;
+        }
+    }
+    p = roots;
+    for (int i = 0; i < count; i++) {
+        if (aadd_file_get(&p, h->node_bytes) > h->nodes) return -1;
+        if (aadd_file_get(&p, h->wgt_bytes) >= h->weights) return -1;
+    }
+
+    // edge weights
+    AADD_WGT *wgts = malloc(h->weights * sizeof(AADD_WGT));
+    CALL(aadd_reader_weights_par, values, wgts, h->weights);
+
+    // nodes, level by level
+    aadd_reader_map_size = h->nodes + 1;
+    aadd_reader_map = malloc(aadd_reader_map_size * sizeof(AADD));
+    for (uint64_t i = 0; i < aadd_reader_map_size; i++) {
+        aadd_reader_map[i] = aadd_bundle(AADD_TERMINAL, AADD_ONE);
+    }
+    p = nodes;
+    level_start = 0;
+    for (uint64_t i = 0; i <= h->nodes; i++) {
+        BDDVAR var = (i < h->nodes) ? aadd_file_get(&p, h->var_bytes) : AADD_INVALID_VAR;
+        p += (i < h->nodes) ? node_size - h->var_bytes : 0;
+        if (i > level_start && (i == h->nodes || var != level_var)) {
+            CALL(aadd_reader_nodes_par, h, nodes, wgts, level_start, i - level_start);
+            level_start = i;
+        }
+        level_var = var;
+    }
+
+    p = roots;
+    for (int i = 0; i < count; i++) {
+        AADD root = aadd_reader_map[aadd_file_get(&p, h->node_bytes)];
+        dds[i] = aadd_reader_edge(root, wgts[aadd_file_get(&p, h->wgt_bytes)]);
+    }
+
+    free(aadd_reader_map);
+    aadd_reader_map = NULL;
+    aadd_reader_map_size = 0;
+    free(wgts);
+    return 0;
+}
+
+TASK_IMPL_3(int, aadd_reader_frombinary, FILE*, in, AADD*, dds, int, count)
+{
+    aadd_file_header_t h;
+    if (fread(&h, sizeof(h), 1, in) != 1) return -1;
+    size_t size = aadd_file_size(&h);
+    if (size == 0) return -1;
+
+    uint8_t *data = malloc(size);
+    if (data == NULL) return -1;
+    memcpy(data, &h, sizeof(h));
+    int res = -1;
+    if (fread(data + sizeof(h), size - sizeof(h), 1, in) == 1 || size == sizeof(h)) {
+        res = CALL(aadd_reader_frommemory, data, &h, dds, count);
+    }
+    free(data);
+    return res;
+}
+
+TASK_IMPL_3(int, aadd_reader_frommmap, const char*, filename, AADD*, dds, int, count)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(aadd_file_header_t)) {
+        close(fd);
+        return -1;
+    }
+    uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    int res = -1;
+    const aadd_file_header_t *h = (const aadd_file_header_t*)data;
+    size_t size = aadd_file_size(h);
+    if (size != 0 && size <= (size_t)st.st_size) {
+        res = CALL(aadd_reader_frommemory, data, h, dds, count);
+    }
+    munmap(data, st.st_size);
+    return res;
+}
+
 /**************************</Printing & file writing>**************************/
 
 
@@ -14,7 +14,7 @@ typedef uint64_t AADD_WGT;  // Edge weight
 typedef uint64_t AADD_TARG; // Edge target
 
 static const AADD_TARG  AADD_TERMINAL = 1;
-static const BDDVAR     AADD_INVALID_VAR = UINT8_MAX;
+static const BDDVAR     AADD_INVALID_VAR = 0xfffff; // max of 20 bit var field
 
 typedef enum weight_norm_strategy {
     NORM_LOW,
@@ -94,6 +94,61 @@ double aadd_get_gc_wgt_table_thres();
 void aadd_gc_wgt_table();
 bool aadd_test_gc_wgt_table();
 
+/**
+ * Disabled by default. When enabled, gc of the edge weight table translates the
+ * operation cache to the new edge weight (and node) indices instead of clearing
+ * it. Entries containing weights or nodes which didn't survive are dropped.
+ */
+void aadd_set_gc_wgt_table_keep_cache(bool enabled);
+
+/**
+ * Disabled by default. When enabled (and supported by the edge weight storage
+ * backend), gc of the edge weight table marks the weights which are still in
+ * use (in protected AADDs or in the node table) and deletes the others in 
+ * place, instead of copying the live weights to a new table. Indices of live
+ * weights don't change, so nodes are not rebuilt and only cache entries with
+ * deleted weights are dropped. This first runs sylvan_gc() to remove unused 
+ * nodes from the node table, since their weights can't be freed otherwise.
+ */
+void aadd_set_gc_wgt_table_inplace(bool enabled);
+
+/**
+ * Callback for translating cache entries of operations defined outside of the
+ * AADD layer (e.g. QMDD gates) after gc of the edge weight table. Should return
+ * false if the entry can't be translated and needs to be dropped.
+ */
+typedef bool (*aadd_cache_remap_cb)(uint64_t opid, uint64_t *a, uint64_t *b, uint64_t *c, uint64_t *res);
+void aadd_set_gc_wgt_table_cache_remap(aadd_cache_remap_cb cb);
+
+/**
+ * Callback for keeping edge weights which are used outside of any AADD (e.g. 
+ * in gate matrices) during gc of the edge weight table. It is called before 
+ * unused weights are deleted, and should pass every such weight through 
+ * aadd_gc_keep_weight(), which keeps it and returns its new index.
+ */
+typedef void (*aadd_gc_keep_hook_cb)();
+void aadd_set_gc_wgt_table_keep_hook(aadd_gc_keep_hook_cb cb);
+AADD_WGT aadd_gc_keep_weight(AADD_WGT a);
+
+/**
+ * Translate an old edge/node/weight to its index after gc of the edge weight
+ * table. Returns false if it didn't survive. (Only valid during the gc.)
+ */
+bool aadd_gc_remap_edge(AADD *a);
+bool aadd_gc_remap_target(AADD_TARG *t);
+bool aadd_gc_remap_weight(AADD_WGT *a);
+
+/**
+ * The remap functions above are also used when the operation cache is kept
+ * during gc of the node table (sylvan_gc_set_keep_cache). Then nodes and weights
+ * keep their index, and the functions only check if the nodes survived. 
+ * aadd_gc_is_node_gc() tells which of the two gcs is running, and 
+ * aadd_gc_check_cache_entry() can be set (with cache_set_check) as the check
+ * of operations handled by the aadd_cache_remap_cb callback.
+ */
+bool aadd_gc_is_node_gc();
+int aadd_gc_check_cache_entry(uint64_t a, uint64_t b, uint64_t c, uint64_t res);
+
 /**
  * Recursive function for moving weights from old to new edge weight table.
  */
@@ -123,6 +178,21 @@ void sylvan_init_aadd(size_t wgt_tab_size, double wgt_tab_tolerance, int edge_we
 void sylvan_init_aadd_defaults(size_t wgt_tab_size);
 void aadd_set_caching_granularity(int granularity);
 
+/**
+ * Adaptive caching: track the operation cache hit rate of aadd_plus and the
+ * matrix multiplications per variable level, and stop caching at levels that
+ * (currently) do not get hits. Disabled by default. Applies on top of the
+ * caching granularity.
+ */
+void aadd_set_adaptive_caching(bool enabled);
+
+/**
+ * Number of times (summed over all workers and levels) that adaptive caching
+ * switched caching at a level off, and back on again, since it was last
+ * enabled with aadd_set_adaptive_caching. Either pointer can be NULL.
+ */
+void aadd_get_adaptive_caching_switches(uint64_t *off, uint64_t *on);
+
 /*****************************</Initialization>********************************/
 
 
@@ -216,6 +286,25 @@ AADD aadd_tensor_prod(AADD a, AADD b, BDDVAR nvars_a);
  */
 uint64_t aadd_countnodes(AADD a);
 
+/**
+ * Statistics of an AADD (see aadd_count_stats).
+ */
+typedef struct aadd_stats {
+    uint64_t nodes;         // number of nodes (incl. terminal), as aadd_countnodes
+    uint64_t weights;       // number of distinct edge weights (incl. root edge)
+    BDDVAR nvars;           // number of entries of level_nodes
+    uint64_t *level_nodes;  // if not NULL, level_nodes[k] = #nodes with var k
+} aadd_stats_t;
+
+/**
+ * Counts the nodes, the distinct edge weights and (if stats->level_nodes is
+ * given) the nodes per variable of 'a' in a single parallel traversal. Nodes
+ * are not marked, so this can run concurrently with other readers of 'a'.
+ * Returns the number of nodes.
+ */
+#define aadd_count_stats(a,stats) (RUN(aadd_count_stats,a,stats))
+TASK_DECL_2(uint64_t, aadd_count_stats, AADD, aadd_stats_t*);
+
 /**************************</AADD utility functions>***************************/
 
 
@@ -229,6 +318,43 @@ uint64_t aadd_countnodes(AADD a);
  */
 void aadd_fprintdot(FILE *out, AADD a, bool draw_zeros);
 
+/**
+ * Writing AADDs to file (e.g. to checkpoint a simulation).
+ *
+ * The binary format stores the nodes of all given AADDs once, ordered by 
+ * decreasing variable, such that children come before their parents, and 
+ * the values of all edge weights used once. All indices are stored with the 
+ * least number of bytes needed. The format is little endian (weight values 
+ * are IEEE 754 doubles); on big endian hosts reading and writing fail. It is
+ * 
+ * header (48 bytes):  "AADDBIN1", size of a weight value, bytes per var, 
+ *                     node index and weight index, number of nodes, weights
+ *                     and stored AADDs, reserved
+ * <weights> times:    weight value
+ * <nodes> times:      var, low node, low weight, high node, high weight
+ * <count> times:      node, weight
+ * 
+ * with node 0 the terminal and nodes 1, 2, ... the nodes in the file.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int aadd_writer_tobinary(FILE *out, AADD *dds, int count);
+
+/**
+ * Read <count> AADDs to <dds> from <in>, as written by aadd_writer_tobinary.
+ * The nodes are created level by level, in parallel. The edge weights are 
+ * normalized again, so the file can be read with any normalization strategy.
+ * Returns 0 if successful, -1 otherwise.
+ */
+TASK_DECL_3(int, aadd_reader_frombinary, FILE*, AADD*, int);
+#define aadd_reader_frombinary(in, dds, count) RUN(aadd_reader_frombinary, in, dds, count)
+
+/**
+ * Same as aadd_reader_frombinary, but maps the file with the given name into 
+ * memory instead of reading it.
+ */
+TASK_DECL_3(int, aadd_reader_frommmap, const char*, AADD*, int);
+#define aadd_reader_frommmap(filename, dds, count) RUN(aadd_reader_frommmap, filename, dds, count)
+
 /*************************</Printing & file writing>***************************/
 
 
@@ -35,11 +35,12 @@ extern AADD_WGT (*normalize_weights)(AADD_WGT *, AADD_WGT *);
  * 
  * 64 bits low:
  *       1 bit:  marked/unmarked flag (same place as MTBDD)
- *       8 bits: variable/qubit number of this node
+ *      20 bits: variable/qubit number of this node
  *       1 bit:  if 0 (1) normalized WGT is on low (high)
  *       1 bit:  if 0 (1) normalized WGT is AADD_ZERO (AADD_ONE)
- *      13 bits: unused
- *      30 bits: low edge pointer to next node (AADD_TARG)
+ *       1 bit:  unused
+ *      40 bits: low edge pointer to next node (AADD_TARG, 30 bits if 
+ *               larger_wgt_indices)
  * 64 bits high:
  *       1 bit:  marked/unmarked flag (same place as MTBDD)
  *      33 bits: index of edge weight of high edge in ctable (AADD_WGT)
@@ -50,9 +51,9 @@ typedef struct __attribute__((packed)) aaddnode {
 } *aaddnode_t; // 16 bytes // TODO: move to sylvan_aadd_int.h
 
 static const AADD aadd_marked_mask  = 0x8000000000000000LL;
-static const AADD aadd_var_mask_low = 0x7f80000000000000LL;
-static const AADD aadd_wgt_pos_mask = 0x0040000000000000LL;
-static const AADD aadd_wgt_val_mask = 0x0020000000000000LL;
+static const AADD aadd_var_mask_low = 0x7ffff80000000000LL;
+static const AADD aadd_wgt_pos_mask = 0x0000040000000000LL;
+static const AADD aadd_wgt_val_mask = 0x0000020000000000LL;
 static const AADD aadd_wgt_mask_23  = 0x7fffff0000000000LL;
 static const AADD aadd_wgt_mask_33  = 0x7fffffffc0000000LL;
 static const AADD aadd_ptr_mask_30  = 0x000000003fffffffLL;
@@ -93,7 +94,7 @@ AADD_TARGET(AADD a)
 static inline BDDVAR
 aaddnode_getvar(aaddnode_t n)
 {
-    return (BDDVAR) ((n->low & aadd_var_mask_low) >> 55 ); // 8 bits
+    return (BDDVAR) ((n->low & aadd_var_mask_low) >> 43 ); // 20 bits
 }
 
 /**
@@ -165,8 +166,8 @@ aaddnode_unpack(aaddnode_t n, AADD_TARG *low, AADD_TARG *high, AADD_WGT *a, AADD
 {
     *low  = aaddnode_getptrlow(n);
     *high = aaddnode_getptrhigh(n);
-    bool norm_pos = (n->low & aadd_wgt_pos_mask) >> 54;
-    bool norm_val = (n->low & aadd_wgt_val_mask) >> 53;
+    bool norm_pos = (n->low & aadd_wgt_pos_mask) >> 42;
+    bool norm_val = (n->low & aadd_wgt_val_mask) >> 41;
 
     if (weight_norm_strat == NORM_L2) {
         *b = AADD_WEIGHT(n->high);
@@ -233,7 +234,8 @@ aaddnode_pack(aaddnode_t n, BDDVAR var, AADD_TARG low, AADD_TARG high, AADD_WGT
     }
 
     // organize the bit structure of low and high
-    n->low  = ((uint64_t)var)<<55 | ((uint64_t)norm_pos)<<54 | ((uint64_t)norm_val)<<53 | low;
+    assert(var < AADD_INVALID_VAR);
+    n->low  = ((uint64_t)var)<<43 | ((uint64_t)norm_pos)<<42 | ((uint64_t)norm_val)<<41 | low;
     if (larger_wgt_indices) {
         n->high = wgt_high<<30 | high;
     }
@@ -0,0 +1,346 @@
+/*
+ * Copyright 2011-2016 Formal Methods and Tools, University of Twente
+ * Copyright 2016-2017 Tom van Dijk, Johannes Kepler University Linz
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sylvan_int.h>
+#include <sylvan_align.h>
+
+#include <errno.h>  // for errno
+#include <string.h> // for strerror
+
+#if SYLVAN_USE_MMAP
+#include <sys/mman.h> // for mmap, madvise
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h> // for SYS_mbind
+#endif
+
+static sylvan_hugepages_t hugepages_mode = SYLVAN_HUGEPAGES_NONE;
+static sylvan_numa_t numa_mode = SYLVAN_NUMA_DEFAULT;
+
+void
+sylvan_set_hugepages(sylvan_hugepages_t mode)
+{
+    hugepages_mode = mode;
+}
+
+void
+sylvan_set_numa(sylvan_numa_t mode)
+{
+    numa_mode = mode;
+}
+
+static const char *numa_names[] = {"default", "interleaved", "first touch"};
+
+#if SYLVAN_USE_MMAP
+
+/**
+ * The allocated tables, with how they were mapped (for clear_table, free_table
+ * and sylvan_alloc_report)
+ */
+#define ALLOC_MAX_TABLES 256
+
+typedef struct alloc_entry
+{
+    char *ptr;
+    size_t size;        // size of the mapping
+    const char *name;
+    int prefault;       // the owner places the pages with prefault_table
+    int hugetlb;        // mapped with MAP_HUGETLB
+    int thp;            // madvise(MADV_HUGEPAGE) succeeded
+    sylvan_numa_t numa; // placement that was applied
+} alloc_entry_t;
+
+static alloc_entry_t alloc_entries[ALLOC_MAX_TABLES];
+static int alloc_count = 0;
+static pthread_mutex_t alloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The default huge page size, from /proc/meminfo (2 MB if unknown)
+ */
+static size_t
+alloc_hugepage_size(void)
+{
+    static size_t hugepage_size = 0;
+    if (hugepage_size != 0) return hugepage_size;
+    size_t kb = 2048;
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (f != NULL) {
+        char line[256];
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1) break;
+        }
+        fclose(f);
+    }
+    hugepage_size = kb * 1024;
+    return hugepage_size;
+}
+
+/**
+ * Interleave the pages of [ptr, ptr+size) over all online NUMA nodes (at most 64).
+ * Returns 0 if there is only one node or the policy could not be set.
+ */
+static int
+alloc_interleave(void *ptr, size_t size)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask = 0;
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if (f == NULL) return 0;
+    unsigned int from, to;
+    char sep;
+    for (;;) {
+        int n = fscanf(f, "%u%c", &from, &sep);
+        if (n < 1) break;
+        to = from;
+        if (n == 2 && sep == '-') {
+            n = fscanf(f, "%u%c", &to, &sep);
+            if (n < 1) break;
+        }
+        for (unsigned int k = from; k <= to && k < 64; k++) mask |= 1UL << k;
+        if (n < 2 || sep != ',') break;
+    }
+    fclose(f);
+    if (__builtin_popcountl(mask) < 2) return 0;
+    const int mpol_interleave = 3; // MPOL_INTERLEAVE in linux/mempolicy.h
+    return syscall(SYS_mbind, ptr, size, mpol_interleave, &mask, 8*sizeof(mask)+1, 0) == 0;
+#else
+    (void)ptr;
+    (void)size;
+    return 0;
+#endif
+}
+
+static void*
+alloc_map(void *addr, size_t size, int hugetlb)
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (addr != NULL) flags |= MAP_FIXED;
+#ifdef MAP_HUGETLB
+    if (hugetlb) flags |= MAP_HUGETLB;
+#else
+    if (hugetlb) return NULL;
+#endif
+    void *res = mmap(addr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return res == MAP_FAILED ? NULL : res;
+}
+
+/**
+ * Set the page size and NUMA policy of a (new) mapping, before it is touched
+ */
+static void
+alloc_apply(alloc_entry_t *e)
+{
+    e->thp = 0;
+#ifdef MADV_HUGEPAGE
+    if (!e->hugetlb && hugepages_mode != SYLVAN_HUGEPAGES_NONE) {
+        e->thp = madvise(e->ptr, e->size, MADV_HUGEPAGE) == 0;
+    }
+#endif
+    e->numa = SYLVAN_NUMA_DEFAULT;
+    if (numa_mode == SYLVAN_NUMA_FIRST_TOUCH && e->prefault) {
+        e->numa = SYLVAN_NUMA_FIRST_TOUCH;
+    } else if (numa_mode != SYLVAN_NUMA_DEFAULT) {
+        // tables which are initialized by one thread are interleaved instead
+        if (alloc_interleave(e->ptr, e->size)) e->numa = SYLVAN_NUMA_INTERLEAVE;
+    }
+}
+
+static alloc_entry_t*
+alloc_find(void *ptr)
+{
+    for (int i=0; i<alloc_count; i++) {
+        if (alloc_entries[i].ptr == ptr) return &alloc_entries[i];
+    }
+    return NULL;
+}
+
+#endif
+
+void*
+alloc_table(size_t size, const char *name, int prefault)
+{
+#if SYLVAN_USE_MMAP
+    alloc_entry_t e;
+    memset(&e, 0, sizeof(e));
+    e.name = name;
+    e.prefault = prefault;
+    if (hugepages_mode != SYLVAN_HUGEPAGES_NONE) {
+        size_t hp = alloc_hugepage_size();
+        e.size = (size + hp - 1) & ~(hp - 1);
+        if (hugepages_mode == SYLVAN_HUGEPAGES_HUGETLB) {
+            e.ptr = (char*)alloc_map(NULL, e.size, 1);
+            e.hugetlb = e.ptr != NULL;
+        }
+        if (e.ptr == NULL) {
+            // align the mapping to the huge page size, such that all of it can use huge pages
+            char *p = (char*)alloc_map(NULL, e.size + hp, 0);
+            if (p == NULL) return 0;
+            e.ptr = (char*)(((uintptr_t)p + hp - 1) & ~(uintptr_t)(hp - 1));
+            if (e.ptr != p) munmap(p, e.ptr - p);
+            munmap(e.ptr + e.size, p + hp - e.ptr);
+        }
+    } else {
+        e.size = (size + LINE_SIZE - 1) & (~(LINE_SIZE - 1));
+        e.ptr = (char*)alloc_map(NULL, e.size, 0);
+        if (e.ptr == NULL) return 0;
+    }
+    alloc_apply(&e);
+
+    pthread_mutex_lock(&alloc_mutex);
+    if (alloc_count == ALLOC_MAX_TABLES) {
+        fprintf(stderr, "alloc_table: Too many tables!\n");
+        exit(1);
+    }
+    alloc_entries[alloc_count++] = e;
+    pthread_mutex_unlock(&alloc_mutex);
+    return e.ptr;
+#else
+    (void)name;
+    (void)prefault;
+    return alloc_aligned(size);
+#endif
+}
+
+void
+free_table(void *ptr, size_t size)
+{
+#if SYLVAN_USE_MMAP
+    pthread_mutex_lock(&alloc_mutex);
+    alloc_entry_t *e = alloc_find(ptr);
+    if (e != NULL) {
+        size = e->size;
+        *e = alloc_entries[--alloc_count];
+    }
+    pthread_mutex_unlock(&alloc_mutex);
+    munmap(ptr, size);
+#else
+    free_aligned(ptr, size);
+#endif
+}
+
+void
+clear_table(void *ptr, size_t size)
+{
+#if SYLVAN_USE_MMAP
+    pthread_mutex_lock(&alloc_mutex);
+    alloc_entry_t *e = alloc_find(ptr);
+    pthread_mutex_unlock(&alloc_mutex);
+    if (e == NULL) {
+        clear_aligned(ptr, size);
+        return;
+    }
+    // get fresh zeroed pages (like clear_aligned), then set page size and placement again
+    if (alloc_map(e->ptr, e->size, e->hugetlb) == NULL) {
+        if (!e->hugetlb || alloc_map(e->ptr, e->size, 0) == NULL) {
+            memset(ptr, 0, size);
+            return;
+        }
+        e->hugetlb = 0;
+    }
+    alloc_apply(e);
+#else
+    clear_aligned(ptr, size);
+#endif
+}
+
+#if SYLVAN_USE_MMAP
+VOID_TASK_2(prefault_table_part, char*, ptr, size_t, used)
+{
+    // every worker touches its own part, aligned to pages
+    size_t page = hugepages_mode != SYLVAN_HUGEPAGES_NONE ? alloc_hugepage_size() : 4096;
+    size_t workers = lace_workers();
+    size_t id = lace_get_worker()->worker;
+    size_t first = (used / workers * id) & ~(page - 1);
+    size_t last = id + 1 == workers ? used : (used / workers * (id + 1)) & ~(page - 1);
+    for (size_t i = first; i < last; i += page) ((volatile char*)ptr)[i] = 0;
+}
+
+#endif
+
+VOID_TASK_IMPL_2(prefault_table, void*, ptr, size_t, used)
+{
+#if SYLVAN_USE_MMAP
+    if (numa_mode != SYLVAN_NUMA_FIRST_TOUCH || ptr == NULL) return;
+    TOGETHER(prefault_table_part, (char*)ptr, used);
+#else
+    // without mmap, alloc_table already touched all memory
+    (void)ptr;
+    (void)used;
+#endif
+}
+
+#if SYLVAN_USE_MMAP
+/**
+ * Read the page size, resident memory and resident memory in huge pages of
+ * [ptr, ptr+size) from /proc/self/smaps (in kB). Adjacent mappings are merged
+ * by the kernel, so the numbers of a mapping which is only partially inside
+ * the table are scaled by the overlap.
+ */
+static void
+alloc_smaps(char *ptr, size_t size, size_t *page_kb, size_t *rss_kb, size_t *huge_kb)
+{
+    *page_kb = *rss_kb = *huge_kb = 0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (f == NULL) return;
+    char line[512];
+    double part = 0; // fraction of the current mapping inside the table
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long start, end;
+        size_t kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            char *lo = (char*)start > ptr ? (char*)start : ptr;
+            char *hi = (char*)end < ptr + size ? (char*)end : ptr + size;
+            part = hi > lo ? (double)(hi - lo) / (end - start) : 0;
+        } else if (part == 0) {
+            continue;
+        } else if (sscanf(line, "KernelPageSize: %zu kB", &kb) == 1) {
+            if (*page_kb == 0) *page_kb = kb;
+        } else if (sscanf(line, "Rss: %zu kB", &kb) == 1) {
+            *rss_kb += kb * part;
+        } else if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+            *huge_kb += kb * part;
+        } else if (sscanf(line, "Private_Hugetlb: %zu kB", &kb) == 1 ||
+                   sscanf(line, "Shared_Hugetlb: %zu kB", &kb) == 1) {
+            // hugetlb pages are not counted in Rss
+            *rss_kb += kb * part;
+            *huge_kb += kb * part;
+        }
+    }
+    fclose(f);
+}
+#endif
+
+void
+sylvan_alloc_report(FILE *target)
+{
+#if SYLVAN_USE_MMAP
+    pthread_mutex_lock(&alloc_mutex);
+    for (int i=0; i<alloc_count; i++) {
+        alloc_entry_t *e = &alloc_entries[i];
+        size_t page_kb, rss_kb, huge_kb;
+        alloc_smaps(e->ptr, e->size, &page_kb, &rss_kb, &huge_kb);
+        fprintf(target, "%-24s %zu MB, %zu kB pages%s, %zu MB resident (%zu MB in huge pages), NUMA %s\n",
+                e->name, e->size >> 20, page_kb, e->hugetlb ? " (hugetlb)" : e->thp ? " (THP)" : "",
+                rss_kb >> 10, huge_kb >> 10, numa_names[e->numa]);
+    }
+    pthread_mutex_unlock(&alloc_mutex);
+#else
+    (void)numa_names;
+    fprintf(target, "Tables are allocated with malloc (SYLVAN_USE_MMAP is off)\n");
+#endif
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2011-2016 Formal Methods and Tools, University of Twente
+ * Copyright 2016-2017 Tom van Dijk, Johannes Kepler University Linz
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Do not include this file directly. Instead, include sylvan.h */
+
+#ifndef SYLVAN_ALLOC_H
+#define SYLVAN_ALLOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Allocation of the large tables (nodes table, operation cache, edge weight table)
+ *
+ * Random probes into tables of several GB are dominated by TLB misses, and on
+ * multi-socket machines by accesses to the memory of the other socket. Both the
+ * page size and the NUMA placement of these tables can be configured, before
+ * sylvan_init_package (and before creating the edge weight table):
+ *   sylvan_set_hugepages(SYLVAN_HUGEPAGES_HUGETLB);
+ *   sylvan_set_numa(SYLVAN_NUMA_FIRST_TOUCH);
+ * Both settings need SYLVAN_USE_MMAP (and Linux), otherwise they are ignored.
+ * Use sylvan_alloc_report to see which page size the tables actually got.
+ */
+typedef enum sylvan_hugepages {
+    SYLVAN_HUGEPAGES_NONE,    // normal pages (default)
+    SYLVAN_HUGEPAGES_THP,     // ask for transparent huge pages with madvise
+    SYLVAN_HUGEPAGES_HUGETLB, // reserved huge pages (MAP_HUGETLB), else THP
+} sylvan_hugepages_t;
+
+typedef enum sylvan_numa {
+    SYLVAN_NUMA_DEFAULT,      // the policy of the process (default)
+    SYLVAN_NUMA_INTERLEAVE,   // pages interleaved over all NUMA nodes
+    SYLVAN_NUMA_FIRST_TOUCH,  // every Lace worker touches an equal part first
+} sylvan_numa_t;
+
+void sylvan_set_hugepages(sylvan_hugepages_t mode);
+void sylvan_set_numa(sylvan_numa_t mode);
+
+/**
+ * Print the size, page size (and how much of it is resident in transparent
+ * huge pages) and NUMA placement of the allocated tables.
+ */
+void sylvan_alloc_report(FILE *target);
+
+/**
+ * Allocate a zeroed table of <size> bytes with the configured page size and
+ * NUMA placement. With <prefault> set, the caller places the pages by calling
+ * prefault_table; otherwise first-touch placement falls back to interleaving.
+ * Returns 0 if no memory could be allocated.
+ */
+void *alloc_table(size_t size, const char *name, int prefault);
+
+/* Free a table allocated with alloc_table */
+void free_table(void *ptr, size_t size);
+
+/* Zero a table allocated with alloc_table (keeping its page size and placement) */
+void clear_table(void *ptr, size_t size);
+
+/**
+ * First-touch placement: all Lace workers touch an equal part of the first
+ * <used> bytes of the (zeroed) table. Does nothing for other NUMA modes.
+ */
+VOID_TASK_DECL_2(prefault_table, void*, size_t);
+#define prefault_table(ptr, used) RUN(prefault_table, ptr, used)
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -62,6 +62,33 @@ static uint32_t*          cache_status;
 
 static _Atomic(uint64_t)  next_opid;
 
+/**
+ * Cache segments. Operations can be given their own (direct-mapped) part of the
+ * cache, such that they don't compete with other operations for buckets. Each
+ * segment has its own replacement policy. Segment 0 is the main table above.
+ */
+typedef struct cache_segment {
+    cache_entry_t       table;
+    uint32_t*           status;
+    size_t              size;   // power of 2
+    cache_policy_t      policy;
+} cache_segment_t;
+
+static cache_segment_t    cache_segments[CACHE_MAX_SEGMENTS];
+static int                cache_num_segments = 1;
+static uint8_t            cache_opid_segment[CACHE_STATS_OPIDS]; // 0 = main table
+
+/* Per operation checks for cache_sweep (NULL = use the default check) */
+static cache_check_cb     cache_opid_check[CACHE_STATS_OPIDS];
+
+/* Index of the operation of key 'a' (ignoring the complement bit of BDDs) */
+static inline size_t
+cache_opid_index(uint64_t a)
+{
+    uint64_t op = (a >> 40) & 0x7fffff;
+    return op < CACHE_STATS_OPIDS ? op : CACHE_STATS_OPIDS-1;
+}
+
 uint64_t
 cache_next_opid()
 {
@@ -166,45 +193,76 @@ int
 cache_get(uint64_t a, uint64_t b, uint64_t c, uint64_t *res)
 {
     const uint64_t hash = cache_hash(a, b, c);
+    const size_t op = cache_opid_index(a);
+    _Atomic(uint32_t) *s_bucket;
+    cache_entry_t bucket;
+    const int seg = cache_opid_segment[op];
+    if (seg == 0) {
 #if CACHE_MASK
-    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + (hash & cache_mask);
-    cache_entry_t bucket = cache_table + (hash & cache_mask);
+        s_bucket = (_Atomic(uint32_t)*)cache_status + (hash & cache_mask);
+        bucket = cache_table + (hash & cache_mask);
 #else
-    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + (hash % cache_size);
-    cache_entry_t bucket = cache_table + (hash % cache_size);
+        s_bucket = (_Atomic(uint32_t)*)cache_status + (hash % cache_size);
+        bucket = cache_table + (hash % cache_size);
 #endif
+    } else {
+        const size_t idx = hash & (cache_segments[seg].size - 1);
+        s_bucket = (_Atomic(uint32_t)*)cache_segments[seg].status + idx;
+        bucket = cache_segments[seg].table + idx;
+    }
     const uint32_t s = atomic_load_explicit(s_bucket, memory_order_relaxed);
-    // abort if locked or if part of a 2-part cache entry
-    if (s & 0xc0000000) return 0;
-    // abort if different hash
-    if ((s ^ (hash>>32)) & 0x3fff0000) return 0;
-    // abort if key different
-    if (bucket->a != a || bucket->b != b || bucket->c != c) return 0;
+    // abort if locked or if part of a 2-part cache entry, if different hash or
+    // if key different
+    if ((s & 0xc0000000) || ((s ^ (hash>>32)) & 0x3fff0000) ||
+        bucket->a != a || bucket->b != b || bucket->c != c) {
+        sylvan_stats_count_cache(op, CACHE_STATS_MISS);
+        return 0;
+    }
     *res = bucket->res;
     // abort if status field changed after compiler_barrier()
-    return atomic_load_explicit(s_bucket, memory_order_acquire) == s ? 1 : 0;
+    if (atomic_load_explicit(s_bucket, memory_order_acquire) != s) {
+        sylvan_stats_count_cache(op, CACHE_STATS_MISS);
+        return 0;
+    }
+    sylvan_stats_count_cache(op, CACHE_STATS_HIT);
+    return 1;
 }
 
 int
 cache_put(uint64_t a, uint64_t b, uint64_t c, uint64_t res)
 {
     const uint64_t hash = cache_hash(a, b, c);
+    const int seg = cache_opid_segment[cache_opid_index(a)];
+    _Atomic(uint32_t) *s_bucket;
+    cache_entry_t bucket;
+    if (seg == 0) {
 #if CACHE_MASK
-    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + (hash & cache_mask);
-    cache_entry_t bucket = cache_table + (hash & cache_mask);
+        s_bucket = (_Atomic(uint32_t)*)cache_status + (hash & cache_mask);
+        bucket = cache_table + (hash & cache_mask);
 #else
-    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + (hash % cache_size);
-    cache_entry_t bucket = cache_table + (hash % cache_size);
+        s_bucket = (_Atomic(uint32_t)*)cache_status + (hash % cache_size);
+        bucket = cache_table + (hash % cache_size);
 #endif
+    } else {
+        const size_t idx = hash & (cache_segments[seg].size - 1);
+        s_bucket = (_Atomic(uint32_t)*)cache_segments[seg].status + idx;
+        bucket = cache_segments[seg].table + idx;
+    }
     uint32_t s = atomic_load_explicit(s_bucket, memory_order_relaxed);
     // abort if locked
     if (s & 0x80000000) return 0;
+    // abort if the segment only fills empty buckets
+    if (s != 0 && seg != 0 && cache_segments[seg].policy == CACHE_POLICY_KEEP) return 0;
     // abort if hash identical -> no: in iscasmc this occasionally causes timeouts?!
     const uint32_t hash_mask = (hash>>32) & 0x3fff0000;
     // if ((s & 0x7fff0000) == hash_mask) return 0;
     // use cas to claim bucket
     const uint32_t new_s = ((s+1) & 0x0000ffff) | hash_mask;
     if (!atomic_compare_exchange_weak(s_bucket, &s, new_s | 0x80000000)) return 0;
+    // count evicted entry (against the operation it belonged to)
+    if (s != 0 && !(s & 0x40000000)) {
+        sylvan_stats_count_cache(cache_opid_index(bucket->a), CACHE_STATS_OVERWRITE);
+    }
     // cas succesful: write data
     bucket->a = a;
     bucket->b = b;
@@ -237,37 +295,225 @@ cache_create(size_t _cache_size, size_t _max_size)
         exit(1);
     }
 
-    cache_table = (cache_entry_t)alloc_aligned(cache_max * sizeof(struct cache_entry));
-    cache_status = (uint32_t*)alloc_aligned(cache_max * sizeof(uint32_t));
+    cache_table = (cache_entry_t)alloc_table(cache_max * sizeof(struct cache_entry), "operation cache", 1);
+    cache_status = (uint32_t*)alloc_table(cache_max * sizeof(uint32_t), "operation cache (status)", 1);
     if (cache_table == 0 || cache_status == 0) {
         fprintf(stderr, "cache_create: Unable to allocate memory: %s!\n", strerror(errno));
         exit(1);
     }
+    prefault_table(cache_table, cache_size * sizeof(struct cache_entry));
+    prefault_table(cache_status, cache_size * sizeof(uint32_t));
 
     next_opid = 512LL << 40;
 }
 
+static void
+cache_free_main()
+{
+    free_table(cache_table, cache_max * sizeof(struct cache_entry));
+    free_table(cache_status, cache_max * sizeof(uint32_t));
+}
+
+static void
+cache_clear_segments()
+{
+    for (int i=1; i<cache_num_segments; i++) {
+        clear_table(cache_segments[i].status, cache_segments[i].size * sizeof(uint32_t));
+        prefault_table(cache_segments[i].status, cache_segments[i].size * sizeof(uint32_t));
+    }
+}
+
 void
 cache_free()
 {
-    free_aligned(cache_table, cache_max * sizeof(struct cache_entry));
-    free_aligned(cache_status, cache_max * sizeof(uint32_t));
+    cache_free_main();
+    for (int i=1; i<cache_num_segments; i++) {
+        free_table(cache_segments[i].table, cache_segments[i].size * sizeof(struct cache_entry));
+        free_table(cache_segments[i].status, cache_segments[i].size * sizeof(uint32_t));
+    }
+    cache_num_segments = 1;
+    memset(cache_opid_segment, 0, sizeof(cache_opid_segment));
+    memset(cache_opid_check, 0, sizeof(cache_opid_check));
 }
 
 void
 cache_clear()
 {
     // a bit silly, but this works just fine, and does not require writing 0 everywhere...
-    cache_free();
+    cache_free_main();
     cache_create(cache_size, cache_max);
+    cache_clear_segments();
+}
+
+int
+cache_add_segment(size_t size, cache_policy_t policy)
+{
+    if (__builtin_popcountll(size) != 1) {
+        fprintf(stderr, "cache_add_segment: Segment size must be a power of 2!\n");
+        exit(1);
+    }
+    if (cache_num_segments == CACHE_MAX_SEGMENTS) {
+        fprintf(stderr, "cache_add_segment: Too many cache segments!\n");
+        exit(1);
+    }
+    cache_segment_t *seg = &cache_segments[cache_num_segments];
+    seg->size   = size;
+    seg->policy = policy;
+    seg->table  = (cache_entry_t)alloc_table(size * sizeof(struct cache_entry), "cache segment", 1);
+    seg->status = (uint32_t*)alloc_table(size * sizeof(uint32_t), "cache segment (status)", 1);
+    if (seg->table == 0 || seg->status == 0) {
+        fprintf(stderr, "cache_add_segment: Unable to allocate memory: %s!\n", strerror(errno));
+        exit(1);
+    }
+    prefault_table(seg->table, size * sizeof(struct cache_entry));
+    prefault_table(seg->status, size * sizeof(uint32_t));
+    return cache_num_segments++;
+}
+
+void
+cache_set_segment(uint64_t opid, int segment)
+{
+    if (segment < 0 || segment >= cache_num_segments) {
+        fprintf(stderr, "cache_set_segment: Invalid segment %d!\n", segment);
+        exit(1);
+    }
+    size_t op = cache_opid_index(opid);
+    if (op == CACHE_STATS_OPIDS-1) {
+        fprintf(stderr, "cache_set_segment: Operation id too large!\n");
+        exit(1);
+    }
+    cache_opid_segment[op] = (uint8_t)segment;
+}
+
+void
+cache_set_check(uint64_t opid, cache_check_cb cb)
+{
+    size_t op = cache_opid_index(opid);
+    if (op == CACHE_STATS_OPIDS-1) {
+        fprintf(stderr, "cache_set_check: Operation id too large!\n");
+        exit(1);
+    }
+    cache_opid_check[op] = cb;
+}
+
+int
+cache_getnumsegments()
+{
+    return cache_num_segments;
+}
+
+size_t
+cache_segment_getsize(int segment)
+{
+    return (segment == 0) ? cache_size : cache_segments[segment].size;
+}
+
+size_t
+cache_segment_getused(int segment)
+{
+    if (segment == 0) return cache_getused();
+    size_t result = 0;
+    for (size_t i=0; i<cache_segments[segment].size; i++) {
+        if (cache_segments[segment].status[i]) result++;
+    }
+    return result;
+}
+
+void
+cache_remap(cache_remap_cb cb)
+{
+    // Take all entries out of the cache first, so reinserting remapped entries
+    // doesn't overwrite entries which haven't been remapped yet
+    size_t kept = 0, kept_size = 1024;
+    cache_entry_t keep = (cache_entry_t)malloc(kept_size * sizeof(struct cache_entry));
+    if (keep == 0) {
+        fprintf(stderr, "cache_remap: Unable to allocate memory!\n");
+        exit(1);
+    }
+
+    for (int seg=0; seg<cache_num_segments; seg++) {
+        uint32_t *status = (seg == 0) ? cache_status : cache_segments[seg].status;
+        cache_entry_t table = (seg == 0) ? cache_table : cache_segments[seg].table;
+        size_t size = (seg == 0) ? cache_size : cache_segments[seg].size;
+        for (size_t i=0; i<size; i++) {
+            uint32_t s = status[i];
+            if (s == 0) continue;
+            status[i] = 0;
+            // skip 2-part entries
+            if (s & 0xc0000000) continue;
+            uint64_t a = table[i].a, b = table[i].b;
+            uint64_t c = table[i].c, res = table[i].res;
+            if (!cb(&a, &b, &c, &res)) continue;
+            if (kept == kept_size) {
+                kept_size *= 2;
+                keep = (cache_entry_t)realloc(keep, kept_size * sizeof(struct cache_entry));
+                if (keep == 0) {
+                    fprintf(stderr, "cache_remap: Unable to allocate memory!\n");
+                    exit(1);
+                }
+            }
+            keep[kept].a = a;
+            keep[kept].b = b;
+            keep[kept].c = c;
+            keep[kept].res = res;
+            kept++;
+        }
+    }
+
+    for (size_t i=0; i<kept; i++) {
+        cache_put(keep[i].a, keep[i].b, keep[i].c, keep[i].res);
+    }
+    free(keep);
+}
+
+TASK_5(size_t, cache_sweep_par, cache_entry_t, table, uint32_t*, status, size_t, first, size_t, count, cache_check_cb, dflt)
+{
+    if (count > 4096) {
+        size_t split = count/2;
+        SPAWN(cache_sweep_par, table, status, first, split, dflt);
+        size_t dropped = CALL(cache_sweep_par, table, status, first + split, count - split, dflt);
+        return dropped + SYNC(cache_sweep_par);
+    }
+
+    size_t dropped = 0;
+    for (size_t i=first; i<first+count; i++) {
+        uint32_t s = status[i];
+        if (s == 0) continue;
+        // drop 2-part entries, they are not checked
+        int keep = 0;
+        if (!(s & 0xc0000000)) {
+            cache_entry_t e = table + i;
+            cache_check_cb cb = cache_opid_check[cache_opid_index(e->a)];
+            if (cb == NULL) cb = dflt;
+            keep = cb(e->a, e->b, e->c, e->res);
+        }
+        if (!keep) {
+            status[i] = 0;
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+TASK_IMPL_1(size_t, cache_sweep, cache_check_cb, dflt)
+{
+    size_t dropped = 0;
+    for (int seg=0; seg<cache_num_segments; seg++) {
+        uint32_t *status = (seg == 0) ? cache_status : cache_segments[seg].status;
+        cache_entry_t table = (seg == 0) ? cache_table : cache_segments[seg].table;
+        size_t size = (seg == 0) ? cache_size : cache_segments[seg].size;
+        dropped += CALL(cache_sweep_par, table, status, 0, size, dflt);
+    }
+    return dropped;
 }
 
 void
 cache_setsize(size_t size)
 {
     // easy solution
-    cache_free();
+    cache_free_main();
     cache_create(size, cache_max);
+    cache_clear_segments();
 }
 
 size_t
@@ -105,6 +105,35 @@ cache_put4(uint64_t opid, uint64_t dd, uint64_t dd2, uint64_t dd3, uint64_t dd4,
 
     return cache_put3(opid, dd, p2, p3, res);
 }
+/**
+ * Cache segments
+ *
+ * By default all operations share one table. Operations can be given their own
+ * segment of the cache, such that cheap but frequent operations don't evict 
+ * the results of expensive ones:
+ *   int seg = cache_add_segment(1LL<<20, CACHE_POLICY_REPLACE);
+ *   cache_set_segment(CACHE_AADD_MATMAT_MULT, seg);
+ * Multiple operations can share a segment. Segments are removed by cache_free
+ * (i.e. sylvan_quit), and cleared together with the main table.
+ */
+#define CACHE_MAX_SEGMENTS 16
+
+typedef enum cache_policy {
+    CACHE_POLICY_REPLACE, // a put replaces whatever is in the bucket (default)
+    CACHE_POLICY_KEEP,    // a put only fills empty buckets (until cache_clear)
+} cache_policy_t;
+
+/* Add a segment of 'size' (power of 2) buckets, returns the segment number */
+int cache_add_segment(size_t size, cache_policy_t policy);
+
+/* Let operation 'opid' use the given segment (0 = main table) */
+void cache_set_segment(uint64_t opid, int segment);
+
+/* Number of segments (including the main table), filled and total buckets */
+int cache_getnumsegments(void);
+size_t cache_segment_getused(int segment);
+size_t cache_segment_getsize(int segment);
+
 /**
  * Functions for Sylvan for cache management
  */
@@ -115,6 +144,35 @@ void cache_free(void);
 
 void cache_clear(void);
 
+/**
+ * Rewrite all entries of the cache with the given callback, which can modify
+ * the key (a, b, c) and the result of an entry. When the callback returns 0 the
+ * entry is dropped. Entries whose key changed are moved to their new bucket
+ * (possibly overwriting other entries). Not thread-safe; only call this when
+ * no other workers access the cache.
+ */
+typedef int (*cache_remap_cb)(uint64_t *a, uint64_t *b, uint64_t *c, uint64_t *res);
+
+void cache_remap(cache_remap_cb cb);
+
+/**
+ * Check whether the entry (a, b, c, res) can stay in the cache, e.g. because all
+ * nodes it refers to survived garbage collection. Returns 0 to drop the entry.
+ */
+typedef int (*cache_check_cb)(uint64_t a, uint64_t b, uint64_t c, uint64_t res);
+
+/* Let the entries of operation 'opid' be checked by 'cb' in cache_sweep (NULL = default) */
+void cache_set_check(uint64_t opid, cache_check_cb cb);
+
+/**
+ * Drop all entries of the cache (main table and segments) for which the check
+ * of their operation returns 0, using 'dflt' for operations without a check.
+ * Entries are not moved. Returns the number of dropped entries. Not thread-safe
+ * with respect to cache_get/cache_put; only call this during garbage collection.
+ */
+TASK_DECL_1(size_t, cache_sweep, cache_check_cb);
+#define cache_sweep(dflt) RUN(cache_sweep, dflt)
+
 void cache_setsize(size_t size);
 
 size_t cache_getused(void);
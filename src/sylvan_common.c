@@ -44,6 +44,33 @@ sylvan_gc_disable()
     gc_enabled = 0;
 }
 
+/**
+ * Whether garbage collection keeps the cache entries of surviving nodes.
+ */
+static int gc_keep_cache = 0;
+
+void
+sylvan_gc_set_keep_cache(int enabled)
+{
+    gc_keep_cache = enabled;
+}
+
+/**
+ * Number of minor garbage collections between full garbage collections.
+ */
+static int gc_minor_max = 0;
+static int gc_minor_count = 0;
+static int gc_minor_skip = 0;
+static int gc_force_full = 0;
+
+void
+sylvan_gc_set_minor(int max_minor)
+{
+    gc_minor_max = max_minor;
+    gc_minor_count = 0;
+    gc_minor_skip = 0;
+}
+
 /**
  * This variable is used for a cas flag so only one gc runs at one time
  */
@@ -104,6 +131,33 @@ VOID_TASK_IMPL_0(sylvan_clear_cache)
    cache_clear();
 }
 
+/**
+ * Default check for cache_sweep: every field of the entry is taken to be a node
+ * index in the lower 40 bits (as with BDDs and MTBDDs). Fields which are not
+ * nodes at worst cause the entry to be dropped.
+ */
+static inline int
+gc_cache_field_alive(uint64_t x)
+{
+    const uint64_t index = x & 0x000000ffffffffffLL;
+    return index < 2 || index >= llmsset_get_size(nodes) || llmsset_is_marked(nodes, index);
+}
+
+static int
+gc_cache_entry_alive(uint64_t a, uint64_t b, uint64_t c, uint64_t res)
+{
+    return gc_cache_field_alive(a) && gc_cache_field_alive(b) &&
+           gc_cache_field_alive(c) && gc_cache_field_alive(res);
+}
+
+/**
+ * Drop the cache entries which refer to nodes that were not marked.
+ */
+VOID_TASK_IMPL_0(sylvan_sweep_cache)
+{
+    CALL(cache_sweep, gc_cache_entry_alive);
+}
+
 /**
  * Clear the nodes table and mark all referenced nodes.
  *
@@ -122,6 +176,27 @@ VOID_TASK_IMPL_0(sylvan_clear_and_mark)
     llmsset_destroy_unmarked(nodes);
 }
 
+/**
+ * Minor garbage collection: unmark and sweep only the nodes created since the
+ * last garbage collection. Returns 0 if the nodes table (with tombstones) is
+ * still more than half full afterwards, then a full garbage collection is needed.
+ */
+TASK_0(int, sylvan_gc_minor)
+{
+    llmsset_clear_young(nodes);
+
+    for (gc_hook_entry_t e = mark_list; e != NULL; e = e->next) {
+        WRAP(e->cb);
+    }
+
+    if (gc_keep_cache) CALL(sylvan_sweep_cache);
+
+    llmsset_sweep_young(nodes);
+
+    size_t used = llmsset_get_survivors(nodes) + llmsset_get_tombstones(nodes);
+    return used*2 <= llmsset_get_size(nodes);
+}
+
 /**
  * Clear the hash array of the nodes table and rehash all marked buckets.
  */
@@ -141,6 +216,55 @@ VOID_TASK_IMPL_0(sylvan_rehash_all)
  * Logic for resizing the nodes table and operation cache
  */
 
+/**
+ * Memory budget (0 = no budget) and the other stores which count towards it.
+ */
+static size_t memory_budget = 0;
+
+typedef struct budget_store_entry
+{
+    struct budget_store_entry *next;
+    budget_usage_cb usage;
+    budget_fill_cb fill;
+    budget_grow_cb grow;
+    int handled;
+} * budget_store_entry_t;
+
+static budget_store_entry_t budget_stores;
+
+/**
+ * The operation cache is not shrunk below this number of buckets to make room
+ * for other stores.
+ */
+static const size_t budget_cache_floor = 1ULL<<16;
+
+void
+sylvan_budget_add_store(budget_usage_cb usage, budget_fill_cb fill, budget_grow_cb grow)
+{
+    budget_store_entry_t e = (budget_store_entry_t)malloc(sizeof(struct budget_store_entry));
+    e->usage = usage;
+    e->fill = fill;
+    e->grow = grow;
+    e->handled = 0;
+    e->next = budget_stores;
+    budget_stores = e;
+}
+
+size_t
+sylvan_get_memory_budget(void)
+{
+    return memory_budget;
+}
+
+size_t
+sylvan_get_memory_usage(void)
+{
+    size_t used = llmsset_get_size(nodes) * 24 + cache_getsize() * 36;
+    for (int seg = 1; seg < cache_getnumsegments(); seg++) used += cache_segment_getsize(seg) * 36;
+    for (budget_store_entry_t e = budget_stores; e != NULL; e = e->next) used += e->usage();
+    return used;
+}
+
 /**
  * Helper routine to compute the next size....
  */
@@ -182,12 +306,98 @@ VOID_TASK_IMPL_0(sylvan_gc_aggressive_resize)
     }
 }
 
+/**
+ * Resizing within the memory budget. The nodes table and the registered stores
+ * which are more than 50% filled are grown in order of their fill rate, as long
+ * as the total stays within the budget. To make room, the operation cache is
+ * halved (clearing it). The cache grows with the nodes table if there is room.
+ */
+static void
+sylvan_gc_budget_resize(void)
+{
+    size_t used = sylvan_get_memory_usage();
+
+    size_t nodes_size = llmsset_get_size(nodes);
+    size_t nodes_max = llmsset_get_max_size(nodes);
+    double nodes_fill = 0;
+    if (nodes_size < nodes_max) nodes_fill = (double)llmsset_count_marked(nodes) / nodes_size;
+    for (budget_store_entry_t e = budget_stores; e != NULL; e = e->next) e->handled = 0;
+
+    for (;;) {
+        // find the fullest store (or nodes table) that wants to grow
+        budget_store_entry_t store = NULL;
+        double fill = 0.5;
+        for (budget_store_entry_t e = budget_stores; e != NULL; e = e->next) {
+            if (e->handled) continue;
+            double f = e->fill();
+            if (f > fill) {
+                store = e;
+                fill = f;
+            }
+        }
+        if (store == NULL && nodes_fill <= 0.5) break;
+        int grow_nodes = nodes_fill > fill;
+
+        // stores double in size, the nodes table grows to the next size
+        size_t new_nodes_size = 0, cost;
+        if (grow_nodes) {
+            new_nodes_size = next_size(nodes_size);
+            if (new_nodes_size > nodes_max) new_nodes_size = nodes_max;
+            cost = (new_nodes_size - nodes_size) * 24;
+            nodes_fill = 0;
+        } else {
+            cost = store->usage();
+            store->handled = 1;
+        }
+
+        // shrink the operation cache to make room
+        size_t cache_size = cache_getsize();
+        size_t new_cache_size = cache_size;
+        while (used + cost > memory_budget && new_cache_size/2 >= budget_cache_floor) {
+            new_cache_size /= 2;
+            used -= new_cache_size * 36;
+        }
+        if (used + cost > memory_budget) {
+            used += (cache_size - new_cache_size) * 36;
+            continue;
+        }
+        if (new_cache_size != cache_size) {
+            cache_setsize(new_cache_size);
+            cache_size = new_cache_size;
+        }
+
+        used += cost;
+        if (!grow_nodes) {
+            store->grow();
+            continue;
+        }
+        llmsset_set_size(nodes, new_nodes_size);
+
+        // also increase the operation cache (if it fits)
+        size_t cache_max = cache_getmaxsize();
+        if (cache_size < cache_max) {
+            new_cache_size = next_size(cache_size);
+            if (new_cache_size > cache_max) new_cache_size = cache_max;
+            cost = (new_cache_size - cache_size) * 36;
+            if (used + cost <= memory_budget) {
+                cache_setsize(new_cache_size);
+                used += cost;
+            }
+        }
+    }
+}
+
 /**
  * Resizing heuristic that only resizes when more than 50% is marked.
  * The operation cache is only resized if the nodes table is resized.
  */
 VOID_TASK_IMPL_0(sylvan_gc_normal_resize)
 {
+    if (memory_budget != 0) {
+        sylvan_gc_budget_resize();
+        return;
+    }
+
     size_t nodes_size = llmsset_get_size(nodes);
     size_t nodes_max = llmsset_get_max_size(nodes);
     if (nodes_size < nodes_max) {
@@ -223,25 +433,54 @@ VOID_TASK_0(sylvan_gc_go)
     }
 
     /*
-     * This simply clears the cache.
-     * Alternatively, we could implement for example some strategy
-     * where part of the cache is cleared and part is marked
+     * Either clear the cache, or (after marking) only drop the entries
+     * which refer to nodes that did not survive
      */
-    CALL(sylvan_clear_cache);
+    if (!gc_keep_cache) CALL(sylvan_clear_cache);
+
+    /*
+     * Try a minor gc first, and continue with a full gc if it did not free
+     * enough space (or after gc_minor_max minor gcs)
+     */
+    int full = 1;
+    if (gc_minor_count < gc_minor_max && !gc_minor_skip && !gc_force_full) {
+        sylvan_stats_count(SYLVAN_GC_MINOR_COUNT);
+        gc_minor_count++;
+        full = !CALL(sylvan_gc_minor);
+    }
+
+    if (full) {
+        gc_minor_count = 0;
+        gc_force_full = 0;
+
+        CALL(sylvan_clear_and_mark);
+
+        if (gc_keep_cache) CALL(sylvan_sweep_cache);
 
-    CALL(sylvan_clear_and_mark);
+        // call hooks for resizing and all that
+        WRAP(main_hook);
 
-    // call hooks for resizing and all that
-    WRAP(main_hook);
+        CALL(sylvan_rehash_all);
 
-    CALL(sylvan_rehash_all);
+        // minor gcs can't free enough space while the table is over half full
+        gc_minor_skip = gc_minor_max > 0 && llmsset_get_survivors(nodes)*2 > llmsset_get_size(nodes);
+    }
 
     // call post gc hooks
     for (gc_hook_entry_t e = postgc_list; e != NULL; e = e->next) {
         WRAP(e->cb);
     }
 
-    sylvan_timer_stop(SYLVAN_GC);
+    sylvan_timer_stop_hist(SYLVAN_GC, full ? SYLVAN_GC_PAUSE_FULL : SYLVAN_GC_PAUSE_MINOR);
+}
+
+/**
+ * Perform full garbage collection (also when minor gcs are enabled)
+ */
+VOID_TASK_IMPL_0(sylvan_gc_full)
+{
+    gc_force_full = 1;
+    CALL(sylvan_gc);
 }
 
 /**
@@ -298,6 +537,7 @@ sylvan_set_sizes(size_t min_tablesize, size_t max_tablesize, size_t min_cachesiz
     table_max = max_tablesize;
     cache_min = min_cachesize;
     cache_max = max_cachesize;
+    memory_budget = 0;
 }
 
 void
@@ -351,6 +591,43 @@ sylvan_set_limits(size_t memorycap, int table_ratio, int initial_ratio)
     table_max = max_t;
     cache_min = min_c;
     cache_max = max_c;
+    memory_budget = 0;
+}
+
+void
+sylvan_set_memory_budget(size_t bytes, int initial_ratio)
+{
+    if (initial_ratio < 0) {
+        fprintf(stderr, "sylvan_set_memory_budget: initial_ratio unreasonable (may not be negative)\n");
+        exit(1);
+    }
+
+    /* Either table may grow to use most of the budget, the heuristic keeps the total within it */
+    size_t max_t = 0x1000, max_c = 0x1000;
+    if (max_t * 24 + max_c * 36 > bytes / 2) {
+        fprintf(stderr, "sylvan_set_memory_budget: memory budget too small!\n");
+        exit(1);
+    }
+    while (max_t * 48 <= bytes && max_t < 0x0000040000000000) max_t *= 2;
+    while (max_c * 72 <= bytes / 2) max_c *= 2;
+
+    /* Initially, leave at least half of the budget for growing and for other stores */
+    size_t min_t = max_t, min_c = max_c;
+    while (min_t > 0x1000 && min_c > 0x1000 && (initial_ratio > 0 || min_t * 24 + min_c * 36 > bytes / 2)) {
+        min_t >>= 1;
+        min_c >>= 1;
+        initial_ratio--;
+    }
+    while (min_t * 24 + min_c * 36 > bytes / 2) {
+        if (min_t > 0x1000) min_t >>= 1;
+        else min_c >>= 1;
+    }
+
+    table_min = min_t;
+    table_max = max_t;
+    cache_min = min_c;
+    cache_max = max_c;
+    memory_budget = bytes;
 }
 
 /**
@@ -360,7 +637,7 @@ void
 sylvan_init_package(void)
 {
     if (table_max == 0) {
-        fprintf(stderr, "sylvan_init_package error: table sizes not set (sylvan_set_sizes or sylvan_set_limits)!");
+        fprintf(stderr, "sylvan_init_package error: table sizes not set (sylvan_set_sizes, sylvan_set_limits or sylvan_set_memory_budget)!");
         exit(1);
     }
 
@@ -375,6 +652,8 @@ sylvan_init_package(void)
 #else
     main_hook = TASK(sylvan_gc_normal_resize);
 #endif
+    // only the normal heuristic keeps the tables within the memory budget
+    if (memory_budget != 0) main_hook = TASK(sylvan_gc_normal_resize);
 
     sylvan_stats_init();
 }
@@ -424,6 +703,12 @@ sylvan_quit()
         free(e);
     }
 
+    while (budget_stores != NULL) {
+        budget_store_entry_t e = budget_stores;
+        budget_stores = e->next;
+        free(e);
+    }
+
     cache_free();
     llmsset_free(nodes);
 }
@@ -29,7 +29,7 @@ extern "C" {
  *
  * First, Sylvan must know how big the nodes table and cache may be.
  * Either use sylvan_set_sizes to explicitly set the table sizes, or use sylvan_set_limits
- * to let Sylvan compute the sizes for you.
+ * or sylvan_set_memory_budget to let Sylvan compute the sizes for you.
  *
  * Then, call sylvan_init_package. This allocates the tables and other support structures.
  * Sylvan allocates virtual memory to accomodate the maximum sizes of both tables.
@@ -69,6 +69,39 @@ void sylvan_set_sizes(size_t min_tablesize, size_t max_tablesize, size_t min_cac
  */
 void sylvan_set_limits(size_t memory_cap, int table_ratio, int initial_ratio);
 
+/**
+ * Set one memory budget (in bytes) for the nodes table, the operation cache and
+ * other stores registered with sylvan_budget_add_store, such as the edge weight
+ * table of AADDs/QMDDs. Use this instead of sylvan_set_sizes/sylvan_set_limits.
+ *
+ * Either table may grow to use most of the budget. Initially, the tables are
+ * 2^initial_ratio times smaller, and use at most half of the budget.
+ * During garbage collection, sylvan_gc_normal_resize grows the tables and stores
+ * which are more than half full, fullest first, as long as the total memory stays
+ * within the budget. It shrinks the operation cache to make room if needed.
+ * With a budget, sylvan_init_package always selects sylvan_gc_normal_resize.
+ */
+void sylvan_set_memory_budget(size_t bytes, int initial_ratio);
+
+/**
+ * Return the memory budget (0 if no budget is set) and the current memory usage
+ * of the nodes table, the operation cache and the registered stores, in bytes.
+ */
+size_t sylvan_get_memory_budget(void);
+size_t sylvan_get_memory_usage(void);
+
+/**
+ * Register a store which counts towards the memory budget.
+ * - usage() returns the number of bytes the store uses (or has reserved)
+ * - fill() returns how full the store is (above 0.5 the store wants to grow)
+ * - grow() doubles the store; this is only called if the budget allows it
+ * The stores are removed by sylvan_quit.
+ */
+typedef size_t (*budget_usage_cb)(void);
+typedef double (*budget_fill_cb)(void);
+typedef void (*budget_grow_cb)(void);
+void sylvan_budget_add_store(budget_usage_cb usage, budget_fill_cb fill, budget_grow_cb grow);
+
 /**
  * Frees all Sylvan data (also calls the quit() functions of BDD/LDD parts)
  */
@@ -99,7 +132,7 @@ VOID_TASK_DECL_2(sylvan_table_usage, size_t*, size_t*);
  * Garbage collection procedure:
  * 1) All installed pre_gc hooks are called.
  *    See sylvan_gc_hook_pre to add hooks.
- * 2) The operation cache is cleared.
+ * 2) The operation cache is cleared (unless the cache is kept, see sylvan_gc_set_keep_cache).
  * 3) The nodes table (data part) is cleared.
  * 4) All nodes are marked (to be rehashed) using the various marking callbacks.
  *    See sylvan_gc_add_mark to add marking callbacks.
@@ -112,10 +145,17 @@ VOID_TASK_DECL_2(sylvan_table_usage, size_t*, size_t*);
  * 7) All installed post_gc hooks are called.
  *    See sylvan_gc_hook_post to add hooks.
  *
+ * Optionally, garbage collection is generational (see sylvan_gc_set_minor).
+ * A minor garbage collection replaces steps 3 to 6: it only unmarks the nodes
+ * created since the last garbage collection, marks with the same callbacks
+ * (which stop at the older nodes, as these stay marked), and removes the unmarked
+ * new nodes from the table. The main gc hook is not called (no resizing).
+ *
  * For parts of the garbage collection process, specific methods exist.
  * - sylvan_clear_cache() clears the operation cache (step 2)
  * - sylvan_clear_and_mark() performs steps 3 and 4.
  * - sylvan_rehash_all() performs steps 5 and 6.
+ * - sylvan_sweep_cache() drops the cache entries with unmarked nodes (after step 4).
  */
 
 /**
@@ -128,6 +168,26 @@ VOID_TASK_DECL_2(sylvan_table_usage, size_t*, size_t*);
 VOID_TASK_DECL_0(sylvan_gc);
 #define sylvan_gc() (RUN(sylvan_gc))
 
+/**
+ * Trigger a full garbage collection manually, also when minor garbage
+ * collections are enabled.
+ */
+VOID_TASK_DECL_0(sylvan_gc_full);
+#define sylvan_gc_full() (RUN(sylvan_gc_full))
+
+/**
+ * Use minor (generational) garbage collections (disabled by default).
+ * A minor gc only deletes nodes that were created since the last gc, so its
+ * pause is proportional to the number of new nodes instead of the table size:
+ * older nodes are kept (also when they are dead), marking stops at them, and
+ * deleted nodes leave a tombstone in the hash table instead of rehashing it.
+ * After <max_minor> minor gcs, the next gc is a full gc, which also deletes the
+ * older dead nodes and tombstones, and resizes the table. If a minor gc leaves
+ * the table (with tombstones) more than half full, the same gc continues with
+ * a full gc. Use 0 to only use full gcs.
+ */
+void sylvan_gc_set_minor(int max_minor);
+
 /**
  * Enable or disable garbage collection.
  *
@@ -151,6 +211,22 @@ void sylvan_gc_disable(void);
 VOID_TASK_DECL_0(sylvan_clear_cache);
 #define sylvan_clear_cache() RUN(sylvan_clear_cache)
 
+/**
+ * Keep the operation cache during garbage collection (disabled by default).
+ * Instead of clearing the cache, the cache is swept after marking and only the
+ * entries that refer to nodes that did not survive are dropped. By default all
+ * fields of an entry are treated as node indices (as for BDDs and MTBDDs);
+ * operations which store nodes differently must set their own check with
+ * cache_set_check (see sylvan_cache.h), as the LDD and AADD operations do.
+ */
+void sylvan_gc_set_keep_cache(int enabled);
+
+/**
+ * Drop the entries of the operation cache which refer to unmarked nodes.
+ */
+VOID_TASK_DECL_0(sylvan_sweep_cache);
+#define sylvan_sweep_cache() RUN(sylvan_sweep_cache)
+
 /**
  * Clear the nodes table (data part) and mark all nodes with the marking mechanisms.
  */
@@ -208,6 +284,8 @@ VOID_TASK_DECL_0(sylvan_gc_aggressive_resize);
  * One of the hooks for resizing behavior.
  * Default if SYLVAN_AGGRESSIVE_RESIZE is not set.
  * Double size on gc() whenever >50% is used.
+ * With a memory budget (sylvan_set_memory_budget), also grows the registered stores
+ * and shrinks the operation cache to stay within the budget.
  * Use sylvan_gc_hook_main() to set this heuristic.
  */
 VOID_TASK_DECL_0(sylvan_gc_normal_resize);
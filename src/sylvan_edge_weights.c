@@ -1,9 +1,11 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <math.h>
 
 #include <sylvan_edge_weights.h>
 #include <sylvan_edge_weights_complex.h>
 #include <sylvan_int.h>
+#include <sylvan_align.h>
 
 
 void *wgt_storage; // TODO: move to source file?
@@ -18,11 +20,15 @@ AADD_WGT AADD_SQRT_TWO;
 
 /**********************<Managing the edge weight table>************************/
 
+static void wgt_memo_init();
+VOID_TASK_DECL_0(wgt_memo_cleanup);
+
 void sylvan_init_edge_weights(size_t size, double tol, edge_weight_type_t edge_weight_type, wgt_storage_backend_t backend);
 void init_edge_weight_functions(edge_weight_type_t edge_weight_type);
 void init_edge_weight_storage(size_t size, double tol, wgt_storage_backend_t backend, void **wgt_store);
 void (*init_wgt_table_entries)(); // set by sylvan_init_aadd
 uint64_t sylvan_get_edge_weight_table_size();
+void sylvan_edge_weights_set_max_size(size_t max_size);
 double sylvan_edge_weights_tolerance();
 uint64_t sylvan_edge_weights_count_entries();
 void sylvan_edge_weights_free();
@@ -34,6 +40,7 @@ _weight_value_f 		_weight_value;
 
 weight_lookup_f 		weight_lookup;
 _weight_lookup_ptr_f	_weight_lookup_ptr;
+_weight_lookup_ptr_batch_f	_weight_lookup_ptr_batch;
 init_one_zero_f 		init_one_zero;
 weight_abs_f 			weight_abs;
 weight_neg_f 			weight_neg;
@@ -58,12 +65,15 @@ static const double default_tolerance = 1e-14;
 static double tolerance;
 static wgt_storage_backend_t wgt_backend;
 size_t table_size;
+static size_t table_max_size = 0; // 0 = don't grow
+static size_t table_next_size = 0; // size of the table created at the next gc
 
 void sylvan_init_edge_weights(size_t size, double tol, edge_weight_type_t edge_weight_type, wgt_storage_backend_t backend)
 {
     init_edge_weight_functions(edge_weight_type);
     init_edge_weight_storage(size, tol, backend, &wgt_storage);
     init_edge_weight_storage_gc();
+    wgt_memo_init();
 }
 
 void init_edge_weight_functions(edge_weight_type_t edge_weight_type)
@@ -75,6 +85,7 @@ void init_edge_weight_functions(edge_weight_type_t edge_weight_type)
         _weight_value       = (_weight_value_f) &_weight_complex_value;
         weight_lookup       = (weight_lookup_f) &weight_complex_lookup;
         _weight_lookup_ptr  = (_weight_lookup_ptr_f) &_weight_complex_lookup_ptr;
+        _weight_lookup_ptr_batch = (_weight_lookup_ptr_batch_f) &_weight_complex_lookup_ptr_batch;
         init_one_zero       = (init_one_zero_f) &init_complex_one_zero;
         weight_abs          = (weight_abs_f) &weight_complex_abs;
         weight_neg          = (weight_neg_f) &weight_complex_neg;
@@ -98,6 +109,13 @@ void init_edge_weight_functions(edge_weight_type_t edge_weight_type)
     
 }
 
+/* The segments of the hash map are filled by a single thread, so no prefault */
+static void *
+wgt_table_alloc(size_t size)
+{
+    return alloc_table(size, "edge weight table", 0);
+}
+
 void
 init_edge_weight_storage(size_t size, double tol, wgt_storage_backend_t backend, void **wgt_store)
 {
@@ -106,9 +124,13 @@ init_edge_weight_storage(size_t size, double tol, wgt_storage_backend_t backend,
     wgt_backend = backend;
 
     init_wgt_storage_functions(backend);
+    if (backend == COMP_HASHMAP) cmap_set_allocator(wgt_table_alloc, free_table);
 
     // create actual table
     *wgt_store = wgt_store_create(table_size, tolerance);
+    if (wgt_store_set_max_size != NULL && table_max_size > table_size) {
+        wgt_store_set_max_size(*wgt_store, table_max_size);
+    }
 
     // Set AADD_WGT values for 1, 0 (and -1)
     init_one_zero(*wgt_store);
@@ -117,7 +139,49 @@ init_edge_weight_storage(size_t size, double tol, wgt_storage_backend_t backend,
 uint64_t
 sylvan_get_edge_weight_table_size()
 {
-    return table_size;
+    // live capacity (the table might have grown since it was created)
+    return wgt_store_get_size(wgt_storage);
+}
+
+void
+sylvan_edge_weights_set_max_size(size_t max_size)
+{
+    table_max_size = max_size;
+}
+
+void
+sylvan_edge_weights_grow(size_t size)
+{
+    table_next_size = size;
+    if (wgt_store_set_max_size != NULL) {
+        table_max_size = size;
+        wgt_store_set_max_size(wgt_storage, size);
+    }
+}
+
+uint64_t
+sylvan_edge_weights_get_reserved()
+{
+    uint64_t size = sylvan_get_edge_weight_table_size();
+    return (table_next_size > size) ? table_next_size : size;
+}
+
+uint64_t
+sylvan_edge_weights_get_capacity()
+{
+    if (wgt_store_set_max_size != NULL) return sylvan_edge_weights_get_reserved();
+    return sylvan_get_edge_weight_table_size();
+}
+
+uint64_t
+sylvan_edge_weights_index_bound()
+{
+    // the table can grow online up to table_max_size
+    uint64_t size = sylvan_edge_weights_get_capacity();
+    if (wgt_store_set_max_size != NULL && table_max_size > size) size = table_max_size;
+    // an index of the real backends packs two table indices (see rmap.c, tree_map.cpp)
+    if (wgt_backend != COMP_HASHMAP) return 1ULL << (2 * (int) ceil(log2(size)));
+    return size;
 }
 
 double
@@ -136,6 +200,8 @@ void
 sylvan_edge_weights_free()
 {
     wgt_store_free(wgt_storage);
+    table_next_size = 0;
+    RUN(wgt_memo_cleanup);
 }
 
 /*********************</Managing the edge weight table>************************/
@@ -182,11 +248,54 @@ void wgt_table_gc_inc_entries_estimate()
     }
 }
 
+// Optional map from indices in the old table to (index + 1) in the new table
+static uint64_t *wgt_gc_map = NULL;
+static size_t wgt_gc_map_size = 0;
+
+void
+wgt_table_gc_map_create()
+{
+    wgt_gc_map_size = sylvan_get_edge_weight_table_size();
+    wgt_gc_map = (uint64_t*)alloc_aligned(wgt_gc_map_size * sizeof(uint64_t));
+    if (wgt_gc_map == 0) {
+        fprintf(stderr, "wgt_table_gc_map_create: Unable to allocate memory!\n");
+        exit(1);
+    }
+}
+
+bool
+wgt_table_gc_map_get(AADD_WGT a, AADD_WGT *res)
+{
+    if (wgt_gc_map == NULL || a >= wgt_gc_map_size) return false;
+    uint64_t m = wgt_gc_map[a];
+    if (m == 0) return false;
+    *res = m - 1;
+    return true;
+}
+
+void
+wgt_table_gc_map_free()
+{
+    if (wgt_gc_map == NULL) return;
+    free_aligned(wgt_gc_map, wgt_gc_map_size * sizeof(uint64_t));
+    wgt_gc_map = NULL;
+    wgt_gc_map_size = 0;
+}
+
 void
 wgt_table_gc_init_new(void (*init_wgt_table_entries)())
 {
-    // init new (empty) edge weight storage
-    init_edge_weight_storage(table_size, tolerance, wgt_backend, &wgt_storage_new);
+    // constants (1, 0, -1) get new indices when the new table is created
+    AADD_WGT old_consts[3] = {AADD_ONE, AADD_ZERO, AADD_MIN_ONE};
+
+    // init new (empty) edge weight storage (of the size the old one grew to)
+    size_t new_size = sylvan_edge_weights_get_reserved();
+    init_edge_weight_storage(new_size, tolerance, wgt_backend, &wgt_storage_new);
+
+    if (wgt_gc_map != NULL) {
+        AADD_WGT new_consts[3] = {AADD_ONE, AADD_ZERO, AADD_MIN_ONE};
+        for (int k = 0; k < 3; k++) wgt_gc_map[old_consts[k]] = new_consts[k] + 1;
+    }
 
     // reset estimate entries counters
     LOCALIZE_THREAD_LOCAL(table_entries_local, size_t);
@@ -208,9 +317,17 @@ wgt_table_gc_init_new(void (*init_wgt_table_entries)())
 void
 wgt_table_gc_delete_old()
 {
+    wgt_memo_invalidate();
     // delete  old (full) table + set new as current
     wgt_store_free(wgt_storage);
     wgt_storage = wgt_storage_new;
+
+    // the survivors were counted in blocks of table_entries_local_buffer, so
+    // count them exactly (otherwise a small table looks empty after gc)
+    LOCALIZE_THREAD_LOCAL(table_entries_local, size_t);
+    table_entries_est = wgt_store_num_entries(wgt_storage);
+    table_entries_local = 0;
+    (void) table_entries_local;
 }
 
 AADD_WGT
@@ -221,15 +338,191 @@ wgt_table_gc_keep(AADD_WGT a)
     _weight_value(wgt_storage, a, wa);
     AADD_WGT res = _weight_lookup_ptr(wa, wgt_storage_new);
     free(wa);
+    if (wgt_gc_map != NULL) wgt_gc_map[a] = res + 1;
     return res;
 }
 
+// Mark bits for in-place gc (1 bit per index in the table)
+static uint64_t *wgt_gc_marks = NULL;
+static size_t wgt_gc_marks_size = 0;
+
+bool
+wgt_table_gc_inplace_supported()
+{
+    return (wgt_store_delete != NULL);
+}
+
+void
+wgt_table_gc_mark_init()
+{
+    wgt_gc_marks_size = sylvan_get_edge_weight_table_size();
+    size_t words = (wgt_gc_marks_size + 63) / 64;
+    wgt_gc_marks = (uint64_t*)alloc_aligned(words * sizeof(uint64_t));
+    if (wgt_gc_marks == 0) {
+        fprintf(stderr, "wgt_table_gc_mark_init: Unable to allocate memory!\n");
+        exit(1);
+    }
+}
+
+void
+wgt_table_gc_mark(AADD_WGT a)
+{
+    if (a >= wgt_gc_marks_size) return;
+    uint64_t mask = 1ULL << (a & 63);
+    if (!(wgt_gc_marks[a/64] & mask)) __sync_fetch_and_or(&wgt_gc_marks[a/64], mask);
+}
+
+bool
+wgt_table_gc_is_marked(AADD_WGT a)
+{
+    if (a >= wgt_gc_marks_size) return false;
+    return (wgt_gc_marks[a/64] >> (a & 63)) & 1;
+}
+
+void
+wgt_table_gc_sweep()
+{
+    wgt_memo_invalidate();
+    // remove all unmarked entries (indices of marked entries don't change)
+    uint64_t live = 0;
+    size_t words = (wgt_gc_marks_size + 63) / 64;
+    for (size_t w = 0; w < words; w++) {
+        uint64_t m = wgt_gc_marks[w];
+        live += __builtin_popcountll(m);
+        if (m == ~0ULL) continue;
+        for (size_t k = 0; k < 64 && w*64 + k < wgt_gc_marks_size; k++) {
+            if (!((m >> k) & 1)) wgt_store_delete(wgt_storage, w*64 + k);
+        }
+    }
+
+    // (marked indices are a superset of the live entries, good enough)
+    LOCALIZE_THREAD_LOCAL(table_entries_local, size_t);
+    table_entries_est = live;
+    table_entries_local = 0;
+    (void) table_entries_local;
+}
+
+void
+wgt_table_gc_mark_free()
+{
+    if (wgt_gc_marks == NULL) return;
+    size_t words = (wgt_gc_marks_size + 63) / 64;
+    free_aligned(wgt_gc_marks, words * sizeof(uint64_t));
+    wgt_gc_marks = NULL;
+    wgt_gc_marks_size = 0;
+}
+
 /************************</GC of edge weight table>****************************/
 
 
 
 
 
+/********************<Per-worker memo of arithmetic ops>***********************/
+
+/**
+ * Small direct-mapped (op, a, b) -> res table per worker, which is checked 
+ * before the (shared) operation cache. Entries are only valid for the epoch in
+ * which they were written, the epoch is bumped whenever indices in the edge
+ * weight table change meaning (gc).
+ */
+#define WGT_MEMO_SIZE 1024 // power of 2
+
+typedef enum wgt_memo_op {
+    WGT_MEMO_ADD = 1,
+    WGT_MEMO_MUL,
+    WGT_MEMO_DIV,
+} wgt_memo_op_t;
+
+typedef struct wgt_memo_entry {
+    AADD_WGT a, b, res;
+    uint32_t epoch;
+    uint32_t op;
+} wgt_memo_entry_t;
+
+static bool WGT_MEMO = true;
+static volatile uint32_t wgt_memo_epoch = 1; // calloc'ed entries are invalid
+DECLARE_THREAD_LOCAL(wgt_memo_key, wgt_memo_entry_t*);
+
+void
+wgt_set_memo(bool on)
+{
+    WGT_MEMO = on;
+}
+
+static void
+wgt_memo_init()
+{
+    INIT_THREAD_LOCAL(wgt_memo_key);
+    wgt_memo_invalidate();
+}
+
+void
+wgt_memo_invalidate()
+{
+    __sync_fetch_and_add(&wgt_memo_epoch, 1);
+}
+
+VOID_TASK_0(wgt_memo_cleanup_task)
+{
+    LOCALIZE_THREAD_LOCAL(wgt_memo_key, wgt_memo_entry_t*);
+    free(wgt_memo_key);
+    SET_THREAD_LOCAL(wgt_memo_key, NULL);
+}
+
+VOID_TASK_IMPL_0(wgt_memo_cleanup)
+{
+    TOGETHER(wgt_memo_cleanup_task);
+}
+
+static inline wgt_memo_entry_t *
+wgt_memo_entry(wgt_memo_op_t op, AADD_WGT a, AADD_WGT b)
+{
+    LOCALIZE_THREAD_LOCAL(wgt_memo_key, wgt_memo_entry_t*);
+    if (wgt_memo_key == NULL) {
+        wgt_memo_key = calloc(WGT_MEMO_SIZE, sizeof(wgt_memo_entry_t));
+        if (wgt_memo_key == NULL) {
+            fprintf(stderr, "wgt_memo: Unable to allocate memory!\n");
+            exit(1);
+        }
+        SET_THREAD_LOCAL(wgt_memo_key, wgt_memo_key);
+    }
+    uint64_t h = (a * 0x9E3779B97F4A7C15ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL) ^ op;
+    return &wgt_memo_key[(h >> 32) & (WGT_MEMO_SIZE - 1)];
+}
+
+static inline bool
+wgt_memo_get(wgt_memo_op_t op, AADD_WGT a, AADD_WGT b, AADD_WGT *res)
+{
+    if (!WGT_MEMO) return false;
+    wgt_memo_entry_t *e = wgt_memo_entry(op, a, b);
+    if (e->epoch == wgt_memo_epoch && e->op == op && e->a == a && e->b == b) {
+        sylvan_stats_count(WGT_MEMO_HIT);
+        *res = e->res;
+        return true;
+    }
+    sylvan_stats_count(WGT_MEMO_MISS);
+    return false;
+}
+
+static inline void
+wgt_memo_put(wgt_memo_op_t op, AADD_WGT a, AADD_WGT b, AADD_WGT res)
+{
+    if (!WGT_MEMO) return;
+    wgt_memo_entry_t *e = wgt_memo_entry(op, a, b);
+    e->a = a;
+    e->b = b;
+    e->res = res;
+    e->op = op;
+    e->epoch = wgt_memo_epoch;
+}
+
+/*******************</Per-worker memo of arithmetic ops>***********************/
+
+
+
+
+
 /********************<For caching arithmetic operations>***********************/
 
 static bool CACHE_WGT_OPS = true;
@@ -394,10 +687,14 @@ wgt_add(AADD_WGT a, AADD_WGT b)
     if (a == AADD_ZERO) return b;
     if (b == AADD_ZERO) return a;
 
-    // check cache
+    // check per-worker memo and cache
     AADD_WGT res;
+    if (wgt_memo_get(WGT_MEMO_ADD, a, b, &res)) return res;
     if (CACHE_WGT_OPS) {
-        if (cache_get_add(a, b, &res)) return res;
+        if (cache_get_add(a, b, &res)) {
+            wgt_memo_put(WGT_MEMO_ADD, a, b, res);
+            return res;
+        }
     }
 
     // compute and lookup result in edge weight table
@@ -410,7 +707,8 @@ wgt_add(AADD_WGT a, AADD_WGT b)
     free(wa);
     free(wb);
 
-    // insert in cache
+    // insert in memo and cache
+    wgt_memo_put(WGT_MEMO_ADD, a, b, res);
     if (CACHE_WGT_OPS) {
         cache_put_add(a, b, res);
     }
@@ -455,10 +753,14 @@ wgt_mul(AADD_WGT a, AADD_WGT b)
     if (b == AADD_ONE) return a;
     if (a == AADD_ZERO || b == AADD_ZERO) return AADD_ZERO;
 
-    // check cache
+    // check per-worker memo and cache
     AADD_WGT res;
+    if (wgt_memo_get(WGT_MEMO_MUL, a, b, &res)) return res;
     if (CACHE_WGT_OPS) {
-        if (cache_get_mul(a, b, &res)) return res;
+        if (cache_get_mul(a, b, &res)) {
+            wgt_memo_put(WGT_MEMO_MUL, a, b, res);
+            return res;
+        }
     }
 
     // compute and lookup result in edge weight table
@@ -471,13 +773,71 @@ wgt_mul(AADD_WGT a, AADD_WGT b)
     free(wa);
     free(wb);
 
-    // insert in cache
+    // insert in memo and cache
+    wgt_memo_put(WGT_MEMO_MUL, a, b, res);
     if (CACHE_WGT_OPS) {
         cache_put_mul(a, b, res);
     }
     return res;
 }
 
+#define WGT_BATCH_SIZE 8
+
+void
+wgt_mul_batch(const AADD_WGT *a, const AADD_WGT *b, AADD_WGT *out, size_t n)
+{
+    // temporaries are allocated on first use and reused for all chunks
+    weight_t ws[WGT_BATCH_SIZE];
+    weight_t wb = NULL;
+    size_t n_ws = 0;
+    AADD_WGT res[WGT_BATCH_SIZE];
+    size_t idx[WGT_BATCH_SIZE];
+
+    for (size_t start = 0; start < n; start += WGT_BATCH_SIZE) {
+        size_t end = (n - start < WGT_BATCH_SIZE) ? n : start + WGT_BATCH_SIZE;
+
+        // 1. special cases and cache, collect the products still to compute
+        size_t m = 0;
+        for (size_t k = start; k < end; k++) {
+            if (a[k] == AADD_ONE) { out[k] = b[k]; continue; }
+            if (b[k] == AADD_ONE) { out[k] = a[k]; continue; }
+            if (a[k] == AADD_ZERO || b[k] == AADD_ZERO) { out[k] = AADD_ZERO; continue; }
+            if (wgt_memo_get(WGT_MEMO_MUL, a[k], b[k], &out[k])) continue;
+            if (CACHE_WGT_OPS) {
+                if (cache_get_mul(a[k], b[k], &out[k])) {
+                    wgt_memo_put(WGT_MEMO_MUL, a[k], b[k], out[k]);
+                    continue;
+                }
+            }
+            idx[m++] = k;
+        }
+        if (m == 0) continue;
+
+        // 2. compute the products
+        if (wb == NULL) wb = weight_malloc();
+        for (; n_ws < m; n_ws++) ws[n_ws] = weight_malloc();
+        for (size_t j = 0; j < m; j++) {
+            weight_value(a[idx[j]], ws[j]);
+            weight_value(b[idx[j]], wb);
+            weight_mul(ws[j], wb);
+        }
+
+        // 3. lookup all products in the edge weight table at once
+        weight_lookup_ptr_batch(ws, res, m);
+
+        // 4. insert in memo and cache
+        for (size_t j = 0; j < m; j++) {
+            out[idx[j]] = res[j];
+            wgt_memo_put(WGT_MEMO_MUL, a[idx[j]], b[idx[j]], res[j]);
+            if (CACHE_WGT_OPS) {
+                cache_put_mul(a[idx[j]], b[idx[j]], res[j]);
+            }
+        }
+    }
+    for (size_t j = 0; j < n_ws; j++) free(ws[j]);
+    free(wb);
+}
+
 AADD_WGT
 wgt_div(AADD_WGT a, AADD_WGT b)
 {
@@ -486,10 +846,14 @@ wgt_div(AADD_WGT a, AADD_WGT b)
     if (a == AADD_ZERO) return AADD_ZERO;
     if (b == AADD_ONE)  return a;
 
-    // check cache
+    // check per-worker memo and cache
     AADD_WGT res;
+    if (wgt_memo_get(WGT_MEMO_DIV, a, b, &res)) return res;
     if (CACHE_WGT_OPS) {
-        if (cache_get_div(a, b, &res)) return res;
+        if (cache_get_div(a, b, &res)) {
+            wgt_memo_put(WGT_MEMO_DIV, a, b, res);
+            return res;
+        }
     }
 
     // compute and lookup result in edge weight table
@@ -502,7 +866,8 @@ wgt_div(AADD_WGT a, AADD_WGT b)
     free(wa);
     free(wb);
 
-    // insert in cache
+    // insert in memo and cache
+    wgt_memo_put(WGT_MEMO_DIV, a, b, res);
     if (CACHE_WGT_OPS) {
         cache_put_div(a, b, res);
     }
@@ -34,6 +34,16 @@ extern void init_edge_weight_storage(size_t size, double tol, wgt_storage_backen
 extern void (*init_wgt_table_entries)(); // set by sylvan_init_aadd
 
 extern uint64_t sylvan_get_edge_weight_table_size();
+/* Allow (supporting backends of) the table to grow up to max_size entries */
+extern void sylvan_edge_weights_set_max_size(size_t max_size);
+/* Let the table grow to size entries: online if the backend supports it, otherwise at the next gc */
+extern void sylvan_edge_weights_grow(size_t size);
+/* Number of entries the table may use (at least its current capacity) */
+extern uint64_t sylvan_edge_weights_get_reserved();
+/* Number of entries that fit before the next gc (the reserved size only if the backend grows online) */
+extern uint64_t sylvan_edge_weights_get_capacity();
+/* Upper bound (exclusive) of the edge weight indices until the next gc */
+extern uint64_t sylvan_edge_weights_index_bound();
 extern double sylvan_edge_weights_tolerance();
 extern uint64_t sylvan_edge_weights_count_entries();
 extern void sylvan_edge_weights_free();
@@ -53,6 +63,19 @@ extern void wgt_table_gc_init_new(void (*init_wgt_table_entries)());
 extern void wgt_table_gc_delete_old();
 extern AADD_WGT wgt_table_gc_keep(AADD_WGT a);
 
+/* Optionally record which index in the old table moved to which in the new */
+extern void wgt_table_gc_map_create();
+extern bool wgt_table_gc_map_get(AADD_WGT a, AADD_WGT *res);
+extern void wgt_table_gc_map_free();
+
+/* In-place (mark and sweep) gc, only for backends which can delete entries */
+extern bool wgt_table_gc_inplace_supported();
+extern void wgt_table_gc_mark_init();
+extern void wgt_table_gc_mark(AADD_WGT a);
+extern bool wgt_table_gc_is_marked(AADD_WGT a);
+extern void wgt_table_gc_sweep();
+extern void wgt_table_gc_mark_free();
+
 /************************</GC of edge weight table>****************************/
 
 
@@ -65,6 +88,7 @@ typedef weight_t (*weight_malloc_f)();
 typedef void (*_weight_value_f)(void *wgt_store, AADD_WGT a, weight_t res);
 typedef AADD_WGT (*weight_lookup_f)(weight_t a);
 typedef AADD_WGT (*_weight_lookup_ptr_f)(weight_t a, void *wgt_store);
+typedef void (*_weight_lookup_ptr_batch_f)(weight_t *a, AADD_WGT *res, size_t n, void *wgt_store);
 
 typedef void (*init_one_zero_f)(void *wgt_store);
 
@@ -93,6 +117,7 @@ extern _weight_value_f 		_weight_value;
 
 extern weight_lookup_f 		weight_lookup;
 extern _weight_lookup_ptr_f	_weight_lookup_ptr;
+extern _weight_lookup_ptr_batch_f	_weight_lookup_ptr_batch;
 extern init_one_zero_f 		init_one_zero;
 extern weight_abs_f 		weight_abs;
 extern weight_neg_f 		weight_neg;
@@ -112,6 +137,7 @@ extern weight_fprint_f 		weight_fprint;
 
 
 #define weight_lookup_ptr(a) _weight_lookup_ptr(a, wgt_storage)
+#define weight_lookup_ptr_batch(a, res, n) _weight_lookup_ptr_batch(a, res, n, wgt_storage)
 #define weight_value(a, res) _weight_value(wgt_storage, a, res)
 #define weight_approx_eq(a,b) weight_eps_close(a,b,sylvan_edge_weights_tolerance())
 
@@ -125,6 +151,12 @@ extern weight_fprint_f 		weight_fprint;
 
 void wgt_set_inverse_chaching(bool on);
 
+/* Per-worker memo of (a, b) -> a op b for add, mul and div (on by default).
+ * wgt_memo_invalidate() drops all entries, which is needed whenever existing
+ * indices in the edge weight table change meaning. */
+void wgt_set_memo(bool on);
+void wgt_memo_invalidate();
+
 /*******************</For caching arithmetic operations>***********************/
 
 
@@ -141,6 +173,10 @@ AADD_WGT wgt_sub(AADD_WGT a, AADD_WGT b); // returns a - b
 AADD_WGT wgt_mul(AADD_WGT a, AADD_WGT b); // returns a * b
 AADD_WGT wgt_div(AADD_WGT a, AADD_WGT b); // returns a / b
 
+/* Computes out[k] = a[k] * b[k] for k < n. Equivalent to n calls to wgt_mul,
+ * but the edge weight table lookups of the products are done together. */
+void wgt_mul_batch(const AADD_WGT *a, const AADD_WGT *b, AADD_WGT *out, size_t n);
+
 /********************</Arithmetic functions on AADD_WGT's>*********************/
 
 
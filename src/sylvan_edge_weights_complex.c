@@ -66,6 +66,33 @@ _weight_complex_lookup_ptr(complex_t *a, void *wgt_store)
     return (AADD_WGT) res; 
 }
 
+void
+_weight_complex_lookup_ptr_batch(complex_t **a, AADD_WGT *res, size_t n, void *wgt_store)
+{
+    if (wgt_store_find_or_put_batch == NULL) {
+        for (size_t k = 0; k < n; k++) {
+            res[k] = _weight_complex_lookup_ptr(a[k], wgt_store);
+        }
+        return;
+    }
+
+    complex_t vals[CMAP_BATCH_SIZE];
+    int present[CMAP_BATCH_SIZE];
+    for (size_t start = 0; start < n; start += CMAP_BATCH_SIZE) {
+        size_t m = (n - start < CMAP_BATCH_SIZE) ? n - start : CMAP_BATCH_SIZE;
+        for (size_t k = 0; k < m; k++) {
+            vals[k] = *a[start+k];
+        }
+        if (wgt_store_find_or_put_batch(wgt_store, vals, &res[start], present, m) == -1) {
+            printf("Amplitude table full!\n");
+            exit(1);
+        }
+        for (size_t k = 0; k < m; k++) {
+            if (present[k] == 0) wgt_table_gc_inc_entries_estimate();
+        }
+    }
+}
+
 AADD_WGT
 weight_complex_lookup(complex_t *a)
 {
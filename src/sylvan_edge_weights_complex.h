@@ -11,6 +11,7 @@ complex_t *weight_complex_malloc();
 void _weight_complex_value(void *wgt_store, AADD_WGT a, complex_t *res);
 AADD_WGT weight_complex_lookup(complex_t *a);
 AADD_WGT _weight_complex_lookup_ptr(complex_t *a, void *wgt_store);
+void _weight_complex_lookup_ptr_batch(complex_t **a, AADD_WGT *res, size_t n, void *wgt_store);
 
 void init_complex_one_zero(void *wgt_store);
 
@@ -100,6 +100,9 @@ static const uint64_t CACHE_MTBDD_LESS              = (53LL<<40);
 static const uint64_t CACHE_MTBDD_GEQ               = (54LL<<40);
 static const uint64_t CACHE_MTBDD_GREATER           = (55LL<<40);
 static const uint64_t CACHE_MTBDD_EVAL_COMPOSE      = (56LL<<40);
+static const uint64_t CACHE_MTBDD_MATVEC_MULT       = (57LL<<40);
+static const uint64_t CACHE_MTBDD_MATMAT_MULT       = (58LL<<40);
+static const uint64_t CACHE_MTBDD_KRONECKER         = (59LL<<40);
 
 // AADD operations
 static const uint64_t CACHE_AADD_PLUS               = (60LL<<40);
@@ -116,12 +119,15 @@ static const uint64_t CACHE_WGT_SUB                 = (71LL<<40);
 static const uint64_t CACHE_WGT_MUL                 = (72LL<<40);
 static const uint64_t CACHE_WGT_DIV                 = (73LL<<40);
 
-// QMDD operations
-static const uint64_t CACHE_QMDD_GATE               = (80LL<<40);
-static const uint64_t CACHE_QMDD_CGATE              = (81LL<<40);
-static const uint64_t CACHE_QMDD_CGATE_RANGE        = (82LL<<40);
-static const uint64_t CACHE_QMDD_SUBCIRC            = (83LL<<40);
-static const uint64_t CACHE_QMDD_PROB               = (84LL<<40);
+// QMDD operations (80-93 are used by the ZDD operations)
+static const uint64_t CACHE_QMDD_GATE               = (94LL<<40);
+static const uint64_t CACHE_QMDD_CGATE              = (95LL<<40);
+static const uint64_t CACHE_QMDD_CGATE_RANGE        = (96LL<<40);
+static const uint64_t CACHE_QMDD_SUBCIRC            = (97LL<<40);
+static const uint64_t CACHE_QMDD_PROB               = (98LL<<40);
+static const uint64_t CACHE_QMDD_GATE_LAYER         = (99LL<<40);
+static const uint64_t CACHE_QMDD_GATE2              = (100LL<<40);
+static const uint64_t CACHE_QMDD_GATE2_MIX          = (101LL<<40);
 
 // ZDD operations
 static const uint64_t CACHE_ZDD_FROM_MTBDD          = (80LL<<40);
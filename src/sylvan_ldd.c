@@ -318,6 +318,26 @@ lddmc_refs_sync(MDD result)
 
 VOID_TASK_DECL_0(lddmc_gc_mark_serialize);
 
+/**
+ * Cache check for operations using cache_get4/cache_put4, which store the 4th
+ * LDD in the upper bits of the 2nd and 3rd key (used when the cache is kept
+ * during garbage collection)
+ */
+static inline int
+lddmc_gc_alive(uint64_t dd)
+{
+    dd &= 0x000000ffffffffffLL;
+    return dd < 2 || llmsset_is_marked(nodes, dd);
+}
+
+static int
+lddmc_cache4_alive(uint64_t a, uint64_t b, uint64_t c, uint64_t res)
+{
+    uint64_t dd4 = ((b >> 40) & 0x00000000000fffffLL) | ((c >> 20) & 0x000000fffff00000LL);
+    return lddmc_gc_alive(a) && lddmc_gc_alive(b) && lddmc_gc_alive(c) &&
+           lddmc_gc_alive(dd4) && lddmc_gc_alive(res);
+}
+
 /**
  * Initialize and quit functions
  */
@@ -335,6 +355,9 @@ sylvan_init_ldd()
     sylvan_gc_add_mark(TASK(lddmc_gc_mark_external_refs));
     sylvan_gc_add_mark(TASK(lddmc_gc_mark_protected));
     sylvan_gc_add_mark(TASK(lddmc_gc_mark_serialize));
+    cache_set_check(CACHE_MDD_RELPROD, lddmc_cache4_alive);
+    cache_set_check(CACHE_MDD_RELPREV, lddmc_cache4_alive);
+    cache_set_check(CACHE_MDD_JOIN, lddmc_cache4_alive);
 
     refs_create(&lddmc_refs, 1024);
     if (!lddmc_protected_created) {
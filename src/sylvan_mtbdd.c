@@ -376,6 +376,91 @@ mtbdd_refs_sync(MTBDD result)
     return result;
 }
 
+/**
+ * Complex double leaves do not fit in 64 bits; the leaf value is a pointer to
+ * a heap copy of the complex_double_t, owned by the unique table.
+ */
+static uint32_t complex_double_type;
+
+static uint64_t
+complex_double_hash(const uint64_t v, const uint64_t seed)
+{
+    complex_double_t *x = (complex_double_t*)(size_t)v;
+    const uint64_t prime = 1099511628211;
+    uint64_t hash = seed;
+    hash = (hash ^ *(uint64_t*)&x->real) * prime;
+    hash = (hash ^ (hash >> 29)) * prime;
+    hash = (hash ^ *(uint64_t*)&x->imag) * prime;
+    return hash ^ (hash >> 32);
+}
+
+static int
+complex_double_equals(const uint64_t left, const uint64_t right)
+{
+    complex_double_t *x = (complex_double_t*)(size_t)left;
+    complex_double_t *y = (complex_double_t*)(size_t)right;
+    return x->real == y->real && x->imag == y->imag;
+}
+
+static void
+complex_double_create(uint64_t *val)
+{
+    complex_double_t *x = (complex_double_t*)malloc(sizeof(complex_double_t));
+    *x = **(complex_double_t**)val;
+    *(complex_double_t**)val = x;
+}
+
+static void
+complex_double_destroy(uint64_t val)
+{
+    free((void*)(size_t)val);
+}
+
+static char*
+complex_double_to_str(int comp, uint64_t val, char *buf, size_t buflen)
+{
+    complex_double_t *x = (complex_double_t*)(size_t)val;
+    size_t len = snprintf(buf, buflen, "%g%+gi", x->real, x->imag) + 1;
+    if (len <= buflen) return buf;
+    char *res = (char*)malloc(len);
+    snprintf(res, len, "%g%+gi", x->real, x->imag);
+    return res;
+    (void)comp;
+}
+
+static int
+complex_double_write_binary(FILE* out, uint64_t val)
+{
+    complex_double_t *x = (complex_double_t*)(size_t)val;
+    if (fwrite(x, sizeof(complex_double_t), 1, out) != 1) return -1;
+    return 0;
+}
+
+static int
+complex_double_read_binary(FILE* in, uint64_t *val)
+{
+    complex_double_t *x = (complex_double_t*)malloc(sizeof(complex_double_t));
+    if (fread(x, sizeof(complex_double_t), 1, in) != 1) {
+        free(x);
+        return -1;
+    }
+    *(complex_double_t**)val = x;
+    return 0;
+}
+
+static void
+complex_double_init()
+{
+    complex_double_type = sylvan_mt_create_type();
+    sylvan_mt_set_hash(complex_double_type, complex_double_hash);
+    sylvan_mt_set_equals(complex_double_type, complex_double_equals);
+    sylvan_mt_set_create(complex_double_type, complex_double_create);
+    sylvan_mt_set_destroy(complex_double_type, complex_double_destroy);
+    sylvan_mt_set_to_str(complex_double_type, complex_double_to_str);
+    sylvan_mt_set_write_binary(complex_double_type, complex_double_write_binary);
+    sylvan_mt_set_read_binary(complex_double_type, complex_double_read_binary);
+}
+
 /**
  * Initialize and quit functions
  */
@@ -406,6 +491,8 @@ sylvan_init_mtbdd()
     sylvan_gc_add_mark(TASK(mtbdd_gc_mark_external_refs));
     sylvan_gc_add_mark(TASK(mtbdd_gc_mark_protected));
 
+    complex_double_init();
+
     refs_create(&mtbdd_refs, 1024);
     if (!mtbdd_protected_created) {
         protect_create(&mtbdd_protected, 4096);
@@ -616,8 +703,22 @@ mtbdd_fraction(int64_t nom, uint64_t denom)
 MTBDD
 mtbdd_complex_double(complex_double_t value)
 {
-    uint32_t terminal_type = 3; // Custom type for complex double
-    return mtbdd_makeleaf(terminal_type, *(uint64_t*)&value);
+    // normalize all -0.0 to 0.0
+    if (value.real == 0.0) value.real = 0.0;
+    if (value.imag == 0.0) value.imag = 0.0;
+    return mtbdd_makeleaf(complex_double_type, (size_t)&value);
+}
+
+uint32_t
+mtbdd_complex_double_type()
+{
+    return complex_double_type;
+}
+
+complex_double_t
+mtbdd_getcomplex_double(MTBDD leaf)
+{
+    return *(complex_double_t*)(size_t)mtbdd_getvalue(leaf);
 }
 
 MTBDD
@@ -1185,6 +1286,14 @@ TASK_IMPL_2(MTBDD, mtbdd_op_plus, MTBDD*, pa, MTBDD*, pb)
             denom_a *= denom_b/c;
             // add
             return mtbdd_fraction(nom_a + nom_b, denom_a);
+        } else if (mtbddnode_gettype(na) == complex_double_type && mtbddnode_gettype(nb) == complex_double_type) {
+            // both complex double
+            complex_double_t c_a = *(complex_double_t*)(size_t)val_a;
+            complex_double_t c_b = *(complex_double_t*)(size_t)val_b;
+            if (c_a.real == 0.0 && c_a.imag == 0.0) return b;
+            if (c_b.real == 0.0 && c_b.imag == 0.0) return a;
+            complex_double_t c = { c_a.real + c_b.real, c_a.imag + c_b.imag };
+            return mtbdd_complex_double(c);
         } else {
             assert(0); // failure
         }
@@ -1299,6 +1408,17 @@ TASK_IMPL_2(MTBDD, mtbdd_op_times, MTBDD*, pa, MTBDD*, pb)
             nom_a *= (nom_b/c);
             denom_a *= (denom_b/d);
             return mtbdd_fraction(nom_a, denom_a);
+        } else if (mtbddnode_gettype(na) == complex_double_type && mtbddnode_gettype(nb) == complex_double_type) {
+            // both complex double
+            complex_double_t c_a = *(complex_double_t*)(size_t)val_a;
+            complex_double_t c_b = *(complex_double_t*)(size_t)val_b;
+            if (c_a.real == 0.0 && c_a.imag == 0.0) return a;
+            if (c_b.real == 0.0 && c_b.imag == 0.0) return b;
+            if (c_a.real == 1.0 && c_a.imag == 0.0) return b;
+            if (c_b.real == 1.0 && c_b.imag == 0.0) return a;
+            complex_double_t c = { c_a.real * c_b.real - c_a.imag * c_b.imag,
+                                   c_a.real * c_b.imag + c_a.imag * c_b.real };
+            return mtbdd_complex_double(c);
         } else {
             assert(0); // failure
         }
@@ -2322,6 +2442,233 @@ TASK_IMPL_3(MTBDD, mtbdd_and_abstract_max, MTBDD, a, MTBDD, b, MTBDD, v)
     return result;
 }
 
+/**
+ * Return 1 if <a> is mtbdd_false or a zero leaf, 0 otherwise.
+ */
+static inline int
+mtbdd_iszero(MTBDD a)
+{
+    if (a == mtbdd_false) return 1;
+    if (a == mtbdd_true || !mtbdd_isleaf(a)) return 0;
+    uint32_t type = mtbdd_gettype(a);
+    uint64_t val = mtbdd_getvalue(a);
+    if (type == 0) return *(int64_t*)&val == 0;
+    if (type == 1) return *(double*)&val == 0.0;
+    if (type == 2) return (int32_t)(val>>32) == 0;
+    if (type == complex_double_type) {
+        complex_double_t *c = (complex_double_t*)(size_t)val;
+        return c->real == 0.0 && c->imag == 0.0;
+    }
+    return 0;
+}
+
+/**
+ * Get the cofactors of <a> w.r.t. variable <var>; both are <a> itself when
+ * <a> does not test <var> at its root.
+ */
+static inline void
+mtbdd_cofactors(MTBDD a, uint32_t var, MTBDD *low, MTBDD *high)
+{
+    if (!mtbdd_isleaf(a)) {
+        mtbddnode_t n = MTBDD_GETNODE(a);
+        if (mtbddnode_getvariable(n) == var) {
+            *low  = node_getlow(a, n);
+            *high = node_gethigh(a, n);
+            return;
+        }
+    }
+    *low  = a;
+    *high = a;
+}
+
+/**
+ * Compute A.v for the part of A and v at or below qubit <nextvar>.
+ */
+TASK_IMPL_4(MTBDD, mtbdd_matvec_mult_rec, MTBDD, A, MTBDD, v, int, n, int, nextvar)
+{
+    /* Trivial case: either one is all 0 */
+    if (mtbdd_iszero(A)) return A;
+    if (mtbdd_iszero(v)) return v;
+
+    /* Terminal case: past last variable */
+    if (nextvar == n) {
+        assert(mtbdd_isleaf(A) && mtbdd_isleaf(v));
+        return mtbdd_apply(A, v, TASK(mtbdd_op_times));
+    }
+
+    /* Maybe perform garbage collection */
+    sylvan_gc_test();
+
+    /* Count operation */
+    sylvan_stats_count(MTBDD_MATVEC_MULT);
+
+    /* Check cache */
+    MTBDD result;
+    if (cache_get3(CACHE_MTBDD_MATVEC_MULT, A, v, nextvar, &result)) {
+        sylvan_stats_count(MTBDD_MATVEC_MULT_CACHED);
+        return result;
+    }
+
+    /* Get cofactors: column bit on 2k, row bit on 2k+1 */
+    MTBDD v_low, v_high, A_low, A_high, u00, u10, u01, u11;
+    mtbdd_cofactors(v, nextvar, &v_low, &v_high);
+    mtbdd_cofactors(A, 2*nextvar, &A_low, &A_high);
+    mtbdd_cofactors(A_low, 2*nextvar+1, &u00, &u10);
+    mtbdd_cofactors(A_high, 2*nextvar+1, &u01, &u11);
+
+    /* Recursive */
+    // |u00 u01| |v_low | = v_low|u00| + v_high|u01|
+    // |u10 u11| |v_high|        |u10|         |u11|
+    mtbdd_refs_spawn(SPAWN(mtbdd_matvec_mult_rec, u00, v_low,  n, nextvar+1));
+    mtbdd_refs_spawn(SPAWN(mtbdd_matvec_mult_rec, u10, v_low,  n, nextvar+1));
+    mtbdd_refs_spawn(SPAWN(mtbdd_matvec_mult_rec, u01, v_high, n, nextvar+1));
+    MTBDD r11 = mtbdd_refs_push(CALL(mtbdd_matvec_mult_rec, u11, v_high, n, nextvar+1));
+    MTBDD r01 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matvec_mult_rec)));
+    MTBDD r10 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matvec_mult_rec)));
+    MTBDD r00 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matvec_mult_rec)));
+
+    /* Gather and add the two halves */
+    MTBDD res_low  = mtbdd_refs_push(mtbdd_makenode(nextvar, r00, r10));
+    MTBDD res_high = mtbdd_refs_push(mtbdd_makenode(nextvar, r01, r11));
+    result = CALL(mtbdd_apply, res_low, res_high, TASK(mtbdd_op_plus));
+    mtbdd_refs_pop(6);
+
+    /* Store in cache */
+    if (cache_put3(CACHE_MTBDD_MATVEC_MULT, A, v, nextvar, result)) {
+        sylvan_stats_count(MTBDD_MATVEC_MULT_CACHEDPUT);
+    }
+
+    return result;
+}
+
+/**
+ * Compute A.B for the part of A and B at or below qubit <nextvar>.
+ */
+TASK_IMPL_4(MTBDD, mtbdd_matmat_mult_rec, MTBDD, A, MTBDD, B, int, n, int, nextvar)
+{
+    /* Trivial case: either one is all 0 */
+    if (mtbdd_iszero(A)) return A;
+    if (mtbdd_iszero(B)) return B;
+
+    /* Terminal case: past last variable */
+    if (nextvar == n) {
+        assert(mtbdd_isleaf(A) && mtbdd_isleaf(B));
+        return mtbdd_apply(A, B, TASK(mtbdd_op_times));
+    }
+
+    /* Maybe perform garbage collection */
+    sylvan_gc_test();
+
+    /* Count operation */
+    sylvan_stats_count(MTBDD_MATMAT_MULT);
+
+    /* Check cache */
+    MTBDD result;
+    if (cache_get3(CACHE_MTBDD_MATMAT_MULT, A, B, nextvar, &result)) {
+        sylvan_stats_count(MTBDD_MATMAT_MULT_CACHED);
+        return result;
+    }
+
+    /* Get cofactors: column bit on 2k, row bit on 2k+1 */
+    MTBDD A_low, A_high, a00, a10, a01, a11, B_low, B_high, b00, b10, b01, b11;
+    mtbdd_cofactors(A, 2*nextvar, &A_low, &A_high);
+    mtbdd_cofactors(B, 2*nextvar, &B_low, &B_high);
+    mtbdd_cofactors(A_low, 2*nextvar+1, &a00, &a10);
+    mtbdd_cofactors(A_high, 2*nextvar+1, &a01, &a11);
+    mtbdd_cofactors(B_low, 2*nextvar+1, &b00, &b10);
+    mtbdd_cofactors(B_high, 2*nextvar+1, &b01, &b11);
+
+    /* Recursive */
+    // |a00 a01| |b00 b01| = b00|a00| + b10|a01| , b01|a00| + b11|a01|
+    // |a10 a11| |b10 b11|      |a10|      |a11|      |a10|      |a11|
+    mtbdd_refs_spawn(SPAWN(mtbdd_matmat_mult_rec, a00, b00, n, nextvar+1));
+    mtbdd_refs_spawn(SPAWN(mtbdd_matmat_mult_rec, a00, b01, n, nextvar+1));
+    mtbdd_refs_spawn(SPAWN(mtbdd_matmat_mult_rec, a10, b00, n, nextvar+1));
+    mtbdd_refs_spawn(SPAWN(mtbdd_matmat_mult_rec, a10, b01, n, nextvar+1));
+    mtbdd_refs_spawn(SPAWN(mtbdd_matmat_mult_rec, a01, b10, n, nextvar+1));
+    mtbdd_refs_spawn(SPAWN(mtbdd_matmat_mult_rec, a01, b11, n, nextvar+1));
+    mtbdd_refs_spawn(SPAWN(mtbdd_matmat_mult_rec, a11, b10, n, nextvar+1));
+    MTBDD a11_b11 = mtbdd_refs_push(CALL(mtbdd_matmat_mult_rec, a11, b11, n, nextvar+1));
+    MTBDD a11_b10 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matmat_mult_rec)));
+    MTBDD a01_b11 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matmat_mult_rec)));
+    MTBDD a01_b10 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matmat_mult_rec)));
+    MTBDD a10_b01 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matmat_mult_rec)));
+    MTBDD a10_b00 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matmat_mult_rec)));
+    MTBDD a00_b01 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matmat_mult_rec)));
+    MTBDD a00_b00 = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_matmat_mult_rec)));
+
+    /* Gather and add the partial products per column half */
+    MTBDD lh1 = mtbdd_refs_push(mtbdd_makenode(2*nextvar+1, a00_b00, a10_b00));
+    MTBDD lh2 = mtbdd_refs_push(mtbdd_makenode(2*nextvar+1, a01_b10, a11_b10));
+    MTBDD rh1 = mtbdd_refs_push(mtbdd_makenode(2*nextvar+1, a00_b01, a10_b01));
+    MTBDD rh2 = mtbdd_refs_push(mtbdd_makenode(2*nextvar+1, a01_b11, a11_b11));
+    mtbdd_refs_spawn(SPAWN(mtbdd_apply, lh1, lh2, TASK(mtbdd_op_plus)));
+    MTBDD rh = mtbdd_refs_push(CALL(mtbdd_apply, rh1, rh2, TASK(mtbdd_op_plus)));
+    MTBDD lh = mtbdd_refs_push(mtbdd_refs_sync(SYNC(mtbdd_apply)));
+    result = mtbdd_makenode(2*nextvar, lh, rh);
+    mtbdd_refs_pop(14);
+
+    /* Store in cache */
+    if (cache_put3(CACHE_MTBDD_MATMAT_MULT, A, B, nextvar, result)) {
+        sylvan_stats_count(MTBDD_MATMAT_MULT_CACHEDPUT);
+    }
+
+    return result;
+}
+
+/**
+ * Compute a (tensor) b, where all variables of b are shifted down by <k>.
+ */
+TASK_IMPL_3(MTBDD, mtbdd_kronecker_prod, MTBDD, a, MTBDD, b, int, k)
+{
+    /* Trivial case: either one is all 0 */
+    if (mtbdd_iszero(a)) return a;
+    if (mtbdd_iszero(b)) return b;
+
+    /* Terminal case: scale b with the leaf of a */
+    int la = mtbdd_isleaf(a);
+    int lb = mtbdd_isleaf(b);
+    if (la && lb) return mtbdd_apply(a, b, TASK(mtbdd_op_times));
+
+    /* Maybe perform garbage collection */
+    sylvan_gc_test();
+
+    /* Count operation */
+    sylvan_stats_count(MTBDD_KRONECKER);
+
+    /* Check cache */
+    MTBDD result;
+    if (cache_get3(CACHE_MTBDD_KRONECKER, a, b, k, &result)) {
+        sylvan_stats_count(MTBDD_KRONECKER_CACHED);
+        return result;
+    }
+
+    /* Descend a first; once a is a leaf, descend (and shift) b */
+    uint32_t var;
+    MTBDD low, high;
+    if (!la) {
+        mtbddnode_t na = MTBDD_GETNODE(a);
+        var = mtbddnode_getvariable(na);
+        mtbdd_refs_spawn(SPAWN(mtbdd_kronecker_prod, node_gethigh(a, na), b, k));
+        low = mtbdd_refs_push(CALL(mtbdd_kronecker_prod, node_getlow(a, na), b, k));
+    } else {
+        mtbddnode_t nb = MTBDD_GETNODE(b);
+        var = mtbddnode_getvariable(nb) + k;
+        mtbdd_refs_spawn(SPAWN(mtbdd_kronecker_prod, a, node_gethigh(b, nb), k));
+        low = mtbdd_refs_push(CALL(mtbdd_kronecker_prod, a, node_getlow(b, nb), k));
+    }
+    high = mtbdd_refs_sync(SYNC(mtbdd_kronecker_prod));
+    mtbdd_refs_pop(1);
+    result = mtbdd_makenode(var, low, high);
+
+    /* Store in cache */
+    if (cache_put3(CACHE_MTBDD_KRONECKER, a, b, k, result)) {
+        sylvan_stats_count(MTBDD_KRONECKER_CACHEDPUT);
+    }
+
+    return result;
+}
+
 /**
  * Calculate the support of a MTBDD, i.e. the cube of all variables that appear in the MTBDD nodes.
  */
@@ -33,7 +33,7 @@
  * Type "1" is the Real type.
  * Type "2" is the Fraction type, consisting of two 32-bit integers (numerator and denominator).
  * 
- * TODO: Type "3" is custom: Complex number with doubles
+ * Type "3" is normally the custom Complex double type registered by sylvan_init_mtbdd.
  * TODO: Type "4" is custom: Complex number implemented with the MPC Library.
  * 
  * For non-Boolean MTBDDs, mtbdd_false is used for partial functions, i.e. mtbdd_false
@@ -262,6 +262,16 @@ typedef struct complex_double_s {
 MTBDD
 mtbdd_complex_double(complex_double_t value);
 
+/**
+ * The custom leaf type id of Complex double leaves.
+ */
+uint32_t mtbdd_complex_double_type(void);
+
+/**
+ * Obtain the value of a Complex double leaf.
+ */
+complex_double_t mtbdd_getcomplex_double(MTBDD leaf);
+
 /**
  * Make a Complex MPC library leaf with the given real and imaginary parts
 */
@@ -1201,16 +1211,41 @@ typedef uint32_t MatArr_t;
 MTBDD mtbdd_vector_array_to_mtbdd(VecArr_t vec_arr, int n);
 MTBDD mtbdd_matrix_array_to_mtbdd(MatArr_t mat_arr, int n);
 
-MTBDD mtbdd_matvec_mult(MTBDD A, MTBDD v, int n);    // Computes A.v for an 2^n vector and a 2^n x 2^n matrix.
-MTBDD mtbdd_matmat_mult(MTBDD A, MTBDD B, int n);    // Computes A.B for two 2^n x 2^n matrices.
+/**
+ * Matrix/vector operations for MTBDDs of any leaf type supported by
+ * mtbdd_op_plus and mtbdd_op_times (e.g. complex double leaves).
+ *
+ * A vector over n qubits uses variables 0...n-1. A 2^n x 2^n matrix uses
+ * variables 0...2n-1, with the column bit of qubit k on variable 2k and the
+ * row bit on variable 2k+1, the same layout as the AADD matrices.
+ */
+TASK_DECL_4(MTBDD, mtbdd_matvec_mult_rec, MTBDD, MTBDD, int, int);
+TASK_DECL_4(MTBDD, mtbdd_matmat_mult_rec, MTBDD, MTBDD, int, int);
 
 /**
- * // TODO: Kronecker (or tensor) multiplication
- * 
- * 
-*/
-MTBDD mtbdd_vec_kronecker_prod(MTBDD v, MTBDD w, int n_v);    // Computes a \tensor b for two vector QMDDs.
-MTBDD mtbdd_mat_kronecker_prod(MTBDD A, MTBDD B, MTBDD n_A);  // Computes a \tensor b for two matrix QMDDs.
+ * Computes A.v for a 2^n vector and a 2^n x 2^n matrix.
+ */
+#define mtbdd_matvec_mult(A, v, n) RUN(mtbdd_matvec_mult_rec, A, v, n, 0)
+
+/**
+ * Computes A.B for two 2^n x 2^n matrices.
+ */
+#define mtbdd_matmat_mult(A, B, n) RUN(mtbdd_matmat_mult_rec, A, B, n, 0)
+
+/**
+ * Computes a \tensor b, with all variables of b shifted by k.
+ */
+TASK_DECL_3(MTBDD, mtbdd_kronecker_prod, MTBDD, MTBDD, int);
+
+/**
+ * Computes v \tensor w for a vector v over n_v qubits.
+ */
+#define mtbdd_vec_kronecker_prod(v, w, n_v) RUN(mtbdd_kronecker_prod, v, w, n_v)
+
+/**
+ * Computes A \tensor B for a matrix A over n_A qubits.
+ */
+#define mtbdd_mat_kronecker_prod(A, B, n_A) RUN(mtbdd_kronecker_prod, A, B, 2*(n_A))
 
 
 #ifdef __cplusplus
@@ -36,7 +36,8 @@ pthread_key_t sylvan_stats_key;
 struct
 {
     int type; /* 0 for print line, 1 for simple counter, 2 for operation with CACHED and CACHEDPUT */
-              /* 3 for timer, 4 for report table data */
+              /* 3 for timer, 4 for report table data, 5 for cache counters per opid */
+              /* 6 for a histogram of pause times */
     int id;
     const char *key;
 } sylvan_report_info[] =
@@ -84,6 +85,9 @@ struct
     {2, MTBDD_MINIMUM, "MTBDD minimum"},
     {2, MTBDD_MAXIMUM, "MTBDD maximum"},
     {2, MTBDD_EVAL_COMPOSE, "MTBDD eval_compose"},
+    {2, MTBDD_MATVEC_MULT, "MTBDD matvec"},
+    {2, MTBDD_MATMAT_MULT, "MTBDD matmat"},
+    {2, MTBDD_KRONECKER, "MTBDD kronecker"},
 
     {2, LDD_UNION, "LDD union"},
     {2, LDD_MINUS, "LDD minus"},
@@ -115,9 +119,23 @@ struct
     {2, ZDD_ISOP, "zdd isop"},
     {2, ZDD_COVER_TO_BDD, "zdd cover_to_bdd"},
 
+    {0, 0, "Adaptive caching"},
+    {1, AADD_CACHE_LEVEL_SKIP, "Skipped lookups"},
+    {1, AADD_CACHE_LEVEL_OFF, "Levels switched off"},
+
+    {0, 0, "Edge weights"},
+    {1, WGT_MEMO_HIT, "Memo hits"},
+    {1, WGT_MEMO_MISS, "Memo misses"},
+
+    {0, 0, "Cache (per opid)     Hits             Misses           Overwrites"},
+    {5, 0, NULL}, /* trigger to report operation cache counters per opid */
+
     {0, 0, "Garbage collection"},
     {1, SYLVAN_GC_COUNT, "GC executions"},
+    {1, SYLVAN_GC_MINOR_COUNT, "Minor GCs"},
     {3, SYLVAN_GC, "Total time spent"},
+    {6, SYLVAN_GC_PAUSE_FULL, "Full GC pauses"},
+    {6, SYLVAN_GC_PAUSE_MINOR, "Minor GC pauses"},
 
     {-1, -1, NULL},
 };
@@ -215,6 +233,50 @@ VOID_TASK_IMPL_1(sylvan_stats_snapshot, sylvan_stats_t*, target)
 #define ULINE "\33[4m"
 #define PINK "\33[38;5;200m"
 
+/**
+ * Names of operations for the per-opid cache counters
+ */
+static const struct
+{
+    uint64_t opid;
+    const char *name;
+} cache_opid_names[] =
+{
+    {CACHE_MTBDD_MATVEC_MULT, "MTBDD matvec"},
+    {CACHE_MTBDD_MATMAT_MULT, "MTBDD matmat"},
+    {CACHE_MTBDD_KRONECKER, "MTBDD kronecker"},
+    {CACHE_AADD_PLUS, "AADD plus"},
+    {CACHE_AADD_MATVEC_MULT, "AADD matvec"},
+    {CACHE_AADD_MATMAT_MULT, "AADD matmat"},
+    {CACHE_AADD_REPLACE_TERMINAL, "AADD repl_term"},
+    {CACHE_AADD_INC_VARS, "AADD inc_vars"},
+    {CACHE_AADD_CLEAN_WGT_TABLE, "AADD clean_wgt"},
+    {CACHE_AADD_IS_ORDERED, "AADD is_ordered"},
+    {CACHE_WGT_ADD, "WGT add"},
+    {CACHE_WGT_SUB, "WGT sub"},
+    {CACHE_WGT_MUL, "WGT mul"},
+    {CACHE_WGT_DIV, "WGT div"},
+    {CACHE_QMDD_GATE, "QMDD gate"},
+    {CACHE_QMDD_CGATE, "QMDD cgate"},
+    {CACHE_QMDD_CGATE_RANGE, "QMDD cgate_range"},
+    {CACHE_QMDD_SUBCIRC, "QMDD subcirc"},
+    {CACHE_QMDD_GATE_LAYER, "QMDD gate_layer"},
+    {CACHE_QMDD_GATE2, "QMDD gate2"},
+    {CACHE_QMDD_GATE2_MIX, "QMDD gate2 (mix)"},
+    {0, NULL},
+};
+
+static const char*
+cache_opid_name(size_t op, char *buf)
+{
+    for (int i=0; cache_opid_names[i].name != NULL; i++) {
+        if ((cache_opid_names[i].opid >> 40) == op) return cache_opid_names[i].name;
+    }
+    if (op == CACHE_STATS_OPIDS-1) sprintf(buf, "opid >= %zu", op);
+    else sprintf(buf, "opid %zu", op);
+    return buf;
+}
+
 static char*
 to_h(double size, char *buf)
 {
@@ -225,6 +287,15 @@ to_h(double size, char *buf)
     return buf;
 }
 
+static char*
+to_us(uint64_t us, char *buf)
+{
+    if (us < 1000) sprintf(buf, "%" PRIu64 " us", us);
+    else if (us < 1000000) sprintf(buf, "%.3g ms", (double)us/1000);
+    else sprintf(buf, "%.3g s", (double)us/1000000);
+    return buf;
+}
+
 void
 sylvan_stats_report(FILE *target)
 {
@@ -266,6 +337,9 @@ sylvan_stats_report(FILE *target)
         } else if (type == 4) {
             fprintf(target, "%-20s %'zu of %'zu buckets filled.\n", "Unique nodes table", llmsset_count_marked(nodes), llmsset_get_size(nodes));
             fprintf(target, "%-20s %'zu of %'zu buckets filled.\n", "Operation cache", cache_getused(), cache_getsize());
+            for (int seg=1; seg<cache_getnumsegments(); seg++) {
+                fprintf(target, "Cache segment %-6d %'zu of %'zu buckets filled.\n", seg, cache_segment_getused(seg), cache_segment_getsize(seg));
+            }
             char buf[64], buf2[64];
             to_h(24ULL * llmsset_get_size(nodes), buf);
             to_h(24ULL * llmsset_get_max_size(nodes), buf2);
@@ -273,6 +347,28 @@ sylvan_stats_report(FILE *target)
             to_h(36ULL * cache_getsize(), buf);
             to_h(36ULL * cache_getmaxsize(), buf2);
             fprintf(target, "%-20s %s (max real) of %s (allocated virtual memory).\n", "Memory (cache)", buf, buf2);
+            sylvan_alloc_report(target);
+        } else if (type == 5) {
+            char buf[64];
+            for (size_t op=0; op<CACHE_STATS_OPIDS; op++) {
+                uint64_t *c = totals.counters + CACHE_OPID_COUNTERS + 3*op;
+                if (c[CACHE_STATS_HIT] == 0 && c[CACHE_STATS_MISS] == 0) continue;
+                fprintf(target, "%-20s %'-16"PRIu64 " %'-16"PRIu64" %'-16"PRIu64 "\n", cache_opid_name(op, buf),
+                        c[CACHE_STATS_HIT], c[CACHE_STATS_MISS], c[CACHE_STATS_OVERWRITE]);
+            }
+        } else if (type == 6) {
+            uint64_t *c = totals.counters + id;
+            uint64_t total = 0;
+            for (int k=0; k<SYLVAN_STATS_HIST_BUCKETS; k++) total += c[k];
+            if (total > 0) fprintf(target, "%-20s %'-16"PRIu64"\n", sylvan_report_info[i].key, total);
+            for (int k=0; k<SYLVAN_STATS_HIST_BUCKETS; k++) {
+                if (c[k] == 0) continue;
+                char lo[32], hi[32], range[64];
+                if (k == 0) sprintf(range, "  < %s", to_us(64, hi));
+                else if (k == SYLVAN_STATS_HIST_BUCKETS-1) sprintf(range, "  >= %s", to_us(32ULL<<k, lo));
+                else sprintf(range, "  %s - %s", to_us(32ULL<<k, lo), to_us(64ULL<<k, hi));
+                fprintf(target, "%-20s %'-16"PRIu64"\n", range, c[k]);
+            }
         }
         i++;
     }
@@ -24,8 +24,21 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * Number of operation ids (opid >> 40) that get their own operation cache 
+ * counters. Larger operation ids all share the last counters.
+ */
+#define CACHE_STATS_OPIDS 128
+
 #define OPCOUNTER(NAME) NAME, NAME ## _CACHEDPUT, NAME ## _CACHED
 
+/**
+ * Number of buckets of the pause time histograms. Bucket 0 counts pauses below
+ * 64 us, bucket k counts pauses of [2^(k+5), 2^(k+6)) us, the last bucket also
+ * counts all longer pauses.
+ */
+#define SYLVAN_STATS_HIST_BUCKETS 16
+
 typedef enum {
     /* Creating nodes */
     BDD_NODES_CREATED,
@@ -73,6 +86,9 @@ typedef enum {
     OPCOUNTER(MTBDD_MINIMUM),
     OPCOUNTER(MTBDD_MAXIMUM),
     OPCOUNTER(MTBDD_EVAL_COMPOSE),
+    OPCOUNTER(MTBDD_MATVEC_MULT),
+    OPCOUNTER(MTBDD_MATMAT_MULT),
+    OPCOUNTER(MTBDD_KRONECKER),
 
     /* LDD operations */
     OPCOUNTER(LDD_UNION),
@@ -92,11 +108,14 @@ typedef enum {
     /* AADD operations */
     OPCOUNTER(AADD_PLUS),
     OPCOUNTER(AADD_MULT),
+    AADD_CACHE_LEVEL_SKIP,
+    AADD_CACHE_LEVEL_OFF,
 
     /* QMDD operations */
     OPCOUNTER(QMDD_GATE),
     OPCOUNTER(QMDD_CGATE),
-    OPCOUNTER(QMDD_PROB),
+    OPCOUNTER(QMDD_GATE_LAYER),
+    OPCOUNTER(QMDD_GATE2),
 
     /* AMP arithmetic operations */
     OPCOUNTER(WGT_ADD),
@@ -104,6 +123,8 @@ typedef enum {
     OPCOUNTER(WGT_MUL),
     OPCOUNTER(WGT_DIV),
     OPCOUNTER(WGT_MUL_DOWN), // seperate counter from regular mul
+    WGT_MEMO_HIT,
+    WGT_MEMO_MISS,
     /* ZDD operations */
     OPCOUNTER(ZDD_FROM_MTBDD),
     OPCOUNTER(ZDD_TO_MTBDD),
@@ -123,11 +144,27 @@ typedef enum {
 
     /* Other counters */
     SYLVAN_GC_COUNT,
+    SYLVAN_GC_MINOR_COUNT,
     LLMSSET_LOOKUP,
 
-    SYLVAN_COUNTER_COUNTER
+    /* Pause time histograms of full and minor garbage collection */
+    SYLVAN_GC_PAUSE_FULL,
+    SYLVAN_GC_PAUSE_MINOR = SYLVAN_GC_PAUSE_FULL + SYLVAN_STATS_HIST_BUCKETS,
+    SYLVAN_GC_PAUSE_END = SYLVAN_GC_PAUSE_MINOR + SYLVAN_STATS_HIST_BUCKETS,
+
+    /* Operation cache counters per operation id (see sylvan_stats_count_cache) */
+    CACHE_OPID_COUNTERS = SYLVAN_GC_PAUSE_END,
+
+    SYLVAN_COUNTER_COUNTER = CACHE_OPID_COUNTERS + 3*CACHE_STATS_OPIDS
 } Sylvan_Counters;
 
+typedef enum
+{
+    CACHE_STATS_HIT,
+    CACHE_STATS_MISS,
+    CACHE_STATS_OVERWRITE,
+} Sylvan_Cache_Counters;
+
 #undef OPCOUNTER
 
 typedef enum
@@ -213,6 +250,12 @@ sylvan_stats_add(size_t counter, size_t amount)
 #endif
 }
 
+static inline void
+sylvan_stats_count_cache(size_t opid_index, size_t counter)
+{
+    sylvan_stats_count(CACHE_OPID_COUNTERS + 3*opid_index + counter);
+}
+
 static inline void
 sylvan_timer_start(size_t timer)
 {
@@ -239,6 +282,27 @@ sylvan_timer_stop(size_t timer)
 #endif
 }
 
+/* Stop the timer and also count the elapsed time in the histogram starting at counter <hist> */
+static inline void
+sylvan_timer_stop_hist(size_t timer, size_t hist)
+{
+    uint64_t t = getabstime();
+
+#ifdef __ELF__
+    uint64_t d = t - sylvan_stats.timers_startstop[timer];
+    sylvan_stats.timers[timer] += d;
+#else
+    sylvan_stats_t *sylvan_stats = (sylvan_stats_t*)pthread_getspecific(sylvan_stats_key);
+    uint64_t d = t - sylvan_stats->timers_startstop[timer];
+    sylvan_stats->timers[timer] += d;
+#endif
+
+    uint64_t us = d / 1000;
+    int k = us < 64 ? 0 : 58 - __builtin_clzll(us);
+    if (k >= SYLVAN_STATS_HIST_BUCKETS) k = SYLVAN_STATS_HIST_BUCKETS-1;
+    sylvan_stats_count(hist + k);
+}
+
 #else
 
 static inline void
@@ -254,6 +318,13 @@ sylvan_stats_add(size_t counter, size_t amount)
     (void)amount;
 }
 
+static inline void
+sylvan_stats_count_cache(size_t opid_index, size_t counter)
+{
+    (void)opid_index;
+    (void)counter;
+}
+
 static inline void
 sylvan_timer_start(size_t timer)
 {
@@ -266,6 +337,13 @@ sylvan_timer_stop(size_t timer)
     (void)timer;
 }
 
+static inline void
+sylvan_timer_stop_hist(size_t timer, size_t hist)
+{
+    (void)timer;
+    (void)hist;
+}
+
 #endif
 
 #ifdef __cplusplus
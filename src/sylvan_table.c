@@ -113,6 +113,9 @@ static const uint64_t CL_MASK_R   = ((LINE_SIZE) / 8) - 1;
 #define MASK_INDEX ((uint64_t)0x000000ffffffffff)
 #define MASK_HASH  ((uint64_t)0xffffff0000000000)
 
+/* Hash bucket of deleted data (index 1 is never used for data) */
+#define TOMBSTONE  ((uint64_t)1)
+
 static inline uint64_t
 llmsset_lookup2(const llmsset_t dbs, uint64_t a, uint64_t b, int* created, const int custom)
 {
@@ -152,7 +155,7 @@ llmsset_lookup2(const llmsset_t dbs, uint64_t a, uint64_t b, int* created, const
             }
         }
 
-        if (hash == (v & MASK_HASH)) {
+        if (hash == (v & MASK_HASH) && v != TOMBSTONE) {
             uint64_t d_idx = v & MASK_INDEX;
             uint64_t *d_ptr = ((uint64_t*)dbs->data) + 2*d_idx;
             if (custom) {
@@ -292,8 +295,8 @@ llmsset_create(size_t initial_size, size_t max_size)
     /* This implementation of "resizable hash table" allocates the max_size table in virtual memory,
        but only uses the "actual size" part in real memory */
 
-    dbs->table = (_Atomic(uint64_t)*) alloc_aligned(dbs->max_size * 8);
-    dbs->data = (uint8_t*) alloc_aligned(dbs->max_size * 16);
+    dbs->table = (_Atomic(uint64_t)*) alloc_table(dbs->max_size * 8, "nodes table (hash)", 1);
+    dbs->data = (uint8_t*) alloc_table(dbs->max_size * 16, "nodes table (data)", 1);
 
     /* Also allocate bitmaps. Each region is 64*8 = 512 buckets.
        Overhead of bitmap1: 1 bit per 4096 bucket.
@@ -303,8 +306,9 @@ llmsset_create(size_t initial_size, size_t max_size)
     dbs->bitmap1 = (_Atomic(uint64_t)*)alloc_aligned(dbs->max_size / (512*8));
     dbs->bitmap2 = (_Atomic(uint64_t)*)alloc_aligned(dbs->max_size / 8);
     dbs->bitmapc = (uint64_t*)alloc_aligned(dbs->max_size / 8);
+    dbs->bitmapo = (_Atomic(uint64_t)*)alloc_aligned(dbs->max_size / 8);
 
-    if (dbs->table == 0 || dbs->data == 0 || dbs->bitmap1 == 0 || dbs->bitmap2 == 0 || dbs->bitmapc == 0) {
+    if (dbs->table == 0 || dbs->data == 0 || dbs->bitmap1 == 0 || dbs->bitmap2 == 0 || dbs->bitmapc == 0 || dbs->bitmapo == 0) {
         fprintf(stderr, "llmsset_create: Unable to allocate memory: %s!\n", strerror(errno));
         exit(1);
     }
@@ -315,6 +319,9 @@ llmsset_create(size_t initial_size, size_t max_size)
 
     // forbid first two positions (index 0 and 1)
     dbs->bitmap2[0] = 0xc000000000000000LL;
+    dbs->bitmapo[0] = 0xc000000000000000LL;
+    dbs->tombstones = 0;
+    dbs->survivors = 0;
 
     dbs->hash_cb = NULL;
     dbs->equals_cb = NULL;
@@ -328,6 +335,11 @@ llmsset_create(size_t initial_size, size_t max_size)
     INIT_THREAD_LOCAL(my_region);
     TOGETHER(llmsset_reset_region);
 
+    // with first-touch placement, every worker touches the part where it claims
+    // its first regions (later regions are touched by the worker claiming them)
+    prefault_table(dbs->table, dbs->table_size * 8);
+    prefault_table(dbs->data, dbs->table_size * 16);
+
     // initialize hashtab
     sylvan_init_hash();
 
@@ -337,11 +349,12 @@ llmsset_create(size_t initial_size, size_t max_size)
 void
 llmsset_free(llmsset_t dbs)
 {
-    free_aligned(dbs->table, dbs->max_size * 8);
-    free_aligned(dbs->data, dbs->max_size * 16);
+    free_table(dbs->table, dbs->max_size * 8);
+    free_table(dbs->data, dbs->max_size * 16);
     free_aligned(dbs->bitmap1, dbs->max_size / (512*8));
     free_aligned(dbs->bitmap2, dbs->max_size / 8);
     free_aligned(dbs->bitmapc, dbs->max_size / 8);
+    free_aligned(dbs->bitmapo, dbs->max_size / 8);
     free_aligned(dbs, sizeof(struct llmsset));
 }
 
@@ -358,13 +371,16 @@ VOID_TASK_IMPL_1(llmsset_clear_data, llmsset_t, dbs)
 
     // forbid first two positions (index 0 and 1)
     dbs->bitmap2[0] = 0xc000000000000000LL;
+    dbs->survivors = 0;
 
     TOGETHER(llmsset_reset_region);
 }
 
 VOID_TASK_IMPL_1(llmsset_clear_hashes, llmsset_t, dbs)
 {
-    clear_aligned(dbs->table, dbs->max_size * 8);
+    clear_table(dbs->table, dbs->max_size * 8);
+    CALL(prefault_table, dbs->table, dbs->table_size * 8);
+    dbs->tombstones = 0;
 }
 
 int
@@ -395,11 +411,13 @@ TASK_3(int, llmsset_rehash_par, llmsset_t, dbs, size_t, first, size_t, count)
         return bad + SYNC(llmsset_rehash_par);
     } else {
         int bad = 0;
+        size_t marked = 0;
         _Atomic(uint64_t)* ptr = dbs->bitmap2 + (first / 64);
         uint64_t mask = 0x8000000000000000LL >> (first & 63);
         for (size_t k=0; k<count; k++) {
             if (atomic_load_explicit(ptr, memory_order_relaxed) & mask) {
                 if (llmsset_rehash_bucket(dbs, first+k) == 0) bad++;
+                marked++;
             }
             mask >>= 1;
             if (mask == 0) {
@@ -407,13 +425,18 @@ TASK_3(int, llmsset_rehash_par, llmsset_t, dbs, size_t, first, size_t, count)
                 mask = 0x8000000000000000LL;
             }
         }
+        atomic_fetch_add(&dbs->survivors, marked);
         return bad;
     }
 }
 
 TASK_IMPL_1(int, llmsset_rehash, llmsset_t, dbs)
 {
-    return CALL(llmsset_rehash_par, dbs, 0, dbs->table_size);
+    dbs->survivors = 0;
+    int bad = CALL(llmsset_rehash_par, dbs, 0, dbs->table_size);
+    // the rehashed buckets are the old buckets for the next minor gc
+    memcpy(dbs->bitmapo, dbs->bitmap2, ((dbs->table_size+63)/64) * 8);
+    return bad;
 }
 
 TASK_3(size_t, llmsset_count_marked_par, llmsset_t, dbs, size_t, first, size_t, count)
@@ -485,6 +508,130 @@ VOID_TASK_IMPL_1(llmsset_destroy_unmarked, llmsset_t, dbs)
     CALL(llmsset_destroy_par, dbs, 0, dbs->table_size);
 }
 
+/**
+ * Find the hash bucket of data bucket d_idx, or NULL if it is not in the table
+ * (a lookup can claim a data bucket and then fail to insert it)
+ */
+static _Atomic(uint64_t)*
+llmsset_find_bucket(const llmsset_t dbs, uint64_t d_idx)
+{
+    const uint64_t * const d_ptr = ((uint64_t*)dbs->data) + 2*d_idx;
+    uint64_t hash_rehash = 14695981039346656037LLU;
+    if (is_custom_bucket(dbs, d_idx)) hash_rehash = dbs->hash_cb(d_ptr[0], d_ptr[1], hash_rehash);
+    else hash_rehash = sylvan_tabhash16(d_ptr[0], d_ptr[1], hash_rehash);
+    const uint64_t step = (((hash_rehash >> 20) | 1) << 3);
+    const uint64_t v_idx = (hash_rehash & MASK_HASH) | d_idx;
+    int i=0;
+
+    uint64_t idx, last;
+#if LLMSSET_MASK
+    last = idx = hash_rehash & dbs->mask;
+#else
+    last = idx = hash_rehash % dbs->table_size;
+#endif
+
+    for (;;) {
+        _Atomic(uint64_t)* bucket = &dbs->table[idx];
+        uint64_t v = atomic_load_explicit(bucket, memory_order_relaxed);
+        if (v == v_idx) return bucket;
+        if (v == 0) return NULL;
+
+        // find next idx on probe sequence
+        idx = (idx & CL_MASK) | ((idx+1) & CL_MASK_R);
+        if (idx == last) {
+            if (++i == atomic_load_explicit(&dbs->threshold, memory_order_relaxed)) return NULL;
+
+            // go to next cache line in probe sequence
+            hash_rehash += step;
+
+#if LLMSSET_MASK
+            last = idx = hash_rehash & dbs->mask;
+#else
+            last = idx = hash_rehash % dbs->table_size;
+#endif
+        }
+    }
+}
+
+/* Split the marks of the claimed regions: bitmapo gets the young buckets, bitmap2 the old */
+VOID_TASK_3(llmsset_clear_young_par, llmsset_t, dbs, size_t, first, size_t, count)
+{
+    if (count > 64) {
+        size_t split = count/2;
+        SPAWN(llmsset_clear_young_par, dbs, first, split);
+        CALL(llmsset_clear_young_par, dbs, first + split, count - split);
+        SYNC(llmsset_clear_young_par);
+    } else {
+        for (size_t r=first; r<first+count; r++) {
+            uint64_t mask = 0x8000000000000000LL >> (r&63);
+            if ((atomic_load_explicit(dbs->bitmap1 + (r/64), memory_order_relaxed) & mask) == 0) continue;
+            for (size_t w=8*r; w<8*r+8; w++) {
+                uint64_t young = dbs->bitmap2[w] & ~dbs->bitmapo[w];
+                dbs->bitmapo[w] = young;
+                dbs->bitmap2[w] &= ~young;
+            }
+        }
+    }
+}
+
+VOID_TASK_IMPL_1(llmsset_clear_young, llmsset_t, dbs)
+{
+    CALL(llmsset_clear_young_par, dbs, 0, dbs->table_size/(64*8));
+}
+
+/* Remove the unmarked young buckets of the claimed regions, bitmapo gets the marked buckets */
+TASK_3(size_t, llmsset_sweep_young_par, llmsset_t, dbs, size_t, first, size_t, count)
+{
+    if (count > 64) {
+        size_t split = count/2;
+        SPAWN(llmsset_sweep_young_par, dbs, first, split);
+        size_t removed = CALL(llmsset_sweep_young_par, dbs, first + split, count - split);
+        return removed + SYNC(llmsset_sweep_young_par);
+    }
+
+    size_t removed = 0, kept = 0;
+    for (size_t r=first; r<first+count; r++) {
+        uint64_t mask = 0x8000000000000000LL >> (r&63);
+        if ((atomic_load_explicit(dbs->bitmap1 + (r/64), memory_order_relaxed) & mask) == 0) continue;
+        for (size_t w=8*r; w<8*r+8; w++) {
+            const uint64_t marked = dbs->bitmap2[w];
+            kept += __builtin_popcountll(dbs->bitmapo[w] & marked);
+            uint64_t dead = dbs->bitmapo[w] & ~marked;
+            while (dead) {
+                const int j = __builtin_clzll(dead);
+                dead &= ~(0x8000000000000000LL >> j);
+                const uint64_t d_idx = w*64 + j;
+                _Atomic(uint64_t)* bucket = llmsset_find_bucket(dbs, d_idx);
+                if (bucket != NULL) {
+                    atomic_store_explicit(bucket, TOMBSTONE, memory_order_relaxed);
+                    atomic_fetch_add(&dbs->tombstones, 1);
+                }
+                if (dbs->destroy_cb != NULL && is_custom_bucket(dbs, d_idx)) {
+                    uint64_t *d_ptr = ((uint64_t*)dbs->data) + 2*d_idx;
+                    dbs->destroy_cb(d_ptr[0], d_ptr[1]);
+                    set_custom_bucket(dbs, d_idx, 0);
+                }
+                removed++;
+            }
+            dbs->bitmapo[w] = marked;
+        }
+    }
+    // the old buckets were already counted, add the young ones which survived
+    atomic_fetch_add(&dbs->survivors, kept);
+    return removed;
+}
+
+TASK_IMPL_1(size_t, llmsset_sweep_young, llmsset_t, dbs)
+{
+    size_t removed = CALL(llmsset_sweep_young_par, dbs, 0, dbs->table_size/(64*8));
+
+    // release all regions, the next minor gc only looks at regions claimed from now on
+    clear_aligned(dbs->bitmap1, dbs->max_size / (512*8));
+    TOGETHER(llmsset_reset_region);
+
+    return removed;
+}
+
 /**
  * Set custom functions
  */
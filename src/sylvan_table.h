@@ -56,6 +56,7 @@ typedef struct llmsset
     _Atomic(uint64_t)* bitmap1;      // ownership bitmap (per 512 buckets)
     _Atomic(uint64_t)* bitmap2;      // bitmap for "contains data"
     uint64_t*          bitmapc;      // bitmap for "use custom functions"
+    _Atomic(uint64_t)* bitmapo;      // bitmap for "marked at the last gc" (minor gc)
     size_t             max_size;     // maximum size of the hash table (for resizing)
     size_t             table_size;   // size of the hash table (number of slots) --> power of 2!
 #if LLMSSET_MASK
@@ -67,6 +68,8 @@ typedef struct llmsset
     llmsset_create_cb  create_cb;    // custom create function
     llmsset_destroy_cb destroy_cb;   // custom destroy function
     _Atomic(int16_t)   threshold;    // number of iterations for insertion until returning error
+    _Atomic(size_t)    tombstones;   // number of hash buckets of deleted data (minor gc)
+    _Atomic(size_t)    survivors;    // number of data buckets marked at the last gc
 } *llmsset_t;
 
 /**
@@ -188,6 +191,48 @@ int llmsset_rehash_bucket(const llmsset_t dbs, uint64_t d_idx);
 TASK_DECL_1(size_t, llmsset_count_marked, llmsset_t);
 #define llmsset_count_marked(dbs) RUN(llmsset_count_marked, dbs)
 
+/**
+ * Minor garbage collection only collects the data buckets that were claimed
+ * since the last garbage collection, in the regions claimed since then.
+ * Buckets that survived the last garbage collection stay marked, so marking
+ * stops at them, and no hashes have to be cleared or rehashed. The user is
+ * again responsible that no lookups are performed during the process.
+ * 1) call llmsset_clear_young (instead of llmsset_clear_data)
+ * 2) call llmsset_mark for every bucket to keep
+ * 3) call llmsset_sweep_young (instead of llmsset_clear_hashes, llmsset_rehash
+ *    and llmsset_destroy_unmarked)
+ * The hash buckets of removed data become tombstones, which are only cleaned
+ * by the next (full) garbage collection.
+ */
+VOID_TASK_DECL_1(llmsset_clear_young, llmsset_t);
+#define llmsset_clear_young(dbs) RUN(llmsset_clear_young, dbs)
+
+/**
+ * Remove unmarked young buckets from the hash table and call the destroy
+ * callback for custom data. Returns the number of removed buckets.
+ */
+TASK_DECL_1(size_t, llmsset_sweep_young, llmsset_t);
+#define llmsset_sweep_young(dbs) RUN(llmsset_sweep_young, dbs)
+
+/**
+ * Retrieve number of tombstones in the hash table.
+ */
+static inline size_t
+llmsset_get_tombstones(const llmsset_t dbs)
+{
+    return dbs->tombstones;
+}
+
+/**
+ * Retrieve number of data buckets that survived the last garbage collection,
+ * which llmsset_rehash and llmsset_sweep_young count while they run.
+ */
+static inline size_t
+llmsset_get_survivors(const llmsset_t dbs)
+{
+    return dbs->survivors;
+}
+
 /**
  * During garbage collection, this method calls the destroy callback
  * for all 'custom' data that is not kept.
@@ -102,6 +102,47 @@ test_cache()
     return 0;
 }
 
+static int
+test_cache_segments()
+{
+    /**
+     * Give a (fake) operation its own segment that only fills empty buckets
+     */
+
+    const uint64_t opid = 100LL<<40;
+    int seg = cache_add_segment(1<<10, CACHE_POLICY_KEEP);
+    test_assert(seg > 0);
+    cache_set_segment(opid, seg);
+    test_assert(cache_segment_getused(seg) == 0);
+
+    size_t main_used = cache_getused();
+    size_t stored = 0;
+    for (uint64_t i=0; i<4096; i++) {
+        if (cache_put(opid|i, i, i, 2*i)) {
+            uint64_t val;
+            test_assert(cache_get(opid|i, i, i, &val));
+            test_assert(val == 2*i);
+            stored++;
+        }
+    }
+    // every bucket of the segment is filled at most once, the main table is untouched
+    test_assert(stored == cache_segment_getused(seg));
+    test_assert(stored <= cache_segment_getsize(seg));
+    test_assert(cache_getused() == main_used);
+
+    // stored entries are never replaced
+    for (uint64_t i=0; i<4096; i++) {
+        uint64_t val;
+        if (cache_get(opid|i, i, i, &val)) test_assert(val == 2*i);
+    }
+    test_assert(stored == cache_segment_getused(seg));
+
+    cache_clear();
+    test_assert(cache_segment_getused(seg) == 0);
+    cache_set_segment(opid, 0);
+    return 0;
+}
+
 static inline BDD
 make_random(int i, int j)
 {
@@ -373,6 +414,28 @@ test_relprod()
     return 0;
 }
 
+int
+test_alloc_table()
+{
+    // settings only apply to tables allocated afterwards
+    sylvan_set_hugepages(SYLVAN_HUGEPAGES_THP);
+    sylvan_set_numa(SYLVAN_NUMA_FIRST_TOUCH);
+
+    size_t size = 3<<20;
+    uint64_t *t = (uint64_t*)alloc_table(size, "test table", 1);
+    test_assert(t != NULL);
+    prefault_table(t, size/2);
+    for (size_t i=0; i<size/8; i++) test_assert(t[i] == 0);
+    for (size_t i=0; i<size/8; i+=512) t[i] = i+1;
+    clear_table(t, size);
+    for (size_t i=0; i<size/8; i+=512) test_assert(t[i] == 0);
+    free_table(t, size);
+
+    sylvan_set_hugepages(SYLVAN_HUGEPAGES_NONE);
+    sylvan_set_numa(SYLVAN_NUMA_DEFAULT);
+    return 0;
+}
+
 int
 test_compose()
 {
@@ -521,6 +584,8 @@ TASK_0(int, runtests)
 
     printf("Testing cache.\n");
     if (test_cache()) return 1;
+    if (test_cache_segments()) return 1;
+    if (test_alloc_table()) return 1;
     printf("Testing bdd.\n");
     if (test_bdd()) return 1;
     printf("Testing cube.\n");
@@ -1066,40 +1066,6 @@ test_mtbdd_and_abstract_plus_function()
 }
 
 
-int
-test_mtbdd_matrix_multiplication()
-{
-    // 
-    //  K . L = M
-    //
-    //  K = (1.0  2.0)   L = (1.0  0.5)   M = (1.0 x 1.0 + 2.0 x 0.5  1.0 x 1.0 + 2.0 x 1.0)
-    //      (2.0  1.0)       (0.5  1.0)       (2.0 x 1.0 + 1.0 x 1.0  2.0 x 0.5 + 1.0 x 1.0)
-    //
-    //  M = (2.0  3.0)
-    //      (2.0  2.0)
-    //
-
-    return 0;
-}
-
-int
-test_mtbdd_matrix_kronecker_multiplication()
-{
-    //
-    //  K (x) L = M
-    //
-    //  K = (1.0  2.0)   L = (1.0  0.5)   M = (1.0 x L  2.0 x L)
-    //      (2.0  1.0)       (0.5  1.0)       (2.0 x L  1.0 x L)
-    //
-    //  M = (1.0 0.5 2.0 1.0)
-    //      (0.5 1.0 1.0 2.0)
-    //      (2.0 1.0 1.0 0.5)
-    //      (1.0 2.0 0.5 1.0)
-    //
-
-    return 0;
-}
-
 
 // TODO: make header for test framework
 
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "sylvan.h"
+#include "test_assert.h"
+
+// Matrix/vector and Kronecker products of MTBDDs with complex leaves
+static MTBDD
+complex_leaf(double real, double imag)
+{
+    complex_double_t c = { real, imag };
+    return mtbdd_complex_double(c);
+}
+
+// 2x2 matrix on qubit k: column bit on variable 2k, row bit on variable 2k+1
+static MTBDD
+matrix_2x2(uint32_t k, MTBDD u00, MTBDD u01, MTBDD u10, MTBDD u11)
+{
+    MTBDD low  = mtbdd_makenode(2*k+1, u00, u10);
+    MTBDD high = mtbdd_makenode(2*k+1, u01, u11);
+    return mtbdd_makenode(2*k, low, high);
+}
+
+// Follow the path of <bit> for variable <var>
+static MTBDD
+follow(MTBDD dd, uint32_t var, int bit)
+{
+    if (mtbdd_isleaf(dd) || mtbdd_getvar(dd) != var) return dd;
+    return bit ? mtbdd_gethigh(dd) : mtbdd_getlow(dd);
+}
+
+// Entry (r,c) of a 2^n x 2^n matrix, qubit 0 is the most significant bit
+static complex_double_t
+matrix_get(MTBDD M, int n, int r, int c)
+{
+    for (int k = 0; k < n; k++) {
+        M = follow(M, 2*k,   (c >> (n-1-k)) & 1);
+        M = follow(M, 2*k+1, (r >> (n-1-k)) & 1);
+    }
+    return mtbdd_getcomplex_double(M);
+}
+
+// Entry i of a 2^n vector
+static complex_double_t
+vector_get(MTBDD v, int n, int i)
+{
+    for (int k = 0; k < n; k++) {
+        v = follow(v, k, (i >> (n-1-k)) & 1);
+    }
+    return mtbdd_getcomplex_double(v);
+}
+
+int
+test_mtbdd_matrix_vector_multiplication()
+{
+    //
+    //  Y . v = w
+    //
+    //  Y = (0  -i)   v = (1)   w = (-2i)
+    //      (i   0)       (2)       ( i )
+    //
+    MTBDD Y = matrix_2x2(0, complex_leaf(0, 0), complex_leaf(0, -1), complex_leaf(0, 1), complex_leaf(0, 0));
+    MTBDD v = mtbdd_makenode(0, complex_leaf(1, 0), complex_leaf(2, 0));
+    MTBDD w = mtbdd_matvec_mult(Y, v, 1);
+
+    complex_double_t w0 = vector_get(w, 1, 0);
+    complex_double_t w1 = vector_get(w, 1, 1);
+    test_assert(w0.real == 0.0 && w0.imag == -2.0);
+    test_assert(w1.real == 0.0 && w1.imag == 1.0);
+
+    // Y.Y = I, so Y.(Y.v) = v (and identical by canonicity)
+    test_assert(mtbdd_matvec_mult(Y, w, 1) == v);
+
+    // On two qubits: (I (x) Y).(v (x) v) = v (x) w
+    MTBDD I  = matrix_2x2(0, complex_leaf(1, 0), complex_leaf(0, 0), complex_leaf(0, 0), complex_leaf(1, 0));
+    MTBDD IY = mtbdd_mat_kronecker_prod(I, Y, 1);
+    MTBDD vv = mtbdd_vec_kronecker_prod(v, v, 1);
+    test_assert(mtbdd_matvec_mult(IY, vv, 2) == mtbdd_vec_kronecker_prod(v, w, 1));
+
+    return 0;
+}
+
+int
+test_mtbdd_matrix_multiplication()
+{
+    // 
+    //  K . L = M
+    //
+    //  K = (1.0  2.0)   L = (1.0  0.5)   M = (1.0 x 1.0 + 2.0 x 0.5  1.0 x 0.5 + 2.0 x 1.0)
+    //      (2.0  1.0)       (0.5  1.0)       (2.0 x 1.0 + 1.0 x 0.5  2.0 x 0.5 + 1.0 x 1.0)
+    //
+    //  M = (2.0  2.5)
+    //      (2.5  2.0)
+    //
+    MTBDD K = matrix_2x2(0, complex_leaf(1, 0), complex_leaf(2, 0), complex_leaf(2, 0), complex_leaf(1, 0));
+    MTBDD L = matrix_2x2(0, complex_leaf(1, 0), complex_leaf(0.5, 0), complex_leaf(0.5, 0), complex_leaf(1, 0));
+    MTBDD M = mtbdd_matmat_mult(K, L, 1);
+    test_assert(M == matrix_2x2(0, complex_leaf(2, 0), complex_leaf(2.5, 0), complex_leaf(2.5, 0), complex_leaf(2, 0)));
+
+    // Non-commuting complex case: (K.i).L != L.(K.i) entry-wise
+    MTBDD Ki = matrix_2x2(0, complex_leaf(0, 1), complex_leaf(0, 2), complex_leaf(0, 0), complex_leaf(0, 0));
+    complex_double_t m01 = matrix_get(mtbdd_matmat_mult(Ki, L, 1), 1, 0, 1);
+    complex_double_t m10 = matrix_get(mtbdd_matmat_mult(L, Ki, 1), 1, 1, 0);
+    test_assert(m01.real == 0.0 && m01.imag == 2.5);
+    test_assert(m10.real == 0.0 && m10.imag == 0.5);
+
+    // On two qubits: (K (x) K).(L (x) L) = (K.L) (x) (K.L)
+    MTBDD KK = mtbdd_mat_kronecker_prod(K, K, 1);
+    MTBDD LL = mtbdd_mat_kronecker_prod(L, L, 1);
+    test_assert(mtbdd_matmat_mult(KK, LL, 2) == mtbdd_mat_kronecker_prod(M, M, 1));
+
+    return 0;
+}
+
+int
+test_mtbdd_matrix_kronecker_multiplication()
+{
+    //
+    //  K (x) L = M
+    //
+    //  K = (1.0  2.0)   L = (1.0  0.5)   M = (1.0 x L  2.0 x L)
+    //      (2.0  1.0)       (0.5  1.0)       (2.0 x L  1.0 x L)
+    //
+    //  M = (1.0 0.5 2.0 1.0)
+    //      (0.5 1.0 1.0 2.0)
+    //      (2.0 1.0 1.0 0.5)
+    //      (1.0 2.0 0.5 1.0)
+    //
+    double m[4][4] = {{1.0, 0.5, 2.0, 1.0},
+                      {0.5, 1.0, 1.0, 2.0},
+                      {2.0, 1.0, 1.0, 0.5},
+                      {1.0, 2.0, 0.5, 1.0}};
+    MTBDD K = matrix_2x2(0, complex_leaf(1, 0), complex_leaf(2, 0), complex_leaf(2, 0), complex_leaf(1, 0));
+    MTBDD L = matrix_2x2(0, complex_leaf(1, 0), complex_leaf(0.5, 0), complex_leaf(0.5, 0), complex_leaf(1, 0));
+    MTBDD M = mtbdd_mat_kronecker_prod(K, L, 1);
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            complex_double_t x = matrix_get(M, 2, r, c);
+            test_assert(x.real == m[r][c] && x.imag == 0.0);
+        }
+    }
+
+    return 0;
+}
+
+
+TASK_0(int, runtests)
+{
+    // We are not testing garbage collection
+    sylvan_gc_disable();
+
+    printf("Testing mtbdd matrix/vector product.\n");
+    if (test_mtbdd_matrix_vector_multiplication()) return 1;
+    printf("Testing mtbdd matrix/matrix product.\n");
+    if (test_mtbdd_matrix_multiplication()) return 1;
+    printf("Testing mtbdd kronecker product.\n");
+    if (test_mtbdd_matrix_kronecker_multiplication()) return 1;
+
+    return 0;
+}
+
+int main()
+{
+    // Standard Lace initialization with 1 worker
+    lace_start(1, 0);
+
+    // Simple Sylvan initialization, with MTBDD support
+    sylvan_set_sizes(1LL<<20, 1LL<<20, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    sylvan_init_mtbdd();
+
+    int res = RUN(runtests);
+
+    sylvan_quit();
+    lace_stop();
+
+    return res;
+}
@@ -329,6 +329,107 @@ int test_vector_addition()
     return 0;
 }
 
+int test_count_stats()
+{
+    QMDD q;
+    bool x3[] = {1, 0, 1};
+    uint64_t level_nodes[5];
+    aadd_stats_t stats = {0};
+
+    // |101>: one node per level, edge weights are 0 and 1
+    q = qmdd_create_basis_state(3, x3);
+    stats.nvars = 3;
+    stats.level_nodes = level_nodes;
+    test_assert(aadd_count_stats(q, &stats) == 4);
+    test_assert(stats.nodes == aadd_countnodes(q));
+    test_assert(stats.weights == 2);
+    for (int k = 0; k < 3; k++) test_assert(level_nodes[k] == 1);
+
+    // GHZ state on 5 qubits: 1 node at the top, 2 nodes at every other level
+    q = qmdd_create_all_zero_state(5);
+    q = qmdd_gate(q, GATEID_H, 0);
+    for (BDDVAR k = 0; k < 4; k++) q = qmdd_cgate(q, GATEID_X, k, k+1);
+    stats.nvars = 5;
+    test_assert(aadd_count_stats(q, &stats) == 10);
+    test_assert(aadd_countnodes(q) == 10);
+    test_assert(level_nodes[0] == 1);
+    for (int k = 1; k < 5; k++) test_assert(level_nodes[k] == 2);
+    test_assert(stats.weights >= 2);
+
+    // without histogram, and again (nodes are not left marked)
+    uint64_t weights = stats.weights;
+    stats.level_nodes = NULL;
+    test_assert(aadd_count_stats(q, &stats) == 10);
+    test_assert(stats.weights == weights);
+
+    // the bitmaps are reused, a smaller AADD after a larger one counts the same
+    q = qmdd_create_basis_state(3, x3);
+    test_assert(aadd_countnodes(q) == 4);
+    test_assert(aadd_count_stats(q, &stats) == 4);
+    test_assert(stats.weights == 2);
+
+    if(VERBOSE) printf("aadd count stats:              ok\n");
+    return 0;
+}
+
+int test_binary_file()
+{
+    BDDVAR n = 8;
+    QMDD dds[3], res[3];
+    FILE *f;
+
+    // state with many nodes on the lower levels, a matrix, and a basis state
+    dds[0] = qmdd_create_all_zero_state(n);
+    for (BDDVAR k = 0; k < n; k++) dds[0] = qmdd_gate(dds[0], GATEID_Ry(0.1 + 0.2*k), k);
+    for (BDDVAR k = 0; k < n-1; k++) dds[0] = qmdd_cgate(dds[0], GATEID_Rz(0.3 + k), k, k+1);
+    for (BDDVAR k = 0; k < n; k++) dds[0] = qmdd_gate(dds[0], GATEID_Ry(0.7), k);
+    dds[1] = qmdd_create_single_qubit_gates_same(3, GATEID_H);
+    bool x[] = {1, 0, 1};
+    dds[2] = qmdd_create_basis_state(3, x);
+
+    f = tmpfile();
+    test_assert(aadd_writer_tobinary(f, dds, 3) == 0);
+    rewind(f);
+    test_assert(aadd_reader_frombinary(f, res, 2) == -1); // wrong count
+    rewind(f);
+    test_assert(aadd_reader_frombinary(f, res, 3) == 0);
+    fclose(f);
+    test_assert(aadd_equivalent(res[0], dds[0], n, false, false));
+    test_assert(aadd_countnodes(res[0]) == aadd_countnodes(dds[0]));
+    test_assert(aadd_equivalent(res[1], dds[1], 2*3, false, false));
+    test_assert(res[2] == dds[2]);
+
+    // the same, through mmap
+    char filename[] = "/tmp/test_qmdd_XXXXXX";
+    int fd = mkstemp(filename);
+    test_assert(fd >= 0);
+    f = fdopen(fd, "w");
+    test_assert(aadd_writer_tobinary(f, dds, 3) == 0);
+    fclose(f);
+    test_assert(aadd_reader_frommmap(filename, res, 3) == 0);
+    test_assert(aadd_equivalent(res[0], dds[0], n, false, false));
+    test_assert(aadd_equivalent(res[1], dds[1], 2*3, false, false));
+    test_assert(res[2] == dds[2]);
+
+    // a number of weights for which the file size wraps around
+    f = fopen(filename, "r+");
+    uint64_t weights = 1ULL << 60;
+    test_assert(fseek(f, 24, SEEK_SET) == 0);
+    test_assert(fwrite(&weights, sizeof(weights), 1, f) == 1);
+    fclose(f);
+    test_assert(aadd_reader_frommmap(filename, res, 3) == -1);
+
+    // not an AADD file
+    f = fopen(filename, "w");
+    fprintf(f, "no AADDs in here, but long enough for a header..........\n");
+    fclose(f);
+    test_assert(aadd_reader_frommmap(filename, res, 3) == -1);
+    unlink(filename);
+
+    if(VERBOSE) printf("aadd binary file:              ok\n");
+    return 0;
+}
+
 int run_qmdd_tests()
 {
     // we are not testing garbage collection
@@ -338,6 +439,8 @@ int run_qmdd_tests()
     if (test_complex_operations()) return 1;
     if (test_basis_state_creation()) return 1;
     if (test_vector_addition()) return 1;
+    if (test_count_stats()) return 1;
+    if (test_binary_file()) return 1;
 
     return 0;
 }
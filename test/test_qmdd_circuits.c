@@ -733,6 +733,201 @@ int test_20qubit_circuit()
     return 0;
 }
 
+int test_sample_shots()
+{
+    QMDD q;
+    qmdd_shots_t h, h2;
+    uint64_t shots = 10000;
+
+    // |0>|+>  (qubit 0 in |+>, qubit 2 in |1>): outcomes 100 and 101
+    q = qmdd_create_all_zero_state(3);
+    q = qmdd_gate(q, GATEID_H, 0);
+    q = qmdd_gate(q, GATEID_X, 2);
+    test_assert(qmdd_sample_shots(q, 3, shots, 42, &h) == 2);
+    test_assert(h.outcomes[0] == 0x4 && h.outcomes[1] == 0x5);
+    test_assert(h.counts[0] + h.counts[1] == shots);
+    test_assert(h.counts[0] > 4500 && h.counts[0] < 5500);
+
+    // same seed, same histogram
+    test_assert(qmdd_sample_shots(q, 3, shots, 42, &h2) == 2);
+    test_assert(h2.counts[0] == h.counts[0] && h2.counts[1] == h.counts[1]);
+    qmdd_shots_free(&h);
+    qmdd_shots_free(&h2);
+
+    // |++>: four equally likely outcomes
+    q = qmdd_create_all_zero_state(2);
+    q = qmdd_gate(q, GATEID_H, 0);
+    q = qmdd_gate(q, GATEID_H, 1);
+    test_assert(qmdd_sample_shots(q, 2, shots, 7, &h) == 4);
+    for (int i = 0; i < 4; i++) test_assert(h.counts[i] > 2200 && h.counts[i] < 2800);
+    qmdd_shots_free(&h);
+
+    // Bell state: outcomes 00 and 11
+    q = qmdd_create_all_zero_state(2);
+    q = qmdd_gate(q, GATEID_H, 0);
+    q = qmdd_cgate(q, GATEID_X, 0, 1);
+    test_assert(qmdd_sample_shots(q, 2, shots, 7, &h) == 2);
+    test_assert(h.outcomes[0] == 0x0 && h.outcomes[1] == 0x3);
+    test_assert(h.counts[0] > 4500 && h.counts[0] < 5500);
+    qmdd_shots_free(&h);
+
+    if(VERBOSE) printf("qmdd sample shots:         ok\n");
+    return 0;
+}
+
+int test_memo()
+{
+    BDDVAR n = 5;
+    QMDD q, q1, q2;
+    qmdd_memo_t memo, memo2;
+
+    // some state with all amplitudes non-zero
+    q = qmdd_create_all_zero_state(n);
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_H, k);
+    q = qmdd_gate(q, GATEID_Ry(0.3), 0);
+    q = qmdd_cgate(q, GATEID_Rz(0.7), 0, 4);
+    q = qmdd_gate(q, GATEID_T, 2);
+    aadd_protect(&q);
+
+    // sub-circuit on qubits 1-3, including a control below its target
+    BDDVAR cs1[] = {1, AADD_INVALID_VAR, AADD_INVALID_VAR};
+    BDDVAR cs3[] = {3, AADD_INVALID_VAR, AADD_INVALID_VAR};
+    memo = qmdd_memo_create(n, 1, 3);
+    qmdd_memo_gate(memo, GATEID_H, 1);
+    qmdd_memo_cgate(memo, GATEID_X, cs1, 2);
+    qmdd_memo_gate(memo, GATEID_T, 3);
+    qmdd_memo_cgate(memo, GATEID_Z, cs3, 1);
+    qmdd_memo_gate(memo, GATEID_Ry(0.5), 2);
+
+    // applying the memo equals applying the gates
+    q1 = qmdd_memo_apply(q, memo);
+    q2 = qmdd_gate(q, GATEID_H, 1);
+    q2 = qmdd_cgate(q2, GATEID_X, 1, 2);
+    q2 = qmdd_gate(q2, GATEID_T, 3);
+    q2 = qmdd_cgate(q2, GATEID_Z, 1, 3); // CZ is symmetric
+    q2 = qmdd_gate(q2, GATEID_Ry(0.5), 2);
+    test_assert(aadd_equivalent(q1, q2, n, false, false));
+    test_assert(qmdd_circuit(q, CIRCID_memo, memo, 0) == q1);
+
+    // controlled on qubit 0
+    BDDVAR cs[] = {0, AADD_INVALID_VAR, AADD_INVALID_VAR};
+    q1 = qmdd_ccircuit(q, CIRCID_memo, cs, memo, 0);
+    q2 = qmdd_cgate(q, GATEID_H, 0, 1);
+    q2 = qmdd_cgate2(q2, GATEID_X, 0, 1, 2);
+    q2 = qmdd_cgate(q2, GATEID_T, 0, 3);
+    q2 = qmdd_cgate2(q2, GATEID_Z, 0, 1, 3);
+    q2 = qmdd_cgate(q2, GATEID_Ry(0.5), 0, 2);
+    test_assert(aadd_equivalent(q1, q2, n, false, false));
+    test_assert(qmdd_is_close_to_unitvector(q1, n, 1e-9));
+
+    // controlled on qubits 0 and 4 does not fit (4 is not above the memo),
+    // but controlled on 0 with a memo on 2-4 does, with two controls
+    memo2 = qmdd_memo_create(n, 2, 4);
+    qmdd_memo_gate(memo2, GATEID_H, 4);
+    qmdd_memo_cgate(memo2, GATEID_X, cs3, 4);
+    BDDVAR cs01[] = {0, 1, AADD_INVALID_VAR};
+    q1 = qmdd_ccircuit(q, CIRCID_memo, cs01, memo2, 0);
+    q2 = qmdd_cgate2(q, GATEID_H, 0, 1, 4);
+    q2 = qmdd_cgate3(q2, GATEID_X, 0, 1, 3, 4);
+    test_assert(aadd_equivalent(q1, q2, n, false, false));
+    qmdd_memo_free(memo2);
+
+    // a memo of a memo applied twice
+    memo2 = qmdd_memo_create(n, 0, 4);
+    qmdd_memo_append(memo2, memo);
+    qmdd_memo_append(memo2, memo);
+    q1 = qmdd_memo_apply(q, memo2);
+    q2 = qmdd_memo_apply(qmdd_memo_apply(q, memo), memo);
+    test_assert(aadd_equivalent(q1, q2, n, false, false));
+
+    qmdd_memo_free(memo2);
+
+    // built-in circuits as memos, applied (controlled) in one multiplication
+    memo2 = qmdd_memo_create(n, 2, 4);
+    qmdd_memo_circuit(memo2, CIRCID_QFT, 2, 4);
+    q1 = qmdd_memo_apply(q, memo2);
+    q2 = qmdd_circuit(q, CIRCID_QFT, 2, 4);
+    test_assert(aadd_equivalent(q1, q2, n, false, false));
+    q1 = qmdd_ccircuit(q, CIRCID_memo, cs, memo2, 0);
+    q2 = qmdd_ccircuit(q, CIRCID_QFT, cs, 2, 4);
+    test_assert(aadd_equivalent(q1, q2, n, false, false));
+    qmdd_memo_circuit(memo2, CIRCID_reverse_range, 2, 4);
+    qmdd_memo_circuit(memo2, CIRCID_reverse_range, 2, 4);
+    qmdd_memo_circuit(memo2, CIRCID_QFT_inv, 2, 4);
+    test_assert(aadd_equivalent(qmdd_memo_apply(q, memo2), q, n, false, false));
+    q1 = qmdd_ccircuit(q, CIRCID_memo, cs, memo2, 0);
+    test_assert(aadd_equivalent(q1, q, n, false, false));
+    qmdd_memo_free(memo2);
+
+    // gates appended after a memo has been applied (controlled) are applied too
+    memo2 = qmdd_memo_create(n, 2, 4);
+    qmdd_memo_gate(memo2, GATEID_X, 2);
+    q1 = qmdd_ccircuit(q, CIRCID_memo, cs, memo2, 0);
+    test_assert(aadd_equivalent(q1, qmdd_cgate(q, GATEID_X, 0, 2), n, false, false));
+    qmdd_memo_gate(memo2, GATEID_X, 3);
+    q1 = qmdd_ccircuit(q, CIRCID_memo, cs, memo2, 0);
+    q2 = qmdd_cgate(qmdd_cgate(q, GATEID_X, 0, 2), GATEID_X, 0, 3);
+    test_assert(aadd_equivalent(q1, q2, n, false, false));
+    test_assert(aadd_equivalent(qmdd_memo_apply(q, memo2), qmdd_gate(qmdd_gate(q, GATEID_X, 2), GATEID_X, 3), n, false, false));
+
+    // the recorded matrices survive garbage collection
+    q1 = qmdd_memo_apply(q, memo);
+    aadd_protect(&q1);
+    sylvan_gc_enable();
+    sylvan_gc();
+    sylvan_gc_disable();
+    test_assert(qmdd_memo_apply(q, memo) == q1);
+    aadd_unprotect(&q1);
+
+    qmdd_memo_free(memo);
+    qmdd_memo_free(memo2);
+    aadd_unprotect(&q);
+
+    if(VERBOSE) printf("qmdd sub-circuit memos:    ok\n");
+    return 0;
+}
+
+int test_many_qubits()
+{
+    // more qubits than fit in an 8 bit variable field (also as matrix vars)
+    BDDVAR n = 300;
+    QMDD q, q2, mat;
+    bool x[300] = {0};
+    AMP a;
+
+    // GHZ state on 300 qubits
+    q = qmdd_create_all_zero_state(n);
+    q = qmdd_gate(q, GATEID_H, 0);
+    for (BDDVAR k = 0; k < n-1; k++) {
+        q = qmdd_cgate(q, GATEID_X, k, k+1);
+    }
+    test_assert(aadd_is_ordered(q, n));
+    test_assert(qmdd_is_unitvector(q, n));
+    test_assert(aadd_countnodes(q) == 2*n);
+    a = aadd_getvalue(q, x); test_assert(a == complex_lookup(1.0/flt_sqrt(2.0),0));
+    for (BDDVAR k = 0; k < n; k++) x[k] = 1;
+    a = aadd_getvalue(q, x); test_assert(a == complex_lookup(1.0/flt_sqrt(2.0),0));
+    x[299] = 0;
+    a = aadd_getvalue(q, x); test_assert(a == AADD_ZERO);
+
+    // controls and targets > 255 (cache keys)
+    x[299] = 1;
+    q2 = qmdd_cgate(q, GATEID_X, 260, 299);
+    q2 = qmdd_cgate(q2, GATEID_X, 280, 299);
+    test_assert(q2 == q);
+    q2 = qmdd_cgate2(q, GATEID_X, 260, 280, 299);
+    test_assert(aadd_getvalue(q2, x) == AADD_ZERO);
+    q2 = qmdd_cgate_range(q2, GATEID_X, 260, 280, 299);
+    test_assert(q2 == q);
+
+    // matrix vars > 255
+    mat = qmdd_create_controlled_gate(n, 260, 299, GATEID_X);
+    test_assert(aadd_is_ordered(mat, 2*n));
+
+    if(VERBOSE) printf("qmdd > 256 qubits:         ok\n");
+    return 0;
+}
+
 int run_qmdd_tests()
 {
     // we are not testing garbage collection
@@ -743,10 +938,13 @@ int run_qmdd_tests()
     if (test_cswap_circuit()) return 1;
     if (test_tensor_product()) return 1;
     if (test_measurements()) return 1;
+    if (test_sample_shots()) return 1;
+    if (test_many_qubits()) return 1;
     if (test_5qubit_circuit()) return 1;
     if (test_10qubit_circuit()) return 1;
     //if (test_20qubit_circuit()) return 1;
     if (test_QFT()) return 1;
+    if (test_memo()) return 1;
 
     return 0;
 }
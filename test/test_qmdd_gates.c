@@ -402,6 +402,45 @@ int test_pauli_rotation_gates()
     return 0;
 }
 
+int test_rotation_gate_ids()
+{
+    // the same rotation always gets the same gate id
+    uint32_t rz = GATEID_Rz(0.3), rx = GATEID_Rx(0.3), ry = GATEID_Ry(0.3);
+    test_assert(rz >= num_static_gates && rx >= num_static_gates && ry >= num_static_gates);
+    test_assert(rz != rx && rz != ry && rx != ry);
+    test_assert(GATEID_Rz(0.3) == rz);
+    test_assert(GATEID_Rx(0.3) == rx);
+    test_assert(GATEID_Ry(0.3) == ry);
+
+    // also after many other rotations (more than the old 1000 dynamic ids)
+    uint32_t prev = GATEID_Rz(0.001);
+    for (int i = 1; i < 1500; i++) {
+        uint32_t id = GATEID_Rz(0.001 * (i+1));
+        test_assert(id != prev);
+        prev = id;
+    }
+    test_assert(GATEID_Rz(0.3) == rz);
+    test_assert(GATEID_Rx(0.3) == rx);
+    test_assert(gates[rz][1] == AADD_ZERO && gates[rz][2] == AADD_ZERO);
+
+    // more different gates than there are IDs: the registry starts over
+    AMP w[40], u[4];
+    for (int i = 0; i < 40; i++) w[i] = complex_lookup(0.01 * (i+1), 0.0);
+    uint32_t id = 0;
+    for (uint64_t i = 0; i <= num_dynamic_gates + 16; i++) {
+        for (int k = 0, j = i; k < 4; k++, j /= 40) u[k] = w[j % 40];
+        id = GATEID_custom(u);
+        test_assert(id >= num_static_gates && id < num_static_gates + num_dynamic_gates);
+    }
+    test_assert(GATEID_custom(u) == id);
+    for (int k = 0; k < 4; k++) test_assert(gates[id][k] == u[k]);
+    rz = GATEID_Rz(0.3);
+    test_assert(gates[rz][1] == AADD_ZERO && gates[rz][2] == AADD_ZERO && rz != id);
+
+    if(VERBOSE) printf("qmdd rotation gate ids:    ok\n");
+    return 0;
+}
+
 int test_cx_gate()
 {
     QMDD qBell;
@@ -554,6 +593,152 @@ int test_controlled_range_gate()
     return 0;
 }
 
+int test_gate_layer()
+{
+    BDDVAR nqubits = 6;
+    QMDD q0, q1, q2;
+    bool x[] = {0,0,0,0,0,0};
+    gate_id_t gates[6];
+    int controls[6];
+
+    // some non-trivial start state
+    x[1] = 1; x[4] = 1; q0 = qmdd_create_basis_state(nqubits, x);
+    q0 = qmdd_gate(q0, GATEID_H, 1);
+    q0 = qmdd_gate(q0, GATEID_H, 2);
+    q0 = qmdd_gate(q0, GATEID_T, 2);
+    q0 = qmdd_cgate(q0, GATEID_X, 2, 5);
+
+    // single qubit gates only
+    for (BDDVAR k = 0; k < nqubits; k++) { gates[k] = GATEID_I; controls[k] = -1; }
+    gates[0] = GATEID_H; gates[2] = GATEID_S; gates[5] = GATEID_Y;
+    q1 = qmdd_gate_layer(q0, nqubits, gates, controls);
+    q2 = qmdd_gate(q0, GATEID_H, 0);
+    q2 = qmdd_gate(q2, GATEID_S, 2);
+    q2 = qmdd_gate(q2, GATEID_Y, 5);
+    test_assert(q1 == q2);
+    test_assert(aadd_is_ordered(q1, nqubits));
+
+    // H(0), CX(1,3), CCZ(2,4,5)
+    for (BDDVAR k = 0; k < nqubits; k++) { gates[k] = GATEID_I; controls[k] = -1; }
+    gates[0] = GATEID_H;
+    gates[3] = GATEID_X; controls[1] = 3;
+    gates[5] = GATEID_Z; controls[2] = 5; controls[4] = 5;
+    q1 = qmdd_gate_layer(q0, nqubits, gates, controls);
+    q2 = qmdd_gate(q0, GATEID_H, 0);
+    q2 = qmdd_cgate(q2, GATEID_X, 1, 3);
+    q2 = qmdd_cgate2(q2, GATEID_Z, 2, 4, 5);
+    test_assert(q1 == q2);
+    test_assert(qmdd_is_unitvector(q1, nqubits));
+
+    // applying the layer again, to its result
+    q1 = qmdd_gate_layer(q1, nqubits, gates, controls);
+    test_assert(q1 == q0);
+
+    // equal layers share their cache ID, other layers don't
+    gate_id_t gates_copy[6];
+    int controls_copy[6];
+    memcpy(gates_copy, gates, sizeof(gates));
+    memcpy(controls_copy, controls, sizeof(controls));
+    uint32_t layer_id = qmdd_gate_layer_id(nqubits, gates, controls);
+    test_assert(layer_id != 0);
+    test_assert(qmdd_gate_layer_id(nqubits, gates_copy, controls_copy) == layer_id);
+    controls_copy[4] = -1;
+    test_assert(qmdd_gate_layer_id(nqubits, gates_copy, controls_copy) != layer_id);
+    test_assert(qmdd_gate_layer(q0, nqubits, gates, controls) == q2);
+
+    // a layer with more than 64 controlled gates is applied in parts
+    BDDVAR wide = 141;
+    bool *xw = calloc(wide, sizeof(bool));
+    gate_id_t *wgates = malloc(wide * sizeof(gate_id_t));
+    int *wcontrols = malloc(wide * sizeof(int));
+    for (BDDVAR k = 0; k < wide; k += 4) xw[k] = 1;
+    q0 = qmdd_create_basis_state(wide, xw);
+    q0 = qmdd_gate(q0, GATEID_H, 2);
+    q0 = qmdd_gate(q0, GATEID_H, 138);
+    for (BDDVAR k = 0; k < wide; k++) { wgates[k] = GATEID_I; wcontrols[k] = -1; }
+    for (BDDVAR k = 0; k + 1 < wide; k += 2) { wgates[k+1] = GATEID_X; wcontrols[k] = k+1; }
+    wgates[140] = GATEID_H;
+    q1 = qmdd_gate_layer(q0, wide, wgates, wcontrols);
+    q2 = q0;
+    for (BDDVAR k = 0; k + 1 < wide; k += 2) q2 = qmdd_cgate(q2, GATEID_X, k, k+1);
+    q2 = qmdd_gate(q2, GATEID_H, 140);
+    test_assert(q1 == q2);
+    free(xw);
+    free(wgates);
+    free(wcontrols);
+
+    if(VERBOSE) printf("qmdd gate layer:           ok\n");
+    return 0;
+}
+
+int test_two_qubit_gates()
+{
+    BDDVAR nqubits = 5;
+    QMDD q0, q1, q2;
+    bool x[] = {0,0,0,0,0};
+
+    // some non-trivial start state
+    x[1] = 1; x[4] = 1; q0 = qmdd_create_basis_state(nqubits, x);
+    q0 = qmdd_gate(q0, GATEID_H, 0);
+    q0 = qmdd_gate(q0, GATEID_H, 3);
+    q0 = qmdd_gate(q0, GATEID_T, 3);
+    q0 = qmdd_cgate(q0, GATEID_X, 0, 2);
+    q0 = qmdd_gate(q0, GATEID_Ry(0.1), 4);
+
+    // SWAP (in both orders)
+    q1 = qmdd_gate2(q0, GATEID2_SWAP, 1, 3);
+    q2 = qmdd_circuit_swap(q0, 1, 3);
+    test_assert(aadd_equivalent(q1, q2, nqubits, false, false));
+    test_assert(qmdd_gate2(q0, GATEID2_SWAP, 3, 1) == q1);
+    test_assert(aadd_is_ordered(q1, nqubits));
+
+    // CNOT as a 4x4 gate: control t1, target t2
+    AMP cx[16] = {AADD_ONE,  AADD_ZERO, AADD_ZERO, AADD_ZERO,
+                  AADD_ZERO, AADD_ONE,  AADD_ZERO, AADD_ZERO,
+                  AADD_ZERO, AADD_ZERO, AADD_ZERO, AADD_ONE,
+                  AADD_ZERO, AADD_ZERO, AADD_ONE,  AADD_ZERO};
+    uint32_t cx_id = GATEID2_custom(cx);
+    test_assert(cx_id >= num_static_gates2 && GATEID2_custom(cx) == cx_id);
+    q1 = qmdd_gate2(q0, cx_id, 2, 4);
+    q2 = qmdd_cgate(q0, GATEID_X, 2, 4);
+    test_assert(q1 == q2);
+    // upside down: control 4, target 2
+    q1 = qmdd_gate2(q0, cx_id, 4, 2);
+    q2 = qmdd_gate(q0, GATEID_H, 2);
+    q2 = qmdd_gate(q2, GATEID_H, 4);
+    q2 = qmdd_cgate(q2, GATEID_X, 2, 4);
+    q2 = qmdd_gate(q2, GATEID_H, 2);
+    q2 = qmdd_gate(q2, GATEID_H, 4);
+    test_assert(aadd_equivalent(q1, q2, nqubits, false, false));
+    test_assert(qmdd_is_unitvector(q1, nqubits));
+
+    // ZZ(a) = CX(0,3) Rz(a)(3) CX(0,3)
+    q1 = qmdd_gate2(q0, GATEID2_ZZ(0.15), 0, 3);
+    q2 = qmdd_cgate(q0, GATEID_X, 0, 3);
+    q2 = qmdd_gate(q2, GATEID_Rz(0.15), 3);
+    q2 = qmdd_cgate(q2, GATEID_X, 0, 3);
+    test_assert(aadd_equivalent(q1, q2, nqubits, false, false));
+    q2 = qmdd_gate2(q0, GATEID2_ZZ(0.15), 3, 0);
+    test_assert(aadd_equivalent(q1, q2, nqubits, false, false));
+
+    // iSWAP twice = Z(1) Z(3) (both orders)
+    q1 = qmdd_gate2(q0, GATEID2_iSWAP, 1, 3);
+    q1 = qmdd_gate2(q1, GATEID2_iSWAP, 3, 1);
+    q2 = qmdd_gate(q0, GATEID_Z, 1);
+    q2 = qmdd_gate(q2, GATEID_Z, 3);
+    test_assert(aadd_equivalent(q1, q2, nqubits, false, false));
+
+    // fSim(1/4, 0) = iSWAP^dag, XX(0) = YY(0) = identity
+    q1 = qmdd_gate2(q0, GATEID2_iSWAP, 0, 4);
+    q1 = qmdd_gate2(q1, GATEID2_fSim(0.25, 0.0), 0, 4);
+    test_assert(aadd_equivalent(q1, q0, nqubits, false, false));
+    test_assert(qmdd_gate2(q0, GATEID2_XX(0.0), 1, 2) == q0);
+    test_assert(qmdd_gate2(q0, GATEID2_YY(0.0), 1, 2) == q0);
+
+    if(VERBOSE) printf("qmdd two-qubit gates:      ok\n");
+    return 0;
+}
+
 int run_qmdd_tests()
 {
     // we are not testing garbage collection
@@ -564,10 +749,13 @@ int run_qmdd_tests()
     if (test_h_gate()) return 1;
     if (test_phase_gates()) return 1;
     if (test_pauli_rotation_gates()) return 1;
+    if (test_rotation_gate_ids()) return 1;
     if (test_cx_gate()) return 1;
     if (test_cz_gate()) return 1;
     if (test_controlled_range_gate()) return 1;
     if (test_ccz_gate()) return 1;
+    if (test_gate_layer()) return 1;
+    if (test_two_qubit_gates()) return 1;
 
     return 0;
 }
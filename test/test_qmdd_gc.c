@@ -1,3 +1,5 @@
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 
 #include "qsylvan.h"
@@ -21,20 +23,106 @@ int test_grover_gc()
     printf("flag prob = %lf\n", flag_prob);
     test_assert(flag_prob > 0.9 && flag_prob < 1.0+1e-6);
 
+    // squared norms of nodes are recomputed after gc
+    aadd_protect(&qmdd);
+    test_assert(fabs(qmdd_get_magnitude(qmdd, qubits+1) - 1.0) < 1e-6);
+    sylvan_gc();
+    test_assert(fabs(qmdd_get_magnitude(qmdd, qubits+1) - 1.0) < 1e-6);
+    aadd_unprotect(&qmdd);
+
     return 0;
 }
 
 
+int test_minor_gc()
+{
+    int qubits = 6;
+    bool *flag = qmdd_grover_ones_flag(qubits+1);
+    QMDD qmdd = qmdd_grover(qubits, flag);
+    double prob = qmdd_amp_to_prob(aadd_getvalue(qmdd, flag));
+    QMDD basis = qmdd_create_basis_state(qubits+1, flag);
+    aadd_protect(&qmdd);
+    aadd_protect(&basis);
+
+    // nodes created after the last gc which are not protected are deleted,
+    // older nodes which are not protected only by a full gc
+    // (no gcs in between, which would keep the nodes alive at that time)
+    qmdd_set_periodic_gc_nodetable(0);
+    sylvan_gc_full();
+    size_t filled_before, filled_garbage, filled_after, total;
+    sylvan_table_usage(&filled_before, &total);
+    for (int k = 0; k < qubits; k++) {
+        flag[k] = 0;
+        qmdd_grover(qubits, flag);
+        qmdd_create_basis_state(qubits+1, flag);
+        flag[k] = 1;
+    }
+    sylvan_table_usage(&filled_garbage, &total);
+    sylvan_gc();
+    sylvan_table_usage(&filled_after, &total);
+    test_assert(filled_after < filled_garbage);
+    test_assert(llmsset_get_survivors(nodes) == filled_after);
+    sylvan_gc_full();
+    sylvan_table_usage(&filled_after, &total);
+    test_assert(filled_after == filled_before);
+    test_assert(llmsset_get_survivors(nodes) == filled_after);
+
+    // the protected qmdds are intact, and existing nodes are still found
+    test_assert(fabs(qmdd_amp_to_prob(aadd_getvalue(qmdd, flag)) - prob) < 1e-9);
+    test_assert(fabs(qmdd_get_magnitude(qmdd, qubits+1) - 1.0) < 1e-6);
+    test_assert(qmdd_create_basis_state(qubits+1, flag) == basis);
+    free(flag);
+
+    aadd_unprotect(&basis);
+    aadd_unprotect(&qmdd);
+    return 0;
+}
+
+int test_gate_registry_gc()
+{
+    // a custom gate with all weights in use, and one with unused weights
+    uint32_t g_live = GATEID_Ry(0.123);
+    uint32_t g_unused = GATEID_Ry(0.456);
+    AADD ws[4];
+    for (int k = 0; k < 4; k++) {
+        ws[k] = aadd_bundle(AADD_TERMINAL, gates[g_live][k]);
+        aadd_protect(&ws[k]);
+    }
+    QMDD q = qmdd_create_all_zero_state(3);
+    q = qmdd_gate(q, GATEID_H, 1);
+    QMDD q_live = qmdd_gate(q, g_live, 0);
+    aadd_protect(&q);
+    aadd_protect(&q_live);
+
+    aadd_gc_wgt_table();
+
+    // both gates keep their ID, with their weights translated
+    test_assert(qmdd_gate_is_live(g_live));
+    test_assert(qmdd_gate_is_live(g_unused));
+    test_assert(GATEID_Ry(0.123) == g_live);
+    test_assert(GATEID_Ry(0.456) == g_unused);
+    for (int k = 0; k < 4; k++) test_assert(gates[g_live][k] == AADD_WEIGHT(ws[k]));
+    test_assert(qmdd_gate(q, g_live, 0) == q_live);
+    test_assert(fabs(qmdd_get_magnitude(qmdd_gate(q, g_unused, 0), 3) - 1.0) < 1e-6);
+
+    for (int k = 0; k < 4; k++) aadd_unprotect(&ws[k]);
+    aadd_unprotect(&q);
+    aadd_unprotect(&q_live);
+    return 0;
+}
+
 int run_qmdd_tests()
 {
     // Test gc by running some circuits for which gc triggers
     if (test_grover_gc()) return 1;
+    if (test_minor_gc()) return 1;
+    if (test_gate_registry_gc()) return 1;
 
     return 0;
 }
 
 
-int test_with(int amps_backend, int norm_strat) 
+int test_with(int amps_backend, int norm_strat, bool keep_cache, bool inplace, bool gc_keep_cache, int minor_gcs) 
 {
     // Standard Lace initialization
     int workers = 1;
@@ -49,21 +137,94 @@ int test_with(int amps_backend, int norm_strat)
     sylvan_init_package();
     qsylvan_init_simulator(wgt_tab_size, tol, amps_backend, norm_strat);
     qmdd_set_testing_mode(true); // turn on internal sanity tests
-
-    printf("amps backend = %d, norm strategy = %d:\n", amps_backend, norm_strat);
+    aadd_set_gc_wgt_table_keep_cache(keep_cache);
+    aadd_set_gc_wgt_table_inplace(inplace);
+    // keeping the cache during gc of the node table needs frequent node gcs
+    sylvan_gc_set_keep_cache(gc_keep_cache);
+    qmdd_set_periodic_gc_nodetable(gc_keep_cache || minor_gcs ? 10 : 0);
+    sylvan_gc_set_minor(minor_gcs);
+
+    printf("amps backend = %d, norm strategy = %d, keep cache = %d, in place = %d, gc keep cache = %d, minor gcs = %d:\n", amps_backend, norm_strat, keep_cache, inplace, gc_keep_cache, minor_gcs);
     int res = run_qmdd_tests();
 
+    sylvan_gc_set_keep_cache(0);
+    sylvan_gc_set_minor(0);
+    qmdd_set_periodic_gc_nodetable(0);
+
     sylvan_quit();
     lace_stop();
     return res;
 }
 
+int test_memory_budget(int amps_backend, bool inplace, bool keep_cache)
+{
+    lace_start(1, 0);
+
+    // Low gc threshold for the edge weight table, such that the weights which
+    // survive gc fill the table up to the threshold and it needs to grow
+    size_t budget = 1ULL<<26;
+    uint64_t wgt_tab_size = 1LL<<12;
+    sylvan_set_memory_budget(budget, 4);
+    sylvan_init_package();
+    qsylvan_init_simulator(wgt_tab_size, 0, amps_backend, NORM_LOW);
+    aadd_set_gc_wgt_table_inplace(inplace);
+    aadd_set_gc_wgt_table_keep_cache(keep_cache);
+    qmdd_set_periodic_gc_nodetable(10);
+    aadd_set_gc_wgt_table_thres(0.1);
+    printf("memory budget = %zu, amps backend = %d, in place = %d, keep cache = %d: ", budget, amps_backend, inplace, keep_cache);
+
+    test_assert(sylvan_get_memory_budget() == budget);
+    test_assert(sylvan_get_memory_usage() <= budget);
+    if (test_grover_gc()) return 1;
+    test_assert(sylvan_edge_weights_get_reserved() > wgt_tab_size);
+    test_assert(sylvan_get_memory_usage() <= budget);
+
+    aadd_set_gc_wgt_table_thres(0.5);
+    qmdd_set_periodic_gc_nodetable(0);
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
+int test_wide_weight_indices(int amps_backend)
+{
+    lace_start(1, 0);
+
+    // With more than 2^23 edge weights, the weight indices in the edges reach
+    // into the lower 40 bits which the default cache check takes as node index
+    uint64_t wgt_tab_size = 1LL<<24;
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    qsylvan_init_simulator(wgt_tab_size, 0, amps_backend, NORM_LOW);
+    sylvan_gc_set_keep_cache(1);
+    qmdd_set_periodic_gc_nodetable(10);
+    printf("wgt table size = %" PRIu64 ", amps backend = %d, gc keep cache = 1: ", wgt_tab_size, amps_backend);
+
+    if (test_grover_gc()) return 1;
+
+    sylvan_gc_set_keep_cache(0);
+    qmdd_set_periodic_gc_nodetable(0);
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
 int runtests()
 {
     int backend = COMP_HASHMAP;
     for (int norm_strat = 0; norm_strat < n_norm_strategies; norm_strat++) {
-        if (test_with(backend, norm_strat)) return 1;
+        if (test_with(backend, norm_strat, false, false, false, 0)) return 1;
+        if (test_with(backend, norm_strat, true, false, false, 0)) return 1;
+        if (test_with(backend, norm_strat, false, true, false, 0)) return 1;
+        if (test_with(backend, norm_strat, false, false, true, 0)) return 1;
+        if (test_with(backend, norm_strat, true, true, true, 0)) return 1;
+        if (test_with(backend, norm_strat, false, false, false, 4)) return 1;
+        if (test_with(backend, norm_strat, true, true, true, 1000)) return 1;
     }
+    if (test_memory_budget(backend, false, false)) return 1;
+    if (test_memory_budget(backend, true, true)) return 1;
+    if (test_memory_budget(REAL_TUPLES_HASHMAP, false, false)) return 1;
+    if (test_wide_weight_indices(backend)) return 1;
     return 0;
 }
 
@@ -658,6 +658,39 @@ int test_tensor_product()
     return 0;
 }
 
+int test_adaptive_caching()
+{
+    QMDD qInit, qTest, qRef, mH, mX;
+    BDDVAR nqubits = 10;
+    bool x[10];
+
+    // the top level gets (almost) no hits on the first 1024 different basis
+    // states, so caching is switched off there, and after enough skipped
+    // calls it is switched back on again
+    // (results should not depend on which levels are cached)
+    aadd_set_adaptive_caching(true);
+    mH = qmdd_create_single_qubit_gates_same(nqubits, GATEID_H);
+    mX = qmdd_create_single_qubit_gate(nqubits, 2, GATEID_X);
+    for (int i = 0; i < 36000; i++) {
+        for (BDDVAR k = 0; k < nqubits; k++) x[k] = (i >> k) & 1;
+        qInit = qmdd_create_basis_state(nqubits, x);
+        qTest = aadd_matvec_mult(mH, qInit, nqubits);
+        qTest = aadd_matvec_mult(mH, qTest, nqubits);
+        test_assert(qTest == qInit);
+    }
+    qRef  = qmdd_gate(qInit, GATEID_X, 2);
+    qTest = aadd_matvec_mult(mX, qTest, nqubits);
+    test_assert(qTest == qRef);
+    uint64_t off, on;
+    aadd_get_adaptive_caching_switches(&off, &on);
+    test_assert(off >= 1);
+    test_assert(on >= 1);
+    aadd_set_adaptive_caching(false);
+
+    if(VERBOSE) printf("matrix qmdd adaptive caching: ok\n");
+    return 0;
+}
+
 int runtests()
 {
     // we are not testing garbage collection
@@ -671,6 +704,7 @@ int runtests()
     if (test_ccz_gate()) return 1;
     if (test_multi_cgate()) return 1;
     if (test_tensor_product()) return 1;
+    if (test_adaptive_caching()) return 1;
 
     return 0;
 }
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "qsylvan.h"
+#include <sylvan_edge_weights_complex.h>
+#include "../qasm/qsylvan_qasm.h"
+#include "test_assert.h"
+
+bool VERBOSE = true;
+
+static char qasm_file[] = "/tmp/test_qmdd_qasm_XXXXXX";
+
+/* Writes <qasm> to a temporary file, of which the name is in qasm_file */
+static void write_qasm(const char *qasm)
+{
+    strcpy(qasm_file + strlen(qasm_file) - 6, "XXXXXX");
+    int fd = mkstemp(qasm_file);
+    FILE *f = fdopen(fd, "w");
+    fputs(qasm, f);
+    fclose(f);
+}
+
+/* Applies the gates of <c_s> to <qmdd>, gate by gate through their matrices 
+   (controls have to be above the target, as for qmdd_cgate) */
+static QMDD simulate_c_struct(QMDD qmdd, C_struct c_s)
+{
+    complex_t m[4];
+    AMP u[4];
+    for (BDDVAR j = 0; j < c_s.depth; j++) {
+        for (BDDVAR i = 0; i < c_s.qubits; i++) {
+            Gate gate = c_s.circuit[i][j];
+            if (gate.id == gate_I.id || gate.id == gate_ctrl.id || gate.id == gate_ctrl_c.id || gate.id == gate_barrier.id)
+                continue;
+            if (!get_gate_matrix(gate, m)) {
+                fprintf(stderr, "simulate_c_struct: gate %s not supported\n", gate.gateSymbol);
+                exit(1);
+            }
+            for (int k = 0; k < 4; k++) u[k] = weight_complex_lookup(&m[k]);
+            uint32_t gate_id = GATEID_custom(u);
+            if (gate.controlSize == 0)
+                qmdd = qmdd_gate(qmdd, gate_id, i);
+            else if (gate.controlSize == 1)
+                qmdd = qmdd_cgate(qmdd, gate_id, gate.control[0], i);
+            else if (gate.controlSize == 2)
+                qmdd = qmdd_cgate2(qmdd, gate_id, gate.control[0], gate.control[1], i);
+            else
+                qmdd = qmdd_cgate3(qmdd, gate_id, gate.control[0], gate.control[1], gate.control[2], i);
+        }
+    }
+    return qmdd;
+}
+
+/* Whether all amplitudes of <a> and <b> differ less than <eps>. Products of 
+   gate matrices round differently than applying the gates one by one, so the 
+   states can differ by more than the tolerance of the edge weight table. */
+static bool states_close(QMDD a, QMDD b, BDDVAR n, double eps)
+{
+    bool x[n];
+    for (BDDVAR k = 0; k < n; k++) x[k] = 0;
+    do {
+        complex_t ca = qmdd_get_amplitude(a, x);
+        complex_t cb = qmdd_get_amplitude(b, x);
+        if (flt_abs(ca.r - cb.r) > eps || flt_abs(ca.i - cb.i) > eps) return false;
+    } while (_next_bitstring(x, n));
+    return true;
+}
+
+/* Number of gates (not counting controls and identities) in <c_s> */
+static int count_gates(C_struct c_s)
+{
+    int n = 0;
+    for (BDDVAR j = 0; j < c_s.depth; j++) {
+        for (BDDVAR i = 0; i < c_s.qubits; i++) {
+            BDDVAR id = c_s.circuit[i][j].id;
+            if (id != gate_I.id && id != gate_ctrl.id && id != gate_ctrl_c.id) n++;
+        }
+    }
+    return n;
+}
+
+// Runs of single-qubit gates, around controls and (controlled) diagonal gates
+static const char *fuse_circuit =
+    "OPENQASM 2.0;\n"
+    "include \"qelib1.inc\";\n"
+    "qreg q[4];\n"
+    "creg c[4];\n"
+    "h q[0];\n"
+    "t q[0];\n"
+    "h q[0];\n"
+    "rx(0.3) q[1];\n"
+    "ry(0.2) q[1];\n"
+    "s q[2];\n"
+    "cx q[0],q[1];\n"
+    "t q[0];\n"        // diagonal on a control, fuses with s below
+    "cx q[0],q[2];\n"
+    "s q[0];\n"
+    "sdg q[2];\n"      // diagonal on the target of a controlled diagonal gate
+    "cz q[1],q[2];\n"
+    "t q[2];\n"
+    "h q[1];\n"
+    "ry(0.7) q[1];\n"
+    "cx q[1],q[3];\n"  // not diagonal, blocks fusion over the control
+    "h q[1];\n"
+    "x q[1];\n"
+    "ccx q[0],q[1],q[3];\n"
+    "sx q[3];\n"
+    "y q[3];\n"
+    "sy q[0];\n"
+    "tdg q[0];\n";
+
+int test_fuse_c_struct()
+{
+    write_qasm(fuse_circuit);
+    C_struct c_s = make_c_struct(qasm_file, false);
+    C_struct c_fused = make_c_struct(qasm_file, true);
+    unlink(qasm_file);
+
+    // the fused circuit has fewer gates, and gives the same state
+    test_assert(count_gates(c_fused) < count_gates(c_s));
+    QMDD q0 = qmdd_create_all_zero_state(c_s.qubits);
+    QMDD q1 = simulate_c_struct(q0, c_s);
+    QMDD q2 = simulate_c_struct(q0, c_fused);
+    test_assert(aadd_equivalent(q1, q2, c_s.qubits, false, false));
+
+    // fusing a circuit again changes nothing
+    test_assert(fuse_c_struct(&c_fused) == 0);
+    test_assert(aadd_equivalent(simulate_c_struct(q0, c_fused), q1, c_s.qubits, false, false));
+
+    // a run which multiplies to the identity is removed
+    write_qasm("OPENQASM 2.0;\nqreg q[2];\nh q[0];\ns q[1];\nh q[0];\nsdg q[1];\ncx q[0],q[1];\n");
+    C_struct c_id = make_c_struct(qasm_file, true);
+    unlink(qasm_file);
+    test_assert(count_gates(c_id) == 1);
+
+    delete_c_struct(&c_s);
+    delete_c_struct(&c_fused);
+    delete_c_struct(&c_id);
+
+    if(VERBOSE) printf("qasm gate fusion:              ok\n");
+    return 0;
+}
+
+int test_c_stream()
+{
+    write_qasm(fuse_circuit);
+    C_struct c_s = make_c_struct(qasm_file, false);
+    QMDD q0 = qmdd_create_all_zero_state(c_s.qubits);
+    QMDD q1 = simulate_c_struct(q0, c_s);
+
+    // Every line is a column, so the small windows end inside the runs of gates 
+    // (on one or more lines) which are fused when the circuit is read as a whole
+    for (BDDVAR window = 2; window <= 8; window++) {
+        for (int optimize = 0; optimize <= 1; optimize++) {
+            C_stream *s = open_c_stream(qasm_file, window, optimize);
+            test_assert(s->window.qubits == c_s.qubits);
+            QMDD q2 = q0;
+            int windows = 0;
+            do {
+                test_assert(s->window.depth <= window);
+                q2 = simulate_c_struct(q2, s->window);
+                windows++;
+            } while (next_window_c_stream(s));
+            test_assert(windows > 1);
+            test_assert(aadd_equivalent(q1, q2, c_s.qubits, false, false));
+
+            // reading it again gives the same
+            rewind_c_stream(s);
+            q2 = q0;
+            do {
+                q2 = simulate_c_struct(q2, s->window);
+            } while (next_window_c_stream(s));
+            test_assert(aadd_equivalent(q1, q2, c_s.qubits, false, false));
+            close_c_stream(s);
+        }
+    }
+    unlink(qasm_file);
+    delete_c_struct(&c_s);
+
+    if(VERBOSE) printf("qasm stream:                   ok\n");
+    return 0;
+}
+
+// Entangled 7-qubit state (large enough for matrix-matrix multiplication of
+// the columns after it to be cheaper), followed by columns of single-qubit gates
+static const char *adaptive_circuit =
+    "OPENQASM 2.0;\n"
+    "include \"qelib1.inc\";\n"
+    "qreg q[7];\n"
+    "ry(0.11) q[0];\nry(0.23) q[1];\nry(0.37) q[2];\nry(0.41) q[3];\nry(0.53) q[4];\nry(0.67) q[5];\nry(0.79) q[6];\n"
+    "cx q[0],q[1];\ncx q[1],q[2];\ncx q[2],q[3];\ncx q[3],q[4];\ncx q[4],q[5];\ncx q[5],q[6];\n"
+    "ry(0.13) q[0];\nry(0.29) q[1];\nry(0.31) q[2];\nry(0.43) q[3];\nry(0.59) q[4];\nry(0.61) q[5];\nry(0.71) q[6];\n"
+    "cx q[0],q[6];\ncx q[0],q[2];\ncx q[2],q[4];\ncx q[4],q[6];\ncx q[1],q[3];\ncx q[3],q[5];\n"
+    "h q[0];\nt q[1];\nh q[2];\nrz(0.3) q[3];\nh q[4];\ns q[5];\nh q[6];\n"
+    "t q[0];\nh q[1];\nrx(0.2) q[2];\nh q[3];\nt q[4];\nh q[5];\nsdg q[6];\n";
+
+/* Runs <c_s> with run_circuit_adaptive, returns the state and whether a
+   segment of columns was applied via matrix-matrix multiplication */
+static QMDD run_adaptive(C_struct c_s, bool *used_matmat)
+{
+    int measurements[c_s.qubits];
+    bool results[c_s.bits + 1];
+
+    // the segments applied via matmat are only reported in the output
+    char out_file[] = "/tmp/test_qmdd_qasm_out_XXXXXX";
+    int fd = mkstemp(out_file);
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    QMDD qmdd = run_circuit_adaptive(c_s, measurements, results, true);
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    char line[256];
+    FILE *f = fdopen(fd, "r");
+    rewind(f);
+    *used_matmat = false;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "columns", 7) == 0 && strstr(line, "via matmat") != NULL) *used_matmat = true;
+    }
+    fclose(f);
+    unlink(out_file);
+    return qmdd;
+}
+
+int test_run_circuit_adaptive()
+{
+    const char *circuits[] = {fuse_circuit, adaptive_circuit};
+    bool used_matmat[2];
+    for (int k = 0; k < 2; k++) {
+        write_qasm(circuits[k]);
+        C_struct c_s = make_c_struct(qasm_file, false);
+        unlink(qasm_file);
+        int measurements[c_s.qubits];
+        bool results[c_s.bits + 1];
+
+        // the states have to survive gc of the edge weight table
+        QMDD q1 = run_c_struct(c_s, measurements, results, false);
+        aadd_protect(&q1);
+        QMDD q2 = run_adaptive(c_s, &used_matmat[k]);
+        aadd_protect(&q2);
+        QMDD q3 = simulate_c_struct(qmdd_create_all_zero_state(c_s.qubits), c_s);
+        test_assert(states_close(q1, q3, c_s.qubits, 1e-9));
+        test_assert(states_close(q1, q2, c_s.qubits, 1e-9));
+        aadd_unprotect(&q1);
+        aadd_unprotect(&q2);
+        delete_c_struct(&c_s);
+    }
+    // the small circuit is applied to the state column by column, the large one not
+    test_assert(!used_matmat[0]);
+    test_assert(used_matmat[1]);
+
+    if(VERBOSE) printf("qasm adaptive run:             ok\n");
+    return 0;
+}
+
+int runtests()
+{
+    // we are not testing garbage collection
+    sylvan_gc_disable();
+
+    if (test_fuse_c_struct()) return 1;
+    if (test_c_stream()) return 1;
+    if (test_run_circuit_adaptive()) return 1;
+
+    return 0;
+}
+
+int test_with(int wgt_backend, int norm_strat)
+{
+    // Standard Lace initialization
+    int workers = 1;
+    lace_start(workers, 0);
+    printf("%d worker(s), ", workers);
+
+    // Simple Sylvan initialization
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    double tolerance = -1; // default
+    if (norm_strat == NORM_L2) tolerance = 1e-13;
+    // the matrix of a segment of columns in the adaptive run has many weights
+    qsylvan_init_simulator(1LL<<16, tolerance, wgt_backend, norm_strat);
+
+    printf("weigth backend = %d, norm strategy = %d:\n", wgt_backend, norm_strat);
+    int res = runtests();
+
+    sylvan_quit();
+    lace_stop();
+
+    return res;
+}
+
+int main()
+{
+    for (int backend = 0; backend < n_backends; backend++) {
+        for (int norm_strat = 0; norm_strat < n_norm_strategies; norm_strat++) {
+            if (test_with(backend, norm_strat)) return 1;
+        }
+    }
+    return 0;
+}